@@ -0,0 +1,228 @@
+#include <string.h>
+
+#include "dtu_line_parser.h"
+#include "text_codec.h"
+
+// 短信行前缀;发送短信的响应 config,sms,ok,<0/1> 没有内容字段,按普通行处理
+#define SMS_PREFIX     "config,sms,ok,"
+#define SMS_PREFIX_LEN (sizeof(SMS_PREFIX) - 1)
+
+enum {
+    STATE_TEXT,   // 普通行,或尚未读完短信行前缀
+    STATE_SENDER, // 前缀之后、第一个','之前的号码
+    STATE_HEX,    // 号码之后的UTF-8内容hex
+    STATE_NO_BUFFER, // 短信行,但没有解码目标,其余字节跳过
+};
+
+// 截断处若正好切在UTF-8多字节字符中间,去掉末尾不完整的序列,返回新长度
+static size_t utf8_trim_incomplete_tail(char *buf, size_t len) {
+    size_t end = len;
+    int back = 0;
+    while (end > 0 && back < 3 && ((unsigned char)buf[end - 1] & 0xC0) == 0x80) {
+        end--;
+        back++;
+    }
+    if (end == 0) {
+        return len; // 找不到lead字节,数据本身非法,原样保留
+    }
+    unsigned char lead = (unsigned char)buf[end - 1];
+    int seq_len = 1;
+    if ((lead & 0xE0) == 0xC0) seq_len = 2;
+    else if ((lead & 0xF0) == 0xE0) seq_len = 3;
+    else if ((lead & 0xF8) == 0xF0) seq_len = 4;
+    if (back + 1 < seq_len) {
+        buf[end - 1] = '\0';
+        return end - 1;
+    }
+    return len;
+}
+
+static void line_reset(dtu_line_parser_t *p) {
+    p->state = STATE_TEXT;
+    p->line_done = false;
+    p->text_truncated = false;
+    p->text_len = 0;
+    p->line_bytes = 0;
+    p->text[0] = '\0';
+}
+
+static void text_append(dtu_line_parser_t *p, char c) {
+    if (p->text_len < sizeof(p->text) - 1) {
+        p->text[p->text_len++] = c;
+    } else {
+        p->text_truncated = true;
+    }
+}
+
+static void sender_byte(dtu_line_parser_t *p, char c) {
+    if (c != ',') {
+        if (p->sender_len < sizeof(p->sms->sender) - 1) {
+            if (p->sms != NULL) {
+                p->sms->sender[p->sender_len] = c;
+            }
+            p->sender_len++;
+        } else {
+            p->state = STATE_TEXT; // 号码过长,不是短信行
+        }
+        return;
+    }
+    if (p->sender_len == 0) {
+        p->state = STATE_TEXT;
+        return;
+    }
+    if (p->sms == NULL) {
+        p->state = STATE_NO_BUFFER;
+        return;
+    }
+    p->sms->sender[p->sender_len] = '\0';
+    p->state = STATE_HEX;
+    p->hex_cr = false;
+    p->hex_invalid = false;
+    p->content_truncated = false;
+    p->hex_high = -1;
+    p->content_len = 0;
+    p->hex_chars = 0;
+}
+
+// 解码一个hex字符;与整行解码一致,内容截断后的字符只计数不校验
+static inline void hex_byte(dtu_line_parser_t *p, uint8_t c) {
+    if (c == '\r') {
+        p->hex_cr = true;
+        return;
+    }
+    p->hex_chars++;
+    if (p->hex_invalid || p->content_truncated) {
+        return;
+    }
+    uint8_t v = text_hex_value[c];
+    if (v > 15 || p->hex_cr) {
+        p->hex_invalid = true;
+        return;
+    }
+    if (p->hex_high < 0) {
+        p->hex_high = (int8_t)v;
+        return;
+    }
+    if (p->content_len >= sizeof(p->sms->content) - 1) {
+        p->content_truncated = true;
+        return;
+    }
+    p->sms->content[p->content_len++] = (char)((p->hex_high << 4) | v);
+    p->hex_high = -1;
+}
+
+// 快速路径: 从data[i]起成对解码,遇到非hex字符(含"\r\n")、只剩半对或内容写满时停下,
+// 其余交给hex_byte逐字节处理。返回停下的位置
+static size_t hex_run(dtu_line_parser_t *p, const uint8_t *data, size_t i, size_t len) {
+    char *start = p->sms->content + p->content_len;
+    char *end = p->sms->content + sizeof(p->sms->content) - 1;
+    char *out = start;
+    while (i + 1 < len && out < end) {
+        uint8_t hi = text_hex_value[data[i]];
+        uint8_t lo = text_hex_value[data[i + 1]];
+        if ((hi | lo) > 15) {
+            break;
+        }
+        *out++ = (char)((hi << 4) | lo);
+        i += 2;
+    }
+    p->content_len += (uint16_t)(out - start);
+    p->hex_chars += 2 * (uint32_t)(out - start);
+    return i;
+}
+
+static dtu_line_type_t line_end(dtu_line_parser_t *p) {
+    p->line_done = true;
+    if (p->discarding) {
+        p->discarding = false;
+        return DTU_LINE_NONE;
+    }
+    if (p->text_truncated) {
+        p->truncated_lines++;
+    } else if (p->text_len > 0 && p->text[p->text_len - 1] == '\r') {
+        p->text_len--;
+    }
+    p->text[p->text_len] = '\0';
+    if (p->state == STATE_NO_BUFFER) {
+        return DTU_LINE_SMS_NO_BUFFER;
+    }
+    if (p->state != STATE_HEX) {
+        return DTU_LINE_TEXT;
+    }
+    if (p->hex_invalid || p->hex_chars == 0 || p->hex_chars % 2 != 0) {
+        return DTU_LINE_SMS_INVALID;
+    }
+    p->sms->content[p->content_len] = '\0';
+    if (p->content_truncated) {
+        p->truncated_lines++;
+        p->content_len = (uint16_t)utf8_trim_incomplete_tail(p->sms->content, p->content_len);
+    }
+    return DTU_LINE_SMS;
+}
+
+void dtu_line_parser_init(dtu_line_parser_t *parser, sms_message_t *sms) {
+    memset(parser, 0, sizeof(*parser));
+    parser->sms = sms;
+    parser->hex_high = -1;
+    line_reset(parser);
+}
+
+size_t dtu_line_parser_feed(dtu_line_parser_t *parser, const uint8_t *data, size_t len,
+                            dtu_line_type_t *type) {
+    dtu_line_parser_t *p = parser;
+    size_t i = 0;
+
+    *type = DTU_LINE_NONE;
+    if (p->line_done && len > 0) {
+        line_reset(p);
+    }
+    while (i < len) {
+        if (p->state == STATE_HEX && !p->discarding) {
+            // 内容是一行中的绝大部分字节,成对解码走hex_run
+            while (i < len && data[i] != '\n') {
+                if (p->hex_high < 0 && !p->hex_cr && !p->hex_invalid && !p->content_truncated) {
+                    i = hex_run(p, data, i, len);
+                    if (i == len || data[i] == '\n') {
+                        break;
+                    }
+                }
+                hex_byte(p, data[i++]);
+            }
+            if (i == len) {
+                break;
+            }
+        }
+        uint8_t c = data[i++];
+        if (c == '\n') {
+            p->line_bytes += i;
+            *type = line_end(p);
+            return i;
+        }
+        if (p->discarding) {
+            p->dropped_bytes++;
+            continue;
+        }
+        if (p->state == STATE_NO_BUFFER) {
+            continue;
+        }
+        text_append(p, (char)c);
+        if (p->state == STATE_SENDER) {
+            sender_byte(p, (char)c);
+        } else if (p->text_len == SMS_PREFIX_LEN && !p->text_truncated &&
+                   memcmp(p->text, SMS_PREFIX, SMS_PREFIX_LEN) == 0) {
+            p->state = STATE_SENDER;
+            p->sender_len = 0;
+        }
+    }
+    p->line_bytes += i;
+    return i;
+}
+
+void dtu_line_parser_mark_gap(dtu_line_parser_t *parser) {
+    line_reset(parser);
+    parser->discarding = true;
+}
+
+bool dtu_line_parser_starts_with(const dtu_line_parser_t *parser, const char *prefix) {
+    return strncmp(parser->text, prefix, strlen(prefix)) == 0;
+}
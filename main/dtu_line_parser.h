@@ -0,0 +1,80 @@
+#ifndef DTU_LINE_PARSER_H
+#define DTU_LINE_PARSER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "uart_at_manager.h" // sms_message_t
+
+/*
+ * 银尔达DTU串口输出的流式分行解析。
+ *
+ * 字节按到达顺序逐段送入,不需要缓存整行: "config,sms,ok,<号码>,<UTF-8内容hex>"
+ * 识别出前缀和号码后,hex内容两两解码直接写入目标sms_message_t;其余行只保留
+ * 前DTU_LINE_PARSER_TEXT_SIZE - 1个字符(命令响应都很短)。
+ */
+
+#define DTU_LINE_PARSER_TEXT_SIZE 128
+
+typedef enum {
+    DTU_LINE_NONE,        // 行尚未结束
+    DTU_LINE_TEXT,        // 普通行(含无内容字段的config,sms,ok[,x]),见parser->text
+    DTU_LINE_SMS,         // 短信行,已解码到目标sms_message_t
+    DTU_LINE_SMS_INVALID, // 短信行,但内容hex为空、长度为奇数或含非hex字符
+    DTU_LINE_SMS_NO_BUFFER, // 短信行,但没有解码目标(sms为NULL),内容未解码
+} dtu_line_type_t;
+
+typedef struct {
+    sms_message_t *sms;       // 短信的解码目标,解析短信行期间被逐步写入;两行之间可以更换,可为NULL
+    uint8_t state;
+    bool line_done;           // 上一行已结束,下一个字节开始新行
+    bool discarding;          // 断流后丢弃到下一个'\n'
+    bool text_truncated;      // 本行超出text
+    bool hex_cr;              // hex内容后出现了'\r',其后只能是'\n'
+    bool hex_invalid;
+    bool content_truncated;   // 内容超出sms->content,其余hex只计数
+    int8_t hex_high;          // 待配对的高半字节,-1表示无
+    uint16_t sender_len;
+    uint16_t content_len;
+    uint16_t text_len;
+    uint32_t hex_chars;       // 本行内容的hex字符数
+    uint32_t line_bytes;      // 本行的串口字节数,含"\r\n"
+    uint32_t truncated_lines; // 普通行超过text或短信内容超过content的次数
+    uint32_t dropped_bytes;   // 断流后丢弃的字节数
+    char text[DTU_LINE_PARSER_TEXT_SIZE]; // 当前/最近一行的开头,NUL结尾,不含"\r\n"
+} dtu_line_parser_t;
+
+/**
+ * @brief Initializes the parser.
+ *
+ * @param sms Destination for decoded SMS lines; it is overwritten while an
+ *        SMS line is being parsed, so handle each DTU_LINE_SMS before
+ *        feeding further bytes. While it is NULL, SMS lines are skipped and
+ *        reported as DTU_LINE_SMS_NO_BUFFER.
+ */
+void dtu_line_parser_init(dtu_line_parser_t *parser, sms_message_t *sms);
+
+/**
+ * @brief Feeds received bytes, up to and including the end of one line.
+ *
+ * @param type DTU_LINE_NONE if all bytes were consumed without completing a
+ *        line, otherwise the kind of line that ended.
+ * @return Number of bytes consumed; feed the rest after handling the line.
+ */
+size_t dtu_line_parser_feed(dtu_line_parser_t *parser, const uint8_t *data, size_t len,
+                            dtu_line_type_t *type);
+
+/**
+ * @brief Marks a gap in the byte stream (e.g. the driver flushed its FIFO):
+ *        the line in progress is dropped, as is input up to the next '\n'.
+ */
+void dtu_line_parser_mark_gap(dtu_line_parser_t *parser);
+
+/**
+ * @brief Checks whether the last line (its first DTU_LINE_PARSER_TEXT_SIZE - 1
+ *        characters) starts with prefix.
+ */
+bool dtu_line_parser_starts_with(const dtu_line_parser_t *parser, const char *prefix);
+
+#endif // DTU_LINE_PARSER_H
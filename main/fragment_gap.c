@@ -0,0 +1,112 @@
+#include <stdatomic.h>
+#include <string.h>
+
+#include "esp_log.h"
+
+#include "fragment_gap.h"
+
+static const char *TAG = "fragment_gap";
+
+#define GAP_MIN_SAMPLES     8    // 样本少于此数时使用上限
+#define GAP_DECAY_SAMPLES   128  // 每记录这么多个间隔,全部计数减半
+#define GAP_PERCENTILE      99
+#define GAP_MARGIN_PERCENT  150  // 分位数所在桶上界再放宽50%
+
+const uint32_t fragment_gap_bucket_ms[FRAGMENT_GAP_BUCKETS - 1] = {
+    200, 500, 1000, 1500, 2000, 3000, 4000, 6000, 8000, 12000, 16000, 24000, 30000,
+};
+
+static uint32_t gap_bucket(uint32_t gap_ms) {
+    uint32_t i = 0;
+    while (i < FRAGMENT_GAP_BUCKETS - 1 && gap_ms > fragment_gap_bucket_ms[i]) {
+        i++;
+    }
+    return i;
+}
+
+static void gap_update_timeout(fragment_gap_t *gap) {
+    uint32_t counts[FRAGMENT_GAP_BUCKETS];
+    uint32_t total = 0;
+
+    for (int i = 0; i < FRAGMENT_GAP_BUCKETS; i++) {
+        counts[i] = atomic_load_explicit(&gap->counts[i], memory_order_relaxed);
+        total += counts[i];
+    }
+
+    uint32_t timeout = FRAGMENT_GAP_TIMEOUT_MAX_MS;
+    if (total >= GAP_MIN_SAMPLES) {
+        // 累计计数第一次达到总数99%的桶
+        uint32_t need = (total * GAP_PERCENTILE + 99) / 100;
+        uint32_t sum = 0;
+        int i = 0;
+        while (i < FRAGMENT_GAP_BUCKETS - 1 && (sum += counts[i]) < need) {
+            i++;
+        }
+        if (i < FRAGMENT_GAP_BUCKETS - 1) {
+            timeout = fragment_gap_bucket_ms[i] * GAP_MARGIN_PERCENT / 100;
+        }
+    }
+    if (timeout < FRAGMENT_GAP_TIMEOUT_MIN_MS) {
+        timeout = FRAGMENT_GAP_TIMEOUT_MIN_MS;
+    } else if (timeout > FRAGMENT_GAP_TIMEOUT_MAX_MS) {
+        timeout = FRAGMENT_GAP_TIMEOUT_MAX_MS;
+    }
+
+    if (timeout != atomic_load_explicit(&gap->timeout_ms, memory_order_relaxed)) {
+        ESP_LOGD(TAG, "Fragment timeout now %lu ms (%lu gaps in histogram)",
+                 (unsigned long)timeout, (unsigned long)total);
+        atomic_store_explicit(&gap->timeout_ms, timeout, memory_order_relaxed);
+    }
+}
+
+void fragment_gap_init(fragment_gap_t *gap) {
+    memset(gap, 0, sizeof(*gap));
+    atomic_store_explicit(&gap->timeout_ms, FRAGMENT_GAP_TIMEOUT_MAX_MS, memory_order_relaxed);
+}
+
+void fragment_gap_set_context(fragment_gap_t *gap, const char *context) {
+    if (strncmp(context, gap->context, sizeof(gap->context) - 1) == 0) {
+        return;
+    }
+    if (gap->context[0] != '\0') {
+        ESP_LOGI(TAG, "Operator changed, relearning SMS fragment gaps.");
+    }
+    strncpy(gap->context, context, sizeof(gap->context) - 1);
+    for (int i = 0; i < FRAGMENT_GAP_BUCKETS; i++) {
+        atomic_store_explicit(&gap->counts[i], 0, memory_order_relaxed);
+    }
+    gap->since_decay = 0;
+    gap_update_timeout(gap);
+}
+
+void fragment_gap_record(fragment_gap_t *gap, uint32_t gap_ms) {
+    if (++gap->since_decay >= GAP_DECAY_SAMPLES) {
+        gap->since_decay = 0;
+        for (int i = 0; i < FRAGMENT_GAP_BUCKETS; i++) {
+            atomic_store_explicit(&gap->counts[i],
+                                  atomic_load_explicit(&gap->counts[i], memory_order_relaxed) / 2,
+                                  memory_order_relaxed);
+        }
+    }
+    atomic_fetch_add_explicit(&gap->counts[gap_bucket(gap_ms)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&gap->samples, 1, memory_order_relaxed);
+    gap_update_timeout(gap);
+}
+
+void fragment_gap_record_late(fragment_gap_t *gap, uint32_t gap_ms) {
+    atomic_fetch_add_explicit(&gap->late_fragments, 1, memory_order_relaxed);
+    fragment_gap_record(gap, gap_ms);
+}
+
+uint32_t fragment_gap_timeout_ms(fragment_gap_t *gap) {
+    return atomic_load_explicit(&gap->timeout_ms, memory_order_relaxed);
+}
+
+void fragment_gap_get_stats(fragment_gap_t *gap, fragment_gap_stats_t *stats) {
+    for (int i = 0; i < FRAGMENT_GAP_BUCKETS; i++) {
+        stats->counts[i] = atomic_load_explicit(&gap->counts[i], memory_order_relaxed);
+    }
+    stats->samples = atomic_load_explicit(&gap->samples, memory_order_relaxed);
+    stats->late_fragments = atomic_load_explicit(&gap->late_fragments, memory_order_relaxed);
+    stats->timeout_ms = atomic_load_explicit(&gap->timeout_ms, memory_order_relaxed);
+}
@@ -0,0 +1,73 @@
+#ifndef FRAGMENT_GAP_H
+#define FRAGMENT_GAP_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define FRAGMENT_GAP_BUCKETS        14
+#define FRAGMENT_GAP_TIMEOUT_MIN_MS 3000   // 自适应超时下限
+#define FRAGMENT_GAP_TIMEOUT_MAX_MS 30000  // 自适应超时上限,样本不足时也用此值
+
+// 各直方图桶的上界(毫秒),最后一桶收集超过上限的间隔
+extern const uint32_t fragment_gap_bucket_ms[FRAGMENT_GAP_BUCKETS - 1];
+
+typedef struct {
+    uint32_t counts[FRAGMENT_GAP_BUCKETS]; // 按fragment_gap_bucket_ms分桶的衰减计数
+    uint32_t samples;                      // 累计记录的间隔数(不衰减)
+    uint32_t late_fragments;               // 超时投递后才到达的分段数
+    uint32_t timeout_ms;                   // 当前使用的分段超时
+} fragment_gap_stats_t;
+
+/*
+ * 每个模组一份直方图: 只有该模组的uart_at_task写入;其他任务读取统计时
+ * 各计数可能相差一次更新,仅用于观测
+ */
+typedef struct {
+    _Atomic uint32_t counts[FRAGMENT_GAP_BUCKETS];
+    _Atomic uint32_t samples;
+    _Atomic uint32_t late_fragments;
+    _Atomic uint32_t timeout_ms;
+    uint32_t since_decay;
+    char context[32];
+} fragment_gap_t;
+
+/**
+ * @brief Empties the histogram; the timeout starts at FRAGMENT_GAP_TIMEOUT_MAX_MS.
+ */
+void fragment_gap_init(fragment_gap_t *gap);
+
+/**
+ * @brief Forgets the gaps learned so far, e.g. when a SIM of another operator
+ *        is detected. Gap distributions differ between networks.
+ *
+ * @param context Operator name; the histogram is only reset if it changed.
+ */
+void fragment_gap_set_context(fragment_gap_t *gap, const char *context);
+
+/**
+ * @brief Records the time between two consecutive parts of one long SMS.
+ *
+ * The histogram halves all counts every 128 samples, so it follows the
+ * recent behaviour of the network.
+ */
+void fragment_gap_record(fragment_gap_t *gap, uint32_t gap_ms);
+
+/**
+ * @brief Records a part that arrived gap_ms after its message was already
+ *        flushed by the timeout; widens the learned distribution.
+ */
+void fragment_gap_record_late(fragment_gap_t *gap, uint32_t gap_ms);
+
+/**
+ * @brief How long to wait for the next part before delivering an incomplete
+ *        long SMS: the 99th percentile of the learned gaps with 50% margin,
+ *        bounded to [FRAGMENT_GAP_TIMEOUT_MIN_MS, FRAGMENT_GAP_TIMEOUT_MAX_MS].
+ */
+uint32_t fragment_gap_timeout_ms(fragment_gap_t *gap);
+
+/**
+ * @brief Reads the gap histogram. Safe to call from any task.
+ */
+void fragment_gap_get_stats(fragment_gap_t *gap, fragment_gap_stats_t *stats);
+
+#endif // FRAGMENT_GAP_H
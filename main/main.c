@@ -11,12 +11,13 @@
 
 // Include our custom modules
 #include "wifi_manager.h"
-#include "uart_at_manager.h"
-#include "uart_dtu_manager.h"
+#include "modem_backend.h"
 #include "mqtt_manager.h"
 #include "sms_processor.h"
 #include "sntp_manager.h"
 #include "remote_log.h"
+#include "sms_dedup.h"
+#include "sms_pool.h"
 
 static const char *TAG = "app_main";
 
@@ -34,6 +35,7 @@ void app_main(void)
     esp_log_level_set("wifi_manager", ESP_LOG_INFO);
     esp_log_level_set("uart_at_manager", ESP_LOG_INFO); // Set to VERBOSE for detailed AT command logs
     esp_log_level_set("uart_dtu_manager", ESP_LOG_DEBUG);
+    esp_log_level_set("modem_backend", ESP_LOG_INFO);
     esp_log_level_set("mqtt_manager", ESP_LOG_INFO);
     esp_log_level_set("sms_processor", ESP_LOG_INFO);
     esp_log_level_set("remote_log", ESP_LOG_INFO);
@@ -52,6 +54,9 @@ void app_main(void)
     }
     ESP_ERROR_CHECK(ret);
 
+    // 去重表在调制解调器任务启动前从NVS恢复,重启前已投递的短信不会再次发布
+    ESP_ERROR_CHECK(sms_dedup_init());
+
     // Initialize TCP/IP stack and default event loop
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
@@ -65,23 +70,26 @@ void app_main(void)
     }
     ESP_LOGI(TAG, "Wi-Fi connected successfully.");
 
-    // 2. Create SMS message queue
-    g_sms_queue = xQueueCreate(10, sizeof(sms_message_t)); // Queue can hold 10 SMS messages
+    // 2. Create the SMS buffer pool and message queue. The queue only carries
+    //    sms_message_t pointers; the messages stay in the pool from decoding to publish/persist
+    if (sms_pool_init(SMS_QUEUE_LEN) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to allocate SMS buffers. Aborting.");
+        while(1) { vTaskDelay(pdMS_TO_TICKS(1000)); }
+    }
+    g_sms_queue = xQueueCreate(SMS_QUEUE_LEN, sizeof(sms_message_t *));
     if (g_sms_queue == NULL) {
         ESP_LOGE(TAG, "Failed to create SMS queue. Aborting.");
         while(1) { vTaskDelay(pdMS_TO_TICKS(1000)); }
     }
 
-    // 3. Initialize UART manager (AT or DTU firmware) and create its task
-#if CONFIG_APP_MODEM_FIRMWARE_DTU
-    ESP_LOGI(TAG, "Initializing UART DTU manager...");
-    ESP_ERROR_CHECK(uart_dtu_init(g_sms_queue));
-    xTaskCreate(uart_dtu_task, "uart_dtu_task", 8192, NULL, 6, NULL);
-#else
-    ESP_LOGI(TAG, "Initializing UART AT manager...");
-    ESP_ERROR_CHECK(uart_at_init(g_sms_queue));
-    xTaskCreate(uart_at_task, "uart_at_task", 8192, NULL, 6, NULL); // 8KB stack for SMS fragment processing (sms_message_t is 2KB)
-#endif
+    // 3. Start one backend per modem (AT or DTU firmware, fixed or detected at startup) and its task.
+    //    固件探测在各模组的后台任务中进行,不阻塞后面的启动步骤
+    modem_instance_config_t modem_configs[MODEM_MAX_INSTANCES];
+    for (uint8_t i = 0; i < MODEM_MAX_INSTANCES; i++) {
+        modem_backend_default_config(i, &modem_configs[i]);
+    }
+    ESP_LOGI(TAG, "Starting %d modem backend(s)...", MODEM_MAX_INSTANCES);
+    ESP_ERROR_CHECK(modem_backend_start(g_sms_queue, modem_configs, MODEM_MAX_INSTANCES));
 
     // 4. Start MQTT client
     ESP_LOGI(TAG, "Starting MQTT client...");
@@ -94,7 +102,7 @@ void app_main(void)
 
     // 5. Create SMS processor task
     ESP_LOGI(TAG, "Creating SMS processor task...");
-    xTaskCreate(sms_processor_task, "sms_processor_task", 10240, (void*)g_sms_queue, 4, NULL); // 10KB stack (sms_message_t=2KB + mqtt_payload=2.5KB + network stack)
+    xTaskCreate(sms_processor_task, "sms_processor_task", 8192, (void*)g_sms_queue, 4, NULL); // 8KB stack (mqtt_payload=2.5KB + network stack; messages stay in sms_pool)
 
     ESP_LOGI(TAG, "All critical components initialized.");
 
@@ -0,0 +1,355 @@
+#include <stdio.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "nvs.h"
+#include "sdkconfig.h"
+
+#include "modem_backend.h"
+#include "modem_uart.h"
+#include "sms_dedup.h"
+
+#ifdef CONFIG_APP_MODEM_PROBE_TIMEOUT_S
+#define MODEM_PROBE_TIMEOUT_MS (CONFIG_APP_MODEM_PROBE_TIMEOUT_S * 1000)
+#else
+#define MODEM_PROBE_TIMEOUT_MS 15000
+#endif
+#define MODEM_PROBE_REPLY_MS   300  // 单条识别命令的应答等待;两种固件都在几毫秒内应答
+#define MODEM_PROBE_RETRY_MS   500  // 一轮都没有应答(模组还在开机)时的间隔
+#define MODEM_PROBE_RX_BUF_SIZE 512
+// 短信缓冲来自sms_pool,拼接状态在各后端的上下文中,都不占任务栈。栈上最深的是AT后端初始化:
+// uart_at_task和get_sim_imsi各有一个1KB的响应缓冲,再加ESP_LOG格式化、NVS写入和
+// 就绪消息的发布(localtime_r、MQTT)
+#define MODEM_TASK_STACK       8192
+#define MODEM_TASK_PRIORITY    6
+
+#define BACKEND_NVS_NAMESPACE "modem_backend"
+#define BACKEND_NVS_KEY_LAST  "last" // 上次在该端口识别出的后端在s_backends中的下标
+
+static const char *TAG = "modem_backend";
+
+// 探测顺序: 首次开机时AT在前
+static const modem_backend_t *const s_backends[] = {
+    &uart_at_backend,
+    &uart_dtu_backend,
+};
+#define BACKEND_COUNT (sizeof(s_backends) / sizeof(s_backends[0]))
+
+static QueueHandle_t s_sms_queue = NULL;
+static modem_instance_t s_modems[MODEM_MAX_INSTANCES];
+static size_t s_modem_count = 0;
+
+static uint32_t load_last_backend(const modem_instance_t *modem) {
+    char name[MODEM_NVS_NAME_SIZE];
+    nvs_handle_t nvs_handle;
+    uint32_t index = 0;
+    if (modem_backend_nvs_name(modem, BACKEND_NVS_NAMESPACE, name, sizeof(name)) == ESP_OK &&
+        nvs_open(name, NVS_READONLY, &nvs_handle) == ESP_OK) {
+        if (nvs_get_u32(nvs_handle, BACKEND_NVS_KEY_LAST, &index) != ESP_OK || index >= BACKEND_COUNT) {
+            index = 0;
+        }
+        nvs_close(nvs_handle);
+    }
+    return index;
+}
+
+static void save_last_backend(const modem_instance_t *modem, uint32_t index) {
+    char name[MODEM_NVS_NAME_SIZE];
+    esp_err_t err = modem_backend_nvs_name(modem, BACKEND_NVS_NAMESPACE, name, sizeof(name));
+    nvs_handle_t nvs_handle;
+    if (err == ESP_OK) {
+        err = nvs_open(name, NVS_READWRITE, &nvs_handle);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to open NVS namespace: %s", esp_err_to_name(err));
+        return;
+    }
+    err = nvs_set_u32(nvs_handle, BACKEND_NVS_KEY_LAST, index);
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs_handle);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to save modem backend: %s", esp_err_to_name(err));
+    }
+    nvs_close(nvs_handle);
+}
+
+// 先按基础速率识别;后端保存过协商后的速率时再按该速率试一次,最后恢复基础速率
+static bool modem_backend_probe_one(modem_instance_t *modem, const modem_backend_t *backend) {
+    if (backend->probe(modem, pdMS_TO_TICKS(MODEM_PROBE_REPLY_MS))) {
+        return true;
+    }
+    uint32_t saved_baud = backend->saved_baud ? backend->saved_baud(modem) : 0;
+    if (saved_baud == 0 || saved_baud == UART_BAUD_RATE) {
+        return false;
+    }
+    uart_set_baudrate(modem->uart.num, saved_baud);
+    bool answered = backend->probe(modem, pdMS_TO_TICKS(MODEM_PROBE_REPLY_MS));
+    uart_set_baudrate(modem->uart.num, UART_BAUD_RATE);
+    if (answered) {
+        ESP_LOGI(TAG, "Modem %u answered at the saved %lu baud", modem->index, (unsigned long)saved_baud);
+    }
+    return answered;
+}
+
+/**
+ * @brief 在模组串口上依次发送各后端的识别命令,返回第一个应答的后端
+ *
+ * 上次在该端口上识别出的后端最先尝试,模组已在运行时一次往返即可确定。ESP32单独重启时
+ * 模组可能仍停在AT后端协商后的速率,所以每个后端除基础速率外还按它保存的速率试一次。一轮都没有
+ * 应答说明模组还在开机,隔MODEM_PROBE_RETRY_MS再试,直到MODEM_PROBE_TIMEOUT_MS;
+ * 超时则沿用上次的后端,由它自己的开机流程继续重试。
+ */
+static const modem_backend_t *modem_backend_probe(modem_instance_t *modem) {
+    static const modem_uart_config_t probe_uart = {
+        .rx_buffer_size = MODEM_PROBE_RX_BUF_SIZE,
+    };
+    uint32_t last = load_last_backend(modem);
+    TickType_t start = xTaskGetTickCount();
+    uint32_t rounds = 0;
+    int found = -1;
+
+    if (modem_uart_install(&modem->uart, &probe_uart, NULL) == ESP_OK) {
+        do {
+            rounds++;
+            for (uint32_t i = 0; i < BACKEND_COUNT && found < 0; i++) {
+                uint32_t index = (last + i) % BACKEND_COUNT;
+                if (modem_backend_probe_one(modem, s_backends[index])) {
+                    found = (int)index;
+                }
+            }
+            if (found < 0) {
+                vTaskDelay(pdMS_TO_TICKS(MODEM_PROBE_RETRY_MS));
+            }
+        } while (found < 0 && xTaskGetTickCount() - start < pdMS_TO_TICKS(MODEM_PROBE_TIMEOUT_MS));
+        // 后端初始化时按自己的参数重新安装驱动
+        uart_driver_delete(modem->uart.num);
+    }
+
+    uint32_t elapsed_ms = (uint32_t)pdTICKS_TO_MS(xTaskGetTickCount() - start);
+    atomic_store(&modem->probe_ms, elapsed_ms > 0 ? elapsed_ms : 1);
+    atomic_store(&modem->probe_rounds, rounds);
+    atomic_store(&modem->probe_detected, found >= 0);
+    if (found < 0) {
+        ESP_LOGW(TAG, "Modem %u: no firmware answered within %d ms, using %s",
+                 modem->index, MODEM_PROBE_TIMEOUT_MS, s_backends[last]->name);
+        return s_backends[last];
+    }
+    ESP_LOGI(TAG, "Modem %u firmware detected: %s in %lu ms (%lu round(s))",
+             modem->index, s_backends[found]->name, (unsigned long)elapsed_ms, (unsigned long)rounds);
+    if ((uint32_t)found != last) {
+        save_last_backend(modem, (uint32_t)found);
+    }
+    return s_backends[found];
+}
+
+static esp_err_t modem_backend_run(modem_instance_t *modem, const modem_backend_t *backend) {
+    ESP_LOGI(TAG, "Initializing %s modem backend on modem %u (UART%d)...",
+             backend->name, modem->index, modem->uart.num);
+    esp_err_t err = backend->init(modem, s_sms_queue);
+    if (err != ESP_OK) {
+        return err;
+    }
+    atomic_store(&modem->backend, backend);
+    // 各模组的任务同名,靠参数区分
+    if (xTaskCreate(backend->run, backend->task_name, MODEM_TASK_STACK, modem,
+                    MODEM_TASK_PRIORITY, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+// 探测期间模组可能还在开机,放在单独的任务中,不阻塞app_main启动MQTT等其余部分;
+// 多个模组各自探测,互不等待
+static void modem_probe_task(void *pvParameters) {
+    modem_instance_t *modem = pvParameters;
+    ESP_ERROR_CHECK(modem_backend_run(modem, modem_backend_probe(modem)));
+    vTaskDelete(NULL);
+}
+
+void modem_backend_default_config(uint8_t index, modem_instance_config_t *config) {
+    modem_uart_default_port(index, &config->uart);
+    config->phone_number = CONFIG_APP_SIM_PHONE_NUMBER;
+#if CONFIG_APP_MODEM_COUNT >= 2
+    if (index == 1) {
+        config->phone_number = CONFIG_APP_MODEM2_PHONE_NUMBER;
+    }
+#endif
+#if CONFIG_APP_MODEM_FIRMWARE_DTU
+    config->backend = &uart_dtu_backend;
+#elif CONFIG_APP_MODEM_FIRMWARE_AT
+    config->backend = &uart_at_backend;
+#else
+    config->backend = NULL;
+#endif
+}
+
+esp_err_t modem_backend_start(QueueHandle_t sms_queue, const modem_instance_config_t *configs,
+                              size_t count) {
+    if (count == 0 || count > MODEM_MAX_INSTANCES || s_modem_count > 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_sms_queue = sms_queue;
+    for (size_t i = 0; i < count; i++) {
+        modem_instance_t *modem = &s_modems[i];
+        modem->index = (uint8_t)i;
+        modem->uart = configs[i].uart;
+        modem->uart.capture = i == 0; // 抓包缓冲只有一份,只记录第一个模组
+        modem->phone_number = configs[i].phone_number != NULL ? configs[i].phone_number : "";
+    }
+    s_modem_count = count;
+
+    for (size_t i = 0; i < count; i++) {
+        modem_instance_t *modem = &s_modems[i];
+        esp_err_t err;
+        if (configs[i].backend != NULL) {
+            err = modem_backend_run(modem, configs[i].backend);
+        } else {
+            err = xTaskCreate(modem_probe_task, "modem_probe_task", 4096, modem,
+                              MODEM_TASK_PRIORITY, NULL) == pdPASS ? ESP_OK : ESP_ERR_NO_MEM;
+        }
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+size_t modem_backend_count(void) {
+    return s_modem_count;
+}
+
+modem_instance_t *modem_backend_instance(size_t index) {
+    return index < s_modem_count ? &s_modems[index] : NULL;
+}
+
+const modem_backend_t *modem_backend_get(size_t index) {
+    return index < s_modem_count ? atomic_load(&s_modems[index].backend) : NULL;
+}
+
+void modem_backend_request_sms_poll(void) {
+    for (size_t i = 0; i < s_modem_count; i++) {
+        const modem_backend_t *backend = atomic_load(&s_modems[i].backend);
+        if (backend != NULL && backend->request_sms_poll != NULL) {
+            backend->request_sms_poll(&s_modems[i]);
+        }
+    }
+}
+
+#define MODEM_METRICS_ENTRY_FMT \
+    "%s{\"modem\":%u,\"backend\":\"%s\",\"operator\":\"%s\"," \
+    "\"sms_queued\":%lu,\"sms_duplicates\":%lu,\"sms_dropped\":%lu," \
+    "\"sms_peak_per_s\":%lu,\"rx_bytes\":%lu,\"rx_peak_Bps\":%lu}%s"
+
+// 7个数字各10位,运营商名,前缀",\"modems\":["和后端名各按16字节计
+_Static_assert(sizeof(MODEM_METRICS_ENTRY_FMT) + 7 * 10 + sizeof(((modem_instance_t *)0)->operator_name) + 2 * 16
+               <= MODEM_METRICS_ENTRY_MAX, "MODEM_METRICS_ENTRY_MAX too small for one modems[] entry");
+
+int modem_backend_format_metrics(char *buf, size_t size) {
+    if (s_modem_count == 0) {
+        return 0;
+    }
+    // 第一个模组沿用原来的平铺字段,已有的看板不受影响
+    modem_instance_t *first = &s_modems[0];
+    const modem_backend_t *backend = atomic_load(&first->backend);
+    int len = snprintf(buf, size,
+                       ",\"modem_backend\":\"%s\",\"modem_probe_ms\":%lu,"
+                       "\"modem_probe_rounds\":%lu,\"modem_probe_detected\":%u",
+                       backend != NULL ? backend->name : "",
+                       (unsigned long)atomic_load(&first->probe_ms),
+                       (unsigned long)atomic_load(&first->probe_rounds),
+                       atomic_load(&first->probe_detected) ? 1u : 0u);
+    if (backend != NULL && len >= 0 && len < (int)size) {
+        len += backend->format_metrics(first, buf + len, size - len);
+    }
+
+    for (size_t i = 0; i < s_modem_count && len >= 0 && len < (int)size; i++) {
+        modem_backend_stats_t st;
+        modem_backend_get_stats(i, &st);
+        len += snprintf(buf + len, size - len, MODEM_METRICS_ENTRY_FMT,
+                        i == 0 ? ",\"modems\":[" : ",", (unsigned)i,
+                        st.backend != NULL ? st.backend : "", s_modems[i].operator_name,
+                        (unsigned long)st.sms_queued, (unsigned long)st.sms_duplicates,
+                        (unsigned long)st.sms_dropped, (unsigned long)st.sms_peak_per_s,
+                        (unsigned long)st.rx_bytes, (unsigned long)st.rx_peak_bytes_per_s,
+                        i + 1 == s_modem_count ? "]" : "");
+    }
+    return len;
+}
+
+void modem_backend_get_stats(size_t index, modem_backend_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+    if (index >= s_modem_count) {
+        return;
+    }
+    modem_instance_t *modem = &s_modems[index];
+    const modem_backend_t *backend = atomic_load(&modem->backend);
+    stats->backend = backend != NULL ? backend->name : NULL;
+    stats->probe_ms = atomic_load(&modem->probe_ms);
+    stats->probe_rounds = atomic_load(&modem->probe_rounds);
+    stats->detected = atomic_load(&modem->probe_detected);
+    stats->sms_queued = atomic_load(&modem->sms_queued);
+    stats->sms_duplicates = atomic_load(&modem->sms_duplicates);
+    stats->sms_dropped = atomic_load(&modem->sms_dropped);
+    stats->sms_peak_per_s = atomic_load(&modem->sms_peak_per_s);
+    stats->rx_bytes = atomic_load(&modem->rx_bytes);
+    stats->rx_peak_bytes_per_s = atomic_load(&modem->rx_peak_bytes_per_s);
+}
+
+esp_err_t modem_backend_nvs_name(const modem_instance_t *modem, const char *base, char *out, size_t size) {
+    int n = modem->index == 0 ? snprintf(out, size, "%s", base) : snprintf(out, size, "%s%u", base, modem->index);
+    return n >= 0 && (size_t)n < size ? ESP_OK : ESP_ERR_INVALID_SIZE;
+}
+
+void modem_backend_count_rx(modem_instance_t *modem, uint32_t len) {
+    TickType_t now = xTaskGetTickCount();
+    atomic_fetch_add_explicit(&modem->rx_bytes, len, memory_order_relaxed);
+    if (now - modem->rx_window_start >= pdMS_TO_TICKS(1000)) {
+        modem->rx_window_start = now;
+        modem->rx_window_bytes = 0;
+    }
+    modem->rx_window_bytes += len;
+    if (modem->rx_window_bytes > atomic_load_explicit(&modem->rx_peak_bytes_per_s, memory_order_relaxed)) {
+        atomic_store_explicit(&modem->rx_peak_bytes_per_s, modem->rx_window_bytes, memory_order_relaxed);
+    }
+}
+
+void modem_backend_count_dropped(modem_instance_t *modem) {
+    atomic_fetch_add_explicit(&modem->sms_dropped, 1, memory_order_relaxed);
+}
+
+static void count_queued(modem_instance_t *modem) {
+    TickType_t now = xTaskGetTickCount();
+    atomic_fetch_add_explicit(&modem->sms_queued, 1, memory_order_relaxed);
+    if (now - modem->sms_window_start >= pdMS_TO_TICKS(1000)) {
+        modem->sms_window_start = now;
+        modem->sms_window_count = 0;
+    }
+    modem->sms_window_count++;
+    if (modem->sms_window_count > atomic_load_explicit(&modem->sms_peak_per_s, memory_order_relaxed)) {
+        atomic_store_explicit(&modem->sms_peak_per_s, modem->sms_window_count, memory_order_relaxed);
+    }
+}
+
+modem_sms_handoff_t modem_backend_hand_off(modem_instance_t *modem, QueueHandle_t queue,
+                                           sms_message_t **sms, TickType_t wait_ticks) {
+    sms_message_t *message = *sms;
+    uint32_t fingerprint;
+    message->modem = modem->index;
+    if (sms_dedup_seen(message, &fingerprint)) {
+        atomic_fetch_add_explicit(&modem->sms_duplicates, 1, memory_order_relaxed);
+        return MODEM_SMS_DUPLICATE;
+    }
+    // 只传指针;入队后缓冲归sms_processor,之后不能再访问message
+    if (xQueueSend(queue, &message, wait_ticks) != pdPASS) {
+        atomic_fetch_add_explicit(&modem->sms_dropped, 1, memory_order_relaxed);
+        return MODEM_SMS_DROPPED;
+    }
+    *sms = NULL;
+    sms_dedup_record(fingerprint);
+    count_queued(modem);
+    return MODEM_SMS_QUEUED;
+}
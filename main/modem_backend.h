@@ -0,0 +1,211 @@
+#ifndef MODEM_BACKEND_H
+#define MODEM_BACKEND_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+#include "sdkconfig.h"
+
+#include "modem_uart.h"
+#include "uart_at_manager.h" // sms_message_t, modem_instance_t
+
+// 同时接入的模组数,每个模组占一个UART端口
+#ifdef CONFIG_APP_MODEM_COUNT
+#define MODEM_MAX_INSTANCES CONFIG_APP_MODEM_COUNT
+#else
+#define MODEM_MAX_INSTANCES 1
+#endif
+
+// 指标中"modems"数组每个模组一项的最大长度,modem_backend.c中静态检查
+#define MODEM_METRICS_ENTRY_MAX 320
+
+/*
+ * 模组固件后端: AT固件(uart_at_manager)和银尔达DTU固件(uart_dtu_manager)
+ * 实现同一组接口。固件类型可在menuconfig中固定,也可在开机时探测
+ * (CONFIG_APP_MODEM_FIRMWARE_AUTO): 模组串口上依次发送各后端的识别命令,
+ * 上次识别出的固件最先尝试,第一个应答的后端接管串口。
+ *
+ * 每个模组是一个modem_instance_t,各自的串口、任务和缓冲互不共享,后端的
+ * 状态挂在instance->ctx上;所有模组的短信进入同一个队列,由sms_message_t.modem
+ * 区分来自哪张SIM卡。
+ */
+typedef struct {
+    const char *name;          // "AT" / "DTU",用于日志和指标
+    const char *task_name;
+
+    /**
+     * Sends the backend's identification command on the UART installed by
+     * the probe at its current baud rate and waits up to reply_ticks for its
+     * reply. Runs before init; must not change the baud rate.
+     */
+    bool (*probe)(modem_instance_t *modem, TickType_t reply_ticks);
+
+    /**
+     * Returns the baud rate the backend last switched the modem to (saved in
+     * NVS), or 0 if the modem is at the base rate. An ESP32-only reset leaves
+     * the modem there, so the probe retries the backend at that rate. May be NULL.
+     */
+    uint32_t (*saved_baud)(modem_instance_t *modem);
+
+    esp_err_t (*init)(modem_instance_t *modem, QueueHandle_t sms_queue);
+    void (*run)(void *pvParameters); // 任务主体,参数为modem_instance_t,不返回
+
+    /**
+     * Appends the backend's metrics as JSON members (",\"key\":value...").
+     * Returns the snprintf-style length; safe to call from any task.
+     */
+    int (*format_metrics)(const modem_instance_t *modem, char *buf, size_t size);
+
+    void (*request_sms_poll)(modem_instance_t *modem); // 上游恢复后补读模组缓存,可为NULL
+} modem_backend_t;
+
+extern const modem_backend_t uart_at_backend;
+extern const modem_backend_t uart_dtu_backend;
+
+// 一个模组的启动参数
+typedef struct {
+    modem_uart_port_t uart;
+    const char *phone_number;       // 本机号码,用于上报;空串表示未知
+    const modem_backend_t *backend; // NULL: 开机探测
+} modem_instance_config_t;
+
+struct modem_instance {
+    uint8_t index;
+    modem_uart_port_t uart;
+    const char *phone_number;
+    char operator_name[32];         // 后端识别出的运营商,例如"中国移动"
+    void *ctx;                      // 后端的运行状态,由后端的init分配
+
+    _Atomic(const modem_backend_t *) backend; // 探测期间为NULL
+    _Atomic uint32_t probe_ms;
+    _Atomic uint32_t probe_rounds;
+    _Atomic bool probe_detected;
+
+    // 吞吐统计,两种后端共用
+    _Atomic uint32_t sms_queued;
+    _Atomic uint32_t sms_duplicates;
+    _Atomic uint32_t sms_dropped;
+    _Atomic uint32_t sms_peak_per_s;
+    TickType_t sms_window_start;    // 窗口字段只由本模组的任务更新
+    uint32_t sms_window_count;
+    _Atomic uint32_t rx_bytes;
+    _Atomic uint32_t rx_peak_bytes_per_s;
+    TickType_t rx_window_start;
+    uint32_t rx_window_bytes;
+};
+
+// 交给短信队列的结果
+typedef enum {
+    MODEM_SMS_QUEUED,    // 已入队并记入去重表
+    MODEM_SMS_DUPLICATE, // 去重窗口内已投递过,未入队
+    MODEM_SMS_DROPPED,   // 队列满,未入队也未记入去重表,之后重读时仍会投递
+} modem_sms_handoff_t;
+
+// 固件探测和吞吐统计
+typedef struct {
+    const char *backend;  // 当前后端名称,尚未选定时为NULL
+    uint32_t probe_ms;    // 探测耗时,未探测(固定固件类型)时为0
+    uint32_t probe_rounds; // 所有后端都试过一遍记一轮
+    bool detected;        // false: 探测超时,沿用上次识别的后端
+    uint32_t sms_queued;
+    uint32_t sms_duplicates;
+    uint32_t sms_dropped;  // 队列满未能入队,或取不到缓冲未能解码的次数
+    uint32_t sms_peak_per_s; // 1秒窗口内的最高入队条数
+    uint32_t rx_bytes;
+    uint32_t rx_peak_bytes_per_s;
+} modem_backend_stats_t;
+
+/**
+ * @brief Fills in the Kconfig settings of modem index: its UART port, local
+ *        number and firmware choice (NULL for CONFIG_APP_MODEM_FIRMWARE_AUTO).
+ */
+void modem_backend_default_config(uint8_t index, modem_instance_config_t *config);
+
+/**
+ * @brief Creates one modem instance per config and starts their tasks.
+ *
+ * Each instance first probes its modem if its backend is NULL, then
+ * initialises the chosen backend and runs it, so app_main is not held up
+ * while the modems boot. If no backend answers within
+ * CONFIG_APP_MODEM_PROBE_TIMEOUT_S, the last one detected on that port (AT on
+ * first boot) is used and keeps retrying on its own. Only modem 0 is recorded
+ * by uart_capture.
+ *
+ * @param sms_queue Queue all instances send parsed SMS to.
+ * @param configs Up to MODEM_MAX_INSTANCES configs; index i becomes modem i.
+ * @param count Number of configs.
+ */
+esp_err_t modem_backend_start(QueueHandle_t sms_queue, const modem_instance_config_t *configs,
+                              size_t count);
+
+// 已启动的模组数
+size_t modem_backend_count(void);
+
+/**
+ * @brief Returns modem instance index, or NULL if it was not started.
+ */
+modem_instance_t *modem_backend_instance(size_t index);
+
+/**
+ * @brief Returns the backend running on modem index, or NULL while its probe
+ *        is running or if it was not started.
+ */
+const modem_backend_t *modem_backend_get(size_t index);
+
+/**
+ * @brief Forwards to each running backend's request_sms_poll, if any.
+ *        Safe to call from any task.
+ */
+void modem_backend_request_sms_poll(void);
+
+/**
+ * @brief Appends modem 0's backend name, probe results and backend metrics as
+ *        JSON members, followed by a "modems" array with every instance's
+ *        backend, operator and throughput. Returns the snprintf-style length.
+ *        The array takes at most MODEM_METRICS_ENTRY_MAX bytes per instance.
+ */
+int modem_backend_format_metrics(char *buf, size_t size);
+
+// 统计index号模组,未启动时全部为0
+void modem_backend_get_stats(size_t index, modem_backend_stats_t *stats);
+
+#define MODEM_NVS_NAME_SIZE 16 // NVS命名空间最长15个字符
+
+/**
+ * @brief Builds the NVS namespace of a per-modem setting: base for modem 0,
+ *        base followed by the index for the others, so a single-modem device
+ *        keeps its existing settings.
+ *
+ * @param size Size of out, normally MODEM_NVS_NAME_SIZE
+ * @return ESP_OK, or ESP_ERR_INVALID_SIZE if the name does not fit (out is
+ *         then truncated and must not be used)
+ */
+esp_err_t modem_backend_nvs_name(const modem_instance_t *modem, const char *base, char *out, size_t size);
+
+// 接收吞吐统计,由后端的读取路径调用
+void modem_backend_count_rx(modem_instance_t *modem, uint32_t len);
+
+// 缓冲池空、短信未能解码而丢弃时由后端调用,计入sms_dropped
+void modem_backend_count_dropped(modem_instance_t *modem);
+
+/**
+ * @brief Tags a parsed SMS with the receiving modem, hands it to the queue
+ *        unless it is a duplicate, and records it for duplicate suppression
+ *        once it was queued. Common to all backends; the caller logs the
+ *        outcome.
+ *
+ * @param sms The caller's reference to an sms_pool buffer. Only the pointer
+ *        is queued: on MODEM_SMS_QUEUED the queue takes ownership and *sms is
+ *        set to NULL; otherwise the caller keeps the buffer and may reuse it.
+ */
+modem_sms_handoff_t modem_backend_hand_off(modem_instance_t *modem, QueueHandle_t queue,
+                                           sms_message_t **sms, TickType_t wait_ticks);
+
+#endif // MODEM_BACKEND_H
@@ -0,0 +1,419 @@
+#include <stdatomic.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "modem_status.h"
+
+static const char *TAG = "modem_status";
+
+#define STATUS_MAX_FIELDS       6
+#define NETWORK_TIME_MIN_YEAR   2024  // 更早的时间是模组RTC的默认值,不是网络下发的
+
+// 状态快照: 只有所属模组的uart_at_task写入。写入方先把当前快照复制到另一份缓冲上修改,
+// 再递增序号发布;读取方按序号取对应缓冲,读完序号未变就说明读到的缓冲期间未被改写。
+// 写到一半的修改不改变序号,高优先级任务打断写入方时读取一次即成功,不会空转等待
+#define MODEM_STATUS_INIT {                 \
+        .creg_stat = MODEM_REG_UNKNOWN,     \
+        .cgreg_stat = MODEM_REG_UNKNOWN,    \
+        .cereg_stat = MODEM_REG_UNKNOWN,    \
+        .access_tech = 0xFF,                \
+        .rssi_dbm = MODEM_RSSI_UNKNOWN,     \
+        .ber = 99,                          \
+        .sys_mode = 0xFF,                   \
+        .sys_submode = 0xFF,                \
+        .sim = MODEM_SIM_UNKNOWN,           \
+    }
+
+typedef struct {
+    const char *s;
+    int len;
+    bool quoted;
+} status_field_t;
+
+static uint32_t now_ms(void) {
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+// 取得待修改的快照副本,修改后调用status_publish
+static modem_status_t *status_edit(modem_status_cache_t *cache) {
+    uint32_t seq = atomic_load_explicit(&cache->seq, memory_order_relaxed);
+    modem_status_t *next = &cache->snapshot[(seq + 1) & 1];
+    // 这份缓冲可能正被按上一个序号读取,改写必须排在上次发布之后
+    atomic_thread_fence(memory_order_release);
+    *next = cache->snapshot[seq & 1];
+    return next;
+}
+
+static void status_publish(modem_status_cache_t *cache, modem_status_t *next) {
+    next->updated_ms = now_ms();
+    if (next->updated_ms == 0) {
+        next->updated_ms = 1;
+    }
+    atomic_fetch_add_explicit(&cache->seq, 1, memory_order_release);
+}
+
+void modem_status_init(modem_status_cache_t *cache) {
+    static const modem_status_t initial = MODEM_STATUS_INIT;
+    cache->snapshot[0] = initial;
+    cache->snapshot[1] = initial;
+    atomic_store(&cache->seq, 0);
+}
+
+void modem_status_get(modem_status_cache_t *cache, modem_status_t *status) {
+    uint32_t before;
+    uint32_t after;
+    do {
+        before = atomic_load_explicit(&cache->seq, memory_order_acquire);
+        memcpy(status, &cache->snapshot[before & 1], sizeof(*status));
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&cache->seq, memory_order_relaxed);
+    } while (after != before);
+}
+
+bool modem_status_is_registered(const modem_status_t *status) {
+    return status->cereg_stat == 1 || status->cereg_stat == 5 ||
+           status->creg_stat == 1 || status->creg_stat == 5;
+}
+
+int64_t modem_status_network_time_now(const modem_status_t *status) {
+    if (status->network_time == 0) {
+        return 0;
+    }
+    return status->network_time + (int64_t)((uint32_t)(now_ms() - status->network_time_ms) / 1000);
+}
+
+// 把"+XXX: a,"b",c"的参数部分按逗号拆开(引号内的逗号不拆),返回字段数
+static int split_fields(const char *line, int len, status_field_t *fields, int max_fields) {
+    const char *p = memchr(line, ':', (size_t)len);
+    const char *end = line + len;
+    int count = 0;
+
+    if (p == NULL) {
+        return 0;
+    }
+    p++;
+    while (p < end && count < max_fields) {
+        while (p < end && *p == ' ') {
+            p++;
+        }
+        status_field_t *f = &fields[count++];
+        f->quoted = p < end && *p == '"';
+        if (f->quoted) {
+            const char *close = memchr(p + 1, '"', (size_t)(end - p - 1));
+            f->s = p + 1;
+            f->len = (int)((close ? close : end) - f->s);
+            p = close ? close + 1 : end;
+            while (p < end && *p != ',') {
+                p++;
+            }
+        } else {
+            f->s = p;
+            while (p < end && *p != ',') {
+                p++;
+            }
+            f->len = (int)(p - f->s);
+            while (f->len > 0 && f->s[f->len - 1] == ' ') {
+                f->len--;
+            }
+        }
+        if (p < end) {
+            p++; // 跳过逗号
+            if (p == end && count < max_fields) {
+                fields[count++] = (status_field_t){ .s = p, .len = 0, .quoted = false };
+            }
+        }
+    }
+    return count;
+}
+
+static bool field_uint(const status_field_t *f, unsigned base, uint32_t *value) {
+    uint32_t v = 0;
+    if (f->len == 0 || f->len > 8) {
+        return false;
+    }
+    for (int i = 0; i < f->len; i++) {
+        char c = f->s[i];
+        unsigned digit;
+        if (c >= '0' && c <= '9') {
+            digit = (unsigned)(c - '0');
+        } else if (base == 16 && c >= 'A' && c <= 'F') {
+            digit = (unsigned)(c - 'A' + 10);
+        } else if (base == 16 && c >= 'a' && c <= 'f') {
+            digit = (unsigned)(c - 'a' + 10);
+        } else {
+            return false;
+        }
+        v = v * base + digit;
+    }
+    *value = v;
+    return true;
+}
+
+static const char *reg_stat_name(uint8_t stat) {
+    switch (stat) {
+        case 0: return "not registered";
+        case 1: return "registered (home)";
+        case 2: return "searching";
+        case 3: return "denied";
+        case 5: return "registered (roaming)";
+        default: return "unknown";
+    }
+}
+
+/**
+ * @brief +CREG/+CGREG/+CEREG: 主动上报为<stat>[,<lac>,<ci>[,<AcT>]],
+ *        查询响应多一个前导的<n>,以第二个字段是否为不带引号的数字区分
+ */
+bool modem_status_on_reg(const char *line, int len, void *arg) {
+    modem_status_cache_t *cache = arg;
+    status_field_t f[STATUS_MAX_FIELDS];
+    int n = split_fields(line, len, f, STATUS_MAX_FIELDS);
+    uint32_t stat;
+    uint32_t value;
+    int i = 0;
+
+    if (n >= 2 && !f[1].quoted && field_uint(&f[1], 10, &value)) {
+        i = 1;
+    }
+    if (n <= i || !field_uint(&f[i], 10, &stat) || stat > 0xFE) {
+        return false;
+    }
+
+    modem_status_t *next = status_edit(cache);
+    uint8_t *target;
+    const char *domain;
+    if (line[2] == 'E') {
+        target = &next->cereg_stat;
+        domain = "LTE";
+    } else if (line[2] == 'G') {
+        target = &next->cgreg_stat;
+        domain = "GPRS";
+    } else {
+        target = &next->creg_stat;
+        domain = "CS";
+    }
+    bool changed = *target != stat;
+    *target = (uint8_t)stat;
+    if (n > i + 2 && field_uint(&f[i + 1], 16, &value) && value <= 0xFFFF) {
+        next->lac = (uint16_t)value;
+        if (field_uint(&f[i + 2], 16, &value)) {
+            next->cell_id = value;
+        }
+        if (n > i + 3 && field_uint(&f[i + 3], 10, &value) && value < 0xFF) {
+            next->access_tech = (uint8_t)value;
+        }
+    }
+    status_publish(cache, next);
+
+    if (changed) {
+        ESP_LOGI(TAG, "Network registration (%s): %s", domain, reg_stat_name((uint8_t)stat));
+    }
+    return false;
+}
+
+// +CSQ: <rssi>,<ber>; rssi 0..31对应-113..-51 dBm,99为未知
+bool modem_status_on_csq(const char *line, int len, void *arg) {
+    modem_status_cache_t *cache = arg;
+    status_field_t f[2];
+    uint32_t rssi;
+    uint32_t ber = 99;
+    int n = split_fields(line, len, f, 2);
+
+    if (n < 1 || !field_uint(&f[0], 10, &rssi)) {
+        return false;
+    }
+    if (n < 2 || !field_uint(&f[1], 10, &ber)) {
+        ber = 99;
+    }
+    modem_status_t *next = status_edit(cache);
+    next->rssi_dbm = rssi <= 31 ? (int8_t)(-113 + 2 * (int)rssi) : MODEM_RSSI_UNKNOWN;
+    next->ber = ber <= 7 ? (uint8_t)ber : 99;
+    status_publish(cache, next);
+    return false;
+}
+
+bool modem_status_on_cpin(const char *line, int len, void *arg) {
+    modem_status_cache_t *cache = arg;
+    status_field_t f[1];
+    modem_sim_state_t sim;
+
+    if (split_fields(line, len, f, 1) < 1) {
+        return false;
+    }
+    if (f[0].len == 5 && memcmp(f[0].s, "READY", 5) == 0) {
+        sim = MODEM_SIM_READY;
+    } else if (f[0].len >= 3 && memcmp(f[0].s, "SIM", 3) == 0) {
+        sim = MODEM_SIM_PIN_REQUIRED; // SIM PIN / SIM PUK / SIM PIN2 ...
+    } else if (f[0].len == 12 && memcmp(f[0].s, "NOT INSERTED", 12) == 0) {
+        sim = MODEM_SIM_NOT_INSERTED;
+    } else {
+        sim = MODEM_SIM_NOT_READY;
+    }
+
+    modem_status_t *next = status_edit(cache);
+    bool changed = next->sim != sim;
+    next->sim = sim;
+    status_publish(cache, next);
+    if (changed) {
+        ESP_LOGI(TAG, "SIM state: %.*s", f[0].len, f[0].s);
+    }
+    return false;
+}
+
+// ^MODE: <sys_mode>[,<sys_submode>]
+bool modem_status_on_mode(const char *line, int len, void *arg) {
+    modem_status_cache_t *cache = arg;
+    status_field_t f[2];
+    uint32_t mode;
+    uint32_t submode = 0xFF;
+    int n = split_fields(line, len, f, 2);
+
+    if (n < 1 || !field_uint(&f[0], 10, &mode) || mode > 0xFE) {
+        return false;
+    }
+    if (n < 2 || !field_uint(&f[1], 10, &submode) || submode > 0xFE) {
+        submode = 0xFF;
+    }
+    modem_status_t *next = status_edit(cache);
+    next->sys_mode = (uint8_t)mode;
+    next->sys_submode = (uint8_t)submode;
+    status_publish(cache, next);
+    return false;
+}
+
+// 读取1..max_digits位十进制数
+static const char *parse_digits(const char *p, const char *end, int max_digits, int *value) {
+    int v = 0;
+    int n = 0;
+    while (p < end && n < max_digits && *p >= '0' && *p <= '9') {
+        v = v * 10 + (*p++ - '0');
+        n++;
+    }
+    if (n == 0) {
+        return NULL;
+    }
+    *value = v;
+    return p;
+}
+
+// 公历日期 -> 距1970-01-01的天数
+static int64_t days_from_civil(int y, int m, int d) {
+    y -= m <= 2;
+    int era = (y >= 0 ? y : y - 399) / 400;
+    int yoe = y - era * 400;
+    int doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return (int64_t)era * 146097 + doe - 719468;
+}
+
+// 解析"yy/MM/dd,hh:mm:ss[±zz]"(年份也可为4位),时间为当地时间,zz为15分钟为单位的时区
+static bool parse_network_time(const char *p, const char *end, int64_t *utc, int *tz, bool *has_tz) {
+    int year, month, day, hour, minute, second;
+    const char *q = parse_digits(p, end, 4, &year);
+
+    if (q == NULL || q >= end || *q != '/' ||
+        (q = parse_digits(q + 1, end, 2, &month)) == NULL || q >= end || *q != '/' ||
+        (q = parse_digits(q + 1, end, 2, &day)) == NULL || q >= end || *q != ',' ||
+        (q = parse_digits(q + 1, end, 2, &hour)) == NULL || q >= end || *q != ':' ||
+        (q = parse_digits(q + 1, end, 2, &minute)) == NULL || q >= end || *q != ':' ||
+        (q = parse_digits(q + 1, end, 2, &second)) == NULL) {
+        return false;
+    }
+    if (year < 100) {
+        year += year < 69 ? 2000 : 1900; // 同strptime的%y,RTC默认的"70/01/01"不会被当成2070年
+    }
+    if (year < NETWORK_TIME_MIN_YEAR || month < 1 || month > 12 || day < 1 || day > 31 ||
+        hour > 23 || minute > 59 || second > 60) {
+        return false;
+    }
+
+    *has_tz = false;
+    if (q < end && (*q == '+' || *q == '-')) {
+        int quarters;
+        if (parse_digits(q + 1, end, 3, &quarters) != NULL && quarters <= 56) {
+            *tz = *q == '-' ? -quarters : quarters;
+            *has_tz = true;
+        }
+    }
+    *utc = days_from_civil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second -
+           (*has_tz ? *tz * 15 * 60 : 0);
+    return true;
+}
+
+/**
+ * @brief +NITZ/+CTZV/+CCLK: 在行内查找"yy/MM/dd,hh:mm:ss±zz"格式的网络时间;
+ *        只有时区("+CTZV: +32")时只更新时区
+ */
+bool modem_status_on_time(const char *line, int len, void *arg) {
+    modem_status_cache_t *cache = arg;
+    const char *end = line + len;
+    const char *colon = memchr(line, ':', (size_t)len);
+    const char *p;
+    int64_t utc = 0;
+    int tz = 0;
+    bool has_tz = false;
+    bool has_time = false;
+
+    if (colon == NULL) {
+        return false;
+    }
+    for (p = colon + 1; p < end && !has_time; p++) {
+        if (*p >= '0' && *p <= '9' && (p[-1] < '0' || p[-1] > '9')) {
+            has_time = parse_network_time(p, end, &utc, &tz, &has_tz);
+        }
+    }
+    if (!has_time) {
+        int quarters;
+        p = colon + 1;
+        while (p < end && (*p == ' ' || *p == '"')) {
+            p++;
+        }
+        if (p >= end || (*p != '+' && *p != '-') ||
+            parse_digits(p + 1, end, 3, &quarters) == NULL || quarters > 56) {
+            return false;
+        }
+        tz = *p == '-' ? -quarters : quarters;
+        has_tz = true;
+    }
+
+    modem_status_t *next = status_edit(cache);
+    if (has_tz) {
+        next->tz_quarter_hours = (int16_t)tz;
+    }
+    if (has_time) {
+        bool first = next->network_time == 0;
+        next->network_time = utc;
+        next->network_time_ms = now_ms();
+        if (first) {
+            ESP_LOGI(TAG, "Network time received (UTC %lld, tz %+d min)",
+                     (long long)utc, next->tz_quarter_hours * 15);
+        }
+    }
+    status_publish(cache, next);
+    return false;
+}
+
+/**
+ * @brief +CPMS: 查询响应为"<mem1>",<used1>,<total1>,...,设置响应为<used1>,<total1>,...;
+ *        只记录<mem1>(读取与删除所用的存储)
+ */
+bool modem_status_on_cpms(const char *line, int len, void *arg) {
+    modem_status_cache_t *cache = arg;
+    status_field_t f[3];
+    uint32_t used;
+    uint32_t total;
+    int n = split_fields(line, len, f, 3);
+    int i = n > 0 && f[0].quoted ? 1 : 0;
+
+    if (n < i + 2 || !field_uint(&f[i], 10, &used) || !field_uint(&f[i + 1], 10, &total) ||
+        total == 0 || total > 0xFFFF || used > total) {
+        return false;
+    }
+    modem_status_t *next = status_edit(cache);
+    next->sms_used = (uint16_t)used;
+    next->sms_total = (uint16_t)total;
+    status_publish(cache, next);
+    return false;
+}
@@ -0,0 +1,87 @@
+#ifndef MODEM_STATUS_H
+#define MODEM_STATUS_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define MODEM_REG_UNKNOWN   0xFF  // 尚未收到注册状态
+#define MODEM_RSSI_UNKNOWN  0     // 尚未收到信号强度或模组报告99
+
+typedef enum {
+    MODEM_SIM_UNKNOWN,
+    MODEM_SIM_READY,
+    MODEM_SIM_PIN_REQUIRED,  // SIM PIN/PUK等待输入
+    MODEM_SIM_NOT_INSERTED,
+    MODEM_SIM_NOT_READY,     // 其他+CPIN状态(如NOT READY)
+} modem_sim_state_t;
+
+/**
+ * @brief Modem status collected from URCs and from the responses of
+ *        commands that were sent anyway, so readers never cost an AT round trip.
+ *
+ * Registration values are the 3GPP TS 27.007 <stat> codes:
+ * 0 not registered, 1 home, 2 searching, 3 denied, 4 unknown, 5 roaming.
+ */
+typedef struct {
+    uint8_t creg_stat;          // +CREG (CS域),MODEM_REG_UNKNOWN表示未知
+    uint8_t cgreg_stat;         // +CGREG (GPRS)
+    uint8_t cereg_stat;         // +CEREG (LTE EPS),Cat.1模组以此为准
+    uint8_t access_tech;        // 最近一次注册上报中的<AcT>,0xFF未知
+    uint16_t lac;               // 最近一次注册上报中的LAC/TAC,0未知
+    uint32_t cell_id;           // 最近一次注册上报中的小区ID,0未知
+    int8_t rssi_dbm;            // +CSQ换算的dBm(-113..-51),MODEM_RSSI_UNKNOWN未知
+    uint8_t ber;                // +CSQ <ber>,99未知
+    uint8_t sys_mode;           // ^MODE <sys_mode>,0xFF未知
+    uint8_t sys_submode;        // ^MODE <sys_submode>,0xFF未知
+    modem_sim_state_t sim;
+    uint16_t sms_used;          // +CPMS <mem1>中已存短信数
+    uint16_t sms_total;         // +CPMS <mem1>容量,0未知
+    int16_t tz_quarter_hours;   // 网络时区,单位15分钟
+    int64_t network_time;       // 网络下发的UTC时间(Unix秒),0表示未收到
+    uint32_t network_time_ms;   // 收到network_time时距开机的毫秒数
+    uint32_t updated_ms;        // 任一字段最近一次更新时距开机的毫秒数,0表示从未更新
+} modem_status_t;
+
+// 每个模组一份状态缓存,由该模组的AT任务更新
+typedef struct {
+    modem_status_t snapshot[2];
+    _Atomic uint32_t seq;
+} modem_status_cache_t;
+
+/**
+ * @brief Resets a status cache to "nothing received yet".
+ */
+void modem_status_init(modem_status_cache_t *cache);
+
+/**
+ * @brief Reads a consistent snapshot of the cached modem status.
+ *
+ * Lock-free (sequence counter): safe from any task, never blocks the
+ * AT task that updates the cache.
+ */
+void modem_status_get(modem_status_cache_t *cache, modem_status_t *status);
+
+/**
+ * @brief True if the modem reports itself registered (home or roaming)
+ *        on LTE or on the CS domain.
+ */
+bool modem_status_is_registered(const modem_status_t *status);
+
+/**
+ * @brief Current network time estimated from the last network time report.
+ *
+ * @return UTC Unix seconds, or 0 if the network never reported the time.
+ */
+int64_t modem_status_network_time_now(const modem_status_t *status);
+
+// 以下URC处理函数由uart_at_manager注册,只在对应模组的uart_at_task中调用,
+// arg为该模组的modem_status_cache_t;均返回false,同一行若是命令的响应仍照常归入命令
+bool modem_status_on_reg(const char *line, int len, void *arg);
+bool modem_status_on_csq(const char *line, int len, void *arg);
+bool modem_status_on_cpin(const char *line, int len, void *arg);
+bool modem_status_on_mode(const char *line, int len, void *arg);
+bool modem_status_on_time(const char *line, int len, void *arg);
+bool modem_status_on_cpms(const char *line, int len, void *arg);
+
+#endif // MODEM_STATUS_H
@@ -0,0 +1,138 @@
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+
+#include "modem_uart.h"
+
+#define PROBE_LINE_SIZE 64 // 只比较行首,更长的行截断
+
+static const char *TAG = "modem_uart";
+
+void modem_uart_default_port(uint8_t index, modem_uart_port_t *port) {
+    *port = (modem_uart_port_t){
+        .num = CONFIG_APP_UART_PORT_NUM,
+        .txd = CONFIG_APP_UART_TXD,
+        .rxd = CONFIG_APP_UART_RXD,
+        .rts = UART_PIN_NO_CHANGE,
+        .cts = UART_PIN_NO_CHANGE,
+    };
+#if CONFIG_APP_UART_HW_FLOWCTRL
+    port->rts = CONFIG_APP_UART_RTS;
+    port->cts = CONFIG_APP_UART_CTS;
+#endif
+#if CONFIG_APP_MODEM_COUNT >= 2
+    if (index == 1) {
+        port->num = CONFIG_APP_MODEM2_UART_PORT_NUM;
+        port->txd = CONFIG_APP_MODEM2_UART_TXD;
+        port->rxd = CONFIG_APP_MODEM2_UART_RXD;
+#if CONFIG_APP_UART_HW_FLOWCTRL
+        port->rts = CONFIG_APP_MODEM2_UART_RTS;
+        port->cts = CONFIG_APP_MODEM2_UART_CTS;
+#endif
+    }
+#else
+    (void)index;
+#endif
+}
+
+esp_err_t modem_uart_install(const modem_uart_port_t *port, const modem_uart_config_t *config,
+                             QueueHandle_t *event_queue) {
+    // Clean up existing UART driver if already installed (important for device restarts)
+    if (uart_is_driver_installed(port->num)) {
+        ESP_LOGI(TAG, "UART driver already installed on port %d, uninstalling first...", port->num);
+        uart_driver_delete(port->num);
+        vTaskDelay(pdMS_TO_TICKS(100)); // Give time for cleanup
+    }
+
+    uart_config_t uart_config = {
+        .baud_rate = UART_BAUD_RATE,
+        .data_bits = UART_DATA_8_BITS,
+        .parity    = UART_PARITY_DISABLE,
+        .stop_bits = UART_STOP_BITS_1,
+        .flow_ctrl = UART_FLOW_CTRL,
+        .rx_flow_ctrl_thresh = UART_RX_FLOW_THRESH,
+        .source_clk = UART_SCLK_DEFAULT,
+    };
+    int intr_alloc_flags = 0;
+#if CONFIG_UART_ISR_IN_IRAM
+    intr_alloc_flags = ESP_INTR_FLAG_IRAM;
+#endif
+
+    esp_err_t err = uart_driver_install(port->num, config->rx_buffer_size, config->tx_buffer_size,
+                                        config->event_queue_len,
+                                        config->event_queue_len > 0 ? event_queue : NULL,
+                                        intr_alloc_flags);
+    if (err == ESP_OK) {
+        err = uart_param_config(port->num, &uart_config);
+    }
+    if (err == ESP_OK) {
+        err = uart_set_pin(port->num, port->txd, port->rxd, port->rts, port->cts);
+    }
+    if (err == ESP_OK && config->pattern_queue_len > 0) {
+        // 每个'\n'产生一次UART_PATTERN_DET,由驱动完成分行
+        err = uart_enable_pattern_det_baud_intr(port->num, '\n', 1, 9, 0, 0);
+        if (err == ESP_OK) {
+            err = uart_pattern_queue_reset(port->num, config->pattern_queue_len);
+        }
+    }
+    if (err == ESP_OK && config->rx_full_thresh > 0) {
+        err = uart_set_rx_full_threshold(port->num, config->rx_full_thresh);
+    }
+    if (err == ESP_OK && config->rx_timeout_symbols > 0) {
+        err = uart_set_rx_timeout(port->num, config->rx_timeout_symbols);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "UART setup on port %d failed: %s", port->num, esp_err_to_name(err));
+    }
+    return err;
+}
+
+bool modem_uart_probe(const modem_uart_port_t *port, const char *cmd, const char *reply_prefix,
+                      TickType_t timeout_ticks) {
+    uart_flush_input(port->num);
+    uart_write_bytes(port->num, cmd, strlen(cmd));
+    uart_write_bytes(port->num, "\r\n", 2);
+    modem_uart_capture(port, UART_CAPTURE_TX, cmd, strlen(cmd));
+    modem_uart_capture(port, UART_CAPTURE_TX, "\r\n", 2);
+
+    size_t prefix_len = strlen(reply_prefix);
+    char line[PROBE_LINE_SIZE];
+    size_t line_len = 0;
+    uint8_t chunk[64];
+    TickType_t start = xTaskGetTickCount();
+    TickType_t elapsed;
+    while ((elapsed = xTaskGetTickCount() - start) < timeout_ticks) {
+        // 等第一个字节,再取走已到达的其余字节
+        int len = uart_read_bytes(port->num, chunk, 1, timeout_ticks - elapsed);
+        if (len <= 0) {
+            break;
+        }
+        size_t buffered = 0;
+        uart_get_buffered_data_len(port->num, &buffered);
+        if (buffered > sizeof(chunk) - 1) {
+            buffered = sizeof(chunk) - 1;
+        }
+        if (buffered > 0) {
+            int more = uart_read_bytes(port->num, chunk + 1, buffered, 0);
+            len += more > 0 ? more : 0;
+        }
+        modem_uart_capture(port, UART_CAPTURE_RX, chunk, (size_t)len);
+
+        for (int i = 0; i < len; i++) {
+            char c = (char)chunk[i];
+            if (c != '\r' && c != '\n') {
+                if (line_len < sizeof(line)) {
+                    line[line_len++] = c;
+                }
+                continue;
+            }
+            if (line_len >= prefix_len && memcmp(line, reply_prefix, prefix_len) == 0) {
+                return true;
+            }
+            line_len = 0;
+        }
+    }
+    return false;
+}
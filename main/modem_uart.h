@@ -0,0 +1,84 @@
+#ifndef MODEM_UART_H
+#define MODEM_UART_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "driver/uart.h"
+#include "sdkconfig.h"
+
+#include "uart_capture.h"
+
+// 所有模组共用的UART配置(Kconfig),端口和引脚见modem_uart_port_t
+#define UART_BAUD_RATE     CONFIG_APP_UART_BAUD_RATE
+#if CONFIG_APP_UART_HW_FLOWCTRL
+#define UART_FLOW_CTRL     UART_HW_FLOWCTRL_CTS_RTS
+#define UART_RX_FLOW_THRESH CONFIG_APP_UART_RX_FLOWCTRL_THRESH
+#else
+#define UART_FLOW_CTRL     UART_HW_FLOWCTRL_DISABLE
+#define UART_RX_FLOW_THRESH 0
+#endif
+
+// 一个模组所接的UART端口和引脚
+typedef struct {
+    uart_port_t num;
+    int txd;
+    int rxd;
+    int rts;           // 未启用硬件流控时为UART_PIN_NO_CHANGE
+    int cts;
+    bool capture;      // 收发记入uart_capture,只有一个模组记录(见modem_backend_start)
+} modem_uart_port_t;
+
+/**
+ * @brief Fills in the Kconfig port and pins of modem index (0: APP_UART_*,
+ *        1: APP_MODEM2_UART_*). Capture is left off.
+ */
+void modem_uart_default_port(uint8_t index, modem_uart_port_t *port);
+
+static inline void modem_uart_capture(const modem_uart_port_t *port, uart_capture_dir_t dir,
+                                      const void *data, size_t len) {
+    if (port->capture) {
+        uart_capture_record(dir, data, len);
+    }
+}
+
+// 各后端的驱动参数,其余(基础波特率、流控)取自Kconfig
+typedef struct {
+    int rx_buffer_size;
+    int tx_buffer_size;      // 0: uart_write_bytes阻塞到写入FIFO
+    int event_queue_len;     // 0: 不需要事件队列
+    int pattern_queue_len;   // 0: 不检测'\n'
+    int rx_full_thresh;      // RX FIFO达到该值时搬入驱动缓冲,0保持驱动默认
+    int rx_timeout_symbols;  // 线路空闲多少个字符时间上报超时,0保持驱动默认
+} modem_uart_config_t;
+
+/**
+ * @brief Installs the modem UART driver at the base baud rate, replacing a
+ *        driver left installed by a previous backend or an earlier start.
+ *
+ * @param port Port and pins of the modem.
+ * @param config Driver parameters of the calling backend.
+ * @param event_queue Receives the event queue, may be NULL if
+ *        config->event_queue_len is 0.
+ * @return ESP_OK or the error of the failing driver call.
+ */
+esp_err_t modem_uart_install(const modem_uart_port_t *port, const modem_uart_config_t *config,
+                             QueueHandle_t *event_queue);
+
+/**
+ * @brief Sends cmd + "\r\n" and waits for a line starting with reply_prefix.
+ *
+ * For firmware detection before a backend is running: discards pending input,
+ * reads the driver buffer directly and returns as soon as the reply arrives.
+ * Both directions are recorded by uart_capture if port->capture is set.
+ *
+ * @return true if the reply arrived within timeout_ticks.
+ */
+bool modem_uart_probe(const modem_uart_port_t *port, const char *cmd, const char *reply_prefix,
+                      TickType_t timeout_ticks);
+
+#endif // MODEM_UART_H
@@ -14,16 +14,17 @@
 #include "sdkconfig.h"
 
 #include "mqtt_manager.h"
-#include "uart_at_manager.h" // 包含此头文件以访问全局变量 g_sim_operator 和 g_sim_phone_number
+#include "uart_at_manager.h"
 #include "wifi_manager.h"     // 包含此头文件以检查Wi-Fi连接状态
 #include "log_redaction.h"
+#include "uart_capture.h"
+#include "modem_backend.h"
 
 static const char *TAG = "mqtt_manager";
 
 // Configuration from Kconfig
 #define MQTT_BROKER_URI CONFIG_APP_MQTT_BROKER_URI
 #define MQTT_TOPIC_SMS  CONFIG_APP_MQTT_TOPIC_SMS
-#define SIM_PHONE_NUMBER CONFIG_APP_SIM_PHONE_NUMBER
 
 static esp_mqtt_client_handle_t s_mqtt_client = NULL;
 static bool s_mqtt_connected = false;
@@ -64,9 +65,12 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
         ESP_LOGI(TAG, "MQTT_EVENT_CONNECTED - Successfully connected to broker");
         ESP_LOGI(TAG, "MQTT keep-alive: 30s, connection stable");
         s_mqtt_connected = true;
-        // Optional: Subscribe to a command topic if needed
-        // msg_id = esp_mqtt_client_subscribe(client, "/esp/commands", 0);
-        // ESP_LOGI(TAG, "sent subscribe successful, msg_id=%d", msg_id);
+#if CONFIG_APP_UART_CAPTURE_ENABLE
+        // 抓包导出命令;重连后会话不保留订阅,每次连接都重新订阅
+        esp_mqtt_client_subscribe(event->client, UART_CAPTURE_CMD_TOPIC, 1);
+#endif
+        // 断线期间(含Wi-Fi断开)可能有短信没能送出,立即补读一次模组缓存(DTU固件)
+        modem_backend_request_sms_poll();
         break;
     case MQTT_EVENT_DISCONNECTED:
         ESP_LOGW(TAG, "MQTT_EVENT_DISCONNECTED - Connection lost, auto-reconnect enabled");
@@ -85,7 +89,12 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
     case MQTT_EVENT_DATA:
         ESP_LOGI(TAG, "MQTT_EVENT_DATA (topic_len=%d, data_len=%d)",
                  event->topic_len, event->data_len);
-        // Handle incoming MQTT commands if subscribed
+#if CONFIG_APP_UART_CAPTURE_ENABLE
+        if (event->topic_len == (int)strlen(UART_CAPTURE_CMD_TOPIC) &&
+            strncmp(event->topic, UART_CAPTURE_CMD_TOPIC, event->topic_len) == 0) {
+            uart_capture_handle_command(event->data, event->data_len);
+        }
+#endif
         break;
     case MQTT_EVENT_ERROR:
         ESP_LOGI(TAG, "MQTT_EVENT_ERROR");
@@ -172,22 +181,23 @@ esp_err_t mqtt_manager_publish_sms(const sms_message_t *sms) {
     strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", &timeinfo);
 
     // 计算新的JSON payload所需的缓冲区大小
-    // 格式示例: {"sender":"%s","content":"%s","operator":"%s","timestamp":"%s"}
+    // 格式示例: {"sender":"%s","content":"%s","operator":"%s","timestamp":"%s","modem":N}
     // 最大长度估算: sender (32), content (2048), local_number (32), operator (32), timestamp (32)
     // 加上固定的JSON字符 (引号, 逗号, 冒号, 大括号) 和 null 终止符
     // 大致: 32 + 2048 + 32 + 32 + 32 + (固定JSON开销 ~ 100) = ~2276 字节
     // 使用一个足够大的缓冲区，例如 2560 字节 (2.5KB)
     char payload[2560];
 
-    // 检查运营商和本机号码是否可用，如果为空则使用"UNKNOWN"
-    const char *operator_str = (strlen(g_sim_operator) > 0) ? g_sim_operator : "UNKNOWN";
-    const char *local_number = (strlen(SIM_PHONE_NUMBER) > 0) ? SIM_PHONE_NUMBER : "UNKNOWN";
+    // 运营商和本机号码取自接收该短信的模组，如果为空则使用"UNKNOWN"
+    const modem_instance_t *modem = modem_backend_instance(sms->modem);
+    const char *operator_str = (modem != NULL && strlen(modem->operator_name) > 0) ? modem->operator_name : "UNKNOWN";
+    const char *local_number = (modem != NULL && strlen(modem->phone_number) > 0) ? modem->phone_number : "UNKNOWN";
 
     // 构建包含运营商、本机号码、时间戳的JSON payload
-    // 示例 JSON 格式: {"sender": "+8613800000000", "content": "Hello World", "local_number": "+8613900000000", "operator": "中国移动", "timestamp": "2025-11-12T10:30:00Z"}
+    // 示例 JSON 格式: {"sender": "+8613800000000", "content": "Hello World", "local_number": "+8613900000000", "operator": "中国移动", "timestamp": "2025-11-12T10:30:00Z", "modem": 0}
     snprintf(payload, sizeof(payload),
-             "{\"sender\":\"%s\",\"content\":\"%s\",\"local_number\":\"%s\",\"operator\":\"%s\",\"timestamp\":\"%s\"}",
-             sms->sender, sms->content, local_number, operator_str, timestamp);
+             "{\"sender\":\"%s\",\"content\":\"%s\",\"local_number\":\"%s\",\"operator\":\"%s\",\"timestamp\":\"%s\",\"modem\":%u}",
+             sms->sender, sms->content, local_number, operator_str, timestamp, (unsigned)sms->modem);
 
     int msg_id = esp_mqtt_client_publish(s_mqtt_client, MQTT_TOPIC_SMS, payload, 0, 1, 0);
     if (msg_id == -1) {
@@ -221,7 +231,7 @@ esp_err_t mqtt_manager_publish(const char *topic, const char *payload, int len,
     return ESP_OK;
 }
 
-esp_err_t mqtt_manager_publish_device_ready(const char *operator_name) {
+esp_err_t mqtt_manager_publish_device_ready(const modem_instance_t *modem) {
     if (!s_mqtt_client) {
         ESP_LOGE(TAG, "MQTT client not initialized.");
         return ESP_FAIL;
@@ -256,15 +266,15 @@ esp_err_t mqtt_manager_publish_device_ready(const char *operator_name) {
     strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", &timeinfo);
 
     // Determine operator string
-    const char *operator_str = (operator_name && strlen(operator_name) > 0) ? operator_name : "未知运营商";
-    const char *local_number = (strlen(SIM_PHONE_NUMBER) > 0) ? SIM_PHONE_NUMBER : "未知号码";
+    const char *operator_str = strlen(modem->operator_name) > 0 ? modem->operator_name : "未知运营商";
+    const char *local_number = strlen(modem->phone_number) > 0 ? modem->phone_number : "未知号码";
 
     // Build JSON payload
-    // Format: {"status":"ready","operator":"中国电信","local_number":"+8613800138000","timestamp":"2025-11-13T10:30:00Z"}
+    // Format: {"status":"ready","operator":"中国电信","local_number":"+8613800138000","timestamp":"2025-11-13T10:30:00Z","modem":0}
     char payload[256];
     snprintf(payload, sizeof(payload),
-             "{\"status\":\"ready\",\"operator\":\"%s\",\"local_number\":\"%s\",\"timestamp\":\"%s\"}",
-             operator_str, local_number, timestamp);
+             "{\"status\":\"ready\",\"operator\":\"%s\",\"local_number\":\"%s\",\"timestamp\":\"%s\",\"modem\":%u}",
+             operator_str, local_number, timestamp, (unsigned)modem->index);
 
     // Publish to 'esp32/device' topic
     const char *device_ready_topic = "esp32/device";
@@ -2,7 +2,7 @@
 #define MQTT_MANAGER_H
 
 #include "esp_err.h"
-#include "uart_at_manager.h" // For sms_message_t
+#include "uart_at_manager.h" // For sms_message_t and modem_instance_t
 
 /**
  * @brief Initializes and starts the MQTT client.
@@ -39,9 +39,10 @@ esp_err_t mqtt_manager_publish(const char *topic, const char *payload, int len,
 /**
  * @brief Publishes a device ready message to the 'esp32/drive' topic.
  *
- * @param operator_name The SIM operator name (e.g., "中国移动", "中国电信").
+ * @param modem The modem that became ready; its index, SIM operator (e.g.
+ *        "中国移动", "中国电信") and local number are included.
  * @return ESP_OK if message was successfully queued for publishing, ESP_FAIL otherwise.
  */
-esp_err_t mqtt_manager_publish_device_ready(const char *operator_name);
+esp_err_t mqtt_manager_publish_device_ready(const modem_instance_t *modem);
 
 #endif // MQTT_MANAGER_H
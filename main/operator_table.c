@@ -0,0 +1,48 @@
+#include <stddef.h>
+
+#include "operator_table.h"
+
+#define OPERATOR_INFO_SPAN_BITS 3
+
+static const uint32_t s_pow10[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000};
+
+static const char *table_lookup(const operator_prefix_table_t *table, const char *digits) {
+    uint32_t key = 0;
+
+    for (uint8_t i = 0; i < table->key_digits; i++) {
+        if (digits[i] < '0' || digits[i] > '9') {
+            return NULL; // 号码太短或含非数字
+        }
+        key = key * 10 + (uint32_t)(digits[i] - '0');
+    }
+
+    // 最后一个起点<=key的区间
+    size_t lo = 0;
+    size_t hi = table->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (table->first[mid] <= key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == 0) {
+        return NULL;
+    }
+
+    uint16_t info = table->info[lo - 1];
+    uint32_t span = s_pow10[info & ((1u << OPERATOR_INFO_SPAN_BITS) - 1)];
+    if (key - table->first[lo - 1] >= span) {
+        return NULL;
+    }
+    return &g_operator_names[g_operator_name_offsets[info >> OPERATOR_INFO_SPAN_BITS]];
+}
+
+const char *operator_table_lookup_imsi(const char *imsi) {
+    return table_lookup(&g_operator_imsi_table, imsi);
+}
+
+const char *operator_table_lookup_iccid(const char *iccid) {
+    return table_lookup(&g_operator_iccid_table, iccid);
+}
@@ -0,0 +1,41 @@
+#ifndef OPERATOR_TABLE_H
+#define OPERATOR_TABLE_H
+
+#include <stdint.h>
+
+/**
+ * @brief Prefix -> operator table generated from operators.csv at build time
+ *        (tools/gen_operator_table.py), kept entirely in flash.
+ *
+ * Each prefix is stored as the range of key_digits-digit numbers it covers:
+ * "46000" with key_digits 6 covers 460000..460009. The ranges are sorted and
+ * do not overlap, so a lookup is one binary search over first[].
+ */
+typedef struct {
+    const uint32_t *first;        // 区间起点,升序
+    const uint16_t *info;         // 高13位: 名称序号; 低3位: 区间长度为10的几次方
+    uint16_t count;
+    uint8_t key_digits;           // 查找时从号码开头取的位数
+} operator_prefix_table_t;
+
+extern const operator_prefix_table_t g_operator_imsi_table;
+extern const operator_prefix_table_t g_operator_iccid_table;
+extern const char g_operator_names[];           // 以'\0'分隔的名称
+extern const uint16_t g_operator_name_offsets[]; // 名称序号 -> g_operator_names中的偏移
+
+/**
+ * @brief Operator name for an IMSI (MCC + 2- or 3-digit MNC).
+ *
+ * @return Name from operators.csv, or NULL if the prefix is not listed or
+ *         the IMSI is too short.
+ */
+const char *operator_table_lookup_imsi(const char *imsi);
+
+/**
+ * @brief Operator name for an ICCID (issuer identifier "89<country><issuer>").
+ *
+ * @return Name from operators.csv, or NULL if the prefix is not listed.
+ */
+const char *operator_table_lookup_iccid(const char *iccid);
+
+#endif // OPERATOR_TABLE_H
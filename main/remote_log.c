@@ -16,6 +16,10 @@
 #include "remote_log.h"
 #include "mqtt_manager.h"
 #include "log_redaction.h"
+#include "modem_backend.h"
+#include "uart_capture.h"
+#include "sms_dedup.h"
+#include "sms_pool.h"
 
 #if CONFIG_APP_REMOTE_LOG_ENABLE
 
@@ -27,12 +31,17 @@ static const char *TAG = "remote_log";
 #define RL_BATCH_MAX_BYTES 3800  // 批量缓冲刷新阈值
 #define RL_FLUSH_MS        2000  // 距首行的最长等待时间
 #define RL_BATCH_BUF_SIZE  4096  // 批量 JSON 缓冲大小
+#define RL_METRICS_BASE_SIZE 2560 // 指标中除 "modems" 数组外的部分（最长约 2400 字节）
+#define RL_METRICS_TAIL_SIZE 40   // 预留给 "metrics_truncated" 和结尾 "}"
+#define RL_METRICS_BUF_SIZE  (RL_METRICS_BASE_SIZE + MODEM_MAX_INSTANCES * MODEM_METRICS_ENTRY_MAX + \
+                              RL_METRICS_TAIL_SIZE)
 
 static RingbufHandle_t s_log_rb = NULL;
 static vprintf_like_t s_orig_vprintf = NULL;
 static TaskHandle_t s_fwd_task = NULL;
 static _Atomic uint32_t s_dropped = 0;   // 钩子入队失败的累计丢弃行数
 static uint32_t s_seq = 0;               // 批次序号，仅转发任务访问
+static uint32_t s_metrics_truncated = 0; // 指标缓冲放不下而省略后续字段的次数，仅转发任务访问
 static char s_device_id[32];
 static char s_phone[24];
 static QueueHandle_t s_sms_queue = NULL;
@@ -285,6 +294,17 @@ static void rl_batch_flush(char *batch, size_t *len, int *lines)
     *lines = 0;
 }
 
+// 追加一段长度为 n 的指标字段；放不下时撤回这段，返回 false
+static bool rl_metrics_keep(char *payload, int *len, int n, size_t limit)
+{
+    if (n < 0 || (size_t)(*len + n) >= limit) {
+        payload[*len] = '\0';
+        return false;
+    }
+    *len += n;
+    return true;
+}
+
 static void rl_publish_metrics(void)
 {
     wifi_ap_record_t ap = {0};
@@ -293,11 +313,12 @@ static void rl_publish_metrics(void)
         rssi = ap.rssi;
     }
 
-    char payload[320];
-    int len = snprintf(payload, sizeof(payload),
+    static char payload[RL_METRICS_BUF_SIZE]; // 只在log_fwd任务中使用,放静态区以免占用任务栈
+    const size_t limit = sizeof(payload) - RL_METRICS_TAIL_SIZE;
+    int len = snprintf(payload, limit,
                        "{\"device\":\"%s\",\"phone\":\"%s\",\"uptime_s\":%lld,"
                        "\"free_heap\":%lu,\"min_free_heap\":%lu,\"rssi_dbm\":%d,"
-                       "\"sms_queue_depth\":%u,\"log_dropped_total\":%lu,\"log_seq\":%lu}",
+                       "\"sms_queue_depth\":%u,\"log_dropped_total\":%lu,\"log_seq\":%lu",
                        s_device_id, s_phone,
                        (long long)(esp_timer_get_time() / 1000000),
                        (unsigned long)esp_get_free_heap_size(),
@@ -306,7 +327,70 @@ static void rl_publish_metrics(void)
                        s_sms_queue ? (unsigned)uxQueueMessagesWaiting(s_sms_queue) : 0,
                        (unsigned long)atomic_load(&s_dropped),
                        (unsigned long)s_seq);
-    if (len > 0 && len < (int)sizeof(payload)) {
+    if (len <= 0 || (size_t)len >= limit) {
+        return;
+    }
+    bool complete = false;
+
+    // 固件类型、探测结果、当前后端的统计和各模组的吞吐
+    int n = modem_backend_format_metrics(&payload[len], limit - len);
+    if (!rl_metrics_keep(payload, &len, n, limit)) {
+        goto truncated;
+    }
+
+    sms_dedup_stats_t dedup;
+    sms_dedup_get_stats(&dedup);
+    n = snprintf(&payload[len], limit - len,
+                 ",\"sms_dedup_entries\":%lu,\"sms_dedup_hits\":%lu,\"sms_dedup_misses\":%lu,"
+                 "\"sms_dedup_evictions\":%lu,\"sms_dedup_expirations\":%lu,"
+                 "\"sms_dedup_restored\":%lu,\"sms_dedup_snapshots\":%lu,"
+                 "\"sms_dedup_snapshot_failures\":%lu",
+                 (unsigned long)dedup.entries, (unsigned long)dedup.hits,
+                 (unsigned long)dedup.misses, (unsigned long)dedup.evictions,
+                 (unsigned long)dedup.expirations, (unsigned long)dedup.restored,
+                 (unsigned long)dedup.snapshots, (unsigned long)dedup.snapshot_failures);
+    if (!rl_metrics_keep(payload, &len, n, limit)) {
+        goto truncated;
+    }
+
+    // 短信缓冲池: 占用接近容量或exhausted增长说明生产者在等待sms_processor归还缓冲
+    sms_pool_stats_t pool;
+    sms_pool_get_stats(&pool);
+    n = snprintf(&payload[len], limit - len,
+                 ",\"sms_pool_size\":%lu,\"sms_pool_in_use\":%lu,\"sms_pool_peak\":%lu,"
+                 "\"sms_pool_exhausted\":%lu,\"sms_pool_alloc_failed\":%lu,\"sms_pool_try_missed\":%lu",
+                 (unsigned long)pool.size, (unsigned long)pool.in_use, (unsigned long)pool.peak,
+                 (unsigned long)pool.exhausted, (unsigned long)pool.failed, (unsigned long)pool.try_missed);
+    if (!rl_metrics_keep(payload, &len, n, limit)) {
+        goto truncated;
+    }
+
+#if CONFIG_APP_UART_CAPTURE_ENABLE
+    uart_capture_stats_t capture;
+    uart_capture_get_stats(&capture);
+    n = snprintf(&payload[len], limit - len,
+                 ",\"uart_capture_used\":%lu,\"uart_capture_lost\":%lu,\"uart_capture_dumps\":%lu",
+                 (unsigned long)capture.used, (unsigned long)capture.lost_records,
+                 (unsigned long)capture.dumps);
+    if (!rl_metrics_keep(payload, &len, n, limit)) {
+        goto truncated;
+    }
+#endif
+    complete = true;
+
+truncated:
+    // 省略放不下的字段，其余照常发布
+    if (!complete) {
+        s_metrics_truncated++;
+        ESP_LOGW(TAG, "Metrics payload exceeds %u bytes, later fields omitted (%lu times)",
+                 (unsigned)limit, (unsigned long)s_metrics_truncated);
+    }
+    if (s_metrics_truncated > 0) {
+        len += snprintf(&payload[len], sizeof(payload) - len, ",\"metrics_truncated\":%lu",
+                        (unsigned long)s_metrics_truncated);
+    }
+    len += snprintf(&payload[len], sizeof(payload) - len, "}");
+    if (len < (int)sizeof(payload)) {
         mqtt_manager_publish(CONFIG_APP_MQTT_TOPIC_METRICS, payload, len, 0);
     }
 }
@@ -0,0 +1,364 @@
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "sdkconfig.h"
+
+#include "sms_dedup.h"
+
+static const char *TAG = "sms_dedup";
+
+/*
+ * 去重表: 开放寻址(线性探测)的哈希表,键是(号码+内容)的32位FNV-1a指纹,值是过期时刻。
+ * 槽数取不小于条目上限1.5倍的2的幂,装载率不超过2/3,查找和插入期望O(1)。
+ * 过期条目惰性清理: 探测途中遇到即用后移删除(backward-shift)移除,不需要墓碑;
+ * 只有表满时才整表扫描一次,清掉过期条目,仍然满则淘汰最早过期的条目。
+ * 不同短信指纹相同的概率约为 条目数/2^32,可以忽略。
+ */
+#define DEDUP_ENTRIES   CONFIG_APP_SMS_DEDUP_ENTRIES
+#define DEDUP_SLOTS_MIN (DEDUP_ENTRIES * 3 / 2)
+#define DEDUP_SLOTS     (DEDUP_SLOTS_MIN <= 32 ? 32 : DEDUP_SLOTS_MIN <= 64 ? 64 :     \
+                         DEDUP_SLOTS_MIN <= 128 ? 128 : DEDUP_SLOTS_MIN <= 256 ? 256 : \
+                         DEDUP_SLOTS_MIN <= 512 ? 512 : DEDUP_SLOTS_MIN <= 1024 ? 1024 : 2048)
+#define DEDUP_MASK      (DEDUP_SLOTS - 1)
+#define DEDUP_WINDOW_S  CONFIG_APP_SMS_DEDUP_WINDOW_S
+
+#define DEDUP_NVS_NAMESPACE    "sms_dedup"
+#define DEDUP_NVS_KEY_SNAPSHOT "snap"
+#define DEDUP_SNAPSHOT_VERSION 1
+#define DEDUP_MIN_VALID_TIME   1577836800 // 2020-01-01,早于此说明系统时间未同步
+
+typedef struct {
+    uint32_t fp;        // 0表示空槽
+    uint32_t expires_s; // 开机以来的秒数
+} dedup_slot_t;
+
+// NVS快照: 头部后接count个条目,只保存未过期的条目及其剩余秒数,与槽数无关
+typedef struct {
+    uint16_t version;
+    uint16_t count;
+    uint32_t wall_time; // 写入时的time(),未同步时为0
+} dedup_snapshot_header_t;
+
+typedef struct {
+    uint32_t fp;
+    uint32_t remaining_s;
+} dedup_snapshot_entry_t;
+
+static dedup_slot_t s_slots[DEDUP_SLOTS];
+static uint32_t s_used = 0; // 非空槽数,不超过DEDUP_ENTRIES
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static _Atomic bool s_dirty = false;
+static _Atomic bool s_snapshot_busy = false;
+static bool s_snapshot_written = false;
+static TickType_t s_snapshot_tick = 0;
+
+static _Atomic uint32_t s_entries = 0;
+static _Atomic uint32_t s_hits = 0;
+static _Atomic uint32_t s_misses = 0;
+static _Atomic uint32_t s_evictions = 0;
+static _Atomic uint32_t s_expirations = 0;
+static _Atomic uint32_t s_restored = 0;
+static _Atomic uint32_t s_snapshots = 0;
+static _Atomic uint32_t s_snapshot_failures = 0;
+
+// FNV-1a hash of sender + content. 不同SIM卡收到的同一条短信各投递一次;
+// 模组0不混入序号,单模组时保存的快照升级后仍然有效
+static uint32_t sms_fingerprint(const sms_message_t *sms) {
+    uint32_t h = 2166136261u;
+    for (const char *p = sms->sender; *p; p++) { h ^= (uint8_t)*p; h *= 16777619u; }
+    h ^= (uint8_t)','; h *= 16777619u;
+    for (const char *p = sms->content; *p; p++) { h ^= (uint8_t)*p; h *= 16777619u; }
+    if (sms->modem != 0) {
+        h ^= sms->modem; h *= 16777619u;
+    }
+    return h != 0 ? h : 1;
+}
+
+static uint32_t dedup_now_s(void) {
+    return (uint32_t)(esp_timer_get_time() / 1000000);
+}
+
+static bool slot_expired(const dedup_slot_t *slot, uint32_t now) {
+    return (int32_t)(slot->expires_s - now) <= 0;
+}
+
+// 删除槽i: 其后同一探测链上的条目逐个前移填补空位,保证查找无需墓碑
+static void slot_remove(uint32_t i) {
+    uint32_t j = i;
+    for (;;) {
+        j = (j + 1) & DEDUP_MASK;
+        if (s_slots[j].fp == 0) {
+            break;
+        }
+        // j处的条目只有在其起始槽不位于(i, j]之间时才能移到i
+        uint32_t home = s_slots[j].fp & DEDUP_MASK;
+        if (((j - home) & DEDUP_MASK) < ((j - i) & DEDUP_MASK)) {
+            continue;
+        }
+        s_slots[i] = s_slots[j];
+        i = j;
+    }
+    s_slots[i].fp = 0;
+    s_used--;
+}
+
+// 查找fp,途中清理过期条目。找到返回槽号,否则返回-1并由*empty给出探测链末尾的空槽
+static int32_t slot_find(uint32_t fp, uint32_t now, uint32_t *empty) {
+    uint32_t i = fp & DEDUP_MASK;
+    while (s_slots[i].fp != 0) {
+        if (slot_expired(&s_slots[i], now)) {
+            atomic_fetch_add_explicit(&s_expirations, 1, memory_order_relaxed);
+            slot_remove(i); // 后面的条目可能移入i,重新检查同一槽
+            continue;
+        }
+        if (s_slots[i].fp == fp) {
+            return (int32_t)i;
+        }
+        i = (i + 1) & DEDUP_MASK;
+    }
+    *empty = i;
+    return -1;
+}
+
+// 表满时调用: 整表清理过期条目,仍然满则淘汰最早过期的条目。只在表满时发生,均摊O(1)
+static void dedup_make_room(uint32_t now) {
+    uint32_t oldest_fp = 0;
+    uint32_t oldest_expires = 0;
+    for (uint32_t i = 0; i < DEDUP_SLOTS; i++) {
+        while (s_slots[i].fp != 0 && slot_expired(&s_slots[i], now)) {
+            atomic_fetch_add_explicit(&s_expirations, 1, memory_order_relaxed);
+            slot_remove(i);
+        }
+        if (s_slots[i].fp != 0 &&
+            (oldest_fp == 0 || (int32_t)(s_slots[i].expires_s - oldest_expires) < 0)) {
+            oldest_fp = s_slots[i].fp;
+            oldest_expires = s_slots[i].expires_s;
+        }
+    }
+    if (s_used < DEDUP_ENTRIES) {
+        return;
+    }
+    // 前移可能改变了条目位置,按指纹重新定位
+    uint32_t empty;
+    int32_t slot = slot_find(oldest_fp, now, &empty);
+    if (slot >= 0) {
+        slot_remove((uint32_t)slot);
+        atomic_fetch_add_explicit(&s_evictions, 1, memory_order_relaxed);
+    }
+}
+
+// 插入或刷新条目,调用方持有s_lock
+static void dedup_insert(uint32_t fp, uint32_t expires_s, uint32_t now) {
+    uint32_t empty;
+    int32_t slot = slot_find(fp, now, &empty);
+    if (slot >= 0) {
+        s_slots[slot].expires_s = expires_s;
+        return;
+    }
+    if (s_used >= DEDUP_ENTRIES) {
+        dedup_make_room(now);
+        slot_find(fp, now, &empty); // 表已变化,重新找空槽
+    }
+    s_slots[empty].fp = fp;
+    s_slots[empty].expires_s = expires_s;
+    s_used++;
+}
+
+esp_err_t sms_dedup_init(void) {
+    portENTER_CRITICAL(&s_lock);
+    memset(s_slots, 0, sizeof(s_slots));
+    s_used = 0;
+    portEXIT_CRITICAL(&s_lock);
+    atomic_store(&s_dirty, false);
+    s_snapshot_written = false;
+
+#if CONFIG_APP_SMS_DEDUP_SNAPSHOT_S > 0
+    nvs_handle_t nvs_handle;
+    if (nvs_open(DEDUP_NVS_NAMESPACE, NVS_READONLY, &nvs_handle) != ESP_OK) {
+        return ESP_OK; // 首次启动,没有快照
+    }
+    size_t size = 0;
+    esp_err_t err = nvs_get_blob(nvs_handle, DEDUP_NVS_KEY_SNAPSHOT, NULL, &size);
+    uint8_t *blob = err == ESP_OK && size >= sizeof(dedup_snapshot_header_t) ? malloc(size) : NULL;
+    if (blob == NULL || nvs_get_blob(nvs_handle, DEDUP_NVS_KEY_SNAPSHOT, blob, &size) != ESP_OK) {
+        nvs_close(nvs_handle);
+        free(blob);
+        return ESP_OK;
+    }
+    nvs_close(nvs_handle);
+
+    dedup_snapshot_header_t header;
+    memcpy(&header, blob, sizeof(header));
+    if (header.version != DEDUP_SNAPSHOT_VERSION ||
+        size != sizeof(header) + header.count * sizeof(dedup_snapshot_entry_t)) {
+        ESP_LOGW(TAG, "Ignoring dedup snapshot (version %u, %u bytes)",
+                 (unsigned)header.version, (unsigned)size);
+        free(blob);
+        return ESP_OK;
+    }
+
+    // 停机时长只有在写快照时和现在系统时间都有效时才可知(如软件复位后),否则按0计
+    time_t now_wall = time(NULL);
+    uint32_t downtime_s = 0;
+    if (header.wall_time >= DEDUP_MIN_VALID_TIME && now_wall >= DEDUP_MIN_VALID_TIME &&
+        (uint32_t)now_wall >= header.wall_time) {
+        downtime_s = (uint32_t)now_wall - header.wall_time;
+    }
+
+    uint32_t restored = 0;
+    const dedup_snapshot_entry_t *entries = (const dedup_snapshot_entry_t *)(blob + sizeof(header));
+    portENTER_CRITICAL(&s_lock);
+    uint32_t now = dedup_now_s();
+    for (uint16_t i = 0; i < header.count; i++) {
+        dedup_snapshot_entry_t e;
+        memcpy(&e, &entries[i], sizeof(e));
+        if (e.fp == 0 || e.remaining_s <= downtime_s) {
+            continue;
+        }
+        uint32_t remaining = e.remaining_s - downtime_s;
+        if (remaining > DEDUP_WINDOW_S) {
+            remaining = DEDUP_WINDOW_S;
+        }
+        dedup_insert(e.fp, now + remaining, now);
+        restored++;
+    }
+    atomic_store(&s_entries, s_used);
+    portEXIT_CRITICAL(&s_lock);
+    free(blob);
+
+    atomic_store(&s_restored, restored);
+    ESP_LOGI(TAG, "Restored %lu dedup entries (downtime %lu s)",
+             (unsigned long)restored, (unsigned long)downtime_s);
+#endif
+    return ESP_OK;
+}
+
+bool sms_dedup_seen(const sms_message_t *sms, uint32_t *fingerprint) {
+    uint32_t fp = sms_fingerprint(sms);
+    uint32_t empty;
+
+    *fingerprint = fp;
+
+    portENTER_CRITICAL(&s_lock);
+    uint32_t now = dedup_now_s();
+    int32_t slot = slot_find(fp, now, &empty);
+    if (slot >= 0) {
+        s_slots[slot].expires_s = now + DEDUP_WINDOW_S;
+    }
+    atomic_store(&s_entries, s_used);
+    portEXIT_CRITICAL(&s_lock);
+
+    if (slot >= 0) {
+        atomic_fetch_add_explicit(&s_hits, 1, memory_order_relaxed);
+        atomic_store(&s_dirty, true);
+        return true;
+    }
+    atomic_fetch_add_explicit(&s_misses, 1, memory_order_relaxed);
+    return false;
+}
+
+void sms_dedup_record(uint32_t fp) {
+    portENTER_CRITICAL(&s_lock);
+    uint32_t now = dedup_now_s();
+    dedup_insert(fp, now + DEDUP_WINDOW_S, now);
+    atomic_store(&s_entries, s_used);
+    portEXIT_CRITICAL(&s_lock);
+    atomic_store(&s_dirty, true);
+}
+
+TickType_t sms_dedup_snapshot_wait(TickType_t max_wait) {
+#if CONFIG_APP_SMS_DEDUP_SNAPSHOT_S > 0
+    if (!atomic_load(&s_dirty) || !s_snapshot_written) {
+        return atomic_load(&s_dirty) ? 0 : max_wait;
+    }
+    TickType_t interval = pdMS_TO_TICKS(CONFIG_APP_SMS_DEDUP_SNAPSHOT_S * 1000);
+    TickType_t elapsed = xTaskGetTickCount() - s_snapshot_tick;
+    TickType_t remaining = elapsed < interval ? interval - elapsed : 0;
+    return remaining < max_wait ? remaining : max_wait;
+#else
+    return max_wait;
+#endif
+}
+
+void sms_dedup_snapshot_if_due(void) {
+#if CONFIG_APP_SMS_DEDUP_SNAPSHOT_S > 0
+    if (!atomic_load(&s_dirty) || sms_dedup_snapshot_wait(1) > 0) {
+        return;
+    }
+    if (atomic_exchange(&s_snapshot_busy, true)) {
+        return; // 另一个任务正在写
+    }
+
+    size_t max_size = sizeof(dedup_snapshot_header_t) + DEDUP_ENTRIES * sizeof(dedup_snapshot_entry_t);
+    uint8_t *blob = malloc(max_size);
+    if (blob == NULL) {
+        atomic_fetch_add_explicit(&s_snapshot_failures, 1, memory_order_relaxed);
+        s_snapshot_written = true; // 按间隔重试
+        s_snapshot_tick = xTaskGetTickCount();
+        atomic_store(&s_snapshot_busy, false);
+        return;
+    }
+
+    time_t now_wall = time(NULL);
+    dedup_snapshot_header_t header = {
+        .version = DEDUP_SNAPSHOT_VERSION,
+        .wall_time = now_wall >= DEDUP_MIN_VALID_TIME ? (uint32_t)now_wall : 0,
+    };
+    dedup_snapshot_entry_t *entries = (dedup_snapshot_entry_t *)(blob + sizeof(header));
+    portENTER_CRITICAL(&s_lock);
+    uint32_t now = dedup_now_s();
+    for (uint32_t i = 0; i < DEDUP_SLOTS && header.count < DEDUP_ENTRIES; i++) {
+        if (s_slots[i].fp != 0 && !slot_expired(&s_slots[i], now)) {
+            dedup_snapshot_entry_t e = {s_slots[i].fp, s_slots[i].expires_s - now};
+            memcpy(&entries[header.count++], &e, sizeof(e));
+        }
+    }
+    atomic_store(&s_dirty, false);
+    portEXIT_CRITICAL(&s_lock);
+    memcpy(blob, &header, sizeof(header));
+
+    size_t size = sizeof(header) + header.count * sizeof(dedup_snapshot_entry_t);
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(DEDUP_NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(nvs_handle, DEDUP_NVS_KEY_SNAPSHOT, blob, size);
+        if (err == ESP_OK) {
+            err = nvs_commit(nvs_handle);
+        }
+        nvs_close(nvs_handle);
+    }
+    free(blob);
+
+    if (err == ESP_OK) {
+        atomic_fetch_add_explicit(&s_snapshots, 1, memory_order_relaxed);
+        ESP_LOGD(TAG, "Saved %u dedup entries", (unsigned)header.count);
+    } else {
+        atomic_store(&s_dirty, true);
+        atomic_fetch_add_explicit(&s_snapshot_failures, 1, memory_order_relaxed);
+        ESP_LOGW(TAG, "Failed to save dedup snapshot: %s", esp_err_to_name(err));
+    }
+    s_snapshot_written = true;
+    s_snapshot_tick = xTaskGetTickCount();
+    atomic_store(&s_snapshot_busy, false);
+#endif
+}
+
+void sms_dedup_get_stats(sms_dedup_stats_t *stats) {
+    stats->entries = atomic_load(&s_entries);
+    stats->capacity = DEDUP_ENTRIES;
+    stats->hits = atomic_load(&s_hits);
+    stats->misses = atomic_load(&s_misses);
+    stats->evictions = atomic_load(&s_evictions);
+    stats->expirations = atomic_load(&s_expirations);
+    stats->restored = atomic_load(&s_restored);
+    stats->snapshots = atomic_load(&s_snapshots);
+    stats->snapshot_failures = atomic_load(&s_snapshot_failures);
+}
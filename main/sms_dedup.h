@@ -0,0 +1,73 @@
+#ifndef SMS_DEDUP_H
+#define SMS_DEDUP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+#include "uart_at_manager.h" // sms_message_t
+
+// 去重统计,只用于观测
+typedef struct {
+    uint32_t entries;        // 表中的条目数(含尚未被清理的过期条目)
+    uint32_t capacity;       // CONFIG_APP_SMS_DEDUP_ENTRIES
+    uint32_t hits;           // 判定为重复而未投递的短信数
+    uint32_t misses;         // 查询后判定为新短信的次数
+    uint32_t evictions;      // 表满时淘汰的未过期条目数
+    uint32_t expirations;    // 超出窗口被清理的条目数
+    uint32_t restored;       // 开机时从NVS快照恢复的条目数
+    uint32_t snapshots;      // 写入NVS快照的次数
+    uint32_t snapshot_failures;
+} sms_dedup_stats_t;
+
+/**
+ * @brief Loads the duplicate-suppression table from its NVS snapshot.
+ *
+ * Call once after nvs_flash_init() and before a modem backend starts. The
+ * time the device was off only counts towards the window if the system
+ * clock was valid both when the snapshot was written and now (e.g. after a
+ * software reset); otherwise it counts as zero.
+ */
+esp_err_t sms_dedup_init(void);
+
+/**
+ * @brief Checks whether the same sender and content was delivered within the
+ *        last CONFIG_APP_SMS_DEDUP_WINDOW_S seconds.
+ *
+ * A hit restarts the window, so a message the modem keeps returning stays
+ * suppressed. Safe to call from any task.
+ *
+ * @param fingerprint Receives the message's fingerprint for sms_dedup_record.
+ */
+bool sms_dedup_seen(const sms_message_t *sms, uint32_t *fingerprint);
+
+/**
+ * @brief Remembers a message that was handed to the SMS queue. Do not record
+ *        messages that were dropped, so a later resend gets through.
+ *
+ * Takes the fingerprint from sms_dedup_seen rather than the message: once
+ * queued, the buffer belongs to the consumer and may already be reused.
+ */
+void sms_dedup_record(uint32_t fingerprint);
+
+/**
+ * @brief Ticks until a pending NVS snapshot is due, at most max_wait. Lets
+ *        the calling task bound its blocking wait instead of polling.
+ */
+TickType_t sms_dedup_snapshot_wait(TickType_t max_wait);
+
+/**
+ * @brief Writes the NVS snapshot if it is due: there are unsaved changes and
+ *        the previous write is at least CONFIG_APP_SMS_DEDUP_SNAPSHOT_S old.
+ *        Blocks for the flash write; call from the backend task.
+ */
+void sms_dedup_snapshot_if_due(void);
+
+/**
+ * @brief Reads the dedup counters. Safe to call from any task.
+ */
+void sms_dedup_get_stats(sms_dedup_stats_t *stats);
+
+#endif // SMS_DEDUP_H
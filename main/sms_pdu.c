@@ -0,0 +1,277 @@
+#include <string.h>
+
+#include "sms_pdu.h"
+#include "text_codec.h"
+
+// TP-MTI (bit1..0 of the first TPDU octet): 00 = SMS-DELIVER
+#define PDU_MTI_MASK            0x03
+#define PDU_MTI_DELIVER         0x00
+// TP-UDHI: user data begins with a user data header
+#define PDU_UDHI                0x40
+#define PDU_SCTS_LEN            7
+#define PDU_MAX_UD_OCTETS       140
+
+// Address type of number (bit6..4 of TOA)
+#define PDU_TON_INTERNATIONAL   1
+#define PDU_TON_ALPHANUMERIC    5
+
+// Concatenated short message information elements
+#define PDU_IEI_CONCAT_8BIT     0x00
+#define PDU_IEI_CONCAT_16BIT    0x08
+
+#define GSM7_ESCAPE             0x1B
+
+// GSM 7-bit default alphabet (3GPP TS 23.038 6.2.1) -> Unicode
+static const uint16_t s_gsm7_basic[128] = {
+    0x0040, 0x00A3, 0x0024, 0x00A5, 0x00E8, 0x00E9, 0x00F9, 0x00EC,
+    0x00F2, 0x00C7, 0x000A, 0x00D8, 0x00F8, 0x000D, 0x00C5, 0x00E5,
+    0x0394, 0x005F, 0x03A6, 0x0393, 0x039B, 0x03A9, 0x03A0, 0x03A8,
+    0x03A3, 0x0398, 0x039E, 0x00A0, 0x00C6, 0x00E6, 0x00DF, 0x00C9,
+    0x0020, 0x0021, 0x0022, 0x0023, 0x00A4, 0x0025, 0x0026, 0x0027,
+    0x0028, 0x0029, 0x002A, 0x002B, 0x002C, 0x002D, 0x002E, 0x002F,
+    0x0030, 0x0031, 0x0032, 0x0033, 0x0034, 0x0035, 0x0036, 0x0037,
+    0x0038, 0x0039, 0x003A, 0x003B, 0x003C, 0x003D, 0x003E, 0x003F,
+    0x00A1, 0x0041, 0x0042, 0x0043, 0x0044, 0x0045, 0x0046, 0x0047,
+    0x0048, 0x0049, 0x004A, 0x004B, 0x004C, 0x004D, 0x004E, 0x004F,
+    0x0050, 0x0051, 0x0052, 0x0053, 0x0054, 0x0055, 0x0056, 0x0057,
+    0x0058, 0x0059, 0x005A, 0x00C4, 0x00D6, 0x00D1, 0x00DC, 0x00A7,
+    0x00BF, 0x0061, 0x0062, 0x0063, 0x0064, 0x0065, 0x0066, 0x0067,
+    0x0068, 0x0069, 0x006A, 0x006B, 0x006C, 0x006D, 0x006E, 0x006F,
+    0x0070, 0x0071, 0x0072, 0x0073, 0x0074, 0x0075, 0x0076, 0x0077,
+    0x0078, 0x0079, 0x007A, 0x00E4, 0x00F6, 0x00F1, 0x00FC, 0x00E0,
+};
+
+// GSM 7-bit default alphabet extension table (3GPP TS 23.038 6.2.1.1)
+static uint16_t gsm7_extension(uint8_t septet)
+{
+    switch (septet) {
+        case 0x0A: return 0x000C;
+        case 0x14: return 0x005E;
+        case 0x28: return 0x007B;
+        case 0x29: return 0x007D;
+        case 0x2F: return 0x005C;
+        case 0x3C: return 0x005B;
+        case 0x3D: return 0x007E;
+        case 0x3E: return 0x005D;
+        case 0x40: return 0x007C;
+        case 0x65: return 0x20AC;
+        default:
+            // 未定义的扩展字符按规范显示为基本字符表中的对应字符
+            return s_gsm7_basic[septet & 0x7F];
+    }
+}
+
+// 解开从第first个septet开始的count个septet(每个7bit,LSB在前连续打包)
+static void gsm7_unpack(const uint8_t *packed, size_t first, size_t count, uint8_t *out)
+{
+    for (size_t i = 0; i < count; i++) {
+        size_t bit = (first + i) * 7;
+        size_t byte = bit >> 3;
+        unsigned shift = bit & 7;
+        unsigned value = packed[byte] >> shift;
+        if (shift > 1) {
+            value |= (unsigned)packed[byte + 1] << (8 - shift);
+        }
+        out[i] = value & 0x7F;
+    }
+}
+
+size_t sms_pdu_ud_to_utf8(sms_pdu_encoding_t encoding, const uint8_t *ud, size_t ud_len,
+                          char *text, size_t text_size, size_t text_len, bool *truncated)
+{
+    if (encoding == SMS_PDU_ENCODING_UCS2) {
+        // 代理对(emoji等)只在同一分段内配对;奇数长度时忽略最后半个字符
+        text_utf16_state_t state = TEXT_UTF16_STATE_INIT;
+        text_codec_result_t result = text_ucs2_to_utf8(&state, ud, ud_len, text, text_size, &text_len);
+        if (result == TEXT_CODEC_OK) {
+            result = text_utf16_finish(&state, text, text_size, &text_len);
+        }
+        if (result == TEXT_CODEC_TRUNCATED && truncated) {
+            *truncated = true;
+        }
+        return text_len;
+    }
+
+    size_t i = 0;
+    while (i < ud_len) {
+        uint32_t cp;
+        if (encoding == SMS_PDU_ENCODING_8BIT) {
+            cp = ud[i++];
+        } else if (ud[i] == GSM7_ESCAPE && i + 1 < ud_len) {
+            cp = gsm7_extension(ud[i + 1]);
+            i += 2;
+        } else {
+            cp = s_gsm7_basic[ud[i++] & 0x7F];
+        }
+
+        if (!text_utf8_append(text, text_size, &text_len, cp)) {
+            if (truncated) {
+                *truncated = true;
+            }
+            break;
+        }
+    }
+    text[text_len] = '\0';
+    return text_len;
+}
+
+// TP-DCS (3GPP TS 23.038 4) -> 字符集; 压缩文本不支持
+static bool dcs_to_encoding(uint8_t dcs, sms_pdu_encoding_t *encoding)
+{
+    if ((dcs & 0x80) == 0x00) {
+        // General data coding / automatic deletion group
+        if (dcs & 0x20) {
+            return false;
+        }
+        switch ((dcs >> 2) & 0x03) {
+            case 1:  *encoding = SMS_PDU_ENCODING_8BIT; break;
+            case 2:  *encoding = SMS_PDU_ENCODING_UCS2; break;
+            default: *encoding = SMS_PDU_ENCODING_GSM7; break;
+        }
+    } else if ((dcs & 0xF0) == 0xF0) {
+        // Data coding/message class
+        *encoding = (dcs & 0x04) ? SMS_PDU_ENCODING_8BIT : SMS_PDU_ENCODING_GSM7;
+    } else if ((dcs & 0xF0) == 0xE0) {
+        // Message waiting indication group, UCS2
+        *encoding = SMS_PDU_ENCODING_UCS2;
+    } else {
+        // Message waiting (discard/store) and reserved groups use the default alphabet
+        *encoding = SMS_PDU_ENCODING_GSM7;
+    }
+    return true;
+}
+
+static void decode_address(const uint8_t *addr, uint8_t digits, uint8_t toa,
+                           char *sender, size_t sender_size)
+{
+    size_t len = 0;
+    unsigned ton = (toa >> 4) & 0x07;
+
+    if (ton == PDU_TON_ALPHANUMERIC) {
+        // 字母数字地址: digits为半字节数,内容为打包的GSM-7
+        uint8_t septets[SMS_PDU_MAX_UD_UNITS];
+        size_t count = (size_t)digits * 4 / 7;
+        gsm7_unpack(addr, 0, count, septets);
+        sms_pdu_ud_to_utf8(SMS_PDU_ENCODING_GSM7, septets, count, sender, sender_size, 0, NULL);
+        return;
+    }
+
+    static const char bcd_digits[] = "0123456789*#abc";
+    if (ton == PDU_TON_INTERNATIONAL && sender_size > 1) {
+        sender[len++] = '+';
+    }
+    for (uint8_t i = 0; i < digits && len + 1 < sender_size; i++) {
+        uint8_t nibble = (i & 1) ? addr[i / 2] >> 4 : addr[i / 2] & 0x0F;
+        if (nibble == 0x0F) {
+            break;
+        }
+        sender[len++] = bcd_digits[nibble];
+    }
+    sender[len] = '\0';
+}
+
+// 只识别长短信分段IE;其余IE跳过
+static void parse_udh(const uint8_t *udh, size_t udh_len, sms_pdu_t *out)
+{
+    size_t i = 0;
+    while (i + 2 <= udh_len) {
+        uint8_t iei = udh[i];
+        uint8_t iel = udh[i + 1];
+        const uint8_t *ied = udh + i + 2;
+        if (i + 2 + iel > udh_len) {
+            break;
+        }
+        if (iei == PDU_IEI_CONCAT_8BIT && iel == 3) {
+            out->concat_ref = ied[0];
+            out->concat_total = ied[1];
+            out->concat_seq = ied[2];
+            out->is_concat = true;
+        } else if (iei == PDU_IEI_CONCAT_16BIT && iel == 4) {
+            out->concat_ref = ((uint16_t)ied[0] << 8) | ied[1];
+            out->concat_total = ied[2];
+            out->concat_seq = ied[3];
+            out->is_concat = true;
+        }
+        i += 2 + iel;
+    }
+
+    // 规范要求忽略取值非法的分段IE,按普通短信处理
+    if (out->is_concat &&
+        (out->concat_total == 0 || out->concat_seq == 0 || out->concat_seq > out->concat_total)) {
+        out->is_concat = false;
+    }
+}
+
+bool sms_pdu_parse_deliver(const uint8_t *pdu, size_t len, sms_pdu_t *out)
+{
+    memset(out, 0, sizeof(*out));
+
+    // SMSC address: length octet + address
+    size_t pos = 1;
+    if (len < 1) {
+        return false;
+    }
+    pos += pdu[0];
+
+    // First octet, TP-OA length (semi-octets) and type of address
+    if (pos + 3 > len) {
+        return false;
+    }
+    uint8_t first = pdu[pos];
+    if ((first & PDU_MTI_MASK) != PDU_MTI_DELIVER) {
+        return false;
+    }
+    uint8_t oa_digits = pdu[pos + 1];
+    uint8_t oa_toa = pdu[pos + 2];
+    size_t oa_bytes = ((size_t)oa_digits + 1) / 2;
+    pos += 3;
+    if (oa_digits > 20 || pos + oa_bytes > len) {
+        return false;
+    }
+    decode_address(pdu + pos, oa_digits, oa_toa, out->sender, sizeof(out->sender));
+    pos += oa_bytes;
+
+    // TP-PID, TP-DCS, TP-SCTS, TP-UDL
+    if (pos + 2 + PDU_SCTS_LEN + 1 > len) {
+        return false;
+    }
+    uint8_t dcs = pdu[pos + 1];
+    uint8_t udl = pdu[pos + 2 + PDU_SCTS_LEN];
+    pos += 2 + PDU_SCTS_LEN + 1;
+    if (!dcs_to_encoding(dcs, &out->encoding)) {
+        return false;
+    }
+
+    const uint8_t *ud = pdu + pos;
+    bool gsm7 = out->encoding == SMS_PDU_ENCODING_GSM7;
+    size_t ud_octets = gsm7 ? ((size_t)udl * 7 + 7) / 8 : udl;
+    if (ud_octets > PDU_MAX_UD_OCTETS || pos + ud_octets > len) {
+        return false;
+    }
+
+    size_t udh_octets = 0;
+    if (first & PDU_UDHI) {
+        if (ud_octets == 0) {
+            return false;
+        }
+        udh_octets = (size_t)ud[0] + 1;
+        if (udh_octets > ud_octets) {
+            return false;
+        }
+        parse_udh(ud + 1, udh_octets - 1, out);
+    }
+
+    if (gsm7) {
+        // UDH之后补齐到septet边界
+        size_t skip = (udh_octets * 8 + 6) / 7;
+        if (skip > udl) {
+            return false;
+        }
+        out->ud_len = udl - skip;
+        gsm7_unpack(ud, skip, out->ud_len, out->ud);
+    } else {
+        out->ud_len = (uint8_t)(ud_octets - udh_octets);
+        memcpy(out->ud, ud + udh_octets, out->ud_len);
+    }
+    return true;
+}
@@ -0,0 +1,58 @@
+#ifndef SMS_PDU_H
+#define SMS_PDU_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// +CMT PDU = SMSC地址(最多12字节) + SMS-DELIVER TPDU(最多164字节)
+#define SMS_PDU_MAX_BYTES       176
+// 单条TP-UD去掉UDH后最多160个GSM-7字符或140字节
+#define SMS_PDU_MAX_UD_UNITS    160
+
+typedef enum {
+    SMS_PDU_ENCODING_GSM7,  // ud中每字节一个未打包的septet
+    SMS_PDU_ENCODING_8BIT,  // ud中为原始字节,按ISO-8859-1显示
+    SMS_PDU_ENCODING_UCS2,  // ud中为UCS2大端字节序
+} sms_pdu_encoding_t;
+
+/**
+ * @brief A decoded SMS-DELIVER TPDU (3GPP TS 23.040).
+ */
+typedef struct {
+    char sender[32];                     // Digits ('+' prefix if international) or decoded alphanumeric sender
+    sms_pdu_encoding_t encoding;
+    bool is_concat;                      // Concatenation UDH (IEI 0x00 or 0x08) present
+    uint16_t concat_ref;                 // Concatenated message reference number
+    uint8_t concat_total;                // Total number of parts
+    uint8_t concat_seq;                  // This part's sequence number, 1-based
+    uint8_t ud_len;                      // Number of units in ud
+    uint8_t ud[SMS_PDU_MAX_UD_UNITS];    // User data after the UDH: septets or octets, see encoding
+} sms_pdu_t;
+
+/**
+ * @brief Parses a +CMT PDU (SMSC address followed by an SMS-DELIVER TPDU).
+ *
+ * GSM-7 user data is unpacked (fill bits after a UDH are skipped), so the
+ * result does not reference the input buffer.
+ *
+ * @param pdu PDU bytes, as converted from the hex line.
+ * @param len Number of bytes in pdu.
+ * @param out Parsed message.
+ * @return true on success, false if the PDU is malformed or not an SMS-DELIVER.
+ */
+bool sms_pdu_parse_deliver(const uint8_t *pdu, size_t len, sms_pdu_t *out);
+
+/**
+ * @brief Appends user data as UTF-8 at text[text_len].
+ *
+ * A character is written only if its whole UTF-8 sequence fits, so the
+ * output never ends in a broken code point. text is always NUL-terminated.
+ *
+ * @param truncated May be NULL; set to true when text_size was too small.
+ * @return New length of text.
+ */
+size_t sms_pdu_ud_to_utf8(sms_pdu_encoding_t encoding, const uint8_t *ud, size_t ud_len,
+                          char *text, size_t text_size, size_t text_len, bool *truncated);
+
+#endif // SMS_PDU_H
@@ -0,0 +1,117 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+#include "modem_backend.h" // MODEM_MAX_INSTANCES
+#include "sms_pool.h"
+
+static const char *TAG = "sms_pool";
+
+// 每个模组后端最多同时持有的缓冲数,见sms_pool.h
+#ifdef CONFIG_APP_SMS_REASSEMBLY_SLOTS
+#define SMS_POOL_BACKEND_RESERVE (CONFIG_APP_SMS_REASSEMBLY_SLOTS + 1)
+#else
+#define SMS_POOL_BACKEND_RESERVE 1
+#endif
+#define SMS_POOL_PROCESSOR_RESERVE 2 // 重试中的一条 + 刚取出的一条(或从NVS读出的一条)
+
+static sms_message_t *s_slabs = NULL;
+static bool *s_slab_used = NULL;   // 只由缓冲当前的持有者修改,用于发现重复归还
+static size_t s_size = 0;
+static QueueHandle_t s_free = NULL; // 空闲缓冲的指针,兼作取缓冲时的等待队列
+
+static _Atomic uint32_t s_in_use = 0;
+static _Atomic uint32_t s_peak = 0;
+static _Atomic uint32_t s_exhausted = 0;
+static _Atomic uint32_t s_failed = 0;
+static _Atomic uint32_t s_try_missed = 0;
+
+esp_err_t sms_pool_init(size_t queue_len) {
+    if (s_slabs != NULL) {
+        return ESP_OK;
+    }
+
+    size_t size = queue_len + SMS_POOL_PROCESSOR_RESERVE + MODEM_MAX_INSTANCES * SMS_POOL_BACKEND_RESERVE;
+    s_slabs = calloc(size, sizeof(sms_message_t));
+    s_slab_used = calloc(size, sizeof(bool));
+    s_free = xQueueCreate(size, sizeof(sms_message_t *));
+    if (s_slabs == NULL || s_slab_used == NULL || s_free == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate %u SMS buffers", (unsigned)size);
+        free(s_slabs);
+        free(s_slab_used);
+        if (s_free != NULL) {
+            vQueueDelete(s_free);
+        }
+        s_slabs = NULL;
+        s_slab_used = NULL;
+        s_free = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (size_t i = 0; i < size; i++) {
+        sms_message_t *sms = &s_slabs[i];
+        xQueueSend(s_free, &sms, 0);
+    }
+    s_size = size;
+    ESP_LOGI(TAG, "%u SMS buffers (%u bytes)", (unsigned)size, (unsigned)(size * sizeof(sms_message_t)));
+    return ESP_OK;
+}
+
+sms_message_t *sms_pool_alloc(TickType_t wait_ticks) {
+    sms_message_t *sms = NULL;
+    if (s_free == NULL) {
+        return NULL;
+    }
+    if (xQueueReceive(s_free, &sms, 0) != pdPASS) {
+        if (wait_ticks == 0) {
+            // 只是试取(如sms_processor读NVS),不算等待
+            atomic_fetch_add_explicit(&s_try_missed, 1, memory_order_relaxed);
+            return NULL;
+        }
+        atomic_fetch_add_explicit(&s_exhausted, 1, memory_order_relaxed);
+        if (xQueueReceive(s_free, &sms, wait_ticks) != pdPASS) {
+            atomic_fetch_add_explicit(&s_failed, 1, memory_order_relaxed);
+            return NULL;
+        }
+    }
+
+    s_slab_used[sms - s_slabs] = true;
+    uint32_t in_use = atomic_fetch_add_explicit(&s_in_use, 1, memory_order_relaxed) + 1;
+    if (in_use > atomic_load_explicit(&s_peak, memory_order_relaxed)) {
+        atomic_store_explicit(&s_peak, in_use, memory_order_relaxed); // 只用于观测,并发时偶尔少记可以接受
+    }
+
+    // 只清空两个字符串的开头,2KB的内容区由解码写入并以NUL结尾
+    sms->sender[0] = '\0';
+    sms->sender[sizeof(sms->sender) - 1] = '\0';
+    sms->content[0] = '\0';
+    sms->modem = 0;
+    return sms;
+}
+
+void sms_pool_free(sms_message_t *sms) {
+    if (sms == NULL) {
+        return;
+    }
+    if (sms < s_slabs || sms >= s_slabs + s_size || !s_slab_used[sms - s_slabs]) {
+        ESP_LOGE(TAG, "Ignoring free of %p, not an allocated SMS buffer", (void *)sms);
+        return;
+    }
+    s_slab_used[sms - s_slabs] = false;
+    atomic_fetch_sub_explicit(&s_in_use, 1, memory_order_relaxed);
+    xQueueSend(s_free, &sms, 0); // 容量等于缓冲总数,不会满
+}
+
+void sms_pool_get_stats(sms_pool_stats_t *stats) {
+    stats->size = (uint32_t)s_size;
+    stats->in_use = atomic_load_explicit(&s_in_use, memory_order_relaxed);
+    stats->peak = atomic_load_explicit(&s_peak, memory_order_relaxed);
+    stats->exhausted = atomic_load_explicit(&s_exhausted, memory_order_relaxed);
+    stats->failed = atomic_load_explicit(&s_failed, memory_order_relaxed);
+    stats->try_missed = atomic_load_explicit(&s_try_missed, memory_order_relaxed);
+}
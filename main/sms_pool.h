@@ -0,0 +1,68 @@
+#ifndef SMS_POOL_H
+#define SMS_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+#include "uart_at_manager.h" // sms_message_t
+
+/*
+ * 短信缓冲池: 开机时一次分配固定数量的sms_message_t,之后不再增减。
+ * 短信从解码开始就写在池中的缓冲里,SMS队列只传递指针,所有权随指针转移:
+ * 后端取出缓冲解码,入队后归队列(即sms_processor)所有,发布成功或写入NVS后归还。
+ * 接收、发布、持久化全程不复制消息内容。
+ *
+ * 池容量 = 队列长度 + sms_processor最多持有的2个 + 每个模组后端最多持有的个数
+ * (AT: 每个长短信拼接条目1个加待投递的单条短信1个; DTU: 解析目标1个),
+ * 所以只要队列有空位,生产者总能立即取到缓冲。
+ */
+
+#define SMS_QUEUE_LEN 10 // SMS队列长度,队列中是sms_message_t指针
+
+// 缓冲池统计,只用于观测
+typedef struct {
+    uint32_t size;       // 缓冲总数
+    uint32_t in_use;     // 当前被后端、队列或sms_processor持有的缓冲数
+    uint32_t peak;       // in_use的峰值
+    uint32_t exhausted;  // 取缓冲时池已空、需要等待的次数(wait_ticks不为0)
+    uint32_t failed;     // 等待超时仍未取到的次数
+    uint32_t try_missed; // wait_ticks为0时池已空、直接返回NULL的次数,不计入上面两项
+} sms_pool_stats_t;
+
+/**
+ * @brief Allocates the buffers for an SMS queue of queue_len pointers and
+ *        the reserve of MODEM_MAX_INSTANCES backends.
+ *
+ * Call once before the SMS queue is created and any backend starts.
+ */
+esp_err_t sms_pool_init(size_t queue_len);
+
+/**
+ * @brief Takes a buffer out of the pool, waiting up to wait_ticks if it is
+ *        empty. Sender and content come back as empty strings; the rest of
+ *        the content is not cleared. Safe to call from any task.
+ *
+ * An empty pool counts as exhausted only when the caller waits, and as
+ * failed only when that wait times out. With wait_ticks 0 it counts as
+ * try_missed instead.
+ *
+ * @return The buffer, owned by the caller until it is queued or freed;
+ *         NULL if none became free in time.
+ */
+sms_message_t *sms_pool_alloc(TickType_t wait_ticks);
+
+/**
+ * @brief Returns a buffer to the pool. NULL is ignored. Safe to call from
+ *        any task.
+ */
+void sms_pool_free(sms_message_t *sms);
+
+/**
+ * @brief Reads the pool counters. Safe to call from any task.
+ */
+void sms_pool_get_stats(sms_pool_stats_t *stats);
+
+#endif // SMS_POOL_H
@@ -9,13 +9,14 @@
 #include "uart_at_manager.h" // For sms_message_t
 #include "mqtt_manager.h"     // For mqtt_manager_publish_sms
 #include "sms_storage.h"      // For NVS persistence
+#include "sms_pool.h"         // Queue entries are sms_pool buffers
 #include "log_redaction.h"
 
 static const char *TAG = "sms_processor";
 
 // Retry state for non-blocking retry mechanism
 typedef struct {
-    sms_message_t sms;
+    sms_message_t *sms; // sms_pool buffer taken over from the queue, freed once published or saved
     int retry_count;
     TickType_t next_retry_time;
     bool is_active;
@@ -23,6 +24,35 @@ typedef struct {
 
 static sms_retry_state_t s_retry_state = {0};
 
+// Saves a message that could not be published to NVS and returns its buffer to the pool
+static void save_and_free(sms_message_t *sms, const char *what) {
+    if (sms_storage_save(sms) != ESP_OK) {
+        char masked_sender[LOG_MASKED_PHONE_SIZE];
+        ESP_LOGE(TAG, "Failed to save %s to NVS, message from '%s' is lost", what,
+                 log_mask_phone(sms->sender, masked_sender, sizeof(masked_sender)));
+    }
+    sms_pool_free(sms);
+}
+
+// Ends the retry of the current message
+static void retry_finish(bool save) {
+    if (save) {
+        save_and_free(s_retry_state.sms, "SMS");
+    } else {
+        sms_pool_free(s_retry_state.sms);
+    }
+    s_retry_state.sms = NULL;
+    s_retry_state.is_active = false;
+}
+
+// Starts retrying a message; the retry state takes over its buffer
+static void retry_start(sms_message_t *sms, int retry_delay_ms) {
+    s_retry_state.sms = sms;
+    s_retry_state.retry_count = 1;
+    s_retry_state.next_retry_time = xTaskGetTickCount() + pdMS_TO_TICKS(retry_delay_ms);
+    s_retry_state.is_active = true;
+}
+
 void sms_processor_task(void *pvParameters) {
     QueueHandle_t sms_queue = (QueueHandle_t)pvParameters;
     if (sms_queue == NULL) {
@@ -40,20 +70,21 @@ void sms_processor_task(void *pvParameters) {
         // Recovered SMS will be processed after MQTT connects
     }
 
-    sms_message_t received_sms;
+    sms_message_t *received_sms;
     const int max_retry_attempts = 3;      // Maximum retry attempts per SMS (reduced for non-blocking)
     const int retry_delay_ms = 10000;      // Wait 10 seconds between retries
     const TickType_t queue_timeout = pdMS_TO_TICKS(1000); // Check queue every 1 second
 
     while (1) {
         // First, try to send any stored SMS from NVS if MQTT is connected
-        if (mqtt_manager_is_connected()) {
-            sms_message_t stored_sms;
-            while (sms_storage_get_next(&stored_sms) == ESP_OK) {
+        if (mqtt_manager_is_connected() && sms_storage_get_count() > 0) {
+            // Read into a pool buffer instead of a 2KB stack copy; the pool reserves one for this task
+            sms_message_t *stored_sms = sms_pool_alloc(0);
+            while (stored_sms != NULL && sms_storage_get_next(stored_sms) == ESP_OK) {
                 char masked_sender[LOG_MASKED_PHONE_SIZE];
                 ESP_LOGI(TAG, "Retrying stored SMS from NVS: Sender='%s'",
-                         log_mask_phone(stored_sms.sender, masked_sender, sizeof(masked_sender)));
-                if (mqtt_manager_publish_sms(&stored_sms) == ESP_OK) {
+                         log_mask_phone(stored_sms->sender, masked_sender, sizeof(masked_sender)));
+                if (mqtt_manager_publish_sms(stored_sms) == ESP_OK) {
                     ESP_LOGI(TAG, "Successfully sent stored SMS, removing from NVS");
                     sms_storage_delete_oldest();
                 } else {
@@ -61,6 +92,7 @@ void sms_processor_task(void *pvParameters) {
                     break; // Stop trying stored SMS for now, try again next iteration
                 }
             }
+            sms_pool_free(stored_sms);
         }
 
         // Check if there's a retry in progress
@@ -69,24 +101,18 @@ void sms_processor_task(void *pvParameters) {
             if (current_time >= s_retry_state.next_retry_time) {
                 // Time to retry
                 if (mqtt_manager_is_connected()) {
-                    if (mqtt_manager_publish_sms(&s_retry_state.sms) == ESP_OK) {
+                    if (mqtt_manager_publish_sms(s_retry_state.sms) == ESP_OK) {
                         char masked_sender[LOG_MASKED_PHONE_SIZE];
                         ESP_LOGI(TAG, "Retry successful for SMS from '%s'",
-                                 log_mask_phone(s_retry_state.sms.sender, masked_sender,
+                                 log_mask_phone(s_retry_state.sms->sender, masked_sender,
                                                 sizeof(masked_sender)));
-                        s_retry_state.is_active = false;
+                        retry_finish(false);
                     } else {
                         s_retry_state.retry_count++;
                         if (s_retry_state.retry_count >= max_retry_attempts) {
                             ESP_LOGE(TAG, "Failed to publish SMS after %d attempts, saving to NVS",
                                      max_retry_attempts);
-                            if (sms_storage_save(&s_retry_state.sms) != ESP_OK) {
-                                char masked_sender[LOG_MASKED_PHONE_SIZE];
-                                ESP_LOGE(TAG, "Failed to save SMS to NVS, message from '%s' is lost",
-                                         log_mask_phone(s_retry_state.sms.sender, masked_sender,
-                                                        sizeof(masked_sender)));
-                            }
-                            s_retry_state.is_active = false;
+                            retry_finish(true);
                         } else {
                             // Schedule next retry
                             s_retry_state.next_retry_time = current_time + pdMS_TO_TICKS(retry_delay_ms);
@@ -99,13 +125,7 @@ void sms_processor_task(void *pvParameters) {
                     if (s_retry_state.retry_count >= max_retry_attempts) {
                         ESP_LOGE(TAG, "MQTT disconnected after %d attempts, saving SMS to NVS",
                                  max_retry_attempts);
-                        if (sms_storage_save(&s_retry_state.sms) != ESP_OK) {
-                            char masked_sender[LOG_MASKED_PHONE_SIZE];
-                            ESP_LOGE(TAG, "Failed to save SMS to NVS, message from '%s' is lost",
-                                     log_mask_phone(s_retry_state.sms.sender, masked_sender,
-                                                    sizeof(masked_sender)));
-                        }
-                        s_retry_state.is_active = false;
+                        retry_finish(true);
                     } else {
                         // Schedule next retry
                         s_retry_state.next_retry_time = current_time + pdMS_TO_TICKS(retry_delay_ms);
@@ -116,43 +136,35 @@ void sms_processor_task(void *pvParameters) {
             }
         }
 
-        // Use timeout-based receive to allow processing retries and stored SMS
+        // Use timeout-based receive to allow processing retries and stored SMS.
+        // The queue carries pointers: this task owns the buffer until it frees it or hands it to the retry
         if (xQueueReceive(sms_queue, &received_sms, queue_timeout) == pdPASS) {
             char masked_sender[LOG_MASKED_PHONE_SIZE];
             ESP_LOGI(TAG, "SMS Processor received new SMS: Sender='%s', content_len=%u",
-                     log_mask_phone(received_sms.sender, masked_sender, sizeof(masked_sender)),
-                     (unsigned)strlen(received_sms.content));
+                     log_mask_phone(received_sms->sender, masked_sender, sizeof(masked_sender)),
+                     (unsigned)strlen(received_sms->content));
 
             // If there's already a retry in progress, save this new SMS to NVS
             if (s_retry_state.is_active) {
                 ESP_LOGW(TAG, "Retry in progress, saving new SMS to NVS for later processing");
-                if (sms_storage_save(&received_sms) != ESP_OK) {
-                    ESP_LOGE(TAG, "Failed to save new SMS to NVS, message from '%s' is lost",
-                             log_mask_phone(received_sms.sender, masked_sender,
-                                            sizeof(masked_sender)));
-                }
+                save_and_free(received_sms, "new SMS");
                 continue;
             }
 
             // Try to publish immediately
             if (mqtt_manager_is_connected()) {
-                if (mqtt_manager_publish_sms(&received_sms) == ESP_OK) {
+                if (mqtt_manager_publish_sms(received_sms) == ESP_OK) {
                     ESP_LOGI(TAG, "SMS published successfully");
+                    sms_pool_free(received_sms);
                 } else {
                     // Start retry mechanism
                     ESP_LOGW(TAG, "Failed to publish SMS, starting retry mechanism");
-                    memcpy(&s_retry_state.sms, &received_sms, sizeof(sms_message_t));
-                    s_retry_state.retry_count = 1;
-                    s_retry_state.next_retry_time = xTaskGetTickCount() + pdMS_TO_TICKS(retry_delay_ms);
-                    s_retry_state.is_active = true;
+                    retry_start(received_sms, retry_delay_ms);
                 }
             } else {
                 // MQTT not connected, start retry mechanism
                 ESP_LOGW(TAG, "MQTT not connected, starting retry mechanism");
-                memcpy(&s_retry_state.sms, &received_sms, sizeof(sms_message_t));
-                s_retry_state.retry_count = 1;
-                s_retry_state.next_retry_time = xTaskGetTickCount() + pdMS_TO_TICKS(retry_delay_ms);
-                s_retry_state.is_active = true;
+                retry_start(received_sms, retry_delay_ms);
             }
         }
     }
@@ -129,6 +129,8 @@ esp_err_t sms_storage_get_next(sms_message_t *sms)
     char key[16];
     snprintf(key, sizeof(key), "%s0", NVS_KEY_PREFIX);
 
+    // Messages saved before the modem field existed read back as modem 0
+    memset(sms, 0, sizeof(*sms));
     size_t required_size = sizeof(sms_message_t);
     err = nvs_get_blob(nvs_handle, key, sms, &required_size);
     if (err != ESP_OK) {
@@ -175,7 +177,7 @@ esp_err_t sms_storage_delete_oldest(void)
         snprintf(src_key, sizeof(src_key), "%s%lu", NVS_KEY_PREFIX, (unsigned long)(i + 1));
         snprintf(dst_key, sizeof(dst_key), "%s%lu", NVS_KEY_PREFIX, (unsigned long)i);
 
-        sms_message_t temp_sms;
+        sms_message_t temp_sms = {0};
         size_t required_size = sizeof(sms_message_t);
 
         // Read from source
@@ -0,0 +1,215 @@
+#include "text_codec.h"
+
+#define UTF8_REPLACEMENT_CHAR   0xFFFD
+
+const uint8_t text_hex_value[256] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+       0,    1,    2,    3,    4,    5,    6,    7,    8,    9, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF,   10,   11,   12,   13,   14,   15, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF,   10,   11,   12,   13,   14,   15, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
+bool text_hex_to_bytes(const char *hex, size_t byte_count, uint8_t *out)
+{
+    const uint8_t *s = (const uint8_t *)hex;
+    size_t i = 0;
+
+    // 每轮4个hex字符,四个查表结果合并后只判断一次是否合法
+    for (; i + 2 <= byte_count; i += 2, s += 4) {
+        uint8_t a = text_hex_value[s[0]];
+        uint8_t b = text_hex_value[s[1]];
+        uint8_t c = text_hex_value[s[2]];
+        uint8_t d = text_hex_value[s[3]];
+        if ((a | b | c | d) & 0xF0) {
+            return false;
+        }
+        out[i] = (uint8_t)((a << 4) | b);
+        out[i + 1] = (uint8_t)((c << 4) | d);
+    }
+    if (i < byte_count) {
+        uint8_t a = text_hex_value[s[0]];
+        uint8_t b = text_hex_value[s[1]];
+        if ((a | b) & 0xF0) {
+            return false;
+        }
+        out[i] = (uint8_t)((a << 4) | b);
+    }
+    return true;
+}
+
+bool text_utf8_append(char *text, size_t text_size, size_t *text_len, uint32_t cp)
+{
+    if ((cp >= 0xD800 && cp <= 0xDFFF) || cp > 0x10FFFF) {
+        cp = UTF8_REPLACEMENT_CHAR;
+    }
+    size_t need = cp < 0x80 ? 1 : (cp < 0x800 ? 2 : (cp < 0x10000 ? 3 : 4));
+    if (*text_len + need >= text_size) {
+        return false;
+    }
+    unsigned char *p = (unsigned char *)text + *text_len;
+    if (need == 1) {
+        p[0] = (unsigned char)cp;
+    } else if (need == 2) {
+        p[0] = 0xC0 | (cp >> 6);
+        p[1] = 0x80 | (cp & 0x3F);
+    } else if (need == 3) {
+        p[0] = 0xE0 | (cp >> 12);
+        p[1] = 0x80 | ((cp >> 6) & 0x3F);
+        p[2] = 0x80 | (cp & 0x3F);
+    } else {
+        p[0] = 0xF0 | (cp >> 18);
+        p[1] = 0x80 | ((cp >> 12) & 0x3F);
+        p[2] = 0x80 | ((cp >> 6) & 0x3F);
+        p[3] = 0x80 | (cp & 0x3F);
+    }
+    *text_len += need;
+    return true;
+}
+
+// 读取第i个UTF-16单元;hex输入含非hex字符时返回值大于0xFFFF
+static inline __attribute__((always_inline))
+uint32_t read_unit(const void *in, size_t i, bool hex)
+{
+    if (!hex) {
+        const uint8_t *b = (const uint8_t *)in + i * 2;
+        return ((uint32_t)b[0] << 8) | b[1];
+    }
+    const uint8_t *s = (const uint8_t *)in + i * 4;
+    uint32_t a = text_hex_value[s[0]];
+    uint32_t b = text_hex_value[s[1]];
+    uint32_t c = text_hex_value[s[2]];
+    uint32_t d = text_hex_value[s[3]];
+    return (a << 12) | (b << 8) | (c << 4) | d | (((a | b | c | d) & 0xF0) << 12);
+}
+
+// 逐个检查空间写入一个单元,处理代理项配对
+static bool put_unit(text_utf16_state_t *state, uint32_t u,
+                     char *out, size_t out_size, size_t *out_len)
+{
+    if (u >= 0xD800 && u <= 0xDBFF) {
+        if (state->pending_high != 0 &&
+            !text_utf8_append(out, out_size, out_len, UTF8_REPLACEMENT_CHAR)) {
+            return false;
+        }
+        state->pending_high = (uint16_t)u;
+        return true;
+    }
+
+    uint32_t cp = u;
+    if (u >= 0xDC00 && u <= 0xDFFF) {
+        cp = state->pending_high == 0 ? UTF8_REPLACEMENT_CHAR :
+             0x10000 + (((uint32_t)state->pending_high - 0xD800) << 10) + (u - 0xDC00);
+    } else if (state->pending_high != 0) {
+        if (!text_utf8_append(out, out_size, out_len, UTF8_REPLACEMENT_CHAR)) {
+            return false;
+        }
+    }
+    state->pending_high = 0;
+    return text_utf8_append(out, out_size, out_len, cp);
+}
+
+static inline __attribute__((always_inline))
+text_codec_result_t ucs2_units_to_utf8(text_utf16_state_t *state, const void *in, size_t units, bool hex,
+                                       char *out, size_t out_size, size_t *out_len)
+{
+    size_t len = *out_len;
+    size_t i = 0;
+    text_codec_result_t result = TEXT_CODEC_OK;
+
+    while (i < units) {
+        if (state->pending_high == 0) {
+            // 一个BMP单元最多3字节UTF-8,按剩余空间一次算出本轮可不查边界的单元数
+            size_t room = (out_size - 1 - len) / 3;
+            size_t end = units - i < room ? units : i + room;
+            unsigned char *p = (unsigned char *)out + len;
+            while (i < end) {
+                uint32_t u = read_unit(in, i, hex);
+                if (u < 0x80) {
+                    *p++ = (unsigned char)u;
+                } else if (u < 0x800) {
+                    p[0] = 0xC0 | (u >> 6);
+                    p[1] = 0x80 | (u & 0x3F);
+                    p += 2;
+                } else if (u <= 0xFFFF && (u & 0xF800) != 0xD800) {
+                    p[0] = 0xE0 | (u >> 12);
+                    p[1] = 0x80 | ((u >> 6) & 0x3F);
+                    p[2] = 0x80 | (u & 0x3F);
+                    p += 3;
+                } else if (u >= 0xD800 && u <= 0xDBFF && i + 1 < end) {
+                    // 代理对: 两个单元的6字节预算内写4字节
+                    uint32_t lo = read_unit(in, i + 1, hex);
+                    if (lo < 0xDC00 || lo > 0xDFFF) {
+                        break;
+                    }
+                    uint32_t cp = 0x10000 + ((u - 0xD800) << 10) + (lo - 0xDC00);
+                    p[0] = 0xF0 | (cp >> 18);
+                    p[1] = 0x80 | ((cp >> 12) & 0x3F);
+                    p[2] = 0x80 | ((cp >> 6) & 0x3F);
+                    p[3] = 0x80 | (cp & 0x3F);
+                    p += 4;
+                    i++;
+                } else {
+                    break; // 孤立代理项、非法hex或代理对被本轮边界切开
+                }
+                i++;
+            }
+            len = (size_t)((char *)p - out);
+            if (i == units) {
+                break;
+            }
+        }
+
+        // 代理项、非法hex或剩余空间不足: 逐个单元检查
+        uint32_t u = read_unit(in, i, hex);
+        if (u > 0xFFFF) {
+            result = TEXT_CODEC_INVALID_HEX;
+            break;
+        }
+        if (!put_unit(state, u, out, out_size, &len)) {
+            state->pending_high = 0;
+            result = TEXT_CODEC_TRUNCATED;
+            break;
+        }
+        i++;
+    }
+
+    out[len] = '\0';
+    *out_len = len;
+    return result;
+}
+
+text_codec_result_t text_ucs2_hex_to_utf8(text_utf16_state_t *state, const char *hex, size_t hex_len,
+                                          char *out, size_t out_size, size_t *out_len)
+{
+    return ucs2_units_to_utf8(state, hex, hex_len / 4, true, out, out_size, out_len);
+}
+
+text_codec_result_t text_ucs2_to_utf8(text_utf16_state_t *state, const uint8_t *ucs2, size_t len,
+                                      char *out, size_t out_size, size_t *out_len)
+{
+    return ucs2_units_to_utf8(state, ucs2, len / 2, false, out, out_size, out_len);
+}
+
+text_codec_result_t text_utf16_finish(text_utf16_state_t *state,
+                                      char *out, size_t out_size, size_t *out_len)
+{
+    if (state->pending_high == 0) {
+        return TEXT_CODEC_OK;
+    }
+    state->pending_high = 0;
+    bool ok = text_utf8_append(out, out_size, out_len, UTF8_REPLACEMENT_CHAR);
+    out[*out_len] = '\0';
+    return ok ? TEXT_CODEC_OK : TEXT_CODEC_TRUNCATED;
+}
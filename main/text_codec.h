@@ -0,0 +1,80 @@
+#ifndef TEXT_CODEC_H
+#define TEXT_CODEC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// hex字符 -> 数值(0..15),非hex字符为0xFF
+extern const uint8_t text_hex_value[256];
+
+typedef enum {
+    TEXT_CODEC_OK,
+    TEXT_CODEC_TRUNCATED,   // 输出缓冲放不下,已写入的都是完整字符
+    TEXT_CODEC_INVALID_HEX, // 遇到非hex字符,之前的内容已写入
+} text_codec_result_t;
+
+/**
+ * @brief UTF-16 decoding state, so that a surrogate pair split across two
+ *        input chunks (e.g. the two segments of a wrapped ring buffer line)
+ *        is still joined into one code point.
+ */
+typedef struct {
+    uint16_t pending_high; // 上一块末尾尚未配对的高代理项,0表示无
+} text_utf16_state_t;
+
+#define TEXT_UTF16_STATE_INIT { 0 }
+
+/**
+ * @brief Returns the value of a hex digit, or -1 if c is not one.
+ */
+static inline int text_hex_nibble(char c)
+{
+    uint8_t v = text_hex_value[(uint8_t)c];
+    return v < 16 ? v : -1;
+}
+
+/**
+ * @brief Converts 2 * byte_count hex characters to bytes.
+ *
+ * @return false if a non-hex character was found (out is then partially written).
+ */
+bool text_hex_to_bytes(const char *hex, size_t byte_count, uint8_t *out);
+
+/**
+ * @brief Appends a Unicode code point as UTF-8 at text[*text_len].
+ *
+ * The character is written only if its whole sequence and the terminating
+ * NUL fit. Surrogate code points are written as U+FFFD.
+ *
+ * @return false if text_size was too small (text is left unchanged).
+ */
+bool text_utf8_append(char *text, size_t text_size, size_t *text_len, uint32_t cp);
+
+/**
+ * @brief Appends UCS2/UTF-16BE given as hex ("4F60597D") as UTF-8.
+ *
+ * Four hex characters are one UTF-16 code unit; a trailing partial unit is
+ * ignored. Surrogate pairs become 4-byte UTF-8, unpaired surrogates U+FFFD.
+ * A high surrogate at the end of the input is kept in state until the next
+ * call or text_utf16_finish(). out is always NUL-terminated.
+ *
+ * @param out_len In: bytes already in out (< out_size). Out: new length.
+ */
+text_codec_result_t text_ucs2_hex_to_utf8(text_utf16_state_t *state, const char *hex, size_t hex_len,
+                                          char *out, size_t out_size, size_t *out_len);
+
+/**
+ * @brief Same as text_ucs2_hex_to_utf8() for big-endian UCS2/UTF-16 bytes.
+ *        A trailing odd byte is ignored.
+ */
+text_codec_result_t text_ucs2_to_utf8(text_utf16_state_t *state, const uint8_t *ucs2, size_t len,
+                                      char *out, size_t out_size, size_t *out_len);
+
+/**
+ * @brief Ends a UTF-16 stream: a high surrogate still pending is written as U+FFFD.
+ */
+text_codec_result_t text_utf16_finish(text_utf16_state_t *state,
+                                      char *out, size_t out_size, size_t *out_len);
+
+#endif // TEXT_CODEC_H
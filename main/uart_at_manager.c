@@ -1,54 +1,167 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdatomic.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
-#include "freertos/semphr.h" // For SemaphoreHandle_t
-#include "freertos/event_groups.h" // For EventGroupHandle_t
 #include "driver/uart.h"
 #include "driver/gpio.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
 #include "sdkconfig.h"
 
 #include "uart_at_manager.h"
 #include "mqtt_manager.h"
 #include "log_redaction.h"
+#include "uart_line_framer.h"
+#include "sms_pdu.h"
+#include "text_codec.h"
+#include "modem_status.h"
+#include "operator_table.h"
+#include "fragment_gap.h"
+#include "sms_dedup.h"
+#include "sms_pool.h"
+#include "uart_capture.h"
+#include "modem_backend.h"
+#include "modem_uart.h"
+
+// Configuration from Kconfig (UART端口、引脚与流控见modem_uart.h)
+#ifdef CONFIG_APP_UART_BAUD_RATE_MAX
+#define UART_BAUD_RATE_MAX CONFIG_APP_UART_BAUD_RATE_MAX
+#else
+#define UART_BAUD_RATE_MAX UART_BAUD_RATE
+#endif
 
-// Configuration from Kconfig
-#define UART_PORT_NUM      CONFIG_APP_UART_PORT_NUM
-#define UART_TXD           CONFIG_APP_UART_TXD
-#define UART_RXD           CONFIG_APP_UART_RXD
-#define UART_BAUD_RATE     CONFIG_APP_UART_BAUD_RATE
-
-#define BUF_SIZE (4096)  // Increased from 1024 to handle long SMS and burst URCs
+#define BUF_SIZE (4096)  // UART driver RX/TX buffer size (driver allocates twice this)
+#define AT_RX_RING_SIZE 4096     // 分帧环形缓冲大小,必须是2的幂
+#define AT_RX_CHUNK_SIZE 256     // uart_event_task单次读取的字节数
+#define AT_RX_PATTERN_QUEUE_LEN 32 // 驱动记录的'\n'位置个数,要能容纳一次突发的全部行
+#define AT_RX_FULL_THRESH 96     // RX FIFO(128字节)达到该值时搬入驱动缓冲,留出中断延迟余量
+#define AT_RX_TOUT_SYMBOLS 10    // 线路空闲约一个字符时间即上报超时,及时取走"> "提示符
 #define AT_RESPONSE_MAX_LEN 1024  // Increased from 512 for longer responses
 #define AT_COMMAND_TIMEOUT_MS 10000 // 10 seconds for AT commands, increased for robustness
 #define AT_PROBE_MAX_RETRIES 3
+#define MODEM_BOOT_TIMEOUT_MS 120000   // 开机就绪探测的总时长上限
+#define MODEM_PROBE_INTERVAL_MS 2000   // 就绪探测间隔
+#define MODEM_PROBE_TIMEOUT_MS 1000    // 单次探测命令的超时
+#define AT_BAUD_SWITCH_SETTLE_MS 50    // 模组回OK后切换速率所需的时间
+#define AT_BAUD_VERIFY_PROBES 3        // 新速率下需连续成功的探测次数
 static const char *TAG = "uart_at_manager";
-static QueueHandle_t s_sms_queue = NULL;
-static QueueHandle_t s_uart_event_queue = NULL; // Declare event queue handle
 
-// Global buffer for collecting UART responses
-static char s_uart_rx_buffer[BUF_SIZE];
-static int s_uart_rx_buffer_idx = 0;
-static SemaphoreHandle_t s_uart_rx_mutex; // Mutex to protect rx_buffer access
-static TaskHandle_t s_uart_event_task_handle = NULL; // Task handle for cleanup
-static TaskHandle_t s_uart_at_task_handle = NULL; // Task handle for AT manager task
+typedef struct uart_at_ctx uart_at_ctx_t; // 每个模组一份,见struct uart_at_ctx
+
+// 波特率协商的候选速率,从高到低尝试,不超过UART_BAUD_RATE_MAX
+static const uint32_t s_baud_candidates[] = {921600, 460800, 230400};
+
+// AT命令引擎: 命令排队依次发送,上一条收到OK/ERROR后立即发送下一条;
+// 整个过程都在uart_at_task中运行,等待期间+CMT等URC照常处理
+typedef enum {
+    AT_RESULT_NONE,     // 尚未完成
+    AT_RESULT_OK,
+    AT_RESULT_ERROR,
+    AT_RESULT_TIMEOUT,
+} at_result_t;
+
+typedef struct at_command at_command_t;
+typedef void (*at_command_done_cb_t)(uart_at_ctx_t *ctx, at_command_t *cmd);
+
+struct at_command {
+    const char *cmd;               // 完整命令行,不含"\r\n"
+    const char *match;             // 非NULL时只有以此开头的行归入响应,其余行按URC处理
+    TickType_t timeout;            // 从发出命令开始计时
+    at_command_done_cb_t on_done;  // 完成时在uart_at_task中调用,可为NULL
+    void *arg;                     // 供on_done使用
+    char *response;                // 响应,保持"\r\n<行>\r\n"格式,可为NULL
+    size_t response_size;
+    size_t response_len;
+    const void *payload;           // 非NULL: 收到"> "提示后发送(如AT+CMGS的PDU加Ctrl-Z),再等最终结果
+    size_t payload_len;
+    bool payload_sent;
+    at_result_t result;            // 完成前为AT_RESULT_NONE,可轮询
+    TickType_t sent_at;
+    uint32_t latency_ms;           // 发出到收到最终结果的耗时
+};
+
+#define AT_CMD_QUEUE_LEN 8         // 最多排队的命令数
+#define AT_CHAIN_MAX_LEN 128       // 合并后的一行命令的最大长度
+
+#if CONFIG_APP_SMS_PDU_MODE
+// 存储转发: 启动时或队列快满时让模组把新短信存入SIM/ME(只上报+CMTI),再用AT+CMGL批量读取,
+// 短信放入队列后才用AT+CMGD删除,模组存储因此成为突发短信的缓冲
+#define SMS_STORE_INDEX_NONE 0xFFFF
+#define SMS_STORE_MAX_INDEX 512         // 支持的存储下标范围(删除标记位图)
+#define SMS_STORE_DELETE_BATCH 8        // 一行合并的AT+CMGD条数
+#define SMS_STORE_PRESSURE_SPACES 1     // 队列剩余空位不超过该值时切到存储模式
+#define SMS_STORE_LIST_TIMEOUT_MS 30000 // AT+CMGL读出全部存储短信的超时
+#define SMS_STORE_DELETE_TIMEOUT_MS 3000 // 一行合并的AT+CMGD的超时,超时后重新读取存储再删
+#define SMS_CNMI_DIRECT "AT+CNMI=2,2,0,0,0"
+#define SMS_CNMI_STORE  "AT+CNMI=2,1,0,0,0"
+#endif
+
+// 模组开机过程中上报的就绪URC
+#define MODEM_URC_RDY       (1u << 0)  // "RDY": 模组固件启动完成
+#define MODEM_URC_SIM_READY (1u << 1)  // "+CPIN: READY"
+#define MODEM_URC_SMS_READY (1u << 2)  // "SMS Ready" / "+QIND: SMS DONE": 可以收发短信
 
-// Event group to signal AT command response
-static EventGroupHandle_t s_at_response_event_group;
-#define AT_RESPONSE_OK_BIT   BIT0
-#define AT_RESPONSE_ERROR_BIT BIT1
-#define AT_RESPONSE_URC_BIT   BIT2 // For unsolicited result codes like +CMT
+// URC分发: 行首与前缀相同即调用处理函数
+typedef struct {
+    const char *prefix;
+    size_t prefix_len;
+    uart_at_urc_handler_t handler;
+    void *arg;
+} at_urc_handler_t;
+
+#define AT_URC_HANDLERS_MAX 8  // uart_at_register_urc_handler可注册的处理函数数
+
+// URC分发索引: 按行首AT_URC_KEY_LEN个字符散列到桶,每行只与同一个桶中的前缀比较,
+// 耗时与处理函数总数无关。处理函数按内置、状态缓存、注册的顺序编号,桶内链表按编号
+// 升序,即调用顺序。前缀不足AT_URC_KEY_LEN个字符的注册处理函数在short链中,每行都检查
+#define AT_URC_KEY_LEN 3
+#define AT_URC_BUCKETS 32       // 2的幂
+#define AT_URC_IDS_MAX 32       // 处理函数编号上限(内置 + 状态缓存 + AT_URC_HANDLERS_MAX)
+#define AT_URC_ID_NONE UINT8_MAX
 
-// 全局变量定义和初始化
-char g_sim_operator[32] = {0};
+typedef struct {
+    _Atomic uint8_t head[AT_URC_BUCKETS];
+    _Atomic uint8_t short_head;
+    _Atomic uint8_t next[AT_URC_IDS_MAX];
+} at_urc_index_t;
+
+// 热启动快速路径: NVS中保存上次完整配置后的模组状态指纹及对应的运营商,
+// 每个模组一个命名空间(modem_backend_nvs_name)
+#define MODEM_NVS_NAMESPACE "modem_cfg"
+#define MODEM_NVS_KEY_FINGERPRINT "fp"
+#define MODEM_NVS_KEY_OPERATOR "operator"
+#define MODEM_NVS_KEY_BAUD "baud"       // 协商后的波特率(模组未断电时仍在用)
+// 一次往返读取设置和IMSI; E0/+CMEE=2是幂等的,顺便保证回显关闭
+#define MODEM_STATE_QUERY "ATE0;+CMEE=2;+CMGF?;+CSCS?;+CNMI?;+CIMI"
+// 初始化完成后查询一次,之后modem_status由URC更新;响应经URC分发写入缓存
+#define MODEM_STATUS_QUERY "AT+CPIN?;+CSQ;+CREG?;+CEREG?;+CCLK?"
+
+// 空闲时段的模组状态采样: 信号、注册状态与短信存储用量,响应经URC分发写入modem_status
+#ifdef CONFIG_APP_MODEM_TELEMETRY_INTERVAL_S
+#define MODEM_TELEMETRY_INTERVAL_MS (CONFIG_APP_MODEM_TELEMETRY_INTERVAL_S * 1000) // 0表示关闭
+#else
+#define MODEM_TELEMETRY_INTERVAL_MS 0
+#endif
+#define MODEM_TELEMETRY_QUERY "AT+CSQ;+CREG?;+CEREG?;+CPMS?"
+#define MODEM_TELEMETRY_TIMEOUT_MS 3000  // 采样命令的超时,不让一次采样长时间占用串口
+#define MODEM_TELEMETRY_SMS_QUIET_MS 5000 // 最近一次短信活动后至少安静这么久才采样
+#define UART_BITS_PER_BYTE 10            // 8N1: 起始位+8数据位+停止位
 
 // SMS分段拼接相关结构和常量
-#define SMS_FRAGMENT_TIMEOUT_MS 30000  // 30秒超时,认为分段SMS已完成
 #define MAX_SMS_FRAGMENTS 10           // 最大支持10段SMS拼接
+#define SMS_FLUSH_QUEUE_WAIT_MS 500    // 冲刷未收齐的长短信时等待队列空位的上限,超时则下个周期重试
+#define SMS_BUFFER_WAIT_MS 500         // 缓冲池空时等待sms_processor归还缓冲的上限,超时该短信不解码
+#ifdef CONFIG_APP_SMS_REASSEMBLY_SLOTS
+#define SMS_REASSEMBLY_SLOTS CONFIG_APP_SMS_REASSEMBLY_SLOTS // 可同时拼接的长短信条数
+#else
+#define SMS_REASSEMBLY_SLOTS 1 // DTU固件不使用本模块,仅保证可以编译
+#endif
 
+#if !CONFIG_APP_SMS_PDU_MODE
 // 文本模式 + AT+CSCS="UCS2" 下每个字符固定占4个hex字符。
 // 长短信的"非末尾"分段载荷长度由协议固定,单条短信最多160(GSM-7)/70(UCS2)字符,
 // 因此只有长度精确落在下列值上才可能是中间分段。
@@ -56,70 +169,258 @@ char g_sim_operator[32] = {0};
 #define SMS_PART_HEX_LEN_GSM7_16BIT_REF 608  // 152字符 (7字节UDH)
 #define SMS_PART_HEX_LEN_UCS2_8BIT_REF  268  // 67字符  (6字节UDH)
 #define SMS_PART_HEX_LEN_UCS2_16BIT_REF 264  // 66字符  (7字节UDH)
+#else
+// PDU模式: 乱序到达、暂时不能接在已解码内容之后的分段,保留未解码的用户数据
+typedef struct {
+    uint8_t encoding;                   // sms_pdu_encoding_t
+    uint8_t len;
+    uint8_t data[SMS_PDU_MAX_UD_UNITS];
+} sms_fragment_part_t;
+
+// 乱序分段共用的缓冲池,所有拼接中的长短信合计最多暂存这么多个分段
+#define SMS_PART_POOL_SIZE (2 * MAX_SMS_FRAGMENTS)
+#define SMS_PART_NONE 0xFF
+#endif
 
+// 拼接表中的一条长短信: 各分段直接解码追加到message->content,完成后只把指针交给队列,不另存副本
 typedef struct {
-    char sender[32];              // 发件人号码
-    char accumulated_content[2048]; // 累积的内容(hex格式)
-    TickType_t last_fragment_time; // 上次片段到达时间
+    sms_message_t *message;        // sms_pool缓冲: 发件人及已解码的UTF-8内容,入队后为NULL
+    size_t content_len;            // message->content中已写入的字节数
+    TickType_t last_fragment_time; // 上次片段到达时间,超过fragment_gap_timeout_ms()即投递
+    uint32_t last_used;            // LRU序号,表满时淘汰最久未更新的条目
     int fragment_count;            // 已接收片段数
-    bool is_active;                // 是否有活跃的分段SMS
-} sms_fragment_buffer_t;
+    bool is_active;                // 条目是否在使用
+    bool flush_pending;            // 已冲刷但队列满,等reassembly_expire重试投递,不再接收分段
+#if CONFIG_APP_SMS_PDU_MODE
+    // 按UDH中的(发件人, 参考号, 总段数)识别同一条长短信
+    uint16_t concat_ref;
+    uint8_t concat_total;          // 实际拼接的段数(不超过MAX_SMS_FRAGMENTS)
+    uint8_t next_seq;              // 已按顺序解码进content的段数
+    uint16_t received_mask;        // bit(n-1): 第n段已收到
+    bool truncated;                // content已写满或总段数超出上限
+    uint8_t part_slot[MAX_SMS_FRAGMENTS]; // 暂存的乱序分段在part_pool中的下标
+    uint16_t store_mask;           // bit(n-1): 第n段来自模组存储,投递后需删除
+    uint16_t store_index[MAX_SMS_FRAGMENTS]; // 各分段的存储下标
+#endif
+} sms_reassembly_entry_t;
+
+// 超时投递的长短信: 之后同一发件人的分段迟到时,把实际间隔也计入统计,
+// 否则超时以上的间隔永远观测不到,学到的超时只会变短
+typedef struct {
+    char sender[32];
+    uint16_t concat_ref;           // PDU模式下的参考号,文本模式为0
+    TickType_t last_fragment_time;
+} sms_expired_entry_t;
+
+/*
+ * 一个AT模组的全部运行状态。每个使用AT固件的模组实例一份,由uart_at_init分配,
+ * 挂在modem_instance_t.ctx上;除标注的统计字段外只由该模组的两个任务访问。
+ */
+struct uart_at_ctx {
+    modem_instance_t *modem;
+    QueueHandle_t sms_queue;
+    QueueHandle_t uart_event_queue;
+    TaskHandle_t uart_event_task_handle;
+    _Atomic TaskHandle_t uart_at_task_handle; // 接收侧有新行时通知该任务
+    char nvs_namespace[MODEM_NVS_NAME_SIZE];  // 该模组的热启动指纹与波特率
+
+    // 接收分帧环形缓冲: 单生产者(uart_event_task)/单消费者(uart_at_task)无锁队列,
+    // 生产端只追加字节并发任务通知,从不阻塞;行的解析全部由uart_at_task完成
+    char rx_ring[AT_RX_RING_SIZE];
+    uart_line_framer_t rx_framer;
+    _Atomic uint32_t rx_high_water;  // 环形缓冲占用峰值,仅生产端更新
+    _Atomic uint32_t rx_wakeups;     // 生产端唤醒uart_at_task的次数
+    _Atomic uint32_t rx_frame_errors;
+    _Atomic uint32_t rx_parity_errors;
+    _Atomic uint32_t rx_fifo_overflows;
+    _Atomic uint32_t rx_buffer_full;
+    _Atomic uint32_t rx_flushed_bytes; // FIFO溢出后随uart_flush_input丢弃的字节数
+    _Atomic bool rx_resync;            // 波特率切换后由生产端丢弃收到一半的行
+    _Atomic uint32_t uart_baud;        // 当前波特率
+    char rx_line[AT_RESPONSE_MAX_LEN]; // 当前处理的行,仅uart_at_task使用
+
+    // 排队中的命令及正在执行的命令,仅uart_at_task访问
+    at_command_t *at_queue[AT_CMD_QUEUE_LEN];
+    size_t at_queue_head;
+    size_t at_queue_count;
+    at_command_t *at_inflight;
+    size_t at_prompt_tail;             // 已处理过的"> "提示在分帧缓冲中的位置,同一个提示只处理一次
+
+    // 命令耗时统计,仅uart_at_task更新
+    _Atomic uint32_t at_cmd_count;
+    _Atomic uint32_t at_cmd_timeouts;
+    _Atomic uint32_t at_cmd_latency_last_ms;
+    _Atomic uint32_t at_cmd_latency_max_ms;
+    uint64_t at_cmd_latency_total_ms;
+    _Atomic uint32_t at_cmd_latency_avg_ms;
+
+    bool cmt_body_pending;             // 已收到+CMT头,等待下一行正文
+#if !CONFIG_APP_SMS_PDU_MODE
+    char cmt_sender[32];               // 文本模式下发件人在头行到达时直接从环形缓冲解码
+#else
+    uint16_t cmt_store_index;          // 当前正文的存储下标: +CMGL头给出,+CMT为SMS_STORE_INDEX_NONE
+    // 已投递、等待AT+CMGD删除的存储下标;重新读到时跳过,避免重复投递
+    uint32_t store_delete_bits[SMS_STORE_MAX_INDEX / 32];
+    bool store_mode;                   // CNMI当前为存储模式
+    bool store_enter_requested;        // 队列快满,需切到存储模式
+    bool store_drain_pending;          // 存储中可能有未读取的短信
+    bool store_stalled;                // 本次读取中队列已满,其余短信留在存储中
+    _Atomic uint32_t store_mode_active;
+    _Atomic uint32_t store_mode_switches;
+    _Atomic uint32_t store_drained;    // 从存储读出并投递的短信数
+    _Atomic uint32_t store_deleted;
+    sms_pdu_t pdu;                     // 当前正文解析出的PDU,不放在深调用链的栈上
+#endif
+    sms_message_t *single_sms;         // 待投递的单条短信(sms_pool缓冲),入队后为NULL,下一条再取
+
+    uint32_t modem_ready_urcs;         // 开机过程中收到的MODEM_URC_*
+    at_urc_handler_t urc_handlers[AT_URC_HANDLERS_MAX]; // uart_at_register_urc_handler注册的处理函数
+    _Atomic size_t urc_handler_count;
+    at_urc_index_t urc_index;
+    modem_status_cache_t status;       // URC与查询响应缓存的模组状态
+    _Atomic uint32_t modem_ready_ms;   // 初始化完成时距开机的毫秒数,0表示尚未完成
+    _Atomic uint32_t modem_warm_start; // 1: 指纹一致,跳过了配置
+
+    // 空闲时段的模组状态采样
+    TickType_t sms_activity_tick;      // 最近一次收到短信相关URC的时刻
+    TickType_t telemetry_last_tick;    // 最近一次发出采样的时刻
+    bool telemetry_busy;               // 采样命令已提交,尚未完成
+    bool telemetry_deferred;           // 本次到期的采样已因短信活动推迟过
+    at_command_t telemetry_cmd;
+    char telemetry_response[256];      // 只用于统计响应字节数,内容已由URC处理函数解析
+    _Atomic uint32_t telemetry_samples;
+    _Atomic uint32_t telemetry_failures;
+    _Atomic uint32_t telemetry_deferrals;
+    _Atomic uint32_t telemetry_latency_ms; // 最近一次采样从发出到OK的耗时
+    _Atomic uint32_t telemetry_uart_us;    // 最近一次采样收发字节在当前波特率下的线路时间
+
+    // 长短信拼接表: 不同发件人(及不同参考号)的长短信可以交错到达、同时拼接
+    sms_reassembly_entry_t reassembly[SMS_REASSEMBLY_SLOTS];
+    sms_expired_entry_t reassembly_expired[SMS_REASSEMBLY_SLOTS];
+    uint32_t reassembly_expired_next;
+    uint32_t reassembly_clock;
+#if CONFIG_APP_SMS_PDU_MODE
+    sms_fragment_part_t part_pool[SMS_PART_POOL_SIZE];
+    uint32_t part_pool_used;           // bit(i): part_pool[i]已占用
+#endif
+    fragment_gap_t gaps;               // 分段间隔直方图,按该模组的运营商学习
 
-static sms_fragment_buffer_t s_fragment_buffer = {0};
+    // 拼接表统计,仅uart_at_task更新
+    _Atomic uint32_t reasm_live;       // 正在拼接的长短信条数
+    _Atomic uint32_t reasm_bytes;      // 已解码内容与暂存分段占用的字节数
+    _Atomic uint32_t reasm_evictions;  // 表或分段缓冲池满时被提前投递的条数
+    _Atomic uint32_t reasm_timeouts;   // 最后一段超时未到而投递的条数
+};
 
 // Forward declarations
-static int handle_urc(char *urc_line_buffer);
-static esp_err_t at_send_command(const char *cmd, char *response_buffer, size_t buffer_size, TickType_t timeout_ticks);
-static esp_err_t configure_modem_for_sms(char *response_buffer, size_t buffer_size,
+#if !CONFIG_APP_SMS_PDU_MODE
+static void parse_cmt_header(const uart_line_span_t *header, char *sender, size_t sender_size);
+#endif
+static void handle_cmt_body(uart_at_ctx_t *ctx, const uart_line_span_t *body);
+static esp_err_t at_send_command(uart_at_ctx_t *ctx, const char *cmd, char *response_buffer, size_t buffer_size, TickType_t timeout_ticks);
+static esp_err_t configure_modem_for_sms(uart_at_ctx_t *ctx, char *response_buffer, size_t buffer_size,
                                          bool *modem_responding);
-static void process_pending_sms_urcs(void);
-static void wait_for_recovery_retry(TickType_t delay_ticks);
-static esp_err_t parse_cmt_text_mode_response(const char *response, sms_message_t *sms_msg);
-static void decode_ucs2_hex_to_utf8(const char *ucs2_hex_str, char *utf8_buf, size_t utf8_buf_len);
+static void process_pending_sms_urcs(uart_at_ctx_t *ctx);
+static void wait_for_recovery_retry(uart_at_ctx_t *ctx, TickType_t delay_ticks);
+#if !CONFIG_APP_SMS_PDU_MODE
+static size_t decode_ucs2_hex_span(const uart_line_span_t *span, size_t start, size_t end,
+                                   char *utf8_buf, size_t utf8_buf_len, size_t utf8_len,
+                                   bool *truncated);
+#endif
 
 // SMS分段拼接相关函数声明
+#if !CONFIG_APP_SMS_PDU_MODE
 static bool is_multipart_part_hex_len(int hex_len);
-static bool is_fragment_timeout(void);
-static void reset_fragment_buffer(void);
-static void flush_fragment_buffer_to_queue(const char *reason);
-static esp_err_t process_sms_fragment(const char *sender, const char *content_hex, int content_hex_len, sms_message_t *complete_sms);
+static sms_reassembly_entry_t *reassembly_find(uart_at_ctx_t *ctx, const char *sender);
+#else
+static sms_reassembly_entry_t *reassembly_find(uart_at_ctx_t *ctx, const char *sender, uint16_t concat_ref,
+                                               uint8_t concat_total);
+static uint8_t part_pool_alloc(uart_at_ctx_t *ctx, const sms_reassembly_entry_t *requester);
+#endif
+static sms_reassembly_entry_t *reassembly_start(uart_at_ctx_t *ctx, const char *sender);
+static void reassembly_touch(uart_at_ctx_t *ctx, sms_reassembly_entry_t *entry);
+static void reassembly_note_gap(uart_at_ctx_t *ctx, const sms_reassembly_entry_t *entry);
+static void reassembly_note_late(uart_at_ctx_t *ctx, const char *sender, uint16_t concat_ref);
+static void reassembly_release(uart_at_ctx_t *ctx, sms_reassembly_entry_t *entry);
+static void reassembly_complete(uart_at_ctx_t *ctx, sms_reassembly_entry_t *entry);
+static void reassembly_flush(uart_at_ctx_t *ctx, sms_reassembly_entry_t *entry, const char *reason,
+                             bool can_retry);
+static void reassembly_expire(uart_at_ctx_t *ctx);
+static void reassembly_update_stats(uart_at_ctx_t *ctx);
+#if CONFIG_APP_SMS_PDU_MODE
+static bool store_delete_pending(uart_at_ctx_t *ctx, uint16_t index);
+static void store_mark_delete(uart_at_ctx_t *ctx, uint16_t index);
+static void store_mark_entry_delete(uart_at_ctx_t *ctx, const sms_reassembly_entry_t *entry);
+static bool store_hand_off(uart_at_ctx_t *ctx, sms_message_t **sms);
+static void store_note_pressure(uart_at_ctx_t *ctx);
+static void sms_store_service(uart_at_ctx_t *ctx, char *response_buffer, size_t buffer_size);
+#endif
 
 // 新增的获取SIM卡信息的辅助函数
-static esp_err_t get_sim_imsi(char *imsi_buffer, size_t buffer_size);
-static esp_err_t get_sim_operator_name(char *operator_buffer, size_t buffer_size);
+static esp_err_t get_sim_imsi(uart_at_ctx_t *ctx, char *imsi_buffer, size_t buffer_size);
+static esp_err_t get_sim_operator_name(uart_at_ctx_t *ctx, char *operator_buffer, size_t buffer_size);
 
-// IMSI到运营商的映射表 (参考Lua脚本)
-typedef struct {
-    const char *mcc_mnc_prefix;
-    const char *operator_name_zh;
-} sim_operator_map_t;
-
-static const sim_operator_map_t s_operator_map[] = {
-    {"46000", "中国移动"},
-    {"46002", "中国移动"},
-    {"46007", "中国移动"},
-    {"46008", "中国移动"},
-    {"46001", "中国联通"},
-    {"46006", "中国联通"},
-    {"46009", "中国联通"},
-    {"46010", "中国联通"},
-    {"46003", "中国电信"},
-    {"46005", "中国电信"},
-    {"46011", "中国电信"},
-    {"46012", "中国电信"},
-    {"46015", "中国广电"},
-    // 可以根据需要添加其他运营商
-    {"23410", "Giffgaff"},
-    {"53005", "Skinny"},
-    {"45403", "Haha"},
-};
-static const size_t s_operator_map_size = sizeof(s_operator_map) / sizeof(s_operator_map[0]);
 
+static void notify_rx_consumer(uart_at_ctx_t *ctx) {
+    TaskHandle_t consumer = atomic_load(&ctx->uart_at_task_handle);
+    if (consumer != NULL) {
+        atomic_fetch_add_explicit(&ctx->rx_wakeups, 1, memory_order_relaxed);
+        xTaskNotifyGive(consumer);
+    }
+}
+
+// 把驱动缓冲中的len字节搬进分帧环形缓冲
+static void rx_forward(uart_at_ctx_t *ctx, uint8_t *dtmp, size_t len) {
+    while (len > 0) {
+        size_t want = len < AT_RX_CHUNK_SIZE ? len : AT_RX_CHUNK_SIZE;
+        int read_len = uart_read_bytes(ctx->modem->uart.num, dtmp, want, 0);
+        if (read_len <= 0) {
+            break;
+        }
+        len -= read_len;
+        modem_backend_count_rx(ctx->modem, (uint32_t)read_len);
+        modem_uart_capture(&ctx->modem->uart, UART_CAPTURE_RX, dtmp, (size_t)read_len);
+
+        // 本任务是唯一的生产者,push前后overflow_events不变说明少存的字节是
+        // 断流后丢弃的半行(而不是环形缓冲满)
+        uint32_t overflows = atomic_load_explicit(&ctx->rx_framer.overflow_events, memory_order_relaxed);
+        size_t stored = uart_line_framer_push(&ctx->rx_framer, dtmp, read_len);
+        size_t used = uart_line_framer_used(&ctx->rx_framer);
+        if (used > atomic_load_explicit(&ctx->rx_high_water, memory_order_relaxed)) {
+            atomic_store_explicit(&ctx->rx_high_water, used, memory_order_relaxed);
+        }
+        if (stored < (size_t)read_len) {
+            if (atomic_load_explicit(&ctx->rx_framer.overflow_events, memory_order_relaxed) != overflows) {
+                ESP_LOGW(TAG, "UART RX ring full (used=%u, max=%d), dropped %d bytes",
+                         (unsigned)used, AT_RX_RING_SIZE, read_len - (int)stored);
+            } else {
+                ESP_LOGD(TAG, "Discarded %d bytes of a line cut off by an RX gap", read_len - (int)stored);
+            }
+        }
+    }
+}
+
+static void rx_forward_buffered(uart_at_ctx_t *ctx, uint8_t *dtmp) {
+    size_t buffered = 0;
+    uart_get_buffered_data_len(ctx->modem->uart.num, &buffered);
+    if (buffered > 0) {
+        rx_forward(ctx, dtmp, buffered);
+        notify_rx_consumer(ctx);
+    }
+}
 
-// UART event handler to collect data
+/**
+ * UART event handler: 只负责把收到的字节追加到分帧环形缓冲,解析全部在uart_at_task中完成
+ *
+ * 分帧交给驱动的'\n'模式检测: 每收到一个完整行产生一个UART_PATTERN_DET事件,
+ * 这里读到该行的'\n'为止再唤醒uart_at_task一次。FIFO阈值产生的UART_DATA事件
+ * 不读取,数据留在驱动缓冲中等该行结束;只有接收超时(线路空闲)且没有未读完的行时
+ * 才把没有'\n'的尾部(如"> "提示符)取走。位置队列溢出时丢失位置的行也由此取走。
+ */
 static void uart_event_task(void *pvParameters) {
+    uart_at_ctx_t *ctx = pvParameters;
     uart_event_t event;
-    uint8_t *dtmp = (uint8_t *) malloc(BUF_SIZE);
+    uint8_t *dtmp = (uint8_t *) malloc(AT_RX_CHUNK_SIZE);
     if (!dtmp) {
         ESP_LOGE(TAG, "Failed to allocate memory for UART event task buffer");
         vTaskDelete(NULL);
@@ -127,137 +428,69 @@ static void uart_event_task(void *pvParameters) {
 
     while (1) {
         // Use xQueueReceive to read from the event queue
-        if (xQueueReceive(s_uart_event_queue, &event, portMAX_DELAY) == pdPASS) {
+        if (xQueueReceive(ctx->uart_event_queue, &event, portMAX_DELAY) == pdPASS) {
+            if (atomic_exchange(&ctx->rx_resync, false)) {
+                // 旧速率的数据已由uart_flush_input清掉,缓冲中剩下的是新速率下收到的
+                // (通常正是触发本事件的验证应答)。重置队列丢掉了这些行的位置,
+                // 不在此取走就要等到下一个'\n'才会被读出
+                uart_pattern_queue_reset(ctx->modem->uart.num, AT_RX_PATTERN_QUEUE_LEN);
+                uart_line_framer_mark_gap(&ctx->rx_framer);
+                rx_forward_buffered(ctx, dtmp);
+            }
             switch (event.type) {
-                case UART_DATA:
-                    xSemaphoreTake(s_uart_rx_mutex, portMAX_DELAY);
-                    int read_len = uart_read_bytes(UART_PORT_NUM, dtmp, event.size, portMAX_DELAY);
-                    if (read_len > 0) {
-                        // 检查是否会溢出
-                        if (s_uart_rx_buffer_idx + read_len >= BUF_SIZE) {
-                            ESP_LOGW(TAG, "UART RX buffer near overflow! Current: %d, Incoming: %d, Max: %d",
-                                     s_uart_rx_buffer_idx, read_len, BUF_SIZE);
-
-                            // 尝试查找并保留+CMT消息,删除其他内容
-                            char *cmt_start = strstr(s_uart_rx_buffer, "+CMT:");
-                            if (cmt_start) {
-                                // 找到+CMT消息,保留它及之后的内容
-                                int keep_offset = cmt_start - s_uart_rx_buffer;
-                                ESP_LOGI(TAG, "Preserving +CMT message, discarding %d bytes before it", keep_offset);
-                                memmove(s_uart_rx_buffer, cmt_start, s_uart_rx_buffer_idx - keep_offset);
-                                s_uart_rx_buffer_idx -= keep_offset;
-                            } else {
-                                // 没有+CMT消息,清空缓冲区以接收新数据
-                                ESP_LOGW(TAG, "No +CMT in buffer, clearing to make space");
-                                s_uart_rx_buffer_idx = 0;
-                            }
-                        }
-
-                        // 再次检查空间是否足够
-                        if (s_uart_rx_buffer_idx + read_len < BUF_SIZE) {
-                            memcpy(s_uart_rx_buffer + s_uart_rx_buffer_idx, dtmp, read_len);
-                            s_uart_rx_buffer_idx += read_len;
-                            s_uart_rx_buffer[s_uart_rx_buffer_idx] = '\0'; // Null-terminate
-                        } else {
-                            // 仍然放不下,只能截断
-                            int can_copy = BUF_SIZE - s_uart_rx_buffer_idx - 1;
-                            if (can_copy > 0) {
-                                ESP_LOGW(TAG, "Buffer still full, copying only %d of %d bytes", can_copy, read_len);
-                                memcpy(s_uart_rx_buffer + s_uart_rx_buffer_idx, dtmp, can_copy);
-                                s_uart_rx_buffer_idx += can_copy;
-                                s_uart_rx_buffer[s_uart_rx_buffer_idx] = '\0';
-                            }
-                        }
-                        ESP_LOGD(TAG, "UART RX buffer updated (len=%d)", s_uart_rx_buffer_idx);
-
-                        // 清理非SMS相关的URC消息,避免缓冲区堆积
-                        // 保留AT命令响应、扩展错误响应和+CMT消息
-                        char *buffer_ptr = s_uart_rx_buffer;
-                        while (*buffer_ptr) {
-                            // 检查是否是需要忽略的URC (不是+CMT的其他URC)
-                            if (*buffer_ptr == '+' || *buffer_ptr == '^') {
-                                // +CME ERROR/+CMS ERROR是AT命令的终止响应，不是普通URC
-                                bool should_preserve_line = strncmp(buffer_ptr, "+CMT:", 5) == 0 ||
-                                                            strncmp(buffer_ptr, "+CME ERROR:", 11) == 0 ||
-                                                            strncmp(buffer_ptr, "+CMS ERROR:", 11) == 0;
-                                if (should_preserve_line) {
-                                    // 跳过这一行以保留它
-                                    char *line_end = strstr(buffer_ptr, "\r\n");
-                                    if (line_end) {
-                                        buffer_ptr = line_end + 2;
-                                    } else {
-                                        break; // 不完整的行,保留
-                                    }
-                                } else {
-                                    // 这是其他URC (如+CGEV, ^MODE, +NITZ等),需要删除
-                                    char *line_end = strstr(buffer_ptr, "\r\n");
-                                    if (line_end) {
-                                        int line_len = line_end + 2 - buffer_ptr;
-                                        ESP_LOGD(TAG, "Removing non-SMS URC (len=%d)", line_len);
-                                        // 移除这一行
-                                        memmove(buffer_ptr, line_end + 2, strlen(line_end + 2) + 1);
-                                        s_uart_rx_buffer_idx -= line_len;
-                                        // 不移动buffer_ptr,因为内容已经前移
-                                    } else {
-                                        break; // 不完整的行,保留
-                                    }
-                                }
-                            } else {
-                                // 不是URC,跳到下一行
-                                char *line_end = strstr(buffer_ptr, "\r\n");
-                                if (line_end) {
-                                    buffer_ptr = line_end + 2;
-                                } else {
-                                    break;
-                                }
-                            }
-                        }
-
-                        // Check for URCs or command responses in the buffer
-                        char *ok_pos = strstr(s_uart_rx_buffer, "OK\r\n");
-                        char *error_pos = strstr(s_uart_rx_buffer, "ERROR\r\n");
-                        char *cme_error_pos = strstr(s_uart_rx_buffer, "+CME ERROR:");
-                        char *cms_error_pos = strstr(s_uart_rx_buffer, "+CMS ERROR:");
-                        char *prompt_pos = strstr(s_uart_rx_buffer, "> "); // For CMGS prompt
-
-                        if (ok_pos) {
-                            xEventGroupSetBits(s_at_response_event_group, AT_RESPONSE_OK_BIT);
-                        } else if (error_pos || cme_error_pos || cms_error_pos || prompt_pos) {
-                            xEventGroupSetBits(s_at_response_event_group, AT_RESPONSE_ERROR_BIT);
-                        }
-
-                        // Check for +CMT URC
-                        char *cmt_pos = strstr(s_uart_rx_buffer, "+CMT:");
-                        if (cmt_pos) {
-                            // Look for the end of the +CMT URC block: two \r\n sequences after +CMT: header
-                            // +CMT: "sender",,"timestamp"\r\n<content>\r\n
-                            char *first_crlf = strstr(cmt_pos, "\r\n");
-                            if (first_crlf) {
-                                char *second_crlf = strstr(first_crlf + 2, "\r\n"); // Look for second \r\n after the first
-                                if (second_crlf) {
-                                    // Found a complete +CMT URC block
-                                    xEventGroupSetBits(s_at_response_event_group, AT_RESPONSE_URC_BIT);
-                                }
-                            }
+                case UART_PATTERN_DET: {
+                    // 位置都相对于当前读指针;已积压的多行一次读完,只唤醒一次
+                    int pos = uart_pattern_pop_pos(ctx->modem->uart.num);
+                    int next;
+                    while (pos >= 0 && (next = uart_pattern_pop_pos(ctx->modem->uart.num)) >= 0) {
+                        pos = next;
+                    }
+                    // pos < 0: 该行已随前一批或空闲超时读走
+                    if (pos >= 0) {
+                        rx_forward(ctx, dtmp, (size_t)pos + 1);
+                        // 模组在每个URC/结果码前发的空行不值得唤醒一次
+                        if (pos > 1 || (pos == 1 && dtmp[0] != '\r')) {
+                            notify_rx_consumer(ctx);
                         }
                     }
-                    xSemaphoreGive(s_uart_rx_mutex);
                     break;
-                case UART_FIFO_OVF:
-                    ESP_LOGW(TAG, "UART FIFO overflow");
-                    uart_flush_input(UART_PORT_NUM);
-                    xQueueReset(s_uart_event_queue); // Use the stored queue handle
+                }
+                case UART_DATA:
+                    if (event.timeout_flag && uart_pattern_get_pos(ctx->modem->uart.num) < 0) {
+                        rx_forward_buffered(ctx, dtmp);
+                    }
+                    break;
+                case UART_FIFO_OVF: {
+                    // 硬件FIFO已丢字节,缓冲中的数据与之后的数据接不上,只能丢弃重新同步
+                    size_t flushed = 0;
+                    uart_get_buffered_data_len(ctx->modem->uart.num, &flushed);
+                    ESP_LOGW(TAG, "UART FIFO overflow, flushing %u bytes", (unsigned)flushed);
+                    atomic_fetch_add_explicit(&ctx->rx_fifo_overflows, 1, memory_order_relaxed);
+                    atomic_fetch_add_explicit(&ctx->rx_flushed_bytes, flushed, memory_order_relaxed);
+                    uart_flush_input(ctx->modem->uart.num);
+                    xQueueReset(ctx->uart_event_queue); // Use the stored queue handle
+                    uart_pattern_queue_reset(ctx->modem->uart.num, AT_RX_PATTERN_QUEUE_LEN);
+                    uart_line_framer_mark_gap(&ctx->rx_framer);
                     break;
+                }
                 case UART_BUFFER_FULL:
-                    ESP_LOGW(TAG, "UART RX buffer full");
-                    uart_flush_input(UART_PORT_NUM);
-                    xQueueReset(s_uart_event_queue); // Use the stored queue handle
+                    // 驱动缓冲满时尚未丢数据(驱动暂停接收中断,开启流控时RTS同时挡住模组),
+                    // 取走全部缓冲数据即可恢复,不再清空
+                    ESP_LOGW(TAG, "UART RX buffer full, draining");
+                    atomic_fetch_add_explicit(&ctx->rx_buffer_full, 1, memory_order_relaxed);
+                    rx_forward_buffered(ctx, dtmp);
                     break;
-                case UART_BREAK:
-                case UART_PARITY_ERR:
                 case UART_FRAME_ERR:
+                    // 波特率不匹配时最先表现为帧错误
+                    atomic_fetch_add_explicit(&ctx->rx_frame_errors, 1, memory_order_relaxed);
+                    ESP_LOGW(TAG, "UART frame error at %lu baud", (unsigned long)atomic_load(&ctx->uart_baud));
+                    break;
+                case UART_PARITY_ERR:
+                    atomic_fetch_add_explicit(&ctx->rx_parity_errors, 1, memory_order_relaxed);
+                    ESP_LOGW(TAG, "UART parity error");
+                    break;
+                case UART_BREAK:
                 case UART_DATA_BREAK:
-                case UART_PATTERN_DET:
                 case UART_WAKEUP: // Added to handle the switch error
                 case UART_EVENT_MAX:
                     ESP_LOGW(TAG, "UART event type: %d", event.type);
@@ -272,75 +505,420 @@ static void uart_event_task(void *pvParameters) {
     vTaskDelete(NULL);
 }
 
+static bool line_starts_with(const char *line, const char *prefix) {
+    return strncmp(line, prefix, strlen(prefix)) == 0;
+}
+
+// 把一行追加到命令的响应中,保持与原始串口数据相同的"\r\n<行>\r\n"格式
+static void at_command_append_line(at_command_t *cmd, const char *line, int len) {
+    if (cmd->response == NULL || cmd->response_size == 0) {
+        return;
+    }
+    size_t avail = cmd->response_size - cmd->response_len;
+    int n = snprintf(cmd->response + cmd->response_len, avail, "\r\n%.*s\r\n", len, line);
+    if (n > 0) {
+        cmd->response_len += (size_t)n < avail ? (size_t)n : avail - 1;
+    }
+}
 
-static bool has_complete_sms_urc_locked(void) {
-    char *cmt_pos = strstr(s_uart_rx_buffer, "+CMT:");
-    if (cmt_pos == NULL) {
-        return false;
+static void at_record_latency(uart_at_ctx_t *ctx, uint32_t latency_ms) {
+    uint32_t count = atomic_load(&ctx->at_cmd_count) + 1;
+    ctx->at_cmd_latency_total_ms += latency_ms;
+    atomic_store(&ctx->at_cmd_count, count);
+    atomic_store(&ctx->at_cmd_latency_last_ms, latency_ms);
+    atomic_store(&ctx->at_cmd_latency_avg_ms, (uint32_t)(ctx->at_cmd_latency_total_ms / count));
+    if (latency_ms > atomic_load(&ctx->at_cmd_latency_max_ms)) {
+        atomic_store(&ctx->at_cmd_latency_max_ms, latency_ms);
+    }
+}
+
+// 发出队首命令(当前没有执行中的命令时)
+static void at_pump(uart_at_ctx_t *ctx) {
+    if (ctx->at_inflight != NULL || ctx->at_queue_count == 0) {
+        return;
     }
 
-    char *first_crlf = strstr(cmt_pos, "\r\n");
-    return first_crlf != NULL && strstr(first_crlf + 2, "\r\n") != NULL;
+    at_command_t *cmd = ctx->at_queue[ctx->at_queue_head];
+    ctx->at_queue_head = (ctx->at_queue_head + 1) % AT_CMD_QUEUE_LEN;
+    ctx->at_queue_count--;
+
+    ctx->at_inflight = cmd;
+    cmd->sent_at = xTaskGetTickCount();
+    uart_write_bytes(ctx->modem->uart.num, cmd->cmd, strlen(cmd->cmd));
+    uart_write_bytes(ctx->modem->uart.num, "\r\n", 2); // AT commands usually end with CR+LF
+    modem_uart_capture(&ctx->modem->uart, UART_CAPTURE_TX, cmd->cmd, strlen(cmd->cmd));
+    modem_uart_capture(&ctx->modem->uart, UART_CAPTURE_TX, "\r\n", 2);
+}
+
+// 结束执行中的命令,通知提交者并立即发出下一条
+static void at_command_complete(uart_at_ctx_t *ctx, at_result_t result) {
+    at_command_t *cmd = ctx->at_inflight;
+
+    ctx->at_inflight = NULL;
+    cmd->latency_ms = pdTICKS_TO_MS(xTaskGetTickCount() - cmd->sent_at);
+    if (result == AT_RESULT_TIMEOUT) {
+        atomic_fetch_add(&ctx->at_cmd_timeouts, 1);
+    } else {
+        at_record_latency(ctx, cmd->latency_ms);
+    }
+    cmd->result = result;
+    if (cmd->on_done) {
+        cmd->on_done(ctx, cmd);
+    }
+    at_pump(ctx);
 }
 
-static void process_pending_sms_urcs_locked(void) {
-    int processed_len;
+/**
+ * @brief 把命令加入发送队列,前面的命令完成后自动发出
+ *
+ * 只能在uart_at_task中调用。cmd在完成前必须保持有效;完成后result不再是
+ * AT_RESULT_NONE,并调用on_done(如有)。on_done中不得阻塞等待其他命令。
+ *
+ * @return ESP_OK,队列满时返回ESP_ERR_NO_MEM
+ */
+static esp_err_t at_submit(uart_at_ctx_t *ctx, at_command_t *cmd) {
+    if (ctx->at_queue_count == AT_CMD_QUEUE_LEN) {
+        ESP_LOGE(TAG, "AT command queue full");
+        return ESP_ERR_NO_MEM;
+    }
+
+    cmd->response_len = 0;
+    if (cmd->response != NULL && cmd->response_size > 0) {
+        cmd->response[0] = '\0';
+    }
+    cmd->result = AT_RESULT_NONE;
+    cmd->payload_sent = false;
+    cmd->latency_ms = 0;
+    ctx->at_queue[(ctx->at_queue_head + ctx->at_queue_count) % AT_CMD_QUEUE_LEN] = cmd;
+    ctx->at_queue_count++;
+
+    // Process complete SMS reports first so earlier lines do not end up in
+    // this command's response. A report still arriving stays in the ring.
+    if (ctx->at_inflight == NULL) {
+        process_pending_sms_urcs(ctx);
+    }
+    at_pump(ctx);
+    return ESP_OK;
+}
 
-    do {
-        processed_len = handle_urc(s_uart_rx_buffer);
-        if (processed_len > 0) {
-            memmove(s_uart_rx_buffer,
-                    s_uart_rx_buffer + processed_len,
-                    s_uart_rx_buffer_idx - processed_len + 1);
-            s_uart_rx_buffer_idx -= processed_len;
-            ESP_LOGD(TAG, "Buffer after URC processing (len=%d)", s_uart_rx_buffer_idx);
+// 检查执行中命令的超时,以及没有行结束符的"> "提示
+static void at_check_inflight(uart_at_ctx_t *ctx) {
+    if (ctx->at_inflight == NULL) {
+        return;
+    }
+    // 提示之后的数据到达前它一直留在缓冲末尾,按起始位置识别,避免同一个提示处理两次
+    size_t prompt_at = atomic_load_explicit(&ctx->rx_framer.tail, memory_order_relaxed);
+    if (prompt_at != ctx->at_prompt_tail && uart_line_framer_partial_equals(&ctx->rx_framer, "> ")) {
+        at_command_t *cmd = ctx->at_inflight;
+        ctx->at_prompt_tail = prompt_at;
+        if (cmd->payload != NULL && !cmd->payload_sent) {
+            // 发送数据后命令继续执行,以之后的OK/ERROR结束
+            uart_write_bytes(ctx->modem->uart.num, cmd->payload, cmd->payload_len);
+            modem_uart_capture(&ctx->modem->uart, UART_CAPTURE_TX, cmd->payload, cmd->payload_len);
+            cmd->payload_sent = true;
+        } else {
+            // 不需要输入的命令收到提示: 发ESC让模组退出输入状态,命令按失败结束
+            uart_write_bytes(ctx->modem->uart.num, "\x1b", 1);
+            modem_uart_capture(&ctx->modem->uart, UART_CAPTURE_TX, "\x1b", 1);
+            at_command_complete(ctx, AT_RESULT_ERROR);
         }
-    } while (processed_len > 0 && s_uart_rx_buffer_idx > 0);
+    } else if (xTaskGetTickCount() - ctx->at_inflight->sent_at >= ctx->at_inflight->timeout) {
+        at_command_complete(ctx, AT_RESULT_TIMEOUT);
+    }
+}
 
-    if (has_complete_sms_urc_locked()) {
-        xEventGroupSetBits(s_at_response_event_group, AT_RESPONSE_URC_BIT);
-    } else {
-        xEventGroupClearBits(s_at_response_event_group, AT_RESPONSE_URC_BIT);
+// 距执行中命令超时或去重表快照还剩的tick数,最多max_wait
+static TickType_t at_next_wait(uart_at_ctx_t *ctx, TickType_t max_wait) {
+    max_wait = sms_dedup_snapshot_wait(max_wait);
+    if (ctx->at_inflight == NULL) {
+        return max_wait;
+    }
+    TickType_t elapsed = xTaskGetTickCount() - ctx->at_inflight->sent_at;
+    TickType_t remaining = elapsed < ctx->at_inflight->timeout ? ctx->at_inflight->timeout - elapsed : 0;
+    if (remaining == 0) {
+        remaining = 1;
+    }
+    return remaining < max_wait ? remaining : max_wait;
+}
+
+// 就绪URC可能在命令执行期间到达,"+CPIN: READY"也是AT+CPIN?的响应,都照常继续处理
+static bool urc_modem_ready(uart_at_ctx_t *ctx, const char *line, int len, uint32_t flags) {
+    ctx->modem_ready_urcs |= flags;
+    return false;
+}
+
+#if CONFIG_APP_SMS_PDU_MODE
+static bool urc_sms_stored(uart_at_ctx_t *ctx, const char *line, int len, uint32_t flags) {
+    // 新短信已存入模组,由主循环批量读取
+    ESP_LOGI(TAG, "New SMS stored on the modem.");
+    ctx->store_drain_pending = true;
+    ctx->sms_activity_tick = xTaskGetTickCount();
+    return true;
+}
+#endif
+
+#define AT_URC(prefix, handler, arg) { prefix, sizeof(prefix) - 1, handler, arg }
+
+// 内置处理函数直接操作所属模组的上下文,flags取表中给出的常量
+typedef struct {
+    const char *prefix;
+    size_t prefix_len;
+    bool (*handler)(uart_at_ctx_t *ctx, const char *line, int len, uint32_t flags);
+    uint32_t flags;
+} at_builtin_urc_t;
+
+static const at_builtin_urc_t s_builtin_urc_handlers[] = {
+    AT_URC("RDY", urc_modem_ready, MODEM_URC_RDY),
+    AT_URC("+CPIN: READY", urc_modem_ready, MODEM_URC_SIM_READY),
+    AT_URC("SMS Ready", urc_modem_ready, MODEM_URC_SMS_READY),
+    AT_URC("+QIND: SMS DONE", urc_modem_ready, MODEM_URC_SMS_READY),
+#if CONFIG_APP_SMS_PDU_MODE
+    AT_URC("+CMTI:", urc_sms_stored, 0),
+#endif
+};
+
+// 状态类URC全部缓存到本模组的modem_status,其他模块读取状态无需再发AT命令;
+// arg在分发时为该模组的状态缓存
+static const at_urc_handler_t s_status_urc_handlers[] = {
+    AT_URC("+CPIN:", modem_status_on_cpin, NULL),
+    AT_URC("+CREG:", modem_status_on_reg, NULL),
+    AT_URC("+CGREG:", modem_status_on_reg, NULL),
+    AT_URC("+CEREG:", modem_status_on_reg, NULL),
+    AT_URC("+CSQ:", modem_status_on_csq, NULL),
+    AT_URC("^MODE:", modem_status_on_mode, NULL),
+    AT_URC("+NITZ:", modem_status_on_time, NULL),
+    AT_URC("+CTZV:", modem_status_on_time, NULL),
+    AT_URC("+CCLK:", modem_status_on_time, NULL),
+    AT_URC("+CPMS:", modem_status_on_cpms, NULL),
+};
+
+#define AT_URC_BUILTIN_COUNT (sizeof(s_builtin_urc_handlers) / sizeof(s_builtin_urc_handlers[0]))
+#define AT_URC_STATUS_COUNT (sizeof(s_status_urc_handlers) / sizeof(s_status_urc_handlers[0]))
+#define AT_URC_REGISTERED_BASE (AT_URC_BUILTIN_COUNT + AT_URC_STATUS_COUNT)
+
+_Static_assert(AT_URC_REGISTERED_BASE + AT_URC_HANDLERS_MAX <= AT_URC_IDS_MAX,
+               "AT_URC_IDS_MAX too small for the URC handler tables");
+
+static unsigned urc_bucket(const char *s) {
+    return (((uint8_t)s[0] * 31u + (uint8_t)s[1]) * 31u + (uint8_t)s[2]) & (AT_URC_BUCKETS - 1);
+}
+
+// 追加到所属链的末尾;编号只增不减,链保持升序
+static void urc_index_add(at_urc_index_t *index, uint8_t id, const char *prefix, size_t prefix_len) {
+    _Atomic uint8_t *link = prefix_len >= AT_URC_KEY_LEN ? &index->head[urc_bucket(prefix)] : &index->short_head;
+    uint8_t cur;
+    while ((cur = atomic_load_explicit(link, memory_order_relaxed)) != AT_URC_ID_NONE) {
+        link = &index->next[cur];
+    }
+    atomic_store_explicit(&index->next[id], AT_URC_ID_NONE, memory_order_relaxed);
+    // 条目写完再发布,uart_at_task随时可能在分发
+    atomic_store_explicit(link, id, memory_order_release);
+}
+
+static void urc_index_init(at_urc_index_t *index) {
+    for (size_t i = 0; i < AT_URC_BUCKETS; i++) {
+        atomic_init(&index->head[i], AT_URC_ID_NONE);
+    }
+    atomic_init(&index->short_head, AT_URC_ID_NONE);
+    for (size_t i = 0; i < AT_URC_BUILTIN_COUNT; i++) {
+        urc_index_add(index, (uint8_t)i, s_builtin_urc_handlers[i].prefix, s_builtin_urc_handlers[i].prefix_len);
+    }
+    for (size_t i = 0; i < AT_URC_STATUS_COUNT; i++) {
+        urc_index_add(index, (uint8_t)(AT_URC_BUILTIN_COUNT + i), s_status_urc_handlers[i].prefix,
+                      s_status_urc_handlers[i].prefix_len);
+    }
+}
+
+esp_err_t uart_at_register_urc_handler(modem_instance_t *modem, const char *prefix,
+                                       uart_at_urc_handler_t handler, void *arg) {
+    if (prefix == NULL || prefix[0] == '\0' || handler == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (modem->ctx == NULL || atomic_load(&modem->backend) != &uart_at_backend) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    uart_at_ctx_t *ctx = modem->ctx;
+    size_t count = atomic_load_explicit(&ctx->urc_handler_count, memory_order_relaxed);
+    if (count >= AT_URC_HANDLERS_MAX) {
+        return ESP_ERR_NO_MEM;
     }
+    ctx->urc_handlers[count] = (at_urc_handler_t){ prefix, strlen(prefix), handler, arg };
+    urc_index_add(&ctx->urc_index, (uint8_t)(AT_URC_REGISTERED_BASE + count), prefix, strlen(prefix));
+    atomic_store_explicit(&ctx->urc_handler_count, count + 1, memory_order_relaxed);
+    return ESP_OK;
 }
 
-static void process_pending_sms_urcs(void) {
-    xSemaphoreTake(s_uart_rx_mutex, portMAX_DELAY);
-    process_pending_sms_urcs_locked();
-    xSemaphoreGive(s_uart_rx_mutex);
+static bool urc_prefix_matches(const char *prefix, size_t prefix_len, const char *line, int len) {
+    return (size_t)len >= prefix_len && memcmp(line, prefix, prefix_len) == 0;
 }
 
-static void clear_command_data_preserving_sms_locked(void) {
-    char *cmt_start = strstr(s_uart_rx_buffer, "+CMT:");
+static bool urc_dispatch_id(uart_at_ctx_t *ctx, uint8_t id, const char *line, int len, bool *matched) {
+    if (id < AT_URC_BUILTIN_COUNT) {
+        const at_builtin_urc_t *h = &s_builtin_urc_handlers[id];
+        if (!urc_prefix_matches(h->prefix, h->prefix_len, line, len)) {
+            return false;
+        }
+        *matched = true;
+        return h->handler(ctx, line, len, h->flags);
+    }
 
-    if (cmt_start != NULL) {
-        int preserved_len = s_uart_rx_buffer_idx - (int)(cmt_start - s_uart_rx_buffer);
-        memmove(s_uart_rx_buffer, cmt_start, preserved_len);
-        s_uart_rx_buffer_idx = preserved_len;
-        s_uart_rx_buffer[s_uart_rx_buffer_idx] = '\0';
-        ESP_LOGD(TAG, "Preserved %d bytes of an incomplete SMS URC", s_uart_rx_buffer_idx);
+    const at_urc_handler_t *h;
+    void *arg;
+    if (id < AT_URC_REGISTERED_BASE) {
+        // 状态缓存处理函数的arg为本模组的状态缓存
+        h = &s_status_urc_handlers[id - AT_URC_BUILTIN_COUNT];
+        arg = &ctx->status;
     } else {
-        s_uart_rx_buffer_idx = 0;
-        s_uart_rx_buffer[0] = '\0';
+        h = &ctx->urc_handlers[id - AT_URC_REGISTERED_BASE];
+        arg = h->arg;
+    }
+    if (!urc_prefix_matches(h->prefix, h->prefix_len, line, len)) {
+        return false;
     }
+    *matched = true;
+    return h->handler(line, len, arg);
 }
 
-static void wait_for_recovery_retry(TickType_t delay_ticks) {
-    TickType_t start_time = xTaskGetTickCount();
+static bool urc_dispatch_chain(uart_at_ctx_t *ctx, const _Atomic uint8_t *head,
+                               const char *line, int len, bool *matched) {
+    bool consumed = false;
+    uint8_t id = atomic_load_explicit(head, memory_order_acquire);
+    while (id != AT_URC_ID_NONE) {
+        consumed |= urc_dispatch_id(ctx, id, line, len, matched);
+        id = atomic_load_explicit(&ctx->urc_index.next[id], memory_order_acquire);
+    }
+    return consumed;
+}
 
-    while (xTaskGetTickCount() - start_time < delay_ticks) {
-        TickType_t elapsed = xTaskGetTickCount() - start_time;
-        TickType_t remaining = delay_ticks - elapsed;
-        EventBits_t bits = xEventGroupWaitBits(s_at_response_event_group,
-                                               AT_RESPONSE_URC_BIT,
-                                               pdTRUE,
-                                               pdFALSE,
-                                               remaining);
-        if (bits & AT_RESPONSE_URC_BIT) {
-            process_pending_sms_urcs();
-        } else {
-            break;
+/**
+ * @brief 把一行交给前缀匹配的内置及注册的处理函数
+ *
+ * @param matched 至少有一个处理函数匹配时置true
+ * @return true 该行已被消费,不再归入命令响应
+ */
+static bool at_dispatch_urc(uart_at_ctx_t *ctx, const char *line, int len, bool *matched) {
+    bool consumed = false;
+    if (len >= AT_URC_KEY_LEN) {
+        consumed |= urc_dispatch_chain(ctx, &ctx->urc_index.head[urc_bucket(line)], line, len, matched);
+    }
+    consumed |= urc_dispatch_chain(ctx, &ctx->urc_index.short_head, line, len, matched);
+    return consumed;
+}
+
+/**
+ * @brief 按整行分类处理(+CMT已在process_pending_sms_urcs中处理):
+ *        先按前缀分发给URC处理函数,命令执行期间未被消费的行归入命令响应
+ */
+static void at_handle_line(uart_at_ctx_t *ctx, const char *line, int len) {
+    if (len == 0) {
+        return;
+    }
+
+    bool matched = false;
+    if (at_dispatch_urc(ctx, line, len, &matched)) {
+        return;
+    }
+
+    at_command_t *cmd = ctx->at_inflight;
+    if (cmd != NULL) {
+        if (strcmp(line, "OK") == 0) {
+            at_command_append_line(cmd, line, len);
+            at_command_complete(ctx, AT_RESULT_OK);
+            return;
+        }
+        if (strcmp(line, "ERROR") == 0 ||
+            line_starts_with(line, "+CME ERROR:") ||
+            line_starts_with(line, "+CMS ERROR:")) {
+            // +CME ERROR/+CMS ERROR是AT命令的终止响应，不是普通URC
+            at_command_append_line(cmd, line, len);
+            at_command_complete(ctx, AT_RESULT_ERROR);
+            return;
+        }
+        if (cmd->match == NULL || line_starts_with(line, cmd->match)) {
+            at_command_append_line(cmd, line, len);
+            return;
+        }
+    }
+
+    if (!matched && (line[0] == '+' || line[0] == '^')) {
+        // 没有处理函数的URC (如+CGEV)
+        ESP_LOGD(TAG, "Ignoring unhandled URC (len=%d)", len);
+    }
+}
+
+// 取出并处理缓冲中所有完整的行,只在uart_at_task上下文中调用。
+// +CMT头和正文直接在环形缓冲中解析,其余行才拷出到s_rx_line
+static void process_pending_sms_urcs(uart_at_ctx_t *ctx) {
+    uart_line_span_t span;
+
+    while (uart_line_framer_peek_line(&ctx->rx_framer, &span)) {
+        if (ctx->cmt_body_pending) {
+            // +CMT头之后紧跟的一行就是短信正文
+            ctx->cmt_body_pending = false;
+            handle_cmt_body(ctx, &span);
+            uart_line_framer_consume_line(&ctx->rx_framer);
+            continue;
         }
+        if (uart_line_span_starts_with(&span, "+CMT:")) {
+#if !CONFIG_APP_SMS_PDU_MODE
+            parse_cmt_header(&span, ctx->cmt_sender, sizeof(ctx->cmt_sender));
+#else
+            ctx->cmt_store_index = SMS_STORE_INDEX_NONE;
+#endif
+            // PDU模式: +CMT: [<alpha>],<length>,发件人等全部在下一行的PDU中
+            ctx->cmt_body_pending = true;
+            ctx->sms_activity_tick = xTaskGetTickCount();
+            uart_line_framer_consume_line(&ctx->rx_framer);
+            continue;
+        }
+#if CONFIG_APP_SMS_PDU_MODE
+        if (uart_line_span_starts_with(&span, "+CMGL:")) {
+            // +CMGL: <index>,<stat>,[<alpha>],<length>,下一行是PDU,与+CMT正文同样处理
+            unsigned index = 0;
+            size_t pos = strlen("+CMGL:");
+            while (pos < span.len && uart_line_span_at(&span, pos) == ' ') {
+                pos++;
+            }
+            while (pos < span.len && uart_line_span_at(&span, pos) >= '0' &&
+                   uart_line_span_at(&span, pos) <= '9' && index < SMS_STORE_INDEX_NONE) {
+                index = index * 10 + (uart_line_span_at(&span, pos++) - '0');
+            }
+            ctx->cmt_store_index = index < SMS_STORE_INDEX_NONE ? (uint16_t)index : SMS_STORE_INDEX_NONE;
+            ctx->cmt_body_pending = true;
+            ctx->sms_activity_tick = xTaskGetTickCount();
+            uart_line_framer_consume_line(&ctx->rx_framer);
+            continue;
+        }
+#endif
+
+        int len = uart_line_framer_next_line(&ctx->rx_framer, ctx->rx_line, sizeof(ctx->rx_line));
+        at_handle_line(ctx, ctx->rx_line, len);
+    }
+}
+
+// 等待新数据到达并处理,超时或处理完返回;同时推进AT命令队列
+static void wait_for_rx_data(uart_at_ctx_t *ctx, TickType_t wait_ticks) {
+    ulTaskNotifyTake(pdTRUE, at_next_wait(ctx, wait_ticks));
+    process_pending_sms_urcs(ctx);
+    at_check_inflight(ctx);
+    sms_dedup_snapshot_if_due();
+}
+
+static void wait_for_recovery_retry(uart_at_ctx_t *ctx, TickType_t delay_ticks) {
+    TickType_t start_time = xTaskGetTickCount();
+    TickType_t elapsed;
+
+    while ((elapsed = xTaskGetTickCount() - start_time) < delay_ticks) {
+        wait_for_rx_data(ctx, delay_ticks - elapsed);
+    }
+}
+
+/**
+ * @brief 等待已提交的命令完成,期间URC照常处理
+ */
+static void at_wait(uart_at_ctx_t *ctx, const at_command_t *cmd) {
+    while (cmd->result == AT_RESULT_NONE) {
+        wait_for_rx_data(ctx, portMAX_DELAY);
     }
 }
 
@@ -352,265 +930,228 @@ static void wait_for_recovery_retry(TickType_t delay_ticks) {
  * @param response_buffer Buffer to store the response.
  * @param buffer_size Size of the response_buffer.
  * @param timeout_ticks Timeout in FreeRTOS ticks.
- * @return ESP_OK if "OK" is found in response, ESP_FAIL otherwise.
+ * @return ESP_OK if "OK" is found in response, ESP_ERR_TIMEOUT if no final response arrived, ESP_FAIL otherwise.
  */
-static esp_err_t at_send_command(const char *cmd, char *response_buffer, size_t buffer_size, TickType_t timeout_ticks) {
+static esp_err_t at_send_command(uart_at_ctx_t *ctx, const char *cmd, char *response_buffer, size_t buffer_size, TickType_t timeout_ticks) {
     ESP_LOGD(TAG, "Sending AT command");
 
-    xSemaphoreTake(s_uart_rx_mutex, portMAX_DELAY);
-    // Process complete SMS reports first. If a report is still arriving, keep
-    // it in the buffer instead of discarding it for the command transaction.
-    process_pending_sms_urcs_locked();
-    clear_command_data_preserving_sms_locked();
-    xSemaphoreGive(s_uart_rx_mutex);
-
-    xEventGroupClearBits(s_at_response_event_group, AT_RESPONSE_OK_BIT | AT_RESPONSE_ERROR_BIT);
-
-    uart_write_bytes(UART_PORT_NUM, cmd, strlen(cmd));
-    uart_write_bytes(UART_PORT_NUM, "\r\n", 2); // AT commands usually end with CR+LF
-
-    EventBits_t uxBits = xEventGroupWaitBits(s_at_response_event_group,
-                                             AT_RESPONSE_OK_BIT | AT_RESPONSE_ERROR_BIT,
-                                             pdTRUE, // Clear bits on exit
-                                             pdFALSE, // Don't wait for all bits
-                                             timeout_ticks);
-
-    xSemaphoreTake(s_uart_rx_mutex, portMAX_DELAY);
-    strncpy(response_buffer, s_uart_rx_buffer, buffer_size - 1);
-    response_buffer[buffer_size - 1] = '\0';
-    process_pending_sms_urcs_locked();
-    clear_command_data_preserving_sms_locked();
-    xSemaphoreGive(s_uart_rx_mutex);
-
-    if (uxBits & AT_RESPONSE_OK_BIT) {
-        ESP_LOGD(TAG, "AT command succeeded (response_len=%u)",
-                 (unsigned)strlen(response_buffer));
+    at_command_t command = {
+        .cmd = cmd,
+        .timeout = timeout_ticks,
+        .response = response_buffer,
+        .response_size = buffer_size,
+    };
+    if (at_submit(ctx, &command) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    at_wait(ctx, &command);
+
+    if (command.result == AT_RESULT_OK) {
+        ESP_LOGD(TAG, "AT command succeeded in %lu ms (response_len=%u)",
+                 (unsigned long)command.latency_ms, (unsigned)command.response_len);
         return ESP_OK;
-    } else if (uxBits & AT_RESPONSE_ERROR_BIT) {
+    } else if (command.result == AT_RESULT_ERROR) {
         ESP_LOGW(TAG, "AT command failed (response_len=%u)",
-                 (unsigned)strlen(response_buffer));
+                 (unsigned)command.response_len);
         return ESP_FAIL;
     } else {
-        if (response_buffer[0] != '\0') {
+        if (command.response_len > 0) {
             ESP_LOGE(TAG, "AT command timed out (partial_response_len=%u)",
-                     (unsigned)strlen(response_buffer));
+                     (unsigned)command.response_len);
         } else {
             ESP_LOGE(TAG, "AT command timed out (no response received)");
         }
-        return ESP_FAIL;
+        return ESP_ERR_TIMEOUT;
     }
 }
 
 /**
- * @brief Parses a +CMT response (Text Mode) to extract sender and content.
- * Example: +CMT: "+8613800000000","","23/08/15,10:30:00+32"\r\nHello World\r\n
+ * @brief 把多条命令合并成一行,一次往返发送(如AT+CMGF=0;+CNMI=2,2,0,0,0)
  *
- * 支持SMS分段拼接:
- * - 对于长SMS(hex内容>500),会自动累积到缓冲区
- * - 只有收到最后一段时才返回ESP_OK和完整消息
- * - 中间片段返回ESP_ERR_INVALID_STATE,表示需要等待更多片段
+ * 合并后的命令出错时无法得知是哪一条失败,此时逐条重发,由ok[i]给出每条的结果。
+ * 超时则不逐条重发(模组没有应答,每条都会再等满超时),ok[i]全部为false。
  *
- * @param response The full AT response string.
- * @param sms_msg Pointer to sms_message_t to fill.
- * @return ESP_OK on success (complete SMS ready),
- *         ESP_ERR_INVALID_STATE if waiting for more fragments,
- *         ESP_FAIL if parsing fails.
+ * @param cmds 不含"AT"前缀的命令,如"E0"、"+CMGF=0"
+ * @param ok 输出,每条命令是否成功
+ * @return 全部成功时返回ESP_OK,合并的命令超时返回ESP_ERR_TIMEOUT
  */
-static esp_err_t parse_cmt_text_mode_response(const char *response, sms_message_t *sms_msg) {
-    const char *cmt_prefix = "+CMT:";
-    const char *sender_hex_start = NULL;
-    const char *sender_hex_end = NULL;
-    const char *content_hex_start = NULL;
-    char decoded_sender[32] = {0};
-
-    if (!response || !sms_msg) return ESP_FAIL;
-
-    const char *line = strstr(response, cmt_prefix);
-    if (!line) {
-        ESP_LOGW(TAG, "CMT prefix not found in response.");
-        return ESP_FAIL;
-    }
+static esp_err_t at_send_chain(uart_at_ctx_t *ctx, const char *const *cmds, size_t count, bool *ok,
+                               char *response_buffer, size_t buffer_size, TickType_t timeout_ticks) {
+    char line[AT_CHAIN_MAX_LEN];
+    size_t len = snprintf(line, sizeof(line), "AT");
 
-    // Find sender number (between quotes after +CMT:)
-    sender_hex_start = strchr(line, '"'); // First quote
-    if (sender_hex_start) {
-        sender_hex_start++; // Move past the quote
-        sender_hex_end = strchr(sender_hex_start, '"'); // Sender number end
-        if (sender_hex_end) {
-            // Extract the UCS2 hex string for sender
-            char temp_sender_hex[sizeof(decoded_sender) * 2 + 1]; // Max possible hex length
-            int len = sender_hex_end - sender_hex_start;
-            if (len > 0 && len < sizeof(temp_sender_hex)) {
-                strncpy(temp_sender_hex, sender_hex_start, len);
-                temp_sender_hex[len] = '\0';
-
-                // Decode UCS2 hex to UTF-8
-                decode_ucs2_hex_to_utf8(temp_sender_hex, decoded_sender, sizeof(decoded_sender));
-                char masked_sender[LOG_MASKED_PHONE_SIZE];
-                ESP_LOGD(TAG, "Decoded Sender: %s",
-                         log_mask_phone(decoded_sender, masked_sender, sizeof(masked_sender)));
-            } else {
-                ESP_LOGW(TAG, "Sender hex string too long or empty. Len: %d", len);
-                strncpy(decoded_sender, "UNKNOWN", sizeof(decoded_sender));
-            }
-        }
+    for (size_t i = 0; i < count && len < sizeof(line); i++) {
+        len += snprintf(line + len, sizeof(line) - len, "%s%s", i > 0 ? ";" : "", cmds[i]);
+    }
+    esp_err_t chain_ret = len < sizeof(line) ?
+                          at_send_command(ctx, line, response_buffer, buffer_size, timeout_ticks) : ESP_FAIL;
+    for (size_t i = 0; i < count; i++) {
+        ok[i] = chain_ret == ESP_OK;
+    }
+    if (chain_ret == ESP_OK || chain_ret == ESP_ERR_TIMEOUT) {
+        return chain_ret;
     }
 
-    // Find content (after the last line of +CMT: header and before next \r\n or end)
-    content_hex_start = strstr(line, "\r\n"); // End of +CMT: header line
-    if (content_hex_start) {
-        content_hex_start += 2; // Move past \r\n
-        const char *next_line_end = strstr(content_hex_start, "\r\n");
-        int content_hex_len;
-        if (next_line_end) {
-            content_hex_len = next_line_end - content_hex_start;
-        } else {
-            content_hex_len = strlen(content_hex_start); // Take till end if no next line
+    ESP_LOGW(TAG, "Chained AT command failed, retrying %u commands one by one", (unsigned)count);
+    esp_err_t ret = ESP_OK;
+    for (size_t i = 0; i < count; i++) {
+        snprintf(line, sizeof(line), "AT%s", cmds[i]);
+        ok[i] = at_send_command(ctx, line, response_buffer, buffer_size, timeout_ticks) == ESP_OK;
+        if (!ok[i]) {
+            ret = ESP_FAIL;
         }
+    }
+    return ret;
+}
 
-        // Trim trailing \r\n if present
-        while (content_hex_len > 0 && (content_hex_start[content_hex_len - 1] == '\r' || content_hex_start[content_hex_len - 1] == '\n')) {
-            content_hex_len--;
+esp_err_t uart_at_init(modem_instance_t *modem, QueueHandle_t sms_queue) {
+    // 重启时沿用已有的上下文: 删除标记、去重窗口等要跨越重新初始化保留
+    uart_at_ctx_t *ctx = modem->ctx;
+    if (ctx == NULL) {
+        ctx = calloc(1, sizeof(*ctx));
+        if (ctx == NULL) {
+            return ESP_ERR_NO_MEM;
         }
-
-        ESP_LOGD(TAG, "Content hex length: %d", content_hex_len);
-
-        if (content_hex_len > 0) {
-            // 使用动态分配来处理更长的hex字符串
-            char *temp_content_hex = malloc(content_hex_len + 1);
-            if (!temp_content_hex) {
-                ESP_LOGE(TAG, "Failed to allocate memory for content hex string");
-                return ESP_FAIL;
-            }
-
-            strncpy(temp_content_hex, content_hex_start, content_hex_len);
-            temp_content_hex[content_hex_len] = '\0';
-
-            char masked_sender[LOG_MASKED_PHONE_SIZE];
-            ESP_LOGI(TAG, "Processing SMS fragment: Sender='%s', hex_len=%d",
-                     log_mask_phone(decoded_sender, masked_sender, sizeof(masked_sender)),
-                     content_hex_len);
-
-            // 使用分段处理逻辑
-            esp_err_t fragment_result = process_sms_fragment(decoded_sender, temp_content_hex, content_hex_len, sms_msg);
-
-            free(temp_content_hex);
-
-            if (fragment_result == ESP_OK) {
-                ESP_LOGI(TAG, "Complete SMS assembled: Sender='%s', content_len=%u",
-                         log_mask_phone(sms_msg->sender, masked_sender, sizeof(masked_sender)),
-                         (unsigned)strlen(sms_msg->content));
-                return ESP_OK;
-            } else if (fragment_result == ESP_ERR_INVALID_STATE) {
-                ESP_LOGI(TAG, "SMS fragment stored, waiting for more fragments...");
-                return ESP_ERR_INVALID_STATE; // 需要等待更多片段
-            } else {
-                ESP_LOGE(TAG, "Failed to process SMS fragment");
-                return ESP_FAIL;
-            }
-        } else {
-            ESP_LOGW(TAG, "SMS content hex string is empty");
-            strncpy(sms_msg->content, "EMPTY", sizeof(sms_msg->content));
-            return ESP_FAIL;
+        if (modem_backend_nvs_name(modem, MODEM_NVS_NAMESPACE, ctx->nvs_namespace,
+                                   sizeof(ctx->nvs_namespace)) != ESP_OK) {
+            free(ctx);
+            return ESP_ERR_INVALID_SIZE;
         }
+        ctx->modem = modem;
+        modem_status_init(&ctx->status);
+        urc_index_init(&ctx->urc_index);
+        fragment_gap_init(&ctx->gaps);
+#if CONFIG_APP_SMS_PDU_MODE
+        ctx->cmt_store_index = SMS_STORE_INDEX_NONE;
+#endif
+        modem->ctx = ctx;
     }
-
-    ESP_LOGW(TAG, "Failed to parse SMS content from CMT response.");
-    return ESP_FAIL;
-}
-
-
-esp_err_t uart_at_init(QueueHandle_t sms_queue) {
-    s_sms_queue = sms_queue;
+    ctx->sms_queue = sms_queue;
 
     // Delete existing AT task if running (important for device restarts)
-    if (s_uart_at_task_handle != NULL) {
+    if (ctx->uart_at_task_handle != NULL) {
         ESP_LOGI(TAG, "UART AT task already running, deleting it first...");
-        vTaskDelete(s_uart_at_task_handle);
-        s_uart_at_task_handle = NULL;
+        vTaskDelete(ctx->uart_at_task_handle);
+        ctx->uart_at_task_handle = NULL;
         vTaskDelay(pdMS_TO_TICKS(100)); // Give time for task cleanup
     }
 
     // Delete existing UART event task if running (important for device restarts)
-    if (s_uart_event_task_handle != NULL) {
+    if (ctx->uart_event_task_handle != NULL) {
         ESP_LOGI(TAG, "UART event task already running, deleting it first...");
-        vTaskDelete(s_uart_event_task_handle);
-        s_uart_event_task_handle = NULL;
+        vTaskDelete(ctx->uart_event_task_handle);
+        ctx->uart_event_task_handle = NULL;
         vTaskDelay(pdMS_TO_TICKS(100)); // Give time for task cleanup
     }
 
-    // Clean up existing UART driver if already installed (important for device restarts)
-    if (uart_is_driver_installed(UART_PORT_NUM)) {
-        ESP_LOGI(TAG, "UART driver already installed on port %d, uninstalling first...", UART_PORT_NUM);
-        uart_driver_delete(UART_PORT_NUM);
-        vTaskDelay(pdMS_TO_TICKS(100)); // Give time for cleanup
-    }
-
-    // Create or reset synchronization primitives
-    if (s_uart_rx_mutex == NULL) {
-        s_uart_rx_mutex = xSemaphoreCreateMutex();
-    }
-    if (s_at_response_event_group == NULL) {
-        s_at_response_event_group = xEventGroupCreate();
-    } else {
-        // Clear all bits if event group already exists
-        xEventGroupClearBits(s_at_response_event_group, 0xFFFFFF);
-    }
-
-    // Clear UART RX buffer
-    s_uart_rx_buffer_idx = 0;
-    s_uart_rx_buffer[0] = '\0';
-
-    uart_config_t uart_config = {
-        .baud_rate = UART_BAUD_RATE,
-        .data_bits = UART_DATA_8_BITS,
-        .parity    = UART_PARITY_DISABLE,
-        .stop_bits = UART_STOP_BITS_1,
-        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
-        .source_clk = UART_SCLK_DEFAULT,
-    };
-    int intr_alloc_flags = 0;
-#if CONFIG_UART_ISR_IN_IRAM
-    intr_alloc_flags = ESP_INTR_FLAG_IRAM;
+    // Clear UART RX ring (both of its tasks are stopped at this point)
+    uart_line_framer_init(&ctx->rx_framer, ctx->rx_ring, sizeof(ctx->rx_ring));
+    ctx->at_prompt_tail = SIZE_MAX;
+    ctx->cmt_body_pending = false;
+#if CONFIG_APP_SMS_PDU_MODE
+    // 删除标记保留: 重启前已投递的短信不应再投递一次
+    ctx->store_mode = false;
+    ctx->store_enter_requested = false;
+    ctx->store_drain_pending = false;
+    atomic_store(&ctx->store_mode_active, 0);
 #endif
+    atomic_store(&ctx->rx_resync, false);
+    atomic_store(&ctx->uart_baud, UART_BAUD_RATE);
 
     // Install UART driver with event queue
-    // The last parameter is a pointer to the event queue handle
-    ESP_ERROR_CHECK(uart_driver_install(UART_PORT_NUM, BUF_SIZE * 2, BUF_SIZE * 2, 20, &s_uart_event_queue, intr_alloc_flags));
-    ESP_ERROR_CHECK(uart_param_config(UART_PORT_NUM, &uart_config));
-    ESP_ERROR_CHECK(uart_set_pin(UART_PORT_NUM, UART_TXD, UART_RXD, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
+    static const modem_uart_config_t uart = {
+        .rx_buffer_size = BUF_SIZE * 2,
+        .tx_buffer_size = BUF_SIZE * 2,
+        .event_queue_len = 20,
+        .pattern_queue_len = AT_RX_PATTERN_QUEUE_LEN,
+        .rx_full_thresh = AT_RX_FULL_THRESH,
+        .rx_timeout_symbols = AT_RX_TOUT_SYMBOLS,
+    };
+    esp_err_t err = modem_uart_install(&modem->uart, &uart, &ctx->uart_event_queue);
+    if (err != ESP_OK) {
+        return err;
+    }
 
     // Create a task to handle UART events and save the handle
-    xTaskCreate(uart_event_task, "uart_event_task", 3072, NULL, 10, &s_uart_event_task_handle);
+    xTaskCreate(uart_event_task, "uart_event_task", 3072, ctx, 10, &ctx->uart_event_task_handle);
 
-    ESP_LOGI(TAG, "UART AT manager initialized on port %d, TX:%d, RX:%d, Baud:%d",
-             UART_PORT_NUM, UART_TXD, UART_RXD, UART_BAUD_RATE);
+    ESP_LOGI(TAG, "UART AT manager for modem %u initialized on port %d, TX:%d, RX:%d, Baud:%d, "
+             "flow control: %s", modem->index, modem->uart.num, modem->uart.txd, modem->uart.rxd,
+             UART_BAUD_RATE, UART_FLOW_CTRL == UART_HW_FLOWCTRL_CTS_RTS ? "RTS/CTS" : "off");
 
     return ESP_OK;
 }
 
+void uart_at_get_stats(const modem_instance_t *modem, uart_at_stats_t *stats) {
+    const uart_at_ctx_t *ctx = modem->ctx;
+    if (ctx == NULL || atomic_load(&modem->backend) != &uart_at_backend) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    stats->rx_enqueue_failures = atomic_load(&ctx->rx_framer.overflow_events);
+    stats->rx_dropped_bytes = atomic_load(&ctx->rx_framer.dropped_bytes);
+    stats->rx_truncated_lines = atomic_load(&ctx->rx_framer.truncated_lines);
+    stats->rx_ring_high_water = atomic_load(&ctx->rx_high_water);
+    stats->rx_wakeups = atomic_load(&ctx->rx_wakeups);
+    stats->uart_baud_rate = atomic_load(&ctx->uart_baud);
+    stats->rx_bytes = atomic_load(&ctx->modem->rx_bytes);
+    stats->rx_peak_bytes_per_s = atomic_load(&ctx->modem->rx_peak_bytes_per_s);
+    stats->rx_frame_errors = atomic_load(&ctx->rx_frame_errors);
+    stats->rx_parity_errors = atomic_load(&ctx->rx_parity_errors);
+    stats->rx_fifo_overflows = atomic_load(&ctx->rx_fifo_overflows);
+    stats->rx_buffer_full = atomic_load(&ctx->rx_buffer_full);
+    stats->rx_flushed_bytes = atomic_load(&ctx->rx_flushed_bytes);
+#if CONFIG_APP_SMS_PDU_MODE
+    stats->sms_store_mode = atomic_load(&ctx->store_mode_active);
+    stats->sms_store_mode_switches = atomic_load(&ctx->store_mode_switches);
+    stats->sms_store_drained = atomic_load(&ctx->store_drained);
+    stats->sms_store_deleted = atomic_load(&ctx->store_deleted);
+#else
+    stats->sms_store_mode = 0;
+    stats->sms_store_mode_switches = 0;
+    stats->sms_store_drained = 0;
+    stats->sms_store_deleted = 0;
+#endif
+    stats->sms_reasm_live = atomic_load(&ctx->reasm_live);
+    stats->sms_reasm_bytes = atomic_load(&ctx->reasm_bytes);
+    stats->sms_reasm_evictions = atomic_load(&ctx->reasm_evictions);
+    stats->sms_reasm_timeouts = atomic_load(&ctx->reasm_timeouts);
+    stats->at_cmd_count = atomic_load(&ctx->at_cmd_count);
+    stats->at_cmd_timeouts = atomic_load(&ctx->at_cmd_timeouts);
+    stats->at_cmd_latency_last_ms = atomic_load(&ctx->at_cmd_latency_last_ms);
+    stats->at_cmd_latency_avg_ms = atomic_load(&ctx->at_cmd_latency_avg_ms);
+    stats->at_cmd_latency_max_ms = atomic_load(&ctx->at_cmd_latency_max_ms);
+    stats->modem_ready_ms = atomic_load(&ctx->modem_ready_ms);
+    stats->modem_warm_start = atomic_load(&ctx->modem_warm_start);
+    stats->telemetry_samples = atomic_load(&ctx->telemetry_samples);
+    stats->telemetry_failures = atomic_load(&ctx->telemetry_failures);
+    stats->telemetry_deferrals = atomic_load(&ctx->telemetry_deferrals);
+    stats->telemetry_latency_ms = atomic_load(&ctx->telemetry_latency_ms);
+    stats->telemetry_uart_us = atomic_load(&ctx->telemetry_uart_us);
+}
+
 // Helper function to get IMSI
-static esp_err_t get_sim_imsi(char *imsi_buffer, size_t buffer_size) {
+static esp_err_t get_sim_imsi(uart_at_ctx_t *ctx, char *imsi_buffer, size_t buffer_size) {
     char response[AT_RESPONSE_MAX_LEN];
-    if (at_send_command("AT+CIMI", response, sizeof(response), pdMS_TO_TICKS(AT_COMMAND_TIMEOUT_MS)) != ESP_OK) {
+    if (at_send_command(ctx, "AT+CIMI", response, sizeof(response), pdMS_TO_TICKS(AT_COMMAND_TIMEOUT_MS)) != ESP_OK) {
         ESP_LOGE(TAG, "Failed to get IMSI.");
         return ESP_FAIL;
     }
 
-    // Parse IMSI from response. It's usually the line before "OK"
-    // Example: \r\n460001234567890\r\n\r\nOK\r\n
-    char *start = strstr(response, "\r\n");
-    if (start) {
-        start += 2; // Move past the first \r\n
-        char *end = strstr(start, "\r\nOK"); // Find the start of OK
-        if (end) {
-            int len = end - start;
-            if (len > 0 && len < buffer_size) {
-                strncpy(imsi_buffer, start, len);
+    // Parse IMSI from response: the all-digit line before "OK"
+    // Example: \r\n460001234567890\r\n\r\nOK\r\n (an echoed "AT+CIMI" line is skipped)
+    const char *line = response;
+    while ((line = strstr(line, "\r\n")) != NULL) {
+        line += 2;
+        size_t len = strspn(line, "0123456789");
+        if (len > 0 && strncmp(line + len, "\r\n", 2) == 0) {
+            if (len < buffer_size) {
+                memcpy(imsi_buffer, line, len);
                 imsi_buffer[len] = '\0';
                 ESP_LOGI(TAG, "IMSI read successfully (%s)", LOG_REDACTED_VALUE);
                 return ESP_OK;
             }
+            break;
         }
     }
     ESP_LOGE(TAG, "Failed to parse IMSI from response (response_len=%u)",
@@ -619,9 +1160,9 @@ static esp_err_t get_sim_imsi(char *imsi_buffer, size_t buffer_size) {
 }
 
 // Helper function to get SIM operator name
-static esp_err_t get_sim_operator_name(char *operator_buffer, size_t buffer_size) {
+static esp_err_t get_sim_operator_name(uart_at_ctx_t *ctx, char *operator_buffer, size_t buffer_size) {
     char imsi[20]; // IMSI is typically 15 digits
-    if (get_sim_imsi(imsi, sizeof(imsi)) != ESP_OK) {
+    if (get_sim_imsi(ctx, imsi, sizeof(imsi)) != ESP_OK) {
         strncpy(operator_buffer, "UNKNOWN", buffer_size);
         return ESP_FAIL;
     }
@@ -637,13 +1178,13 @@ static esp_err_t get_sim_operator_name(char *operator_buffer, size_t buffer_size
     strncpy(mcc_mnc_prefix, imsi, 5);
     mcc_mnc_prefix[5] = '\0';
 
-    for (size_t i = 0; i < s_operator_map_size; i++) {
-        if (strcmp(mcc_mnc_prefix, s_operator_map[i].mcc_mnc_prefix) == 0) {
-            strncpy(operator_buffer, s_operator_map[i].operator_name_zh, buffer_size - 1);
-            operator_buffer[buffer_size - 1] = '\0';
-            ESP_LOGI(TAG, "SIM Operator: %s (IMSI prefix: %s)", operator_buffer, mcc_mnc_prefix);
-            return ESP_OK;
-        }
+    // 构建时由operators.csv生成的表,MNC为2位或3位均可匹配
+    const char *operator_name = operator_table_lookup_imsi(imsi);
+    if (operator_name != NULL) {
+        strncpy(operator_buffer, operator_name, buffer_size - 1);
+        operator_buffer[buffer_size - 1] = '\0';
+        ESP_LOGI(TAG, "SIM Operator: %s (IMSI prefix: %s)", operator_buffer, mcc_mnc_prefix);
+        return ESP_OK;
     }
 
     ESP_LOGW(TAG, "Unknown SIM operator for IMSI prefix: %s", mcc_mnc_prefix);
@@ -651,7 +1192,42 @@ static esp_err_t get_sim_operator_name(char *operator_buffer, size_t buffer_size
     return ESP_FAIL;
 }
 
-static esp_err_t configure_modem_for_sms(char *response_buffer, size_t buffer_size,
+// 短信接收所需的模组设置,configure_modem_for_sms合并成一行发送
+enum {
+    SETUP_ECHO_OFF,
+    SETUP_VERBOSE_ERRORS,
+    SETUP_SMS_MODE,
+#if !CONFIG_APP_SMS_PDU_MODE
+    SETUP_CHARSET,
+#endif
+    SETUP_NEW_SMS_IND,
+#if CONFIG_APP_UART_HW_FLOWCTRL
+    SETUP_FLOW_CONTROL,
+#endif
+    SETUP_REG_REPORT,
+    SETUP_EPS_REG_REPORT,
+    SETUP_COUNT,
+};
+static const char *const s_setup_cmds[SETUP_COUNT] = {
+    [SETUP_ECHO_OFF] = "E0",
+    [SETUP_VERBOSE_ERRORS] = "+CMEE=2",
+#if CONFIG_APP_SMS_PDU_MODE
+    // PDU模式下短信原样上报,与AT+CSCS字符集无关
+    [SETUP_SMS_MODE] = "+CMGF=0",
+#else
+    [SETUP_SMS_MODE] = "+CMGF=1",
+    [SETUP_CHARSET] = "+CSCS=\"UCS2\"",
+#endif
+    [SETUP_NEW_SMS_IND] = "+CNMI=2,2,0,0,0",
+#if CONFIG_APP_UART_HW_FLOWCTRL
+    [SETUP_FLOW_CONTROL] = "+IFC=2,2", // 双向RTS/CTS
+#endif
+    // 注册状态及小区变化主动上报,由modem_status缓存
+    [SETUP_REG_REPORT] = "+CREG=2",
+    [SETUP_EPS_REG_REPORT] = "+CEREG=2",
+};
+
+static esp_err_t configure_modem_for_sms(uart_at_ctx_t *ctx, char *response_buffer, size_t buffer_size,
                                          bool *modem_responding) {
     esp_err_t at_result = ESP_FAIL;
 
@@ -664,7 +1240,7 @@ static esp_err_t configure_modem_for_sms(char *response_buffer, size_t buffer_si
                      retry_count + 1, AT_PROBE_MAX_RETRIES);
             vTaskDelay(pdMS_TO_TICKS(1000));
         }
-        at_result = at_send_command("AT", response_buffer, buffer_size,
+        at_result = at_send_command(ctx, "AT", response_buffer, buffer_size,
                                     pdMS_TO_TICKS(AT_COMMAND_TIMEOUT_MS));
         if (at_result == ESP_OK) {
             break;
@@ -679,82 +1255,461 @@ static esp_err_t configure_modem_for_sms(char *response_buffer, size_t buffer_si
 
     ESP_LOGI(TAG, "AT command successful, modem is responding.");
     *modem_responding = true;
-    vTaskDelay(pdMS_TO_TICKS(500));
+
+    // 其余设置合并成一行一次往返发送,不再逐条等待;
+    // 只有短信模式和新短信上报是必需的,其他设置失败时继续运行
+    bool setup_ok[SETUP_COUNT];
+    at_send_chain(ctx, s_setup_cmds, SETUP_COUNT, setup_ok, response_buffer, buffer_size,
+                  pdMS_TO_TICKS(AT_COMMAND_TIMEOUT_MS));
 
     // Non-critical setup commands remain best effort.
-    if (at_send_command("ATE0", response_buffer, buffer_size,
-                        pdMS_TO_TICKS(AT_COMMAND_TIMEOUT_MS)) != ESP_OK) {
+    if (!setup_ok[SETUP_ECHO_OFF]) {
         ESP_LOGW(TAG, "Failed to disable AT command echo. Parsing might be more complex.");
     }
-    vTaskDelay(pdMS_TO_TICKS(500));
-
-    if (at_send_command("AT+CMEE=2", response_buffer, buffer_size,
-                        pdMS_TO_TICKS(AT_COMMAND_TIMEOUT_MS)) != ESP_OK) {
+    if (!setup_ok[SETUP_VERBOSE_ERRORS]) {
         ESP_LOGW(TAG, "Failed to enable verbose modem errors (AT+CMEE=2). Continuing with default error reporting.");
     }
-    vTaskDelay(pdMS_TO_TICKS(500));
+#if !CONFIG_APP_SMS_PDU_MODE
+    if (!setup_ok[SETUP_CHARSET]) {
+        ESP_LOGW(TAG, "Failed to set character set to UCS2 (AT+CSCS=\"UCS2\"). SMS might be garbled.");
+    }
+#endif
+#if CONFIG_APP_UART_HW_FLOWCTRL
+    if (!setup_ok[SETUP_FLOW_CONTROL]) {
+        ESP_LOGW(TAG, "Failed to enable RTS/CTS on the modem (AT+IFC=2,2). RX overruns stay possible.");
+    }
+#endif
+    if (!setup_ok[SETUP_REG_REPORT] || !setup_ok[SETUP_EPS_REG_REPORT]) {
+        ESP_LOGW(TAG, "Failed to enable network registration reports (AT+CREG=2/AT+CEREG=2). Cached registration state may be stale.");
+    }
 
     // SMS mode and new-message indications are required before declaring ready.
-    if (at_send_command("AT+CMGF=1", response_buffer, buffer_size,
-                        pdMS_TO_TICKS(AT_COMMAND_TIMEOUT_MS)) != ESP_OK) {
+    if (!setup_ok[SETUP_SMS_MODE]) {
+#if CONFIG_APP_SMS_PDU_MODE
+        ESP_LOGE(TAG, "Failed to set SMS to PDU mode (AT+CMGF=0).");
+#else
         ESP_LOGE(TAG, "Failed to set SMS to text mode (AT+CMGF=1).");
+#endif
         return ESP_FAIL;
     }
-    vTaskDelay(pdMS_TO_TICKS(500));
-
-    if (at_send_command("AT+CSCS=\"UCS2\"", response_buffer, buffer_size,
-                        pdMS_TO_TICKS(AT_COMMAND_TIMEOUT_MS)) != ESP_OK) {
-        ESP_LOGW(TAG, "Failed to set character set to UCS2 (AT+CSCS=\"UCS2\"). SMS might be garbled.");
+    if (!setup_ok[SETUP_NEW_SMS_IND]) {
+        ESP_LOGE(TAG, "Failed to configure new SMS indications (AT+CNMI).");
+        return ESP_FAIL;
     }
-    vTaskDelay(pdMS_TO_TICKS(500));
+    ESP_LOGI(TAG, "4G modem initialized for SMS reception.");
+
+    if (get_sim_operator_name(ctx, ctx->modem->operator_name, sizeof(ctx->modem->operator_name)) != ESP_OK) {
+        ESP_LOGW(TAG, "Could not determine SIM operator.");
+    }
+
+    return ESP_OK;
+}
+
+
+// 开机探测用的AT命令: 与at_send_command相同,但不把探测超时当作错误打印
+static at_result_t at_probe(uart_at_ctx_t *ctx, const char *cmd, char *response_buffer, size_t buffer_size,
+                            TickType_t timeout_ticks) {
+    at_command_t command = {
+        .cmd = cmd,
+        .timeout = timeout_ticks,
+        .response = response_buffer,
+        .response_size = buffer_size,
+    };
+    if (at_submit(ctx, &command) != ESP_OK) {
+        return AT_RESULT_ERROR;
+    }
+    at_wait(ctx, &command);
+    return command.result;
+}
+
+static bool load_modem_baud(const char *nvs_namespace, uint32_t *baud) {
+    nvs_handle_t nvs_handle;
+    if (nvs_open(nvs_namespace, NVS_READONLY, &nvs_handle) != ESP_OK) {
+        return false;
+    }
+    bool found = nvs_get_u32(nvs_handle, MODEM_NVS_KEY_BAUD, baud) == ESP_OK;
+    nvs_close(nvs_handle);
+    return found;
+}
+
+static void save_modem_baud(const char *nvs_namespace, uint32_t baud) {
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(nvs_namespace, NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to open NVS namespace: %s", esp_err_to_name(err));
+        return;
+    }
+    err = nvs_set_u32(nvs_handle, MODEM_NVS_KEY_BAUD, baud);
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs_handle);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to save modem baud rate: %s", esp_err_to_name(err));
+    }
+    nvs_close(nvs_handle);
+}
+
+// 本端切换波特率;旧速率下收到一半的行由uart_event_task作废
+static void uart_at_apply_baud(uart_at_ctx_t *ctx, uint32_t baud) {
+    uart_wait_tx_done(ctx->modem->uart.num, pdMS_TO_TICKS(AT_BAUD_SWITCH_SETTLE_MS));
+    atomic_store(&ctx->rx_resync, true);
+    uart_set_baudrate(ctx->modem->uart.num, baud);
+    uart_flush_input(ctx->modem->uart.num);
+    atomic_store(&ctx->uart_baud, baud);
+}
+
+// 连续AT_BAUD_VERIFY_PROBES次AT都成功才认为当前速率可用
+static bool baud_verify(uart_at_ctx_t *ctx, char *response_buffer, size_t buffer_size) {
+    for (int i = 0; i < AT_BAUD_VERIFY_PROBES; i++) {
+        if (at_probe(ctx, "AT", response_buffer, buffer_size,
+                     pdMS_TO_TICKS(MODEM_PROBE_TIMEOUT_MS)) != AT_RESULT_OK) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 让模组切换到baud(模组以旧速率回OK后才切换),本端随后跟进
+static at_result_t baud_request(uart_at_ctx_t *ctx, uint32_t baud, char *response_buffer, size_t buffer_size) {
+    char cmd[24];
+    snprintf(cmd, sizeof(cmd), "AT+IPR=%lu", (unsigned long)baud);
+    at_result_t result = at_probe(ctx, cmd, response_buffer, buffer_size,
+                                  pdMS_TO_TICKS(MODEM_PROBE_TIMEOUT_MS));
+    if (result == AT_RESULT_OK) {
+        vTaskDelay(pdMS_TO_TICKS(AT_BAUD_SWITCH_SETTLE_MS));
+        uart_at_apply_baud(ctx, baud);
+    }
+    return result;
+}
+
+/**
+ * @brief 在基础速率下与模组协商更高的波特率
+ *
+ * 从不超过CONFIG_APP_UART_BAUD_RATE_MAX的最高候选速率开始尝试: AT+IPR切换后
+ * 用连续探测验证,失败则让双方回到基础速率再试下一档。AT+IPR不写入模组NVM,
+ * 模组断电后回到基础速率;协商结果保存在NVS中,供ESP32单独重启时探测。
+ */
+static void uart_at_escalate_baud(uart_at_ctx_t *ctx, char *response_buffer, size_t buffer_size) {
+    if (atomic_load(&ctx->uart_baud) != UART_BAUD_RATE) {
+        // 开机探测已在保存的速率下连通
+        return;
+    }
+
+    for (size_t i = 0; i < sizeof(s_baud_candidates) / sizeof(s_baud_candidates[0]); i++) {
+        uint32_t baud = s_baud_candidates[i];
+        if (baud > UART_BAUD_RATE_MAX || baud <= UART_BAUD_RATE) {
+            continue;
+        }
+
+        if (baud_request(ctx, baud, response_buffer, buffer_size) != AT_RESULT_OK) {
+            ESP_LOGI(TAG, "Modem rejected %lu baud", (unsigned long)baud);
+            continue;
+        }
+        if (baud_verify(ctx, response_buffer, buffer_size)) {
+            ESP_LOGI(TAG, "UART switched to %lu baud", (unsigned long)baud);
+            save_modem_baud(ctx->nvs_namespace, baud);
+            return;
+        }
+
+        ESP_LOGW(TAG, "No reliable response at %lu baud, falling back to %d",
+                 (unsigned long)baud, UART_BAUD_RATE);
+        // 模组可能已切换也可能没有: 先以新速率要求它切回,再把本端切回
+        baud_request(ctx, UART_BAUD_RATE, response_buffer, buffer_size);
+        uart_at_apply_baud(ctx, UART_BAUD_RATE);
+        if (!baud_verify(ctx, response_buffer, buffer_size)) {
+            ESP_LOGE(TAG, "Modem not responding after baud fallback.");
+            break;
+        }
+    }
+    save_modem_baud(ctx->nvs_namespace, UART_BAUD_RATE);
+}
+
+/**
+ * @brief 主动探测模组是否就绪,取代固定的开机等待
+ *
+ * 每隔MODEM_PROBE_INTERVAL_MS发一次AT,模组响应后用AT+CPIN?确认SIM已就绪;
+ * 期间收到"SMS Ready"等URC时立即结束等待。总时长不超过MODEM_BOOT_TIMEOUT_MS,
+ * 超时后仍进入配置流程,由其重试退避处理。
+ *
+ * @return true 模组已就绪
+ */
+static bool wait_for_modem_ready(uart_at_ctx_t *ctx, char *response_buffer, size_t buffer_size) {
+    TickType_t start_time = xTaskGetTickCount();
+    TickType_t elapsed;
+    int probes = 0;
+    // ESP32单独重启时模组仍停在上次协商的速率: 两种速率轮流探测
+    uint32_t saved_baud = UART_BAUD_RATE;
+    load_modem_baud(ctx->nvs_namespace, &saved_baud);
+
+    while ((elapsed = xTaskGetTickCount() - start_time) < pdMS_TO_TICKS(MODEM_BOOT_TIMEOUT_MS)) {
+        if (ctx->modem_ready_urcs & MODEM_URC_SMS_READY) {
+            ESP_LOGI(TAG, "Modem reported SMS ready after %lu ms",
+                     (unsigned long)pdTICKS_TO_MS(elapsed));
+            return true;
+        }
 
-    if (at_send_command("AT+CNMI=2,2,0,0,0", response_buffer, buffer_size,
+        probes++;
+        if (at_probe(ctx, "AT", response_buffer, buffer_size,
+                     pdMS_TO_TICKS(MODEM_PROBE_TIMEOUT_MS)) == AT_RESULT_OK &&
+            at_probe(ctx, "AT+CPIN?", response_buffer, buffer_size,
+                     pdMS_TO_TICKS(MODEM_PROBE_TIMEOUT_MS)) == AT_RESULT_OK &&
+            strstr(response_buffer, "+CPIN: READY") != NULL) {
+            ESP_LOGI(TAG, "Modem ready after %d probe(s), %lu ms, %lu baud", probes,
+                     (unsigned long)pdTICKS_TO_MS(xTaskGetTickCount() - start_time),
+                     (unsigned long)atomic_load(&ctx->uart_baud));
+            return true;
+        }
+
+        if (saved_baud != UART_BAUD_RATE) {
+            bool to_saved = atomic_load(&ctx->uart_baud) == UART_BAUD_RATE;
+            uart_at_apply_baud(ctx, to_saved ? saved_baud : UART_BAUD_RATE);
+            if (to_saved) {
+                continue; // 基础速率无应答时立即按保存的速率再试,不等下一个探测间隔
+            }
+        }
+
+        // 等到下一次探测,期间处理URC;就绪URC到达时提前结束
+        TickType_t probe_time = xTaskGetTickCount();
+        TickType_t waited;
+        while (!(ctx->modem_ready_urcs & MODEM_URC_SMS_READY) &&
+               (waited = xTaskGetTickCount() - probe_time) < pdMS_TO_TICKS(MODEM_PROBE_INTERVAL_MS)) {
+            wait_for_rx_data(ctx, pdMS_TO_TICKS(MODEM_PROBE_INTERVAL_MS) - waited);
+        }
+    }
+
+    ESP_LOGW(TAG, "Modem not ready after %d probe(s) in %d s; continuing with setup anyway.",
+             probes, MODEM_BOOT_TIMEOUT_MS / 1000);
+    return false;
+}
+
+// FNV-1a
+static uint32_t fingerprint_hash(uint32_t hash, const char *data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief 由MODEM_STATE_QUERY的响应计算配置指纹
+ *
+ * 只取+CMGF/+CSCS/+CNMI行和IMSI行(回显等其他行忽略),并混入本固件要求的设置,
+ * 因此模组设置丢失、固件改变设置(如切换PDU/文本模式)或更换SIM卡后指纹都会变化。
+ *
+ * @return 指纹;响应中缺少任一项时返回0
+ */
+static uint32_t modem_state_fingerprint(const char *response) {
+    static const char *const state_prefixes[] = {"+CMGF:", "+CSCS:", "+CNMI:"};
+    const unsigned all_found = (1u << (sizeof(state_prefixes) / sizeof(state_prefixes[0]) + 1)) - 1;
+    const unsigned imsi_found = 1u << (sizeof(state_prefixes) / sizeof(state_prefixes[0]));
+    uint32_t hash = 2166136261u;
+    unsigned found = 0;
+
+    for (int i = 0; i < SETUP_COUNT; i++) {
+        hash = fingerprint_hash(hash, s_setup_cmds[i], strlen(s_setup_cmds[i]) + 1);
+    }
+
+    const char *line = response;
+    while (*line != '\0') {
+        const char *end = strstr(line, "\r\n");
+        size_t len = end ? (size_t)(end - line) : strlen(line);
+        bool use = false;
+
+        for (size_t i = 0; i < sizeof(state_prefixes) / sizeof(state_prefixes[0]); i++) {
+            if (strncmp(line, state_prefixes[i], strlen(state_prefixes[i])) == 0) {
+                found |= 1u << i;
+                use = true;
+            }
+        }
+        if (len > 0 && strspn(line, "0123456789") == len) {
+            found |= imsi_found;
+            use = true;
+        }
+        if (use) {
+            hash = fingerprint_hash(hash, line, len + 1);
+        }
+        line += len + (end ? 2 : 0);
+    }
+
+    if (found != all_found) {
+        return 0;
+    }
+    return hash != 0 ? hash : 1;
+}
+
+// 一次往返读取模组当前设置和IMSI,计算指纹
+static esp_err_t query_modem_fingerprint(uart_at_ctx_t *ctx, char *response_buffer, size_t buffer_size, uint32_t *fingerprint) {
+    if (at_send_command(ctx, MODEM_STATE_QUERY, response_buffer, buffer_size,
                         pdMS_TO_TICKS(AT_COMMAND_TIMEOUT_MS)) != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to configure new SMS indications (AT+CNMI).");
         return ESP_FAIL;
     }
-    ESP_LOGI(TAG, "4G modem initialized for SMS reception.");
-    vTaskDelay(pdMS_TO_TICKS(500));
+    *fingerprint = modem_state_fingerprint(response_buffer);
+    return *fingerprint != 0 ? ESP_OK : ESP_FAIL;
+}
 
-    if (get_sim_operator_name(g_sim_operator, sizeof(g_sim_operator)) != ESP_OK) {
-        ESP_LOGW(TAG, "Could not determine SIM operator.");
+static bool load_modem_fingerprint(const char *nvs_namespace, uint32_t *fingerprint,
+                                   char *operator_name, size_t operator_size) {
+    nvs_handle_t nvs_handle;
+    if (nvs_open(nvs_namespace, NVS_READONLY, &nvs_handle) != ESP_OK) {
+        return false;
     }
-    vTaskDelay(pdMS_TO_TICKS(500));
 
-    return ESP_OK;
+    size_t required_size = operator_size;
+    bool found = nvs_get_u32(nvs_handle, MODEM_NVS_KEY_FINGERPRINT, fingerprint) == ESP_OK &&
+                 nvs_get_str(nvs_handle, MODEM_NVS_KEY_OPERATOR, operator_name, &required_size) == ESP_OK;
+    nvs_close(nvs_handle);
+    return found;
+}
+
+static void save_modem_fingerprint(const char *nvs_namespace, uint32_t fingerprint, const char *operator_name) {
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(nvs_namespace, NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to open NVS namespace: %s", esp_err_to_name(err));
+        return;
+    }
+
+    err = nvs_set_u32(nvs_handle, MODEM_NVS_KEY_FINGERPRINT, fingerprint);
+    if (err == ESP_OK) {
+        err = nvs_set_str(nvs_handle, MODEM_NVS_KEY_OPERATOR, operator_name);
+    }
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs_handle);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to save modem configuration fingerprint: %s", esp_err_to_name(err));
+    }
+    nvs_close(nvs_handle);
+}
+
+/**
+ * @brief 热启动快速路径: ESP32重启而模组一直在运行时,模组通常仍保持上次的设置
+ *
+ * 用一条查询核对指纹,与NVS中保存的一致时跳过配置,直接使用缓存的运营商。
+ *
+ * @return true 已跳过配置
+ */
+static bool modem_try_warm_start(uart_at_ctx_t *ctx, char *response_buffer, size_t buffer_size) {
+    uint32_t stored_fingerprint;
+    uint32_t fingerprint;
+    char operator_name[sizeof(ctx->modem->operator_name)];
+
+    if (!load_modem_fingerprint(ctx->nvs_namespace, &stored_fingerprint, operator_name,
+                                sizeof(operator_name))) {
+        ESP_LOGI(TAG, "No stored modem configuration fingerprint, running full setup.");
+        return false;
+    }
+    if (query_modem_fingerprint(ctx, response_buffer, buffer_size, &fingerprint) != ESP_OK ||
+        fingerprint != stored_fingerprint) {
+        ESP_LOGI(TAG, "Modem configuration differs from the stored fingerprint, running full setup.");
+        return false;
+    }
+
+    snprintf(ctx->modem->operator_name, sizeof(ctx->modem->operator_name), "%s", operator_name);
+    ESP_LOGI(TAG, "Modem configuration unchanged (fingerprint %08lx), skipping setup.",
+             (unsigned long)fingerprint);
+    return true;
+}
+
+// 完整配置后记录新的指纹,供下次热启动核对
+static void modem_update_fingerprint(uart_at_ctx_t *ctx, char *response_buffer, size_t buffer_size) {
+    uint32_t fingerprint;
+    if (query_modem_fingerprint(ctx, response_buffer, buffer_size, &fingerprint) != ESP_OK) {
+        ESP_LOGW(TAG, "Could not read modem configuration state; warm start will be skipped.");
+        return;
+    }
+    save_modem_fingerprint(ctx->nvs_namespace, fingerprint, ctx->modem->operator_name);
+}
+
+static void telemetry_done(uart_at_ctx_t *ctx, at_command_t *cmd) {
+    ctx->telemetry_busy = false;
+    if (cmd->result != AT_RESULT_OK) {
+        atomic_fetch_add(&ctx->telemetry_failures, 1);
+        ESP_LOGD(TAG, "Modem telemetry sample failed (%s)",
+                 cmd->result == AT_RESULT_TIMEOUT ? "timeout" : "error");
+        return;
+    }
+    // 响应保持"\r\n<行>\r\n"格式,与线路上的字节数一致(超出缓冲的部分不计)
+    uint64_t bytes = strlen(cmd->cmd) + 2 + cmd->response_len;
+    atomic_store(&ctx->telemetry_uart_us,
+                 (uint32_t)(bytes * UART_BITS_PER_BYTE * 1000000ULL / atomic_load(&ctx->uart_baud)));
+    atomic_store(&ctx->telemetry_latency_ms, cmd->latency_ms);
+    atomic_fetch_add(&ctx->telemetry_samples, 1);
 }
 
+// 串口空闲且近期没有短信: 没有排队或执行中的命令,没有等待正文、待拼接或待读取的短信
+static bool telemetry_channel_idle(uart_at_ctx_t *ctx) {
+    if (ctx->at_inflight != NULL || ctx->at_queue_count > 0 || ctx->cmt_body_pending ||
+        atomic_load(&ctx->reasm_live) > 0) {
+        return false;
+    }
+#if CONFIG_APP_SMS_PDU_MODE
+    if (ctx->store_mode || ctx->store_enter_requested || ctx->store_drain_pending) {
+        return false;
+    }
+#endif
+    return xTaskGetTickCount() - ctx->sms_activity_tick >= pdMS_TO_TICKS(MODEM_TELEMETRY_SMS_QUIET_MS);
+}
+
+/**
+ * @brief 到期且串口空闲时提交一次状态采样,不等待结果
+ *
+ * 有短信活动时推迟到安静之后,采样命令不会排在+CMT之前占用模组;
+ * 采样期间到达的URC照常处理。
+ */
+static void modem_telemetry_service(uart_at_ctx_t *ctx) {
+    TickType_t interval = pdMS_TO_TICKS(MODEM_TELEMETRY_INTERVAL_MS);
+    if (interval == 0 || ctx->telemetry_busy || xTaskGetTickCount() - ctx->telemetry_last_tick < interval) {
+        return;
+    }
+    if (!telemetry_channel_idle(ctx)) {
+        if (!ctx->telemetry_deferred) {
+            ctx->telemetry_deferred = true;
+            atomic_fetch_add(&ctx->telemetry_deferrals, 1);
+        }
+        return;
+    }
+
+    ctx->telemetry_deferred = false;
+    ctx->telemetry_last_tick = xTaskGetTickCount();
+    ctx->telemetry_cmd = (at_command_t){
+        .cmd = MODEM_TELEMETRY_QUERY,
+        .timeout = pdMS_TO_TICKS(MODEM_TELEMETRY_TIMEOUT_MS),
+        .on_done = telemetry_done,
+        .response = ctx->telemetry_response,
+        .response_size = sizeof(ctx->telemetry_response),
+    };
+    ctx->telemetry_busy = at_submit(ctx, &ctx->telemetry_cmd) == ESP_OK;
+}
 
 void uart_at_task(void *pvParameters) {
+    modem_instance_t *modem = pvParameters;
+    uart_at_ctx_t *ctx = modem->ctx;
     char response_buffer[AT_RESPONSE_MAX_LEN];
     static const uint32_t recovery_delays_ms[] = {5000, 10000, 20000, 30000};
     size_t recovery_delay_index = 0;
 
     // Register this task's handle for cleanup on restart
-    s_uart_at_task_handle = xTaskGetCurrentTaskHandle();
+    ctx->uart_at_task_handle = xTaskGetCurrentTaskHandle();
 
     // Initialize 4G Cat.1 modem
-    ESP_LOGI(TAG, "Initializing 4G Cat.1 modem...");
-    vTaskDelay(pdMS_TO_TICKS(120000)); // Give modem more time to boot (120 seconds)
+    ESP_LOGI(TAG, "Initializing 4G Cat.1 modem %u...", modem->index);
 
     // A modem that survived an ESP32 restart may already be reporting SMS.
-    // Drain those reports before sending wake-up or validation commands.
-    process_pending_sms_urcs();
+    // Drain those reports before sending probe or validation commands.
+    process_pending_sms_urcs(ctx);
 
-    // Send wake-up sequence to ensure modem is responsive
-    // This is important when ESP32 restarts but modem is still running
-    ESP_LOGI(TAG, "Sending wake-up sequence to modem...");
-    for (int i = 0; i < 3; i++) {
-        uart_write_bytes(UART_PORT_NUM, "AT\r\n", 4);
-        vTaskDelay(pdMS_TO_TICKS(300));
+    // 探测代替固定的开机等待;模组一直在运行时第一次探测就会成功
+    bool modem_ready = wait_for_modem_ready(ctx, response_buffer, sizeof(response_buffer));
+    if (modem_ready) {
+        uart_at_escalate_baud(ctx, response_buffer, sizeof(response_buffer));
     }
-
-    vTaskDelay(pdMS_TO_TICKS(500));
-    process_pending_sms_urcs();
-    ESP_LOGI(TAG, "Wake-up sequence complete, modem should be responsive.");
+    bool warm_start = modem_ready && modem_try_warm_start(ctx, response_buffer, sizeof(response_buffer));
 
     bool modem_responding = false;
-    while (configure_modem_for_sms(response_buffer, sizeof(response_buffer),
+    while (!warm_start &&
+           configure_modem_for_sms(ctx, response_buffer, sizeof(response_buffer),
                                    &modem_responding) != ESP_OK) {
         if (modem_responding) {
             // Communication recovered; restart the backoff for any remaining
@@ -766,7 +1721,7 @@ void uart_at_task(void *pvParameters) {
         ESP_LOGW(TAG,
                  "SMS modem is not ready; UART task remains active and will retry in %lu seconds.",
                  (unsigned long)(retry_delay_ms / 1000));
-        wait_for_recovery_retry(pdMS_TO_TICKS(retry_delay_ms));
+        wait_for_recovery_retry(ctx, pdMS_TO_TICKS(retry_delay_ms));
 
         if (!modem_responding &&
             recovery_delay_index <
@@ -775,137 +1730,758 @@ void uart_at_task(void *pvParameters) {
         }
     }
 
-    process_pending_sms_urcs();
-    ESP_LOGI(TAG, "4G modem initialization complete. Operator: %s", g_sim_operator);
+    if (!warm_start) {
+        modem_update_fingerprint(ctx, response_buffer, sizeof(response_buffer));
+    }
+
+#if CONFIG_APP_SMS_PDU_MODE
+    // 先存储模式读出重启期间积压在模组中的短信,之后按队列压力切换
+    ctx->store_enter_requested = true;
+    ctx->store_drain_pending = true;
+#endif
+
+    if (at_probe(ctx, MODEM_STATUS_QUERY, response_buffer, sizeof(response_buffer),
+                 pdMS_TO_TICKS(AT_COMMAND_TIMEOUT_MS)) != AT_RESULT_OK) {
+        ESP_LOGW(TAG, "Initial modem status query failed; status fills in from URCs.");
+    }
+    ctx->telemetry_last_tick = xTaskGetTickCount();
+
+    process_pending_sms_urcs(ctx);
+    // 分段间隔因网络而异,换了运营商的SIM卡就重新学习
+    fragment_gap_set_context(&ctx->gaps, ctx->modem->operator_name);
+    atomic_store(&ctx->modem_ready_ms, (uint32_t)(esp_timer_get_time() / 1000));
+    atomic_store(&ctx->modem_warm_start, warm_start ? 1 : 0);
+    ESP_LOGI(TAG, "4G modem %u initialization complete in %lu ms since boot (%s). Operator: %s",
+             modem->index, (unsigned long)atomic_load(&ctx->modem_ready_ms),
+             warm_start ? "warm start" : "full setup", modem->operator_name);
 
     ESP_LOGI(TAG, "Publishing device ready message to MQTT...");
-    if (mqtt_manager_publish_device_ready(g_sim_operator) != ESP_OK) {
+    if (mqtt_manager_publish_device_ready(modem) != ESP_OK) {
         ESP_LOGW(TAG, "Failed to publish device ready message.");
     }
 
     // Main loop to listen for incoming URCs (like +CMT:)
     while (1) {
-        // Wait for a URC to be signaled by the uart_event_task. The finite
-        // timeout also drives the fragment buffer timeout check below.
-        EventBits_t uxBits = xEventGroupWaitBits(s_at_response_event_group,
-                                                 AT_RESPONSE_URC_BIT,
-                                                 pdTRUE, // Clear bit on exit
-                                                 pdFALSE, // Don't wait for all bits
-                                                 pdMS_TO_TICKS(1000));
-
-        if (uxBits & AT_RESPONSE_URC_BIT) {
-            process_pending_sms_urcs();
-        }
+        // Wait for data from uart_event_task. The finite timeout also
+        // drives the reassembly timeout check below.
+        wait_for_rx_data(ctx, pdMS_TO_TICKS(1000));
 
         // 最后一段迟迟不到时的兜底:投递已累积的内容,绝不静默丢弃
-        if (is_fragment_timeout()) {
-            flush_fragment_buffer_to_queue("fragment timeout");
+        reassembly_expire(ctx);
+
+#if CONFIG_APP_SMS_PDU_MODE
+        sms_store_service(ctx, response_buffer, sizeof(response_buffer));
+#endif
+
+        modem_telemetry_service(ctx);
+    }
+}
+
+static bool uart_at_probe(modem_instance_t *modem, TickType_t reply_ticks) {
+    return modem_uart_probe(&modem->uart, "AT", "OK", reply_ticks);
+}
+
+// AT+IPR协商后的速率只在模组掉电时丢失,ESP32单独重启后探测需按它再试
+static uint32_t uart_at_saved_baud(modem_instance_t *modem) {
+    char nvs_namespace[MODEM_NVS_NAME_SIZE];
+    uint32_t saved_baud = 0;
+    if (modem_backend_nvs_name(modem, MODEM_NVS_NAMESPACE, nvs_namespace, sizeof(nvs_namespace)) != ESP_OK ||
+        !load_modem_baud(nvs_namespace, &saved_baud)) {
+        return 0;
+    }
+    return saved_baud;
+}
+
+static int uart_at_format_metrics(const modem_instance_t *modem, char *buf, size_t size) {
+    uart_at_ctx_t *ctx = modem->ctx;
+    uart_at_stats_t at_stats;
+    uart_at_get_stats(modem, &at_stats);
+    int len = snprintf(buf, size,
+                       ",\"at_rx_enqueue_fail\":%lu,\"at_rx_dropped_bytes\":%lu,"
+                       "\"at_rx_truncated_lines\":%lu,\"at_rx_ring_high_water\":%lu,\"at_rx_wakeups\":%lu,"
+                       "\"uart_baud\":%lu,\"at_rx_bytes\":%lu,\"at_rx_peak_Bps\":%lu,"
+                       "\"at_rx_frame_err\":%lu,\"at_rx_parity_err\":%lu,"
+                       "\"at_rx_fifo_ovf\":%lu,\"at_rx_buffer_full\":%lu,\"at_rx_flushed_bytes\":%lu,"
+                       "\"sms_store_mode\":%lu,\"sms_store_switches\":%lu,"
+                       "\"sms_store_drained\":%lu,\"sms_store_deleted\":%lu,"
+                       "\"sms_reasm_live\":%lu,\"sms_reasm_bytes\":%lu,"
+                       "\"sms_reasm_evictions\":%lu,\"sms_reasm_timeouts\":%lu,"
+                       "\"at_cmd_count\":%lu,\"at_cmd_timeouts\":%lu,"
+                       "\"at_cmd_latency_last_ms\":%lu,\"at_cmd_latency_avg_ms\":%lu,"
+                       "\"at_cmd_latency_max_ms\":%lu,"
+                       "\"modem_ready_ms\":%lu,\"modem_warm_start\":%lu,"
+                       "\"modem_samples\":%lu,\"modem_sample_failures\":%lu,"
+                       "\"modem_sample_deferrals\":%lu,\"modem_sample_latency_ms\":%lu,"
+                       "\"modem_sample_uart_us\":%lu",
+                       (unsigned long)at_stats.rx_enqueue_failures,
+                       (unsigned long)at_stats.rx_dropped_bytes,
+                       (unsigned long)at_stats.rx_truncated_lines,
+                       (unsigned long)at_stats.rx_ring_high_water,
+                       (unsigned long)at_stats.rx_wakeups,
+                       (unsigned long)at_stats.uart_baud_rate,
+                       (unsigned long)at_stats.rx_bytes,
+                       (unsigned long)at_stats.rx_peak_bytes_per_s,
+                       (unsigned long)at_stats.rx_frame_errors,
+                       (unsigned long)at_stats.rx_parity_errors,
+                       (unsigned long)at_stats.rx_fifo_overflows,
+                       (unsigned long)at_stats.rx_buffer_full,
+                       (unsigned long)at_stats.rx_flushed_bytes,
+                       (unsigned long)at_stats.sms_store_mode,
+                       (unsigned long)at_stats.sms_store_mode_switches,
+                       (unsigned long)at_stats.sms_store_drained,
+                       (unsigned long)at_stats.sms_store_deleted,
+                       (unsigned long)at_stats.sms_reasm_live,
+                       (unsigned long)at_stats.sms_reasm_bytes,
+                       (unsigned long)at_stats.sms_reasm_evictions,
+                       (unsigned long)at_stats.sms_reasm_timeouts,
+                       (unsigned long)at_stats.at_cmd_count,
+                       (unsigned long)at_stats.at_cmd_timeouts,
+                       (unsigned long)at_stats.at_cmd_latency_last_ms,
+                       (unsigned long)at_stats.at_cmd_latency_avg_ms,
+                       (unsigned long)at_stats.at_cmd_latency_max_ms,
+                       (unsigned long)at_stats.modem_ready_ms,
+                       (unsigned long)at_stats.modem_warm_start,
+                       (unsigned long)at_stats.telemetry_samples,
+                       (unsigned long)at_stats.telemetry_failures,
+                       (unsigned long)at_stats.telemetry_deferrals,
+                       (unsigned long)at_stats.telemetry_latency_ms,
+                       (unsigned long)at_stats.telemetry_uart_us);
+    if (len >= (int)size) {
+        return len;
+    }
+
+    // 模组状态来自URC缓存,不产生AT命令
+    modem_status_t status;
+    modem_status_get(&ctx->status, &status);
+    len += snprintf(&buf[len], size - len,
+                    ",\"modem_rssi_dbm\":%d,\"modem_creg\":%u,\"modem_cereg\":%u,"
+                    "\"modem_sim\":%u,\"modem_registered\":%u,"
+                    "\"modem_sms_used\":%u,\"modem_sms_total\":%u,\"modem_status_age_s\":%lu",
+                    status.rssi_dbm, status.creg_stat, status.cereg_stat,
+                    (unsigned)status.sim, modem_status_is_registered(&status) ? 1u : 0u,
+                    status.sms_used, status.sms_total,
+                    status.updated_ms == 0 ? 0ul :
+                    (unsigned long)((uint32_t)(esp_timer_get_time() / 1000) - status.updated_ms) / 1000);
+    if (len >= (int)size) {
+        return len;
+    }
+
+    // 长短信分段间隔直方图,桶上界见fragment_gap_bucket_ms
+    fragment_gap_stats_t gaps;
+    fragment_gap_get_stats(&ctx->gaps, &gaps);
+    len += snprintf(&buf[len], size - len,
+                    ",\"sms_frag_timeout_ms\":%lu,\"sms_frag_late\":%lu,\"sms_gap_samples\":%lu,"
+                    "\"sms_gap_hist\":[",
+                    (unsigned long)gaps.timeout_ms, (unsigned long)gaps.late_fragments,
+                    (unsigned long)gaps.samples);
+    for (int i = 0; i < FRAGMENT_GAP_BUCKETS && len < (int)size; i++) {
+        len += snprintf(&buf[len], size - len, "%s%lu",
+                        i > 0 ? "," : "", (unsigned long)gaps.counts[i]);
+    }
+    if (len >= (int)size) {
+        return len;
+    }
+    return len + snprintf(&buf[len], size - len, "]");
+}
+
+const modem_backend_t uart_at_backend = {
+    .name = "AT",
+    .task_name = "uart_at_task",
+    .probe = uart_at_probe,
+    .saved_baud = uart_at_saved_baud,
+    .init = uart_at_init,
+    .run = uart_at_task,
+    .format_metrics = uart_at_format_metrics,
+    .request_sms_poll = NULL, // 新短信由+CMT/+CMTI上报,存储中的积压由sms_store_service读出
+};
+
+
+#if !CONFIG_APP_SMS_PDU_MODE
+// 在span[from, len)中查找字符,找不到返回span->len
+static size_t span_find_char(const uart_line_span_t *span, size_t from, char c) {
+    for (size_t i = from; i < span->len; i++) {
+        if (uart_line_span_at(span, i) == c) {
+            return i;
         }
     }
+    return span->len;
 }
 
-static int handle_urc(char *urc_line_buffer) { // Now takes a mutable buffer
-    sms_message_t new_sms;
-    int urc_len = 0;
+/**
+ * @brief 直接从环形缓冲中的+CMT头行解码发件人 (Text Mode, UCS2字符集)
+ * Example: +CMT: "002B0038003600310033...","","23/08/15,10:30:00+32"
+ */
+static void parse_cmt_header(const uart_line_span_t *header, char *sender, size_t sender_size) {
+    // Find sender number (between quotes after +CMT:)
+    size_t start = span_find_char(header, 0, '"');
+    size_t end = start < header->len ? span_find_char(header, start + 1, '"') : header->len;
+    size_t hex_len = end - start - 1;
+
+    if (end >= header->len || hex_len == 0 || hex_len > (sender_size - 1) * 2) {
+        ESP_LOGW(TAG, "Sender hex string too long or empty. Len: %d",
+                 end >= header->len ? -1 : (int)hex_len);
+        snprintf(sender, sender_size, "%s", "UNKNOWN");
+        return;
+    }
 
-    // Check for new SMS indication (+CMT:)
-    char *cmt_ptr = strstr(urc_line_buffer, "+CMT:");
-    if (cmt_ptr) {
-        // Find the end of this specific +CMT URC block
-        char *first_crlf = strstr(cmt_ptr, "\r\n");
-        if (first_crlf) {
-            char *second_crlf = strstr(first_crlf + 2, "\r\n");
-            if (second_crlf) {
-                urc_len = (second_crlf - cmt_ptr) + 2; // Length from start of +CMT to end of second \r\n
+    decode_ucs2_hex_span(header, start + 1, end, sender, sender_size, 0, NULL);
+    char masked_sender[LOG_MASKED_PHONE_SIZE];
+    ESP_LOGD(TAG, "Decoded Sender: %s",
+             log_mask_phone(sender, masked_sender, sizeof(masked_sender)));
+}
+#endif
 
-                // Temporarily null-terminate the URC block for parsing
-                char temp_char = cmt_ptr[urc_len];
-                cmt_ptr[urc_len] = '\0';
+// 模组复位后可能重发已投递过的短信,去重窗口内相同(号码+内容)的短信只投递一次
+static void log_duplicate_sms(const sms_message_t *sms) {
+    char masked_sender[LOG_MASKED_PHONE_SIZE];
+    ESP_LOGI(TAG, "Duplicate SMS from %s ignored",
+             log_mask_phone(sms->sender, masked_sender, sizeof(masked_sender)));
+}
 
-                ESP_LOGI(TAG, "New SMS received (direct URC).");
-                esp_err_t parse_result = parse_cmt_text_mode_response(cmt_ptr, &new_sms);
+/**
+ * @brief 取一个sms_pool缓冲用于解码当前正文
+ *
+ * 池中为每个后端预留了单条短信和每个拼接条目各一个缓冲,正常不会等待;
+ * 最多等待SMS_BUFFER_WAIT_MS,以免sms_processor卡住时本任务也停止响应。
+ * 取不到时,从模组存储读出的短信留在存储中稍后重新读取,直接上报的短信丢弃并计入sms_dropped。
+ */
+static sms_message_t *sms_buffer_alloc(uart_at_ctx_t *ctx) {
+    sms_message_t *sms = sms_pool_alloc(pdMS_TO_TICKS(SMS_BUFFER_WAIT_MS));
+    if (sms != NULL) {
+        return sms;
+    }
+#if CONFIG_APP_SMS_PDU_MODE
+    if (ctx->cmt_store_index != SMS_STORE_INDEX_NONE) {
+        ESP_LOGW(TAG, "No SMS buffer free, leaving stored SMS on the modem for later.");
+        ctx->store_stalled = true;
+        ctx->store_drain_pending = true;
+        return NULL;
+    }
+#endif
+    modem_backend_count_dropped(ctx->modem);
+    ESP_LOGE(TAG, "No SMS buffer free within %d ms, message dropped.", SMS_BUFFER_WAIT_MS);
+    return NULL;
+}
 
-                if (parse_result == ESP_OK) {
-                    // 完整SMS已组装完成,发送到队列
-                    if (s_sms_queue != NULL) {
-                        if (xQueueSend(s_sms_queue, &new_sms, portMAX_DELAY) != pdPASS) {
-                            ESP_LOGE(TAG, "Failed to send complete SMS to queue.");
-                        } else {
-                            ESP_LOGI(TAG, "Complete SMS sent to processing queue.");
-                        }
-                    }
-                } else if (parse_result == ESP_ERR_INVALID_STATE) {
-                    // 这是一个片段,已存储,等待更多片段
-                    ESP_LOGD(TAG, "SMS fragment processed, waiting for more fragments.");
-                } else {
-                    ESP_LOGW(TAG, "Failed to parse SMS URC.");
-                }
+// 待投递的单条短信缓冲: 上一条入队后重新取,重复或未入队时沿用
+static sms_message_t *single_sms_buffer(uart_at_ctx_t *ctx) {
+    if (ctx->single_sms == NULL) {
+        ctx->single_sms = sms_buffer_alloc(ctx);
+    }
+    return ctx->single_sms;
+}
+
+// 入队后*sms置为NULL;重复或未能入队时缓冲仍归调用者
+static void send_sms_to_queue(uart_at_ctx_t *ctx, sms_message_t **sms, TickType_t wait_ticks,
+                              const char *what) {
+    if (ctx->sms_queue == NULL) {
+        return;
+    }
+    switch (modem_backend_hand_off(ctx->modem, ctx->sms_queue, sms, wait_ticks)) {
+        case MODEM_SMS_QUEUED:
+            ESP_LOGI(TAG, "%s sent to processing queue.", what);
+            break;
+        case MODEM_SMS_DUPLICATE:
+            log_duplicate_sms(*sms);
+            break;
+        default:
+            ESP_LOGE(TAG, "Failed to send %s to queue.", what);
+            break;
+    }
+}
 
-                cmt_ptr[urc_len] = temp_char; // Restore original char
-                return (cmt_ptr - urc_line_buffer) + urc_len; // Return total length processed from buffer start
+#if !CONFIG_APP_SMS_PDU_MODE
+/**
+ * @brief 处理+CMT正文行(UCS2 hex),一次遍历直接解码为UTF-8写入目标消息
+ *
+ * 支持SMS分段拼接,不同发件人的长短信在拼接表中各占一个条目,互不干扰:
+ * - 长度等于长短信分段载荷长度的正文追加解码到该发件人的条目
+ * - 收到最后一段(长度不等于分段载荷)时投递完整消息
+ * - 普通短消息直接解码到待投递的消息中
+ */
+static void handle_cmt_body(uart_at_ctx_t *ctx, const uart_line_span_t *body) {
+    char masked_sender[LOG_MASKED_PHONE_SIZE];
+    int content_hex_len = (int)body->len;
+
+    log_mask_phone(ctx->cmt_sender, masked_sender, sizeof(masked_sender));
+    ESP_LOGI(TAG, "New SMS received (direct URC).");
+
+    if (content_hex_len == 0) {
+        ESP_LOGW(TAG, "SMS content hex string is empty");
+        return;
+    }
+    ESP_LOGI(TAG, "Processing SMS fragment: Sender='%s', hex_len=%d", masked_sender, content_hex_len);
+
+    // 先投递已超时的条目,再查找本发件人的条目
+    reassembly_expire(ctx);
+
+    // 判断这是否是长短信的中间分段 (长度精确等于协议规定的分段载荷长度)
+    bool is_multipart_part = is_multipart_part_hex_len(content_hex_len);
+    sms_reassembly_entry_t *entry = reassembly_find(ctx, ctx->cmt_sender);
+
+    ESP_LOGD(TAG, "handle_cmt_body: sender='%s', len=%d, is_multipart_part=%d, entry_active=%d",
+             masked_sender, content_hex_len, is_multipart_part, entry != NULL);
+
+    if (entry == NULL) {
+        reassembly_note_late(ctx, ctx->cmt_sender, 0);
+        if (!is_multipart_part) {
+            // 这是一个普通的短SMS,直接解码到待投递的消息
+            ESP_LOGD(TAG, "Processing short SMS (len=%d), no fragmentation", content_hex_len);
+            sms_message_t *single_sms = single_sms_buffer(ctx);
+            if (single_sms == NULL) {
+                return;
             }
+            snprintf(single_sms->sender, sizeof(single_sms->sender), "%s", ctx->cmt_sender);
+            decode_ucs2_hex_span(body, 0, body->len, single_sms->content,
+                                 sizeof(single_sms->content), 0, NULL);
+            ESP_LOGI(TAG, "Complete SMS assembled: Sender='%s', content_len=%u",
+                     masked_sender, (unsigned)strlen(single_sms->content));
+            send_sms_to_queue(ctx, &ctx->single_sms, portMAX_DELAY, "Complete SMS");
+            return;
+        }
+
+        // 这可能是第一个分段,开始累积
+        ESP_LOGI(TAG, "Starting SMS fragment accumulation from sender '%s' (fragment 1, len=%d)",
+                 masked_sender, content_hex_len);
+        entry = reassembly_start(ctx, ctx->cmt_sender);
+        if (entry == NULL) {
+            return;
         }
     }
-    // Add other URC handlers here if needed (e.g., +CGATT, +CPIN)
-    // For this example, we only focus on +CMT
-    return 0; // No complete URC processed
+
+    // 同一发件人,直接解码追加到已累积内容之后
+    bool truncated = false;
+    entry->content_len = decode_ucs2_hex_span(body, 0, body->len,
+                                              entry->message->content,
+                                              sizeof(entry->message->content),
+                                              entry->content_len, &truncated);
+    entry->fragment_count++;
+    reassembly_note_gap(ctx, entry);
+    reassembly_touch(ctx, entry);
+    if (entry->fragment_count > 1) {
+        ESP_LOGI(TAG, "Accumulated SMS fragment %d from '%s' (total_len=%u)",
+                 entry->fragment_count, masked_sender, (unsigned)entry->content_len);
+    }
+
+    if (truncated) {
+        // 缓冲区溢出,用已有内容组装消息
+        ESP_LOGE(TAG, "SMS fragment buffer overflow! Accumulated: %u, Max: %d",
+                 (unsigned)entry->content_len, (int)sizeof(entry->message->content));
+    } else if (is_multipart_part) {
+        // 还需要等待更多片段
+        ESP_LOGI(TAG, "SMS fragment stored, waiting for more fragments...");
+        return;
+    } else {
+        // 长度不等于分段载荷长度的就是最后一段
+        ESP_LOGI(TAG, "Detected final SMS fragment (len=%d), completing message with %d fragments",
+                 content_hex_len, entry->fragment_count);
+    }
+
+    ESP_LOGI(TAG, "Complete SMS assembled: Sender='%s', content_len=%u",
+             masked_sender, (unsigned)entry->content_len);
+    reassembly_complete(ctx, entry);
 }
+#else // CONFIG_APP_SMS_PDU_MODE
 
-// Helper function to convert a hex char to its integer value
-static int hex_char_to_int(char c) {
-    if (c >= '0' && c <= '9') return c - '0';
-    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
-    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
-    return -1; // Invalid hex char
+// 把span中的PDU hex转换为字节,非法hex或超长返回0
+static size_t span_hex_to_bytes(const uart_line_span_t *span, uint8_t *out, size_t out_size) {
+    if (span->len % 2 != 0 || span->len / 2 > out_size) {
+        return 0;
+    }
+    size_t seg0_bytes = span->seg_len[0] / 2;
+    if (!text_hex_to_bytes(span->seg[0], seg0_bytes, out)) {
+        return 0;
+    }
+    size_t pos = seg0_bytes * 2;
+    if (span->seg_len[0] % 2 != 0) {
+        // 回绕处正好切开一个字节的两个hex字符
+        int hi = text_hex_nibble(uart_line_span_at(span, pos));
+        int lo = text_hex_nibble(uart_line_span_at(span, pos + 1));
+        if (hi < 0 || lo < 0) {
+            return 0;
+        }
+        out[seg0_bytes] = (uint8_t)((hi << 4) | lo);
+        pos += 2;
+    }
+    if (pos < span->len &&
+        !text_hex_to_bytes(span->seg[1] + (pos - span->seg_len[0]), (span->len - pos) / 2,
+                           out + pos / 2)) {
+        return 0;
+    }
+    return span->len / 2;
 }
 
-// Function to decode UCS2 hex string to UTF-8 string
-// Note: This is a simplified UCS2 to UTF-8 conversion.
-// It assumes basic multilingual plane characters.
-// For full Unicode support, a more robust library might be needed.
-static void decode_ucs2_hex_to_utf8(const char *ucs2_hex_str, char *utf8_buf, size_t utf8_buf_len) {
-    size_t ucs2_hex_len = strlen(ucs2_hex_str);
-    size_t utf8_idx = 0;
+// 把一段用户数据解码追加到条目已拼接的内容之后
+static void append_fragment_ud(sms_reassembly_entry_t *entry, sms_pdu_encoding_t encoding,
+                               const uint8_t *ud, size_t ud_len) {
+    entry->content_len = sms_pdu_ud_to_utf8(encoding, ud, ud_len,
+                                            entry->message->content,
+                                            sizeof(entry->message->content),
+                                            entry->content_len, &entry->truncated);
+    entry->next_seq++;
+}
 
-    ESP_LOGD(TAG, "decode_ucs2_hex_to_utf8: Input hex length: %d, Output buffer size: %d", ucs2_hex_len, utf8_buf_len);
+/**
+ * @brief 把已收到、紧接在已解码内容之后的分段依次解码追加,并归还其分段缓冲
+ *
+ * @param skip_missing true时跳过缺失的分段(提前投递时使用)
+ */
+static void append_pending_fragment_parts(uart_at_ctx_t *ctx, sms_reassembly_entry_t *entry, bool skip_missing) {
+    while (entry->next_seq < entry->concat_total) {
+        uint8_t slot = entry->part_slot[entry->next_seq];
+        if (slot != SMS_PART_NONE) {
+            const sms_fragment_part_t *part = &ctx->part_pool[slot];
+            entry->part_slot[entry->next_seq] = SMS_PART_NONE;
+            append_fragment_ud(entry, (sms_pdu_encoding_t)part->encoding, part->data, part->len);
+            ctx->part_pool_used &= ~(1u << slot);
+        } else if (skip_missing) {
+            if (!(entry->received_mask & (1u << entry->next_seq))) {
+                ESP_LOGW(TAG, "SMS part %d/%d never arrived",
+                         entry->next_seq + 1, entry->concat_total);
+            }
+            entry->next_seq++;
+        } else {
+            break;
+        }
+    }
+}
 
-    for (size_t i = 0; i + 4 <= ucs2_hex_len && utf8_idx < utf8_buf_len - 4; i += 4) {
-        int h1 = hex_char_to_int(ucs2_hex_str[i]);
-        int h2 = hex_char_to_int(ucs2_hex_str[i+1]);
-        int h3 = hex_char_to_int(ucs2_hex_str[i+2]);
-        int h4 = hex_char_to_int(ucs2_hex_str[i+3]);
+/**
+ * @brief 处理+CMT正文行(SMS-DELIVER PDU hex)
+ *
+ * 长短信按UDH中的(发件人, 参考号, 总段数)在拼接表中各占一个条目,可同时拼接:
+ * - 非长短信直接解码到待投递的消息中
+ * - 按顺序到达的分段直接解码追加到条目的content,乱序到达的分段暂存在共用分段缓冲池
+ * - 所有分段到齐后立即投递,无需等待分段超时
+ */
+static void handle_cmt_body(uart_at_ctx_t *ctx, const uart_line_span_t *body) {
+    // 放在模组上下文中,避免在深调用链上再压栈
+    sms_pdu_t *pdu = &ctx->pdu;
+    uint8_t raw[SMS_PDU_MAX_BYTES];
+    char masked_sender[LOG_MASKED_PHONE_SIZE];
+    uint16_t store_index = ctx->cmt_store_index;
 
-        if (h1 == -1 || h2 == -1 || h3 == -1 || h4 == -1) {
-            ESP_LOGW(TAG, "Invalid UCS2 hex character at position %d", i);
-            break;
+    if (store_index == SMS_STORE_INDEX_NONE) {
+        ESP_LOGI(TAG, "New SMS received (direct URC).");
+    } else if (store_delete_pending(ctx, store_index) || ctx->store_stalled) {
+        // 已投递、尚未删除,或队列已满留待下次读取
+        return;
+    } else {
+        ESP_LOGI(TAG, "Stored SMS read (index %u).", store_index);
+    }
+
+    size_t raw_len = span_hex_to_bytes(body, raw, sizeof(raw));
+    if (raw_len == 0 || !sms_pdu_parse_deliver(raw, raw_len, pdu)) {
+        ESP_LOGW(TAG, "Invalid or unsupported SMS PDU (hex_len=%u)", (unsigned)body->len);
+        return;
+    }
+    log_mask_phone(pdu->sender, masked_sender, sizeof(masked_sender));
+
+    // 先投递已超时的条目,再查找本消息的条目
+    reassembly_expire(ctx);
+
+    if (!pdu->is_concat || pdu->concat_total == 1) {
+        // 普通短SMS,直接解码到待投递的消息;不影响正在拼接的长短信
+        sms_message_t *single_sms = single_sms_buffer(ctx);
+        if (single_sms == NULL) {
+            return;
+        }
+        snprintf(single_sms->sender, sizeof(single_sms->sender), "%s", pdu->sender);
+        sms_pdu_ud_to_utf8(pdu->encoding, pdu->ud, pdu->ud_len, single_sms->content,
+                           sizeof(single_sms->content), 0, NULL);
+        ESP_LOGI(TAG, "Complete SMS assembled: Sender='%s', content_len=%u",
+                 masked_sender, (unsigned)strlen(single_sms->content));
+        if (store_index == SMS_STORE_INDEX_NONE) {
+            send_sms_to_queue(ctx, &ctx->single_sms, portMAX_DELAY, "Complete SMS");
+        } else if (store_hand_off(ctx, &ctx->single_sms)) {
+            store_mark_delete(ctx, store_index);
         }
+        store_note_pressure(ctx);
+        return;
+    }
 
-        uint16_t ucs2_char = (h1 << 12) | (h2 << 8) | (h3 << 4) | h4;
+    ESP_LOGI(TAG, "Processing SMS part %u/%u (ref=%u) from '%s'",
+             pdu->concat_seq, pdu->concat_total, pdu->concat_ref, masked_sender);
 
-        // Convert UCS2 to UTF-8
-        if (ucs2_char < 0x80) { // 1-byte UTF-8 (ASCII)
-            utf8_buf[utf8_idx++] = (char)ucs2_char;
-        } else if (ucs2_char < 0x800) { // 2-byte UTF-8
-            if (utf8_idx + 1 < utf8_buf_len - 1) {
-                utf8_buf[utf8_idx++] = 0xC0 | (ucs2_char >> 6);
-                utf8_buf[utf8_idx++] = 0x80 | (ucs2_char & 0x3F);
-            } else {
-                ESP_LOGW(TAG, "UTF-8 buffer too small for 2-byte char at position %d (utf8_idx=%d)", i, utf8_idx);
-                break; // Buffer too small
+    // 先校验段号再查找条目: 丢弃的分段不能新建条目、挤掉其他长短信或计入分段间隔
+    // (sms_pdu已把段号非法的UDH当作普通短信,这里再防一次)
+    uint8_t total = pdu->concat_total > MAX_SMS_FRAGMENTS ? MAX_SMS_FRAGMENTS : pdu->concat_total;
+    if (pdu->concat_seq == 0 || pdu->concat_seq > pdu->concat_total) {
+        ESP_LOGW(TAG, "Invalid SMS part number %u/%u, dropped", pdu->concat_seq, pdu->concat_total);
+        return;
+    }
+    if (pdu->concat_seq > total) {
+        ESP_LOGW(TAG, "SMS part %u exceeds the %d-part limit, dropped",
+                 pdu->concat_seq, MAX_SMS_FRAGMENTS);
+        return;
+    }
+    uint8_t index = pdu->concat_seq - 1;
+
+    sms_reassembly_entry_t *entry = reassembly_find(ctx, pdu->sender, pdu->concat_ref, total);
+    if (entry == NULL) {
+        if (store_index == SMS_STORE_INDEX_NONE) {
+            reassembly_note_late(ctx, pdu->sender, pdu->concat_ref);
+        }
+        entry = reassembly_start(ctx, pdu->sender);
+        if (entry == NULL) {
+            return;
+        }
+        entry->concat_ref = pdu->concat_ref;
+        entry->concat_total = total;
+        entry->truncated = pdu->concat_total > MAX_SMS_FRAGMENTS;
+    }
+    // 从模组存储批量读出的分段间隔不反映网络,不计入统计
+    if (store_index == SMS_STORE_INDEX_NONE) {
+        reassembly_note_gap(ctx, entry);
+    }
+    reassembly_touch(ctx, entry);
+
+    if (entry->received_mask & (1u << index)) {
+        ESP_LOGW(TAG, "Duplicate SMS part %u/%u ignored", pdu->concat_seq, pdu->concat_total);
+        return;
+    }
+    entry->received_mask |= 1u << index;
+    entry->fragment_count++;
+    if (store_index != SMS_STORE_INDEX_NONE) {
+        entry->store_mask |= 1u << index;
+        entry->store_index[index] = store_index;
+    }
+
+    if (index == entry->next_seq) {
+        // 按顺序到达: 直接解码追加,并接上之前乱序到达的后续分段
+        append_fragment_ud(entry, pdu->encoding, pdu->ud, pdu->ud_len);
+        append_pending_fragment_parts(ctx, entry, false);
+    } else {
+        uint8_t slot = part_pool_alloc(ctx, entry);
+        sms_fragment_part_t *part = &ctx->part_pool[slot];
+        part->encoding = (uint8_t)pdu->encoding;
+        part->len = pdu->ud_len;
+        memcpy(part->data, pdu->ud, pdu->ud_len);
+        entry->part_slot[index] = slot;
+    }
+
+    if (entry->next_seq < entry->concat_total) {
+        ESP_LOGI(TAG, "SMS fragment stored, waiting for more fragments (%d/%d received)...",
+                 entry->fragment_count, entry->concat_total);
+        reassembly_update_stats(ctx);
+        return;
+    }
+
+    if (entry->truncated) {
+        ESP_LOGE(TAG, "SMS content truncated. Accumulated: %u, Max: %d",
+                 (unsigned)entry->content_len, (int)sizeof(entry->message->content));
+    }
+    ESP_LOGI(TAG, "Complete SMS assembled from %d fragments: Sender='%s', content_len=%u",
+             entry->fragment_count, masked_sender, (unsigned)entry->content_len);
+    reassembly_complete(ctx, entry);
+}
+#endif // CONFIG_APP_SMS_PDU_MODE
+
+#if CONFIG_APP_SMS_PDU_MODE
+static bool store_delete_pending(uart_at_ctx_t *ctx, uint16_t index) {
+    return index < SMS_STORE_MAX_INDEX && (ctx->store_delete_bits[index / 32] & (1u << (index % 32)));
+}
+
+static void store_mark_delete(uart_at_ctx_t *ctx, uint16_t index) {
+    if (index < SMS_STORE_MAX_INDEX) {
+        ctx->store_delete_bits[index / 32] |= 1u << (index % 32);
+    }
+}
+
+// 条目中来自模组存储的分段随消息一起投递后才可删除
+static void store_mark_entry_delete(uart_at_ctx_t *ctx, const sms_reassembly_entry_t *entry) {
+    for (int seq = 0; seq < MAX_SMS_FRAGMENTS; seq++) {
+        if (entry->store_mask & (1u << seq)) {
+            store_mark_delete(ctx, entry->store_index[seq]);
+        }
+    }
+}
+
+/**
+ * @brief 投递一条仍保存在模组存储中的短信
+ *
+ * 队列满时不等待: 短信留在存储中,本次读取的其余短信也不再投递,队列有空位后重新读取。
+ *
+ * @return true 已放入队列,可以删除存储中的副本
+ */
+static bool store_hand_off(uart_at_ctx_t *ctx, sms_message_t **sms) {
+    modem_sms_handoff_t result = ctx->sms_queue != NULL ?
+                                 modem_backend_hand_off(ctx->modem, ctx->sms_queue, sms, 0) : MODEM_SMS_DROPPED;
+    if (result == MODEM_SMS_DUPLICATE) {
+        log_duplicate_sms(*sms);
+        return true; // 存储中的副本同样删除
+    }
+    if (result == MODEM_SMS_DROPPED) {
+        ESP_LOGW(TAG, "SMS queue full, leaving stored SMS on the modem for later.");
+        ctx->store_stalled = true;
+        ctx->store_drain_pending = true;
+        return false;
+    }
+    atomic_fetch_add(&ctx->store_drained, 1);
+    ESP_LOGI(TAG, "Stored SMS sent to processing queue.");
+    return true;
+}
+
+// 每次投递后检查队列: 快满时让模组改为先存储,避免+CMT阻塞在满队列上
+static void store_note_pressure(uart_at_ctx_t *ctx) {
+    if (!ctx->store_mode && ctx->sms_queue != NULL &&
+        uxQueueSpacesAvailable(ctx->sms_queue) <= SMS_STORE_PRESSURE_SPACES) {
+        ctx->store_enter_requested = true;
+    }
+}
+
+static bool sms_store_set_mode(uart_at_ctx_t *ctx, bool store, char *response_buffer, size_t buffer_size) {
+    if (at_send_command(ctx, store ? SMS_CNMI_STORE : SMS_CNMI_DIRECT, response_buffer, buffer_size,
+                        pdMS_TO_TICKS(AT_COMMAND_TIMEOUT_MS)) != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to switch new SMS indications to %s mode.", store ? "store" : "direct");
+        return false;
+    }
+    ctx->store_mode = store;
+    atomic_store(&ctx->store_mode_active, store ? 1 : 0);
+    atomic_fetch_add(&ctx->store_mode_switches, 1);
+    ESP_LOGI(TAG, "New SMS now %s.", store ? "stored on the modem (+CMTI)" : "delivered directly (+CMT)");
+    return true;
+}
+
+/**
+ * @brief 删除已投递的存储短信,每行合并最多SMS_STORE_DELETE_BATCH条AT+CMGD
+ *
+ * 删除失败(如下标已空)也清除标记: 若短信其实还在,下次读取会重复投递,
+ * 但不会因为下标被新短信复用而把未投递的新短信跳过。
+ * 合并的删除超时(模组暂时不应答)时不再逐条删除,也不发送其余批次:
+ * 标记同样清除,下一轮重新AT+CMGL,仍在存储中的短信由去重识别后再删除。
+ */
+static void sms_store_delete_handed_off(uart_at_ctx_t *ctx, char *response_buffer, size_t buffer_size) {
+    char cmd_buf[SMS_STORE_DELETE_BATCH][12];
+    const char *cmds[SMS_STORE_DELETE_BATCH];
+    uint16_t indexes[SMS_STORE_DELETE_BATCH];
+    bool ok[SMS_STORE_DELETE_BATCH];
+    uint16_t index = 0;
+
+    while (index < SMS_STORE_MAX_INDEX) {
+        size_t count = 0;
+        for (; index < SMS_STORE_MAX_INDEX && count < SMS_STORE_DELETE_BATCH; index++) {
+            if (store_delete_pending(ctx, index)) {
+                snprintf(cmd_buf[count], sizeof(cmd_buf[count]), "+CMGD=%u", index);
+                cmds[count] = cmd_buf[count];
+                indexes[count++] = index;
             }
-        } else { // 3-byte UTF-8
-            if (utf8_idx + 2 < utf8_buf_len - 1) {
-                utf8_buf[utf8_idx++] = 0xE0 | (ucs2_char >> 12);
-                utf8_buf[utf8_idx++] = 0x80 | ((ucs2_char >> 6) & 0x3F);
-                utf8_buf[utf8_idx++] = 0x80 | (ucs2_char & 0x3F);
-            } else {
-                ESP_LOGW(TAG, "UTF-8 buffer too small for 3-byte char at position %d (utf8_idx=%d)", i, utf8_idx);
-                break; // Buffer too small
+        }
+        if (count == 0) {
+            break;
+        }
+
+        esp_err_t ret = at_send_chain(ctx, cmds, count, ok, response_buffer, buffer_size,
+                                      pdMS_TO_TICKS(SMS_STORE_DELETE_TIMEOUT_MS));
+        for (size_t i = 0; i < count; i++) {
+            ctx->store_delete_bits[indexes[i] / 32] &= ~(1u << (indexes[i] % 32));
+            if (ok[i]) {
+                atomic_fetch_add(&ctx->store_deleted, 1);
+            } else if (ret != ESP_ERR_TIMEOUT) {
+                ESP_LOGW(TAG, "Failed to delete stored SMS at index %u", indexes[i]);
             }
         }
+        if (ret == ESP_ERR_TIMEOUT) {
+            ESP_LOGW(TAG, "Deleting %u stored SMS timed out, listing the storage again.", (unsigned)count);
+            ctx->store_drain_pending = true;
+            return;
+        }
     }
-    ESP_LOGD(TAG, "decode_ucs2_hex_to_utf8: Decoded %d UTF-8 bytes from %d hex chars", utf8_idx, ucs2_hex_len);
-    utf8_buf[utf8_idx] = '\0'; // Null-terminate
+}
+
+/**
+ * @brief 用一条AT+CMGL=4读出存储中的全部短信
+ *
+ * +CMGL头和PDU行与+CMT一样在环形缓冲中逐条解码投递,不整体缓存,
+ * 因此读取多少条都只占用固定的内存。
+ */
+static void sms_store_drain(uart_at_ctx_t *ctx, char *response_buffer, size_t buffer_size) {
+    ctx->store_drain_pending = false;
+    ctx->store_stalled = false;
+
+    if (at_send_command(ctx, "AT+CMGL=4", response_buffer, buffer_size,
+                        pdMS_TO_TICKS(SMS_STORE_LIST_TIMEOUT_MS)) != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to list stored SMS (AT+CMGL=4).");
+    }
+    sms_store_delete_handed_off(ctx, response_buffer, buffer_size);
+}
+
+/**
+ * @brief 存储转发模式的调度,在uart_at_task主循环中调用
+ *
+ * 启动时及队列快满时切换到存储模式(+CNMI=2,1,新短信存入模组,只上报+CMTI),
+ * 有+CMTI且队列有空位时批量读取;队列清空且存储已读完后切回直接上报(+CMT)。
+ */
+static void sms_store_service(uart_at_ctx_t *ctx, char *response_buffer, size_t buffer_size) {
+    if (ctx->store_enter_requested) {
+        ctx->store_enter_requested = false;
+        if (!ctx->store_mode) {
+            sms_store_set_mode(ctx, true, response_buffer, buffer_size);
+        }
+    }
+
+    if (ctx->store_drain_pending) {
+        if (uxQueueSpacesAvailable(ctx->sms_queue) > 0) {
+            sms_store_drain(ctx, response_buffer, buffer_size);
+        }
+    } else if (ctx->store_mode && uxQueueMessagesWaiting(ctx->sms_queue) == 0) {
+        sms_store_set_mode(ctx, false, response_buffer, buffer_size);
+    }
+}
+#endif // CONFIG_APP_SMS_PDU_MODE
+
+#if !CONFIG_APP_SMS_PDU_MODE
+/**
+ * @brief 把span[start, end)中的UCS2 hex解码为UTF-8,追加到utf8_buf[utf8_len]之后
+ *
+ * 只遍历一次输入,不分配内存,直接读取环形缓冲中(可能回绕)的行;
+ * 代理对(emoji等)解码为4字节UTF-8,包括跨越回绕处的代理对。
+ *
+ * @param truncated 可为NULL;输出缓冲放不下时置true
+ * @return 追加后的UTF-8长度(utf8_buf始终以NUL结尾)
+ */
+static size_t decode_ucs2_hex_span(const uart_line_span_t *span, size_t start, size_t end,
+                                   char *utf8_buf, size_t utf8_buf_len, size_t utf8_len,
+                                   bool *truncated) {
+    text_utf16_state_t state = TEXT_UTF16_STATE_INIT;
+    text_codec_result_t result = TEXT_CODEC_OK;
+    size_t seg0_len = span->seg_len[0];
+    size_t pos = start;
+
+    end = start + (end - start) / 4 * 4; // 末尾不足4个字符的部分忽略
+    if (pos < seg0_len) {
+        size_t n = ((end < seg0_len ? end : seg0_len) - pos) / 4 * 4;
+        result = text_ucs2_hex_to_utf8(&state, span->seg[0] + pos, n,
+                                       utf8_buf, utf8_buf_len, &utf8_len);
+        pos += n;
+    }
+    if (result == TEXT_CODEC_OK && pos < seg0_len && pos < end) {
+        // 只有跨越环形缓冲回绕处的这一个字符需要逐字节取
+        char wrapped[4];
+        for (int k = 0; k < 4; k++) {
+            wrapped[k] = uart_line_span_at(span, pos + k);
+        }
+        result = text_ucs2_hex_to_utf8(&state, wrapped, sizeof(wrapped),
+                                       utf8_buf, utf8_buf_len, &utf8_len);
+        pos += 4;
+    }
+    if (result == TEXT_CODEC_OK && pos < end) {
+        result = text_ucs2_hex_to_utf8(&state, span->seg[1] + (pos - seg0_len), end - pos,
+                                       utf8_buf, utf8_buf_len, &utf8_len);
+    }
+    if (result == TEXT_CODEC_OK) {
+        result = text_utf16_finish(&state, utf8_buf, utf8_buf_len, &utf8_len);
+    }
+
+    if (result == TEXT_CODEC_INVALID_HEX) {
+        ESP_LOGW(TAG, "Invalid UCS2 hex character (decoded %u bytes)", (unsigned)utf8_len);
+    } else if (result == TEXT_CODEC_TRUNCATED) {
+        ESP_LOGW(TAG, "UTF-8 buffer too small (utf8_len=%u)", (unsigned)utf8_len);
+        if (truncated) {
+            *truncated = true;
+        }
+    }
+    return utf8_len;
 }
 
 // ==================== SMS分段拼接相关函数实现 ====================
@@ -920,185 +2496,298 @@ static bool is_multipart_part_hex_len(int hex_len) {
            hex_len == SMS_PART_HEX_LEN_UCS2_8BIT_REF ||
            hex_len == SMS_PART_HEX_LEN_UCS2_16BIT_REF;
 }
+#endif // !CONFIG_APP_SMS_PDU_MODE
+
+// 重新统计存活条目数和占用字节数,供uart_at_get_stats读取
+static void reassembly_update_stats(uart_at_ctx_t *ctx) {
+    uint32_t live = 0;
+    uint32_t bytes = 0;
+
+    for (int i = 0; i < SMS_REASSEMBLY_SLOTS; i++) {
+        const sms_reassembly_entry_t *entry = &ctx->reassembly[i];
+        if (!entry->is_active) {
+            continue;
+        }
+        live++;
+        bytes += entry->content_len;
+#if CONFIG_APP_SMS_PDU_MODE
+        for (int seq = 0; seq < MAX_SMS_FRAGMENTS; seq++) {
+            if (entry->part_slot[seq] != SMS_PART_NONE) {
+                bytes += ctx->part_pool[entry->part_slot[seq]].len;
+            }
+        }
+#endif
+    }
+    atomic_store(&ctx->reasm_live, live);
+    atomic_store(&ctx->reasm_bytes, bytes);
+}
 
 /**
- * @brief 检查分段缓冲区是否超时
- * @return true if timeout, false otherwise
+ * @brief 查找正在拼接的条目
+ * @return 找不到返回NULL
  */
-static bool is_fragment_timeout(void) {
-    if (!s_fragment_buffer.is_active) {
-        return false;
+#if CONFIG_APP_SMS_PDU_MODE
+static sms_reassembly_entry_t *reassembly_find(uart_at_ctx_t *ctx, const char *sender, uint16_t concat_ref,
+                                               uint8_t concat_total) {
+#else
+static sms_reassembly_entry_t *reassembly_find(uart_at_ctx_t *ctx, const char *sender) {
+#endif
+    for (int i = 0; i < SMS_REASSEMBLY_SLOTS; i++) {
+        sms_reassembly_entry_t *entry = &ctx->reassembly[i];
+        if (entry->is_active && !entry->flush_pending && strcmp(entry->message->sender, sender) == 0
+#if CONFIG_APP_SMS_PDU_MODE
+            && entry->concat_ref == concat_ref && entry->concat_total == concat_total
+#endif
+            ) {
+            return entry;
+        }
     }
+    return NULL;
+}
 
-    TickType_t current_time = xTaskGetTickCount();
-    TickType_t elapsed = current_time - s_fragment_buffer.last_fragment_time;
+// 返回最久未更新的活跃条目(跳过except),没有则返回NULL
+static sms_reassembly_entry_t *reassembly_lru(uart_at_ctx_t *ctx, const sms_reassembly_entry_t *except) {
+    sms_reassembly_entry_t *oldest = NULL;
 
-    // 转换为毫秒并检查是否超时
-    if ((elapsed * portTICK_PERIOD_MS) > SMS_FRAGMENT_TIMEOUT_MS) {
-        char masked_sender[LOG_MASKED_PHONE_SIZE];
-        ESP_LOGW(TAG, "SMS fragment buffer timeout after %d ms, flushing %d fragments from sender '%s'",
-                 (int)(elapsed * portTICK_PERIOD_MS), s_fragment_buffer.fragment_count,
-                 log_mask_phone(s_fragment_buffer.sender, masked_sender,
-                                sizeof(masked_sender)));
-        return true;
+    for (int i = 0; i < SMS_REASSEMBLY_SLOTS; i++) {
+        sms_reassembly_entry_t *entry = &ctx->reassembly[i];
+        if (entry->is_active && entry != except &&
+            (oldest == NULL || (int32_t)(entry->last_used - oldest->last_used) < 0)) {
+            oldest = entry;
+        }
     }
-    return false;
+    return oldest;
 }
 
-/**
- * @brief 重置分段缓冲区
- */
-static void reset_fragment_buffer(void) {
-    memset(&s_fragment_buffer, 0, sizeof(s_fragment_buffer));
-    s_fragment_buffer.is_active = false;
-    ESP_LOGD(TAG, "SMS fragment buffer reset");
+// 提前投递被淘汰的条目,绝不静默丢弃
+static void reassembly_evict(uart_at_ctx_t *ctx, sms_reassembly_entry_t *entry, const char *reason) {
+    char masked_sender[LOG_MASKED_PHONE_SIZE];
+    ESP_LOGW(TAG, "Evicting pending SMS from '%s' with %d fragment(s) (%s)",
+             log_mask_phone(entry->message->sender, masked_sender, sizeof(masked_sender)),
+             entry->fragment_count, reason);
+    atomic_fetch_add(&ctx->reasm_evictions, 1);
+    reassembly_flush(ctx, entry, reason, false);
 }
 
 /**
- * @brief 把缓冲区中已累积的内容组装成消息并投递到SMS队列,然后重置缓冲区
- *
- * 用于最后一段始终未到达的情况:宁可投递可能不完整的内容,也不静默丢弃。
- *
- * @param reason 冲刷原因,仅用于日志
+ * @brief 为新的长短信分配条目和缓冲;表满时淘汰最久未更新的条目
+ * @return 取不到缓冲时返回NULL
  */
-static void flush_fragment_buffer_to_queue(const char *reason) {
-    // 分段逻辑只在uart_at_task单线程内执行,static避免在深调用链上再压2KB栈
-    static sms_message_t flushed_sms;
+static sms_reassembly_entry_t *reassembly_start(uart_at_ctx_t *ctx, const char *sender) {
+    sms_reassembly_entry_t *entry = NULL;
 
-    if (!s_fragment_buffer.is_active) {
-        return;
+    for (int i = 0; i < SMS_REASSEMBLY_SLOTS; i++) {
+        if (!ctx->reassembly[i].is_active) {
+            entry = &ctx->reassembly[i];
+            break;
+        }
+    }
+    if (entry == NULL) {
+        entry = reassembly_lru(ctx, NULL);
+        reassembly_evict(ctx, entry, "reassembly table full");
     }
 
-    memset(&flushed_sms, 0, sizeof(flushed_sms));
-    strncpy(flushed_sms.sender, s_fragment_buffer.sender, sizeof(flushed_sms.sender) - 1);
-    decode_ucs2_hex_to_utf8(s_fragment_buffer.accumulated_content, flushed_sms.content,
-                            sizeof(flushed_sms.content));
-    int fragment_count = s_fragment_buffer.fragment_count;
+    reassembly_release(ctx, entry);
+    entry->message = sms_buffer_alloc(ctx);
+    if (entry->message == NULL) {
+        return NULL;
+    }
+    snprintf(entry->message->sender, sizeof(entry->message->sender), "%s", sender);
+    entry->is_active = true;
+    return entry;
+}
 
-    reset_fragment_buffer();
+// 记录片段到达: 刷新超时起点和LRU序号
+static void reassembly_touch(uart_at_ctx_t *ctx, sms_reassembly_entry_t *entry) {
+    entry->last_fragment_time = xTaskGetTickCount();
+    entry->last_used = ++ctx->reassembly_clock;
+}
 
-    if (s_sms_queue != NULL) {
-        if (xQueueSend(s_sms_queue, &flushed_sms, 0) != pdPASS) {
-            ESP_LOGE(TAG, "Failed to send flushed SMS to queue (%s).", reason);
-        } else {
-            ESP_LOGI(TAG, "Flushed %d pending SMS fragment(s) to processing queue (%s).",
-                     fragment_count, reason);
+// 在reassembly_touch之前调用: 同一长短信相邻两段的到达间隔计入统计(新条目没有上一段)
+static void reassembly_note_gap(uart_at_ctx_t *ctx, const sms_reassembly_entry_t *entry) {
+    if (entry->last_used != 0) {
+        fragment_gap_record(&ctx->gaps, pdTICKS_TO_MS(xTaskGetTickCount() - entry->last_fragment_time));
+    }
+}
+
+// 没有拼接中的条目时调用: 该长短信若刚因超时投递,这一段就是迟到的分段。
+// 文本模式无法区分迟到的末段与同一发件人紧接着的普通短信,都按迟到计
+static void reassembly_note_late(uart_at_ctx_t *ctx, const char *sender, uint16_t concat_ref) {
+    for (int i = 0; i < SMS_REASSEMBLY_SLOTS; i++) {
+        sms_expired_entry_t *expired = &ctx->reassembly_expired[i];
+        if (expired->sender[0] == '\0' || expired->concat_ref != concat_ref ||
+            strcmp(expired->sender, sender) != 0) {
+            continue;
         }
+        uint32_t gap_ms = pdTICKS_TO_MS(xTaskGetTickCount() - expired->last_fragment_time);
+        if (gap_ms <= FRAGMENT_GAP_TIMEOUT_MAX_MS) {
+            ESP_LOGW(TAG, "SMS fragment arrived %lu ms after the previous one, past the %lu ms timeout",
+                     (unsigned long)gap_ms, (unsigned long)fragment_gap_timeout_ms(&ctx->gaps));
+            fragment_gap_record_late(&ctx->gaps, gap_ms);
+        }
+        expired->sender[0] = '\0';
     }
 }
 
 /**
- * @brief 处理SMS分段,累积并在完成时返回完整消息
- *
- * @param sender 发件人号码
- * @param content_hex SMS内容的hex字符串
- * @param content_hex_len hex字符串长度
- * @param complete_sms 输出参数:完整的SMS消息(仅在返回ESP_OK时有效)
- * @return ESP_OK 如果完整SMS已组装完成
- *         ESP_ERR_INVALID_STATE 如果这是一个片段,需要等待更多片段
- *         ESP_FAIL 如果处理失败
+ * @brief 清空条目并归还其占用的分段缓冲,以及未能入队的消息缓冲
  */
-static esp_err_t process_sms_fragment(const char *sender, const char *content_hex, int content_hex_len, sms_message_t *complete_sms) {
-    if (!sender || !content_hex || !complete_sms) {
-        return ESP_FAIL;
+static void reassembly_release(uart_at_ctx_t *ctx, sms_reassembly_entry_t *entry) {
+    sms_pool_free(entry->message);
+#if CONFIG_APP_SMS_PDU_MODE
+    // 只有活跃条目的part_slot有效(静态初始化的空条目全为0)
+    for (int seq = 0; entry->is_active && seq < MAX_SMS_FRAGMENTS; seq++) {
+        if (entry->part_slot[seq] != SMS_PART_NONE) {
+            ctx->part_pool_used &= ~(1u << entry->part_slot[seq]);
+        }
     }
-    char masked_sender[LOG_MASKED_PHONE_SIZE];
-    log_mask_phone(sender, masked_sender, sizeof(masked_sender));
+#endif
+    memset(entry, 0, sizeof(*entry));
+    entry->is_active = false;
+#if CONFIG_APP_SMS_PDU_MODE
+    memset(entry->part_slot, SMS_PART_NONE, sizeof(entry->part_slot));
+#endif
+    reassembly_update_stats(ctx);
+}
 
-    // 检查是否超时,如果超时则先投递已累积的内容
-    if (is_fragment_timeout()) {
-        flush_fragment_buffer_to_queue("fragment timeout");
+/**
+ * @brief 投递拼接完成的长短信并释放条目
+ */
+static void reassembly_complete(uart_at_ctx_t *ctx, sms_reassembly_entry_t *entry) {
+#if CONFIG_APP_SMS_PDU_MODE
+    if (entry->store_mask != 0 && entry->store_mask == entry->received_mask) {
+        // 所有分段都还在模组存储中: 队列满时不等待,下次读取时重新拼接
+        if (store_hand_off(ctx, &entry->message)) {
+            store_mark_entry_delete(ctx, entry);
+        }
+    } else {
+        send_sms_to_queue(ctx, &entry->message, portMAX_DELAY, "Complete SMS");
+        store_mark_entry_delete(ctx, entry);
     }
+    reassembly_release(ctx, entry);
+    store_note_pressure(ctx);
+#else
+    send_sms_to_queue(ctx, &entry->message, portMAX_DELAY, "Complete SMS");
+    reassembly_release(ctx, entry);
+#endif
+}
 
-    // 判断这是否是长短信的中间分段 (长度精确等于协议规定的分段载荷长度)
-    bool is_multipart_part = is_multipart_part_hex_len(content_hex_len);
+/**
+ * @brief 把条目中已累积的内容直接投递到SMS队列,然后释放条目
+ *
+ * 用于最后一段始终未到达或条目被淘汰的情况:宁可投递可能不完整的内容,也不静默丢弃。
+ * 队列满时最多等待SMS_FLUSH_QUEUE_WAIT_MS;仍放不进且can_retry时保留条目,
+ * 由下一次reassembly_expire不等待地重试,其间AT任务照常处理其他数据。
+ *
+ * @param reason 冲刷原因,仅用于日志
+ * @param can_retry false: 调用者需要空出条目(淘汰),放不进队列即丢弃
+ */
+static void reassembly_flush(uart_at_ctx_t *ctx, sms_reassembly_entry_t *entry, const char *reason,
+                             bool can_retry) {
+    if (!entry->is_active) {
+        return;
+    }
+    if (entry->flush_pending && can_retry && ctx->sms_queue != NULL &&
+        uxQueueSpacesAvailable(ctx->sms_queue) == 0) {
+        // 队列仍满: 不调用modem_backend_hand_off,以免每次重试都计入sms_dropped
+        return;
+    }
+
+    TickType_t wait_ticks = 0;
+    if (!entry->flush_pending) {
+#if CONFIG_APP_SMS_PDU_MODE
+        // 缺失的分段不再等待,已收到的后续分段按顺序接上
+        append_pending_fragment_parts(ctx, entry, true);
+#endif
+        wait_ticks = pdMS_TO_TICKS(SMS_FLUSH_QUEUE_WAIT_MS);
+    }
 
-    ESP_LOGD(TAG, "process_sms_fragment: sender='%s', len=%d, is_multipart_part=%d, buffer_active=%d",
-             masked_sender, content_hex_len, is_multipart_part, s_fragment_buffer.is_active);
-
-    // 场景1: 如果缓冲区是空的
-    if (!s_fragment_buffer.is_active) {
-        if (is_multipart_part) {
-            // 这可能是第一个分段,开始累积
-            ESP_LOGI(TAG, "Starting SMS fragment accumulation from sender '%s' (fragment 1, len=%d)",
-                     masked_sender, content_hex_len);
-            strncpy(s_fragment_buffer.sender, sender, sizeof(s_fragment_buffer.sender) - 1);
-            strncpy(s_fragment_buffer.accumulated_content, content_hex, sizeof(s_fragment_buffer.accumulated_content) - 1);
-            s_fragment_buffer.last_fragment_time = xTaskGetTickCount();
-            s_fragment_buffer.fragment_count = 1;
-            s_fragment_buffer.is_active = true;
-
-            return ESP_ERR_INVALID_STATE; // 需要等待更多片段
+    if (ctx->sms_queue != NULL) {
+        modem_sms_handoff_t result = modem_backend_hand_off(ctx->modem, ctx->sms_queue, &entry->message,
+                                                            wait_ticks);
+        if (result == MODEM_SMS_DROPPED && can_retry) {
+            if (!entry->flush_pending) {
+                ESP_LOGW(TAG, "SMS queue full, will retry the flushed SMS (%s).", reason);
+                entry->flush_pending = true;
+            }
+            return;
+        }
+        if (result == MODEM_SMS_DROPPED) {
+            // 来自模组存储的分段未删除,下次读取时重新拼接
+            ESP_LOGE(TAG, "Failed to send flushed SMS to queue (%s).", reason);
         } else {
-            // 这是一个普通的短SMS,直接处理
-            ESP_LOGD(TAG, "Processing short SMS (len=%d), no fragmentation", content_hex_len);
-            strncpy(complete_sms->sender, sender, sizeof(complete_sms->sender) - 1);
-            decode_ucs2_hex_to_utf8(content_hex, complete_sms->content, sizeof(complete_sms->content));
-            return ESP_OK; // 完整消息已准备好
-        }
-    }
-
-    // 场景2: 缓冲区有活跃的分段
-    if (s_fragment_buffer.is_active) {
-        // 检查发件人是否匹配
-        if (strcmp(s_fragment_buffer.sender, sender) == 0) {
-            // 同一发件人,继续累积
-            size_t current_len = strlen(s_fragment_buffer.accumulated_content);
-            size_t remaining_space = sizeof(s_fragment_buffer.accumulated_content) - current_len - 1;
-
-            if (content_hex_len < remaining_space) {
-                strncat(s_fragment_buffer.accumulated_content, content_hex, remaining_space);
-                s_fragment_buffer.fragment_count++;
-                s_fragment_buffer.last_fragment_time = xTaskGetTickCount();
-
-                ESP_LOGI(TAG, "Accumulated SMS fragment %d from '%s' (total_hex_len=%d)",
-                         s_fragment_buffer.fragment_count, masked_sender,
-                         (int)strlen(s_fragment_buffer.accumulated_content));
-
-                // 判断是否是最后一个分段 (长度不等于分段载荷长度的就是最后一段)
-                if (!is_multipart_part) {
-                    // 这个片段较短,可能是最后一段
-                    ESP_LOGI(TAG, "Detected final SMS fragment (len=%d), completing message with %d fragments",
-                             content_hex_len, s_fragment_buffer.fragment_count);
-
-                    // 组装完整消息
-                    strncpy(complete_sms->sender, s_fragment_buffer.sender, sizeof(complete_sms->sender) - 1);
-                    decode_ucs2_hex_to_utf8(s_fragment_buffer.accumulated_content, complete_sms->content, sizeof(complete_sms->content));
-
-                    // 重置缓冲区
-                    reset_fragment_buffer();
-
-                    return ESP_OK; // 完整消息已准备好
-                } else {
-                    // 还需要等待更多片段
-                    return ESP_ERR_INVALID_STATE;
-                }
+            if (result == MODEM_SMS_DUPLICATE) {
+                log_duplicate_sms(entry->message);
             } else {
-                ESP_LOGE(TAG, "SMS fragment buffer overflow! Accumulated: %d, New: %d, Max: %d",
-                         (int)current_len, content_hex_len, (int)sizeof(s_fragment_buffer.accumulated_content));
+                ESP_LOGI(TAG, "Flushed %d pending SMS fragment(s) to processing queue (%s).",
+                         entry->fragment_count, reason);
+            }
+#if CONFIG_APP_SMS_PDU_MODE
+            store_mark_entry_delete(ctx, entry);
+#endif
+        }
+    }
+    reassembly_release(ctx, entry);
+}
 
-                // 缓冲区溢出,尝试用已有内容组装消息
-                strncpy(complete_sms->sender, s_fragment_buffer.sender, sizeof(complete_sms->sender) - 1);
-                decode_ucs2_hex_to_utf8(s_fragment_buffer.accumulated_content, complete_sms->content, sizeof(complete_sms->content));
+/**
+ * @brief 投递所有超时未收齐的条目
+ */
+static void reassembly_expire(uart_at_ctx_t *ctx) {
+    TickType_t current_time = xTaskGetTickCount();
+    // 由观测到的分段间隔学习,正常网络上为几秒
+    uint32_t timeout_ms = fragment_gap_timeout_ms(&ctx->gaps);
 
-                reset_fragment_buffer();
-                return ESP_OK; // 返回部分消息
-            }
-        } else {
-            // 不同发件人,说明之前的分段SMS已经结束(可能没收到最后一段)
-            char masked_previous_sender[LOG_MASKED_PHONE_SIZE];
-            ESP_LOGW(TAG, "New SMS from different sender '%s' while fragments from '%s' are pending. Flushing old fragments.",
-                     masked_sender,
-                     log_mask_phone(s_fragment_buffer.sender, masked_previous_sender,
-                                    sizeof(masked_previous_sender)));
+    for (int i = 0; i < SMS_REASSEMBLY_SLOTS; i++) {
+        sms_reassembly_entry_t *entry = &ctx->reassembly[i];
+        if (!entry->is_active) {
+            continue;
+        }
+        if (entry->flush_pending) {
+            reassembly_flush(ctx, entry, "retry", true);
+            continue;
+        }
 
-            // 旧片段直接投递到队列,不能借用complete_sms(会被下面的递归覆盖)
-            flush_fragment_buffer_to_queue("sender changed");
+        // 转换为毫秒并检查是否超时
+        TickType_t elapsed = current_time - entry->last_fragment_time;
+        if (pdTICKS_TO_MS(elapsed) > timeout_ms) {
+            char masked_sender[LOG_MASKED_PHONE_SIZE];
+            ESP_LOGW(TAG, "SMS fragment buffer timeout after %d ms, flushing %d fragments from sender '%s'",
+                     (int)pdTICKS_TO_MS(elapsed), entry->fragment_count,
+                     log_mask_phone(entry->message->sender, masked_sender, sizeof(masked_sender)));
+            atomic_fetch_add(&ctx->reasm_timeouts, 1);
+
+            sms_expired_entry_t *expired = &ctx->reassembly_expired[ctx->reassembly_expired_next];
+            ctx->reassembly_expired_next = (ctx->reassembly_expired_next + 1) % SMS_REASSEMBLY_SLOTS;
+            snprintf(expired->sender, sizeof(expired->sender), "%s", entry->message->sender);
+            expired->last_fragment_time = entry->last_fragment_time;
+#if CONFIG_APP_SMS_PDU_MODE
+            expired->concat_ref = entry->concat_ref;
+#else
+            expired->concat_ref = 0;
+#endif
 
-            // 缓冲区已清空,递归只会走场景1,深度确定为1
-            return process_sms_fragment(sender, content_hex, content_hex_len, complete_sms);
+            reassembly_flush(ctx, entry, "fragment timeout", true);
         }
     }
+}
 
-    return ESP_FAIL;
+#if CONFIG_APP_SMS_PDU_MODE
+/**
+ * @brief 从共用分段缓冲池取一个空位;池满时淘汰其他条目中最久未更新的一个
+ *
+ * 池容量大于单条长短信最多能暂存的分段数,因此淘汰完其他条目后一定有空位。
+ */
+static uint8_t part_pool_alloc(uart_at_ctx_t *ctx, const sms_reassembly_entry_t *requester) {
+    while (ctx->part_pool_used == (1u << SMS_PART_POOL_SIZE) - 1) {
+        reassembly_evict(ctx, reassembly_lru(ctx, requester), "fragment pool full");
+    }
+
+    uint8_t slot = 0;
+    while (ctx->part_pool_used & (1u << slot)) {
+        slot++;
+    }
+    ctx->part_pool_used |= 1u << slot;
+    return slot;
 }
+#endif
@@ -1,6 +1,8 @@
 #ifndef UART_AT_MANAGER_H
 #define UART_AT_MANAGER_H
 
+#include <stdbool.h>
+#include <stdint.h>
 #include "esp_err.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
@@ -9,23 +11,103 @@
 typedef struct {
     char sender[32];    // 短信发送者号码
     char content[2048]; // 短信内容 (支持长SMS,最大约4-5段拼接)
+    uint8_t modem;      // 接收该短信的模组/SIM序号,入队时由modem_backend_hand_off填写
 } sms_message_t;
 
-// 全局变量，用于存储SIM卡运营商和本机号码
-extern char g_sim_operator[32];     // 例如："中国移动", "中国联通"
-extern char g_sim_phone_number[20]; // 例如："+8613800000000"
+// 一个模组实例(串口、SIM信息、运行中的后端),见modem_backend.h
+typedef struct modem_instance modem_instance_t;
 
 /**
  * @brief Initializes the UART driver for AT communication with 4G Cat.1 modem.
  *
+ * Allocates the instance's AT context on first use; each modem instance has
+ * its own receive path, command queue and long-SMS reassembly.
+ *
+ * @param modem The modem instance to drive.
  * @param sms_queue A FreeRTOS queue to send parsed SMS messages to.
  * @return ESP_OK on success, error code otherwise.
  */
-esp_err_t uart_at_init(QueueHandle_t sms_queue);
+esp_err_t uart_at_init(modem_instance_t *modem, QueueHandle_t sms_queue);
+
+// 接收路径、长短信拼接与AT命令统计,用于观察背压和模组响应
+typedef struct {
+    uint32_t rx_enqueue_failures; // UART数据块未能完整放入接收环形缓冲的次数
+    uint32_t rx_dropped_bytes;    // 因环形缓冲满或断流后重新同步丢弃的字节数
+    uint32_t rx_truncated_lines;  // 超过行缓冲长度被截断的行数
+    uint32_t rx_ring_high_water;  // 接收环形缓冲占用峰值(字节)
+    uint32_t rx_wakeups;          // 接收侧唤醒AT任务的次数(每个完整行一次)
+    uint32_t uart_baud_rate;      // 当前与模组通信的波特率
+    uint32_t rx_bytes;            // 累计接收字节数
+    uint32_t rx_peak_bytes_per_s; // 1秒窗口内的最高接收字节数(实际吞吐)
+    uint32_t rx_frame_errors;     // UART帧错误次数(波特率不匹配或线路干扰)
+    uint32_t rx_parity_errors;    // UART校验错误次数
+    uint32_t rx_fifo_overflows;   // 硬件RX FIFO溢出次数
+    uint32_t rx_buffer_full;      // 驱动接收缓冲满的次数(取走数据后恢复,不丢数据)
+    uint32_t rx_flushed_bytes;    // FIFO溢出后清空驱动缓冲丢弃的字节数
+    uint32_t sms_store_mode;      // 1: 新短信先存入模组(+CMTI),0: 直接上报(+CMT)
+    uint32_t sms_store_mode_switches; // 存储/直接上报模式切换次数
+    uint32_t sms_store_drained;   // 从模组存储读出并放入队列的短信数
+    uint32_t sms_store_deleted;   // 投递后从模组存储删除的短信数
+    uint32_t sms_reasm_live;      // 正在拼接的长短信条数
+    uint32_t sms_reasm_bytes;     // 拼接表中已解码内容与暂存分段占用的字节数
+    uint32_t sms_reasm_evictions; // 拼接表或分段缓冲池满时被提前投递的长短信数
+    uint32_t sms_reasm_timeouts;  // 最后一段超时未到而投递的长短信数
+    uint32_t at_cmd_count;        // 收到OK/ERROR的AT命令数
+    uint32_t at_cmd_timeouts;     // 超时未响应的AT命令数
+    uint32_t at_cmd_latency_last_ms; // 最近一条命令从发出到OK/ERROR的耗时
+    uint32_t at_cmd_latency_avg_ms;
+    uint32_t at_cmd_latency_max_ms;
+    uint32_t modem_ready_ms;      // 模组初始化完成时距开机的毫秒数,0表示尚未完成
+    uint32_t modem_warm_start;    // 1: 模组设置与保存的指纹一致,跳过了配置
+    uint32_t telemetry_samples;   // 空闲时段完成的模组状态采样次数
+    uint32_t telemetry_failures;  // 出错或超时的采样次数
+    uint32_t telemetry_deferrals; // 因短信活动或串口忙推迟的采样次数
+    uint32_t telemetry_latency_ms; // 最近一次采样从发出到OK的耗时
+    uint32_t telemetry_uart_us;   // 最近一次采样收发字节占用的串口线路时间
+} uart_at_stats_t;
+
+/**
+ * @brief Reads the AT receive path counters of one modem instance. Safe to
+ *        call from any task; all zero if the instance is not running AT.
+ *
+ * @param modem The modem instance.
+ * @param stats Output structure.
+ */
+void uart_at_get_stats(const modem_instance_t *modem, uart_at_stats_t *stats);
+
+/**
+ * @brief Handler for lines from the modem that start with a registered prefix.
+ *
+ * Runs in the AT task for every matching line, unsolicited or not: "+CSQ: ..."
+ * reaches a "+CSQ:" handler also when it is the response to an AT+CSQ in
+ * flight. Handlers must not send AT commands or block.
+ *
+ * @param line NUL-terminated line without "\r\n".
+ * @param len Length of line.
+ * @param arg Value given at registration.
+ * @return true if the line is purely unsolicited and must not be passed on
+ *         to the command in flight.
+ */
+typedef bool (*uart_at_urc_handler_t)(const char *line, int len, void *arg);
+
+/**
+ * @brief Registers a handler for lines starting with prefix (e.g. "+CGEV:")
+ *        received from one modem instance.
+ *
+ * Registered handlers run after the built-in ones (SMS, readiness and the
+ * modem_status cache), in registration order; those with a prefix shorter
+ * than three characters are checked against every line and run last. Call
+ * during startup, from one task at a time; the prefix string must stay valid.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_ARG, ESP_ERR_INVALID_STATE if the instance
+ *         is not running the AT backend, or ESP_ERR_NO_MEM if the table is full.
+ */
+esp_err_t uart_at_register_urc_handler(modem_instance_t *modem, const char *prefix,
+                                       uart_at_urc_handler_t handler, void *arg);
 
 /**
  * @brief FreeRTOS task to handle AT communication, listen for SMS, and send to queue.
- * @param pvParameters Should be NULL.
+ * @param pvParameters The modem_instance_t given to uart_at_init.
  */
 void uart_at_task(void *pvParameters);
 
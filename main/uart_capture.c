@@ -0,0 +1,194 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "uart_capture.h"
+#include "mqtt_manager.h"
+
+static const char *TAG = "uart_capture";
+
+#if CONFIG_APP_UART_CAPTURE_ENABLE
+
+#define CAPTURE_RING_SIZE      CONFIG_APP_UART_CAPTURE_SIZE
+#define CAPTURE_DUMP_TASK_STACK 4096
+
+// 收(uart_event_task)和发(uart_at_task/uart_dtu_task)在不同任务中记录,临界区内只做memcpy
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint8_t s_ring[CAPTURE_RING_SIZE];
+static size_t s_tail = 0;  // 最旧记录的起点
+static size_t s_used = 0;
+static uint32_t s_records = 0;
+static uint32_t s_bytes = 0;
+static uint32_t s_lost_records = 0;
+static uint32_t s_dumps = 0;
+static _Atomic bool s_dump_running = false;
+
+static void ring_write(size_t pos, const void *src, size_t len) {
+    size_t first = CAPTURE_RING_SIZE - pos;
+    if (first > len) {
+        first = len;
+    }
+    memcpy(&s_ring[pos], src, first);
+    memcpy(s_ring, (const uint8_t *)src + first, len - first);
+}
+
+static void ring_read(size_t pos, void *dst, size_t len) {
+    size_t first = CAPTURE_RING_SIZE - pos;
+    if (first > len) {
+        first = len;
+    }
+    memcpy(dst, &s_ring[pos], first);
+    memcpy((uint8_t *)dst + first, s_ring, len - first);
+}
+
+// 调用者持有s_lock;空间不足时丢弃最旧的整条记录
+static void ring_append(const uart_capture_record_t *hdr, const void *data) {
+    size_t need = sizeof(*hdr) + hdr->len;
+    while (CAPTURE_RING_SIZE - s_used < need) {
+        uart_capture_record_t old;
+        ring_read(s_tail, &old, sizeof(old));
+        size_t old_size = sizeof(old) + old.len;
+        s_tail = (s_tail + old_size) % CAPTURE_RING_SIZE;
+        s_used -= old_size;
+        s_lost_records++;
+    }
+    size_t head = (s_tail + s_used) % CAPTURE_RING_SIZE;
+    ring_write(head, hdr, sizeof(*hdr));
+    ring_write((head + sizeof(*hdr)) % CAPTURE_RING_SIZE, data, hdr->len);
+    s_used += need;
+    s_records++;
+    s_bytes += hdr->len;
+}
+
+void uart_capture_record(uart_capture_dir_t dir, const void *data, size_t len) {
+    uart_capture_record_t hdr = {
+        .t_us = (uint32_t)esp_timer_get_time(),
+        .dir = (uint8_t)dir,
+    };
+    const uint8_t *p = data;
+
+    while (len > 0) {
+        hdr.len = len < UART_CAPTURE_MAX_RECORD ? (uint16_t)len : UART_CAPTURE_MAX_RECORD;
+        portENTER_CRITICAL(&s_lock);
+        ring_append(&hdr, p);
+        portEXIT_CRITICAL(&s_lock);
+        p += hdr.len;
+        len -= hdr.len;
+    }
+}
+
+esp_err_t uart_capture_dump(void) {
+    // 先在临界区外分配,再复制当前内容;导出期间的新记录照常写入环中
+    uint8_t *snapshot = malloc(CAPTURE_RING_SIZE);
+    if (snapshot == NULL) {
+        ESP_LOGE(TAG, "No memory for a %d byte capture snapshot", CAPTURE_RING_SIZE);
+        return ESP_ERR_NO_MEM;
+    }
+    portENTER_CRITICAL(&s_lock);
+    size_t used = s_used;
+    uint32_t lost = s_lost_records;
+    ring_read(s_tail, snapshot, used);
+    portEXIT_CRITICAL(&s_lock);
+
+    static uint8_t chunk[sizeof(uart_capture_chunk_t) + UART_CAPTURE_CHUNK_SIZE]; // 只在导出任务中使用
+    uart_capture_chunk_t hdr = {
+        .version = UART_CAPTURE_VERSION,
+        .dump_id = (uint32_t)(esp_timer_get_time() / 1000),
+        .lost_records = lost,
+    };
+    memcpy(hdr.magic, UART_CAPTURE_MAGIC, sizeof(hdr.magic));
+    esp_err_t err = ESP_OK;
+    size_t offset = 0;
+    do {
+        size_t n = used - offset < UART_CAPTURE_CHUNK_SIZE ? used - offset : UART_CAPTURE_CHUNK_SIZE;
+        hdr.flags = offset + n == used ? UART_CAPTURE_CHUNK_LAST : 0;
+        hdr.len = (uint16_t)n;
+        memcpy(chunk, &hdr, sizeof(hdr));
+        memcpy(chunk + sizeof(hdr), snapshot + offset, n);
+        err = mqtt_manager_publish(CONFIG_APP_MQTT_TOPIC_CAPTURE, (const char *)chunk,
+                                   (int)(sizeof(hdr) + n), 1);
+        offset += n;
+        hdr.index++;
+    } while (err == ESP_OK && offset < used);
+    free(snapshot);
+
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Capture dump %lu stopped at chunk %u: %s",
+                 (unsigned long)hdr.dump_id, (unsigned)hdr.index - 1, esp_err_to_name(err));
+        return err;
+    }
+    portENTER_CRITICAL(&s_lock);
+    s_dumps++;
+    portEXIT_CRITICAL(&s_lock);
+    ESP_LOGI(TAG, "Published capture dump %lu: %u bytes in %u chunks (%lu older records lost)",
+             (unsigned long)hdr.dump_id, (unsigned)used, (unsigned)hdr.index, (unsigned long)lost);
+    return ESP_OK;
+}
+
+static void capture_dump_task(void *arg) {
+    (void)arg;
+    uart_capture_dump();
+    atomic_store(&s_dump_running, false);
+    vTaskDelete(NULL);
+}
+
+void uart_capture_handle_command(const char *data, int len) {
+    if (len == 4 && memcmp(data, "dump", 4) == 0) {
+        if (atomic_exchange(&s_dump_running, true)) {
+            ESP_LOGW(TAG, "Capture dump already in progress");
+            return;
+        }
+        // 不在MQTT事件回调中发布,以免阻塞MQTT任务
+        if (xTaskCreate(capture_dump_task, "uart_capture", CAPTURE_DUMP_TASK_STACK, NULL, 2, NULL) != pdPASS) {
+            ESP_LOGE(TAG, "Failed to create capture dump task");
+            atomic_store(&s_dump_running, false);
+        }
+    } else if (len == 5 && memcmp(data, "clear", 5) == 0) {
+        portENTER_CRITICAL(&s_lock);
+        s_tail = 0;
+        s_used = 0;
+        portEXIT_CRITICAL(&s_lock);
+        ESP_LOGI(TAG, "Capture ring cleared");
+    } else {
+        ESP_LOGW(TAG, "Unknown capture command (len=%d)", len);
+    }
+}
+
+void uart_capture_get_stats(uart_capture_stats_t *stats) {
+    portENTER_CRITICAL(&s_lock);
+    stats->records = s_records;
+    stats->bytes = s_bytes;
+    stats->lost_records = s_lost_records;
+    stats->used = (uint32_t)s_used;
+    stats->dumps = s_dumps;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+#else // !CONFIG_APP_UART_CAPTURE_ENABLE
+
+void uart_capture_record(uart_capture_dir_t dir, const void *data, size_t len) {
+    (void)dir;
+    (void)data;
+    (void)len;
+}
+
+esp_err_t uart_capture_dump(void) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+void uart_capture_handle_command(const char *data, int len) {
+    (void)data;
+    ESP_LOGW(TAG, "UART capture is disabled (len=%d)", len);
+}
+
+void uart_capture_get_stats(uart_capture_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+}
+
+#endif // CONFIG_APP_UART_CAPTURE_ENABLE
@@ -0,0 +1,88 @@
+#ifndef UART_CAPTURE_H
+#define UART_CAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+/*
+ * 模组串口原始收发字节的抓包环(CONFIG_APP_UART_CAPTURE_ENABLE)。
+ *
+ * 环中是连续的记录: uart_capture_record_t头 + len字节数据,满了覆盖最旧的记录。
+ * 通过MQTT导出时按UART_CAPTURE_CHUNK_SIZE切块,每块前加uart_capture_chunk_t头,
+ * 各块数据按index拼接即还原记录流。所有字段为小端。
+ * tools/modem_sim/replay.py读取导出文件并把接收字节按原时序回放给解析代码。
+ */
+
+#define UART_CAPTURE_MAGIC      "UCAP"
+#define UART_CAPTURE_VERSION    1
+#define UART_CAPTURE_CHUNK_SIZE 2048 // 每个MQTT消息携带的记录字节数
+#define UART_CAPTURE_MAX_RECORD 512  // 单条记录的最大数据长度,更长的读写拆成多条
+
+typedef enum {
+    UART_CAPTURE_RX = 0, // 模组 -> ESP32
+    UART_CAPTURE_TX = 1, // ESP32 -> 模组
+} uart_capture_dir_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t t_us; // esp_timer_get_time()的低32位,回放只用相邻记录的差值
+    uint16_t len;
+    uint8_t dir;   // uart_capture_dir_t
+    uint8_t reserved;
+} uart_capture_record_t;
+
+#define UART_CAPTURE_CHUNK_LAST 0x01 // 本次导出的最后一块
+
+typedef struct __attribute__((packed)) {
+    char magic[4];         // UART_CAPTURE_MAGIC
+    uint8_t version;       // UART_CAPTURE_VERSION
+    uint8_t flags;         // UART_CAPTURE_CHUNK_*
+    uint16_t index;        // 块序号,从0开始
+    uint32_t dump_id;      // 导出时刻(开机毫秒),区分多次导出
+    uint32_t lost_records; // 导出前被覆盖的记录数
+    uint16_t len;          // 本块记录数据的字节数,多块连续保存在一个文件里时据此分隔
+    uint16_t reserved;
+} uart_capture_chunk_t;
+
+typedef struct {
+    uint32_t records;      // 累计记录数
+    uint32_t bytes;        // 累计记录的收发字节数
+    uint32_t lost_records; // 被覆盖的记录数
+    uint32_t used;         // 环中当前占用(含记录头)
+    uint32_t dumps;        // 完成的导出次数
+} uart_capture_stats_t;
+
+#if CONFIG_APP_UART_CAPTURE_ENABLE
+#define UART_CAPTURE_CMD_TOPIC CONFIG_APP_MQTT_TOPIC_CAPTURE "/cmd"
+#endif
+
+/**
+ * @brief Appends raw UART bytes to the capture ring. Only copies the data
+ *        under a short critical section; no formatting, never blocks.
+ *        Does nothing when capture is disabled in menuconfig.
+ */
+void uart_capture_record(uart_capture_dir_t dir, const void *data, size_t len);
+
+/**
+ * @brief Publishes the current ring contents to CONFIG_APP_MQTT_TOPIC_CAPTURE
+ *        (QoS 1) in the calling task. Recording continues meanwhile; the dump
+ *        is a snapshot taken at the start.
+ *
+ * @return ESP_OK, ESP_ERR_NOT_SUPPORTED if capture is disabled,
+ *         ESP_ERR_NO_MEM if the snapshot could not be allocated,
+ *         or the error of the failing publish.
+ */
+esp_err_t uart_capture_dump(void);
+
+/**
+ * @brief Handles a payload received on UART_CAPTURE_CMD_TOPIC:
+ *        "dump" publishes the ring from a short-lived task, "clear" empties it.
+ *        Called from the MQTT event handler; does not block.
+ */
+void uart_capture_handle_command(const char *data, int len);
+
+void uart_capture_get_stats(uart_capture_stats_t *stats);
+
+#endif // UART_CAPTURE_H
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdatomic.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
@@ -11,349 +12,467 @@
 #include "uart_dtu_manager.h"
 #include "mqtt_manager.h"
 #include "log_redaction.h"
-
-// Configuration from Kconfig (与AT版共用同一组UART配置)
-#define UART_PORT_NUM      CONFIG_APP_UART_PORT_NUM
-#define UART_TXD           CONFIG_APP_UART_TXD
-#define UART_RXD           CONFIG_APP_UART_RXD
-#define UART_BAUD_RATE     CONFIG_APP_UART_BAUD_RATE
-
-// content[2048]的UTF-8 hex最长约4094字符,加号码和"config,sms,ok,"前缀留余量
-#define DTU_LINE_BUF_SIZE        4608
-#define DTU_SMS_POLL_INTERVAL_MS 10000 // 轮询读取DTU缓存短信的间隔
-#define DTU_RX_CHUNK_TIMEOUT_MS  100   // 单次uart_read_bytes的等待时间
+#include "operator_table.h"
+#include "uart_capture.h"
+#include "dtu_line_parser.h"
+#include "sms_dedup.h"
+#include "sms_pool.h"
+#include "modem_backend.h"
+#include "modem_uart.h"
+
+// 固件类型固定为AT时这两项不出现在sdkconfig中,本模块仍参与编译
+#ifdef CONFIG_APP_DTU_SMS_POLL_MIN_S
+#define DTU_SMS_POLL_MIN_MS (CONFIG_APP_DTU_SMS_POLL_MIN_S * 1000) // 轮询读取DTU缓存短信的最短间隔
+#define DTU_SMS_POLL_MAX_MS (CONFIG_APP_DTU_SMS_POLL_MAX_S * 1000)
+#else
+#define DTU_SMS_POLL_MIN_MS 10000
+#define DTU_SMS_POLL_MAX_MS 320000
+#endif
+#define DTU_SMS_POLL_UNCONFIRMED_MAX_MS (DTU_SMS_POLL_MIN_MS * 4) // 还没收到过主动上报时的退避上限
 #define DTU_CMD_RESPONSE_TIMEOUT_MS 5000
+#define DTU_SMS_BUFFER_WAIT_MS 500     // 缓冲池空时最多等待的时间;取不到时短信行不解码,留在DTU缓存中由轮询补送
+#define DTU_UART_RX_BUF_SIZE 4096      // 驱动接收缓冲;行不必整行放下,只需容纳uart_dtu_task等待短信队列期间到达的数据
+#define DTU_RX_CHUNK_SIZE 128          // uart_dtu_task单次从驱动读取的字节数
+#define DTU_RX_PATTERN_QUEUE_LEN 32    // 驱动记录的'\n'位置个数
+#define DTU_RX_FULL_THRESH 96          // RX FIFO(128字节)达到该值时搬入驱动缓冲
+#define DTU_RX_TOUT_SYMBOLS 10         // 线路空闲约一个字符时间即上报超时
 
 static const char *TAG = "uart_dtu_manager";
-static QueueHandle_t s_sms_queue = NULL;
-
-// 行累积缓冲(仅在uart_dtu_task上下文中使用)
-static char s_rx_acc[DTU_LINE_BUF_SIZE];
-static int s_rx_acc_len = 0;
-
-// 行读取缓冲,dtu_query与主循环共用(同一任务上下文,无并发)
-// 必须是全尺寸:查询期间到达的短信上报行也经此缓冲,截断会导致短信丢失
-static char s_line_buf[DTU_LINE_BUF_SIZE];
-
-// DTU固件没有AT通道查IMSI,改用ICCID前缀识别运营商
-typedef struct {
-    const char *iccid_prefix;
-    const char *operator_name_zh;
-} iccid_operator_map_t;
-
-static const iccid_operator_map_t s_iccid_operator_map[] = {
-    {"898600", "中国移动"},
-    {"898602", "中国移动"},
-    {"898604", "中国移动"},
-    {"898607", "中国移动"},
-    {"898608", "中国移动"},
-    {"898601", "中国联通"},
-    {"898606", "中国联通"},
-    {"898609", "中国联通"},
-    {"898603", "中国电信"},
-    {"898611", "中国电信"},
-    {"898615", "中国广电"},
-    {"896405", "Skinny"},  // 新西兰 Skinny(Spark旗下MVNO)
+typedef struct uart_dtu_ctx uart_dtu_ctx_t;
+
+// 一个DTU模组的运行状态,挂在modem_instance_t.ctx上,由uart_dtu_init分配
+struct uart_dtu_ctx {
+    modem_instance_t *modem;
+    QueueHandle_t sms_queue;
+    QueueHandle_t uart_event_queue;
+
+    // 流式分行: uart_dtu_task从驱动缓冲按小块读取并送入解析器,短信内容边收边解码进sms,
+    // 不缓存整行。以下都只在uart_dtu_task中使用
+    dtu_line_parser_t parser;
+    sms_message_t *sms;             // 解析器的解码目标(sms_pool缓冲),入队后换一个新的
+    uint8_t rx_chunk[DTU_RX_CHUNK_SIZE];
+    size_t rx_chunk_pos;
+    size_t rx_chunk_len;
+
+    _Atomic bool rx_resync;         // FIFO溢出后由uart_dtu_task丢弃收到一半的行
+    _Atomic uint32_t rx_buffered_high_water; // 驱动接收缓冲积压峰值
+    _Atomic uint32_t rx_wakeups;    // 唤醒uart_dtu_task的次数
+    _Atomic uint32_t rx_dropped_bytes; // parser中计数的副本,供统计读取
+    _Atomic uint32_t rx_truncated_lines;
+    _Atomic uint32_t rx_fifo_overflows;
+    _Atomic uint32_t rx_buffer_full;
+    TaskHandle_t uart_event_task_handle;
+    _Atomic TaskHandle_t uart_dtu_task_handle; // 有新行时通知
+
+    // 缓存轮询: 空轮询时间隔指数退避,轮询读到主动上报漏掉的短信时回到最短间隔。
+    // 间隔只在uart_dtu_task中修改,其余字段供统计读取
+    _Atomic bool poll_requested;    // 开机、MQTT恢复后立即轮询一次
+    bool push_confirmed;            // 收到过主动上报,才退避到DTU_SMS_POLL_MAX_MS
+    _Atomic uint32_t poll_interval_ms;
+    _Atomic uint32_t polls;
+    _Atomic uint32_t poll_hits;
+    _Atomic uint32_t poll_timeouts;
+    _Atomic uint32_t poll_bytes;    // 轮询命令和响应占用的串口字节数
+    _Atomic uint32_t active_reports; // 轮询之外收到的短信行数
 };
-static const size_t s_iccid_operator_map_size = sizeof(s_iccid_operator_map) / sizeof(s_iccid_operator_map[0]);
+
+// 一行短信的处理结果
+typedef enum {
+    DTU_SMS_NONE,      // 不是短信(或是无内容的config,sms,ok)
+    DTU_SMS_NEW,       // 新短信,已入队
+    DTU_SMS_DUPLICATE, // 去重窗口内已入队过
+    DTU_SMS_DROPPED,   // 短信队列满或没有空闲缓冲,丢弃
+} dtu_sms_result_t;
 
 // 发送一条DTU配置命令,自动追加\r\n
-static void dtu_send_command(const char *cmd) {
-    ESP_LOGD(TAG, "DTU cmd: %s", cmd);
-    uart_write_bytes(UART_PORT_NUM, cmd, strlen(cmd));
-    uart_write_bytes(UART_PORT_NUM, "\r\n", 2);
+static void dtu_send_command(uart_dtu_ctx_t *ctx, const char *cmd) {
+    const modem_uart_port_t *port = &ctx->modem->uart;
+    ESP_LOGD(TAG, "DTU%u cmd: %s", ctx->modem->index, cmd);
+    uart_write_bytes(port->num, cmd, strlen(cmd));
+    uart_write_bytes(port->num, "\r\n", 2);
+    modem_uart_capture(port, UART_CAPTURE_TX, cmd, strlen(cmd));
+    modem_uart_capture(port, UART_CAPTURE_TX, "\r\n", 2);
 }
 
-// 从UART读出一行(去掉\r\n)。返回true表示取到一行,false表示超时
-static bool dtu_read_line(char *line, size_t line_size, TickType_t timeout_ticks) {
-    TickType_t start = xTaskGetTickCount();
-    while (1) {
-        char *nl = memchr(s_rx_acc, '\n', s_rx_acc_len);
-        if (nl) {
-            int line_len = nl - s_rx_acc;
-            int copy_len = line_len;
-            if (copy_len > 0 && s_rx_acc[copy_len - 1] == '\r') {
-                copy_len--;
-            }
-            if (copy_len >= (int)line_size) {
-                ESP_LOGW(TAG, "RX line truncated from %d to %d bytes", copy_len, (int)line_size - 1);
-                copy_len = line_size - 1;
-            }
-            memcpy(line, s_rx_acc, copy_len);
-            line[copy_len] = '\0';
-            int remain = s_rx_acc_len - (line_len + 1);
-            memmove(s_rx_acc, nl + 1, remain);
-            s_rx_acc_len = remain;
-            return true;
-        }
+static void notify_rx_consumer(uart_dtu_ctx_t *ctx) {
+    TaskHandle_t consumer = atomic_load(&ctx->uart_dtu_task_handle);
+    if (consumer != NULL) {
+        atomic_fetch_add_explicit(&ctx->rx_wakeups, 1, memory_order_relaxed);
+        xTaskNotifyGive(consumer);
+    }
+}
 
-        if (xTaskGetTickCount() - start >= timeout_ticks) {
-            return false;
-        }
+/**
+ * UART event handler: 只负责唤醒uart_dtu_task,数据由uart_dtu_task自己从驱动缓冲读取。
+ *
+ * 驱动的'\n'模式检测每收到一行产生一个UART_PATTERN_DET,此时唤醒;长行中途的FIFO阈值
+ * 和空闲超时事件不唤醒,数据留在驱动缓冲中等该行结束。没有数据时两个任务都不唤醒。
+ */
+static void uart_dtu_event_task(void *pvParameters) {
+    uart_dtu_ctx_t *ctx = pvParameters;
+    uart_port_t port = ctx->modem->uart.num;
+    uart_event_t event;
 
-        int space = DTU_LINE_BUF_SIZE - s_rx_acc_len;
-        if (space <= 0) {
-            // 无换行的超长数据(如误开的透传通道数据),丢弃防止卡死
-            ESP_LOGW(TAG, "RX buffer full without newline, dropping %d bytes", s_rx_acc_len);
-            s_rx_acc_len = 0;
-            space = DTU_LINE_BUF_SIZE;
+    while (1) {
+        if (xQueueReceive(ctx->uart_event_queue, &event, portMAX_DELAY) != pdPASS) {
+            continue;
         }
-        int len = uart_read_bytes(UART_PORT_NUM, (uint8_t *)s_rx_acc + s_rx_acc_len, space,
-                                  pdMS_TO_TICKS(DTU_RX_CHUNK_TIMEOUT_MS));
-        if (len > 0) {
-            s_rx_acc_len += len;
+        switch (event.type) {
+            case UART_PATTERN_DET:
+                // 行位置用不到(uart_dtu_task读取全部缓冲数据),只清空位置队列
+                while (uart_pattern_pop_pos(port) >= 0) {
+                }
+                notify_rx_consumer(ctx);
+                break;
+            case UART_DATA:
+                // 还有未取走的行位置: 该行的UART_PATTERN_DET因事件队列满而丢失,补一次唤醒
+                if (event.timeout_flag && uart_pattern_get_pos(port) >= 0) {
+                    while (uart_pattern_pop_pos(port) >= 0) {
+                    }
+                    notify_rx_consumer(ctx);
+                }
+                break;
+            case UART_FIFO_OVF:
+                // 硬件FIFO已丢字节,缓冲中的数据与之后的数据接不上,只能丢弃重新同步
+                ESP_LOGW(TAG, "UART FIFO overflow, flushing input");
+                atomic_fetch_add_explicit(&ctx->rx_fifo_overflows, 1, memory_order_relaxed);
+                uart_flush_input(port);
+                xQueueReset(ctx->uart_event_queue);
+                uart_pattern_queue_reset(port, DTU_RX_PATTERN_QUEUE_LEN);
+                atomic_store(&ctx->rx_resync, true);
+                break;
+            case UART_BUFFER_FULL:
+                // 驱动缓冲满时尚未丢数据,uart_dtu_task取走后即恢复接收(长行也不必等到行尾)
+                ESP_LOGW(TAG, "UART RX buffer full, draining");
+                atomic_fetch_add_explicit(&ctx->rx_buffer_full, 1, memory_order_relaxed);
+                notify_rx_consumer(ctx);
+                break;
+            default:
+                ESP_LOGW(TAG, "UART event type: %d", event.type);
+                break;
         }
     }
+    vTaskDelete(NULL);
 }
 
-static int hex_char_to_int(char c) {
-    if (c >= '0' && c <= '9') return c - '0';
-    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
-    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
-    return -1;
-}
-
-// 截断处若正好切在UTF-8多字节字符中间,去掉末尾不完整的序列,返回新长度
-static size_t utf8_trim_incomplete_tail(char *buf, size_t len) {
-    size_t end = len;
-    int back = 0;
-    while (end > 0 && back < 3 && ((unsigned char)buf[end - 1] & 0xC0) == 0x80) {
-        end--;
-        back++;
+// 从驱动缓冲读取一块到s_rx_chunk,驱动缓冲为空时返回false
+static bool dtu_rx_fill(uart_dtu_ctx_t *ctx) {
+    if (atomic_exchange(&ctx->rx_resync, false)) {
+        dtu_line_parser_mark_gap(&ctx->parser);
     }
-    if (end == 0) {
-        return len; // 找不到lead字节,数据本身非法,原样保留
+    size_t buffered = 0;
+    uart_get_buffered_data_len(ctx->modem->uart.num, &buffered);
+    if (buffered > atomic_load_explicit(&ctx->rx_buffered_high_water, memory_order_relaxed)) {
+        atomic_store_explicit(&ctx->rx_buffered_high_water, buffered, memory_order_relaxed);
     }
-    unsigned char lead = (unsigned char)buf[end - 1];
-    int seq_len = 1;
-    if ((lead & 0xE0) == 0xC0) seq_len = 2;
-    else if ((lead & 0xF0) == 0xE0) seq_len = 3;
-    else if ((lead & 0xF8) == 0xF0) seq_len = 4;
-    if (back + 1 < seq_len) {
-        buf[end - 1] = '\0';
-        return end - 1;
+    int len = uart_read_bytes(ctx->modem->uart.num, ctx->rx_chunk, sizeof(ctx->rx_chunk), 0);
+    if (len <= 0) {
+        return false;
     }
-    return len;
+    modem_backend_count_rx(ctx->modem, (uint32_t)len);
+    modem_uart_capture(&ctx->modem->uart, UART_CAPTURE_RX, ctx->rx_chunk, (size_t)len);
+    ctx->rx_chunk_pos = 0;
+    ctx->rx_chunk_len = (size_t)len;
+    return true;
 }
 
-// 银尔达DTU固件短信内容为UTF-8的hex编码,解码后即为UTF-8字符串
-// 返回解码后的字节数,失败返回-1
-static int decode_utf8_hex(const char *hex, char *out, size_t out_size) {
-    size_t hex_len = strlen(hex);
-    if (hex_len == 0 || hex_len % 2 != 0) {
-        return -1;
-    }
-    size_t byte_len = hex_len / 2;
-    bool truncated = false;
-    if (byte_len >= out_size) {
-        ESP_LOGW(TAG, "SMS content too long (%d bytes), truncating to %d", (int)byte_len, (int)out_size - 1);
-        byte_len = out_size - 1;
-        truncated = true;
-    }
-    for (size_t i = 0; i < byte_len; i++) {
-        int hi = hex_char_to_int(hex[i * 2]);
-        int lo = hex_char_to_int(hex[i * 2 + 1]);
-        if (hi < 0 || lo < 0) {
-            return -1;
+// 解析已收到的数据,直到一行结束或数据用完
+static dtu_line_type_t dtu_parse_available(uart_dtu_ctx_t *ctx) {
+    do {
+        while (ctx->rx_chunk_pos < ctx->rx_chunk_len) {
+            dtu_line_type_t type;
+            ctx->rx_chunk_pos += dtu_line_parser_feed(&ctx->parser, ctx->rx_chunk + ctx->rx_chunk_pos,
+                                                      ctx->rx_chunk_len - ctx->rx_chunk_pos, &type);
+            if (type != DTU_LINE_NONE) {
+                atomic_store(&ctx->rx_truncated_lines, ctx->parser.truncated_lines);
+                atomic_store(&ctx->rx_dropped_bytes, ctx->parser.dropped_bytes);
+                return type;
+            }
         }
-        out[i] = (char)((hi << 4) | lo);
+    } while (dtu_rx_fill(ctx));
+    return DTU_LINE_NONE;
+}
+
+// 取得下一行。没有完整行时阻塞等待通知,不轮询。普通行见ctx->parser.text,短信已解码到ctx->sms。
+// 返回DTU_LINE_NONE表示超时,或被uart_dtu_request_sms_poll()提前唤醒
+static dtu_line_type_t dtu_read_line(uart_dtu_ctx_t *ctx, TickType_t timeout_ticks) {
+    dtu_line_type_t type = dtu_parse_available(ctx);
+    if (type != DTU_LINE_NONE) {
+        return type;
     }
-    out[byte_len] = '\0';
-    if (truncated) {
-        byte_len = utf8_trim_incomplete_tail(out, byte_len);
+    ulTaskNotifyTake(pdTRUE, timeout_ticks);
+    return dtu_parse_available(ctx);
+}
+
+// 取解码下一条短信的缓冲,只在两行之间调用。池中为本后端预留了一个,正常不会等待
+static void dtu_take_sms_buffer(uart_dtu_ctx_t *ctx, TickType_t wait_ticks) {
+    if (ctx->sms == NULL) {
+        ctx->sms = sms_pool_alloc(wait_ticks);
+        ctx->parser.sms = ctx->sms;
     }
-    return byte_len;
 }
 
-// 解析短信行: config,sms,ok,<号码>,<UTF-8内容hex>
-// 注意发送短信的响应是 config,sms,ok,<0/1> (无内容字段),需排除
-static bool parse_sms_line(const char *line, sms_message_t *sms) {
-    static const char prefix[] = "config,sms,ok,";
-    if (strncmp(line, prefix, sizeof(prefix) - 1) != 0) {
-        return false;
+// 处理一行DTU输出: 是短信则去重后入队,其余仅记录日志
+static dtu_sms_result_t dtu_handle_line(uart_dtu_ctx_t *ctx, dtu_line_type_t type) {
+    dtu_take_sms_buffer(ctx, 0);
+    if (type == DTU_LINE_SMS_NO_BUFFER) {
+        modem_backend_count_dropped(ctx->modem);
+        ESP_LOGE(TAG, "No SMS buffer free, SMS left in the DTU cache");
+        return DTU_SMS_DROPPED;
     }
-    const char *sender_start = line + sizeof(prefix) - 1;
-    const char *comma = strchr(sender_start, ',');
-    if (comma == NULL) {
-        return false; // 无内容字段: 是发送响应或空缓存返回
+    if (type == DTU_LINE_TEXT) {
+        if (ctx->parser.text_len > 0) {
+            ESP_LOGD(TAG, "DTU line received (len=%u)", (unsigned)ctx->parser.line_bytes);
+        }
+        return DTU_SMS_NONE;
     }
-    size_t sender_len = comma - sender_start;
-    if (sender_len == 0 || sender_len >= sizeof(sms->sender)) {
-        return false;
+    if (type == DTU_LINE_SMS_INVALID) {
+        ESP_LOGW(TAG, "Failed to decode SMS content hex (hex_len=%u)", (unsigned)ctx->parser.hex_chars);
+        return DTU_SMS_NONE;
+    }
+    if (type != DTU_LINE_SMS) {
+        return DTU_SMS_NONE;
+    }
+    if (ctx->parser.content_truncated) {
+        ESP_LOGW(TAG, "SMS content too long, truncated to %u bytes", (unsigned)ctx->parser.content_len);
     }
 
-    memset(sms, 0, sizeof(sms_message_t));
-    memcpy(sms->sender, sender_start, sender_len);
-    sms->sender[sender_len] = '\0';
-
-    if (decode_utf8_hex(comma + 1, sms->content, sizeof(sms->content)) < 0) {
-        ESP_LOGW(TAG, "Failed to decode SMS content hex (hex_len=%u)",
-                 (unsigned)strlen(comma + 1));
-        return false;
+    char masked_sender[LOG_MASKED_PHONE_SIZE];
+    log_mask_phone(ctx->sms->sender, masked_sender, sizeof(masked_sender));
+    // 主动上报与轮询config,get,sms可能重复送达同一条短信,且轮询不清除DTU缓存,会反复读到同一条
+    switch (modem_backend_hand_off(ctx->modem, ctx->sms_queue, &ctx->sms, pdMS_TO_TICKS(1000))) {
+        case MODEM_SMS_QUEUED:
+            ESP_LOGI(TAG, "SMS received from %s (content_len=%u)",
+                     masked_sender, (unsigned)ctx->parser.content_len);
+            // 缓冲已归队列,下一行解码到新的缓冲;取不到时下一行之后再取
+            dtu_take_sms_buffer(ctx, pdMS_TO_TICKS(DTU_SMS_BUFFER_WAIT_MS));
+            return DTU_SMS_NEW;
+        case MODEM_SMS_DUPLICATE:
+            ESP_LOGD(TAG, "Duplicate SMS from %s ignored", masked_sender);
+            return DTU_SMS_DUPLICATE;
+        default:
+            ESP_LOGE(TAG, "SMS queue full, message from %s dropped", masked_sender);
+            return DTU_SMS_DROPPED;
     }
-    return true;
 }
 
-// 去重: 主动上报与轮询config,get,sms可能重复送达同一条短信,
-// 且轮询若不清除DTU缓存会反复读到同一条。窗口内相同(号码+内容)只入队一次
-#define DTU_DEDUP_CACHE_SIZE 8
-#define DTU_DEDUP_WINDOW_MS  (10 * 60 * 1000)
-
-typedef struct {
-    uint32_t hash;
-    TickType_t tick;
-    bool valid;
-} sms_dedup_entry_t;
-
-static sms_dedup_entry_t s_dedup_cache[DTU_DEDUP_CACHE_SIZE];
-static int s_dedup_next = 0;
-
-// FNV-1a hash of sender + content
-static uint32_t sms_fingerprint(const sms_message_t *sms) {
-    uint32_t h = 2166136261u;
-    for (const char *p = sms->sender; *p; p++) { h ^= (uint8_t)*p; h *= 16777619u; }
-    h ^= (uint8_t)','; h *= 16777619u;
-    for (const char *p = sms->content; *p; p++) { h ^= (uint8_t)*p; h *= 16777619u; }
-    return h;
+// 处理轮询之外收到的一行,即DTU的主动上报
+static void dtu_handle_report(uart_dtu_ctx_t *ctx, dtu_line_type_t type) {
+    dtu_sms_result_t result = dtu_handle_line(ctx, type);
+    if (result != DTU_SMS_NONE) {
+        atomic_fetch_add_explicit(&ctx->active_reports, 1, memory_order_relaxed);
+        ctx->push_confirmed = true;
+    }
+    if (result == DTU_SMS_DROPPED) {
+        // 被丢弃的短信未记入去重缓存,仍留在DTU缓存中,尽快由轮询补送
+        atomic_store(&ctx->poll_interval_ms, DTU_SMS_POLL_MIN_MS);
+    }
 }
 
-// 已见过返回true;命中时刷新时间戳,保证缓存被反复读到时持续抑制
-static bool sms_is_duplicate(const sms_message_t *sms) {
-    uint32_t h = sms_fingerprint(sms);
-    TickType_t now = xTaskGetTickCount();
-    for (int i = 0; i < DTU_DEDUP_CACHE_SIZE; i++) {
-        if (s_dedup_cache[i].valid && s_dedup_cache[i].hash == h &&
-            now - s_dedup_cache[i].tick < pdMS_TO_TICKS(DTU_DEDUP_WINDOW_MS)) {
-            s_dedup_cache[i].tick = now;
+// 发送命令并等待以resp_prefix开头的响应行,其余行交给dtu_handle_line
+// 响应只看行首DTU_LINE_PARSER_TEXT_SIZE - 1个字符,等待期间到达的短信上报照常完整解码
+static bool dtu_query(uart_dtu_ctx_t *ctx, const char *cmd, const char *resp_prefix,
+                      char *resp, size_t resp_size) {
+    dtu_send_command(ctx, cmd);
+    TickType_t start = xTaskGetTickCount();
+    TickType_t timeout = pdMS_TO_TICKS(DTU_CMD_RESPONSE_TIMEOUT_MS);
+    TickType_t elapsed;
+    while ((elapsed = xTaskGetTickCount() - start) < timeout) {
+        dtu_line_type_t type = dtu_read_line(ctx, timeout - elapsed);
+        if (type == DTU_LINE_NONE) {
+            continue;
+        }
+        if (type == DTU_LINE_TEXT && dtu_line_parser_starts_with(&ctx->parser, resp_prefix)) {
+            snprintf(resp, resp_size, "%s", ctx->parser.text);
             return true;
         }
+        dtu_handle_report(ctx, type);
     }
+    ESP_LOGW(TAG, "No response for command: %s", cmd);
     return false;
 }
 
-// 入队成功后调用;队列满丢弃的短信不记录,以便后续轮询补送
-static void sms_dedup_record(const sms_message_t *sms) {
-    s_dedup_cache[s_dedup_next].hash = sms_fingerprint(sms);
-    s_dedup_cache[s_dedup_next].tick = xTaskGetTickCount();
-    s_dedup_cache[s_dedup_next].valid = true;
-    s_dedup_next = (s_dedup_next + 1) % DTU_DEDUP_CACHE_SIZE;
-}
+// 读取一次DTU缓存短信并据结果调整下次轮询的间隔。
+// 响应是 config,sms,ok,<号码>,<内容hex>(最近一条缓存短信)或缓存为空时的 config,sms,ok;
+// 等待期间同样以config,sms,开头的主动上报会被当作响应,最多让间隔提前回到最短
+static void dtu_poll_sms_cache(uart_dtu_ctx_t *ctx) {
+    static const char cmd[] = "config,get,sms";
+    dtu_send_command(ctx, cmd);
+    atomic_fetch_add_explicit(&ctx->polls, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&ctx->poll_bytes, sizeof(cmd) - 1 + 2, memory_order_relaxed);
 
-// 处理一行DTU输出: 是短信则去重后入队,其余仅记录日志
-static void dtu_handle_line(const char *line) {
-    static sms_message_t sms; // 仅在uart_dtu_task上下文中使用,static避免占用任务栈
-    if (line[0] == '\0') {
-        return;
-    }
-    ESP_LOGD(TAG, "DTU line received (len=%u)", (unsigned)strlen(line));
-
-    if (parse_sms_line(line, &sms)) {
-        char masked_sender[LOG_MASKED_PHONE_SIZE];
-        if (sms_is_duplicate(&sms)) {
-            ESP_LOGD(TAG, "Duplicate SMS from %s ignored",
-                     log_mask_phone(sms.sender, masked_sender, sizeof(masked_sender)));
-            return;
-        }
-        ESP_LOGI(TAG, "SMS received from %s (content_len=%u)",
-                 log_mask_phone(sms.sender, masked_sender, sizeof(masked_sender)),
-                 (unsigned)strlen(sms.content));
-        if (xQueueSend(s_sms_queue, &sms, pdMS_TO_TICKS(1000)) == pdPASS) {
-            sms_dedup_record(&sms);
-        } else {
-            ESP_LOGE(TAG, "SMS queue full, message from %s dropped",
-                     log_mask_phone(sms.sender, masked_sender, sizeof(masked_sender)));
-        }
-    }
-}
-
-// 发送命令并等待以resp_prefix开头的响应行,其余行交给dtu_handle_line
-// 读取走全尺寸s_line_buf,保证等待期间到达的短信上报行不被截断
-static bool dtu_query(const char *cmd, const char *resp_prefix, char *resp, size_t resp_size) {
-    dtu_send_command(cmd);
     TickType_t start = xTaskGetTickCount();
     TickType_t timeout = pdMS_TO_TICKS(DTU_CMD_RESPONSE_TIMEOUT_MS);
     TickType_t elapsed;
     while ((elapsed = xTaskGetTickCount() - start) < timeout) {
-        if (!dtu_read_line(s_line_buf, sizeof(s_line_buf), timeout - elapsed)) {
-            break;
+        dtu_line_type_t type = dtu_read_line(ctx, timeout - elapsed);
+        if (type == DTU_LINE_NONE) {
+            continue;
         }
-        if (strncmp(s_line_buf, resp_prefix, strlen(resp_prefix)) == 0) {
-            snprintf(resp, resp_size, "%s", s_line_buf);
-            return true;
+        if (type == DTU_LINE_TEXT && !dtu_line_parser_starts_with(&ctx->parser, "config,sms,")) {
+            dtu_handle_report(ctx, type);
+            continue;
+        }
+        atomic_fetch_add_explicit(&ctx->poll_bytes, ctx->parser.line_bytes, memory_order_relaxed);
+        uint32_t interval = atomic_load(&ctx->poll_interval_ms);
+        switch (dtu_handle_line(ctx, type)) {
+            case DTU_SMS_NEW:
+                // 主动上报漏掉了这条短信,恢复最短间隔
+                atomic_fetch_add_explicit(&ctx->poll_hits, 1, memory_order_relaxed);
+                interval = DTU_SMS_POLL_MIN_MS;
+                break;
+            case DTU_SMS_DROPPED:
+                interval = DTU_SMS_POLL_MIN_MS;
+                break;
+            default: {
+                // 缓存为空或已经送达过: 退避。没见过主动上报时不确定上报通道正常,退避有限
+                uint32_t cap = ctx->push_confirmed ? DTU_SMS_POLL_MAX_MS : DTU_SMS_POLL_UNCONFIRMED_MAX_MS;
+                if (cap > DTU_SMS_POLL_MAX_MS) {
+                    cap = DTU_SMS_POLL_MAX_MS;
+                }
+                interval = interval < cap / 2 ? interval * 2 : cap;
+                break;
+            }
         }
-        dtu_handle_line(s_line_buf);
+        if (interval != atomic_load(&ctx->poll_interval_ms)) {
+            ESP_LOGD(TAG, "SMS cache poll interval now %lu ms", (unsigned long)interval);
+        }
+        atomic_store(&ctx->poll_interval_ms, interval);
+        return;
     }
+    atomic_fetch_add_explicit(&ctx->poll_timeouts, 1, memory_order_relaxed);
     ESP_LOGW(TAG, "No response for command: %s", cmd);
-    return false;
 }
 
-// 通过 config,get,iccid 获取ICCID并识别运营商,结果写入g_sim_operator
-static void detect_operator_from_iccid(void) {
+// 通过 config,get,iccid 获取ICCID并识别运营商,结果写入本模组的operator_name
+static void detect_operator_from_iccid(uart_dtu_ctx_t *ctx) {
     char resp[128];
     // 响应格式: config,iccid,ok,<iccid>
-    if (!dtu_query("config,get,iccid", "config,iccid,ok,", resp, sizeof(resp))) {
+    if (!dtu_query(ctx, "config,get,iccid", "config,iccid,ok,", resp, sizeof(resp))) {
         ESP_LOGW(TAG, "Failed to get ICCID, operator unknown");
         return;
     }
     const char *iccid = resp + strlen("config,iccid,ok,");
     ESP_LOGI(TAG, "ICCID read successfully (%s)", LOG_REDACTED_VALUE);
-    for (size_t i = 0; i < s_iccid_operator_map_size; i++) {
-        if (strncmp(iccid, s_iccid_operator_map[i].iccid_prefix, strlen(s_iccid_operator_map[i].iccid_prefix)) == 0) {
-            strncpy(g_sim_operator, s_iccid_operator_map[i].operator_name_zh, sizeof(g_sim_operator) - 1);
-            ESP_LOGI(TAG, "Operator: %s", g_sim_operator);
-            return;
-        }
+    // DTU固件没有AT通道查IMSI,改用ICCID发卡方前缀(operators.csv中的iccid条目)
+    const char *operator_name = operator_table_lookup_iccid(iccid);
+    if (operator_name != NULL) {
+        modem_instance_t *modem = ctx->modem;
+        strncpy(modem->operator_name, operator_name, sizeof(modem->operator_name) - 1);
+        ESP_LOGI(TAG, "Operator: %s", modem->operator_name);
+        return;
     }
     ESP_LOGW(TAG, "Unknown ICCID prefix, operator unknown");
 }
 
-esp_err_t uart_dtu_init(QueueHandle_t sms_queue) {
-    s_sms_queue = sms_queue;
+esp_err_t uart_dtu_init(modem_instance_t *modem, QueueHandle_t sms_queue) {
+    uart_dtu_ctx_t *ctx = modem->ctx;
+    if (ctx == NULL) {
+        ctx = calloc(1, sizeof(*ctx));
+        if (ctx == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        ctx->modem = modem;
+        modem->ctx = ctx;
+    }
+    ctx->sms_queue = sms_queue;
 
-    // Clean up existing UART driver if already installed (important for device restarts)
-    if (uart_is_driver_installed(UART_PORT_NUM)) {
-        ESP_LOGI(TAG, "UART driver already installed on port %d, uninstalling first...", UART_PORT_NUM);
-        uart_driver_delete(UART_PORT_NUM);
+    // Delete existing UART event task if running (important for device restarts)
+    if (ctx->uart_event_task_handle != NULL) {
+        ESP_LOGI(TAG, "UART event task already running, deleting it first...");
+        vTaskDelete(ctx->uart_event_task_handle);
+        ctx->uart_event_task_handle = NULL;
         vTaskDelay(pdMS_TO_TICKS(100));
     }
 
-    s_rx_acc_len = 0;
-
-    uart_config_t uart_config = {
-        .baud_rate = UART_BAUD_RATE,
-        .data_bits = UART_DATA_8_BITS,
-        .parity    = UART_PARITY_DISABLE,
-        .stop_bits = UART_STOP_BITS_1,
-        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
-        .source_clk = UART_SCLK_DEFAULT,
+    // 解析器只由uart_dtu_task使用,此时尚未运行;重新初始化时沿用上次的缓冲
+    if (ctx->sms == NULL) {
+        ctx->sms = sms_pool_alloc(pdMS_TO_TICKS(DTU_SMS_BUFFER_WAIT_MS));
+        if (ctx->sms == NULL) {
+            ESP_LOGW(TAG, "No SMS buffer free yet, SMS lines are dropped until one is returned");
+        }
+    }
+    dtu_line_parser_init(&ctx->parser, ctx->sms);
+    ctx->rx_chunk_pos = 0;
+    ctx->rx_chunk_len = 0;
+    atomic_store(&ctx->rx_resync, false);
+    // 开机后立即读一次缓存,取回ESP32离线期间到达的短信
+    ctx->push_confirmed = false;
+    atomic_store(&ctx->poll_interval_ms, DTU_SMS_POLL_MIN_MS);
+    atomic_store(&ctx->poll_requested, true);
+
+    static const modem_uart_config_t uart = {
+        .rx_buffer_size = DTU_UART_RX_BUF_SIZE,
+        .event_queue_len = 20,
+        .pattern_queue_len = DTU_RX_PATTERN_QUEUE_LEN,
+        .rx_full_thresh = DTU_RX_FULL_THRESH,
+        .rx_timeout_symbols = DTU_RX_TOUT_SYMBOLS,
     };
-    int intr_alloc_flags = 0;
-#if CONFIG_UART_ISR_IN_IRAM
-    intr_alloc_flags = ESP_INTR_FLAG_IRAM;
-#endif
-
-    ESP_ERROR_CHECK(uart_driver_install(UART_PORT_NUM, DTU_LINE_BUF_SIZE * 2, 0, 0, NULL, intr_alloc_flags));
-    ESP_ERROR_CHECK(uart_param_config(UART_PORT_NUM, &uart_config));
-    ESP_ERROR_CHECK(uart_set_pin(UART_PORT_NUM, UART_TXD, UART_RXD, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
+    esp_err_t err = modem_uart_install(&modem->uart, &uart, &ctx->uart_event_queue);
+    if (err != ESP_OK) {
+        return err;
+    }
 
-    ESP_LOGI(TAG, "UART DTU manager initialized on port %d, TX:%d, RX:%d, Baud:%d",
-             UART_PORT_NUM, UART_TXD, UART_RXD, UART_BAUD_RATE);
+    ESP_LOGI(TAG, "UART DTU manager for modem %u initialized on port %d, TX:%d, RX:%d, Baud:%d, "
+             "flow control: %s", modem->index, modem->uart.num, modem->uart.txd, modem->uart.rxd,
+             UART_BAUD_RATE, UART_FLOW_CTRL == UART_HW_FLOWCTRL_CTS_RTS ? "RTS/CTS" : "off");
 
     return ESP_OK;
 }
 
+void uart_dtu_get_stats(const modem_instance_t *modem, uart_dtu_stats_t *stats) {
+    const uart_dtu_ctx_t *ctx = modem->ctx;
+    if (ctx == NULL || atomic_load(&modem->backend) != &uart_dtu_backend) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    stats->rx_dropped_bytes = atomic_load(&ctx->rx_dropped_bytes);
+    stats->rx_truncated_lines = atomic_load(&ctx->rx_truncated_lines);
+    stats->rx_buffered_high_water = atomic_load(&ctx->rx_buffered_high_water);
+    stats->rx_wakeups = atomic_load(&ctx->rx_wakeups);
+    stats->rx_bytes = atomic_load(&modem->rx_bytes);
+    stats->rx_fifo_overflows = atomic_load(&ctx->rx_fifo_overflows);
+    stats->rx_buffer_full = atomic_load(&ctx->rx_buffer_full);
+    stats->sms_polls = atomic_load(&ctx->polls);
+    stats->sms_poll_hits = atomic_load(&ctx->poll_hits);
+    stats->sms_poll_timeouts = atomic_load(&ctx->poll_timeouts);
+    stats->sms_poll_interval_ms = atomic_load(&ctx->poll_interval_ms);
+    stats->sms_poll_bytes = atomic_load(&ctx->poll_bytes);
+    stats->sms_active_reports = atomic_load(&ctx->active_reports);
+}
+
+void uart_dtu_request_sms_poll(modem_instance_t *modem) {
+    uart_dtu_ctx_t *ctx = modem->ctx;
+    atomic_store(&ctx->poll_requested, true);
+    TaskHandle_t task = atomic_load(&ctx->uart_dtu_task_handle);
+    if (task != NULL) {
+        xTaskNotifyGive(task);
+    }
+}
+
 void uart_dtu_task(void *pvParameters) {
+    modem_instance_t *modem = pvParameters;
+    uart_dtu_ctx_t *ctx = modem->ctx;
     char resp[128];
 
-    // 等待DTU模块开机就绪,丢弃开机期间的输出
+    atomic_store(&ctx->uart_dtu_task_handle, xTaskGetCurrentTaskHandle());
+
+    // 等待DTU模块开机就绪,丢弃开机期间的输出。事件任务此后才启动,
+    // 开机输出(可能停在半行)不会送入解析器
     vTaskDelay(pdMS_TO_TICKS(3000));
-    uart_flush_input(UART_PORT_NUM);
+    uart_flush_input(modem->uart.num);
+    xQueueReset(ctx->uart_event_queue);
+    uart_pattern_queue_reset(modem->uart.num, DTU_RX_PATTERN_QUEUE_LEN);
+    if (xTaskCreate(uart_dtu_event_task, "uart_event_task", 3072, ctx, 10,
+                    &ctx->uart_event_task_handle) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create UART event task");
+    }
 
     // 探测通信: 查询固件版本,重试3次
     bool dtu_ready = false;
     for (int i = 0; i < 3; i++) {
         // 响应格式: config,firmwarever,ok,<version>
-        if (dtu_query("config,get,firmwarever", "config,firmwarever,", resp, sizeof(resp))) {
+        if (dtu_query(ctx, "config,get,firmwarever", "config,firmwarever,", resp, sizeof(resp))) {
             ESP_LOGI(TAG, "DTU firmware: %s", resp);
             dtu_ready = true;
             break;
@@ -364,32 +483,83 @@ void uart_dtu_task(void *pvParameters) {
         ESP_LOGE(TAG, "DTU module not responding, will keep listening for SMS reports anyway");
     }
 
-    detect_operator_from_iccid();
+    detect_operator_from_iccid(ctx);
 
     // smson参数: 开启=1, 过滤=0, 允许号码=0, 上报格式=1(固定), 格式参数=0, 通道=1, 缓存=1
-    if (dtu_query("config,set,smson,1,0,0,1,0,1,1", "config,smson,", resp, sizeof(resp))) {
+    if (dtu_query(ctx, "config,set,smson,1,0,0,1,0,1,1", "config,smson,", resp, sizeof(resp))) {
         ESP_LOGI(TAG, "SMS function enabled: %s", resp);
     } else {
         ESP_LOGE(TAG, "Failed to enable DTU SMS function");
     }
 
-    ESP_LOGI(TAG, "DTU initialization complete. Operator: %s",
-             strlen(g_sim_operator) > 0 ? g_sim_operator : "UNKNOWN");
+    ESP_LOGI(TAG, "DTU %u initialization complete. Operator: %s", modem->index,
+             strlen(modem->operator_name) > 0 ? modem->operator_name : "UNKNOWN");
 
-    if (mqtt_manager_publish_device_ready(g_sim_operator) != ESP_OK) {
+    if (mqtt_manager_publish_device_ready(modem) != ESP_OK) {
         ESP_LOGW(TAG, "Failed to publish device ready message (MQTT may not be connected yet)");
     }
 
     // 主循环: 接收DTU主动上报的短信,并定期轮询读取缓存短信
+    // 没有数据时一直阻塞到下次轮询或去重表快照,空闲期间不唤醒
     TickType_t last_poll = xTaskGetTickCount();
     while (1) {
-        if (dtu_read_line(s_line_buf, sizeof(s_line_buf), pdMS_TO_TICKS(1000))) {
-            dtu_handle_line(s_line_buf);
+        sms_dedup_snapshot_if_due();
+        TickType_t poll_interval = pdMS_TO_TICKS(atomic_load(&ctx->poll_interval_ms));
+        TickType_t elapsed = xTaskGetTickCount() - last_poll;
+        if (!atomic_load(&ctx->poll_requested) && elapsed < poll_interval) {
+            dtu_line_type_t type = dtu_read_line(ctx, sms_dedup_snapshot_wait(poll_interval - elapsed));
+            if (type != DTU_LINE_NONE) {
+                dtu_handle_report(ctx, type);
+            }
+            continue;
         }
-        if (xTaskGetTickCount() - last_poll >= pdMS_TO_TICKS(DTU_SMS_POLL_INTERVAL_MS)) {
-            last_poll = xTaskGetTickCount();
-            // 读取缓存短信,响应格式: config,sms,ok,<号码>,<内容hex>,在主循环中解析
-            dtu_send_command("config,get,sms");
+        if (atomic_exchange(&ctx->poll_requested, false)) {
+            atomic_store(&ctx->poll_interval_ms, DTU_SMS_POLL_MIN_MS);
         }
+        dtu_poll_sms_cache(ctx);
+        last_poll = xTaskGetTickCount();
     }
 }
+
+// 固件探测: AT固件对config命令回ERROR,只有DTU固件回config,firmwarever,ok,<版本>
+static bool uart_dtu_probe(modem_instance_t *modem, TickType_t reply_ticks) {
+    return modem_uart_probe(&modem->uart, "config,get,firmwarever", "config,firmwarever,", reply_ticks);
+}
+
+static int uart_dtu_format_metrics(const modem_instance_t *modem, char *buf, size_t size) {
+    uart_dtu_stats_t dtu_stats;
+    uart_dtu_get_stats(modem, &dtu_stats);
+    return snprintf(buf, size,
+                    ",\"dtu_rx_dropped_bytes\":%lu,"
+                    "\"dtu_rx_truncated_lines\":%lu,\"dtu_rx_buffered_high_water\":%lu,\"dtu_rx_wakeups\":%lu,"
+                    "\"dtu_rx_bytes\":%lu,\"dtu_rx_fifo_ovf\":%lu,\"dtu_rx_buffer_full\":%lu,"
+                    "\"dtu_sms_polls\":%lu,\"dtu_sms_poll_hits\":%lu,\"dtu_sms_poll_hit_pct\":%lu,"
+                    "\"dtu_sms_poll_timeouts\":%lu,\"dtu_sms_poll_interval_ms\":%lu,"
+                    "\"dtu_sms_poll_bytes\":%lu,\"dtu_sms_active_reports\":%lu",
+                    (unsigned long)dtu_stats.rx_dropped_bytes,
+                    (unsigned long)dtu_stats.rx_truncated_lines,
+                    (unsigned long)dtu_stats.rx_buffered_high_water,
+                    (unsigned long)dtu_stats.rx_wakeups,
+                    (unsigned long)dtu_stats.rx_bytes,
+                    (unsigned long)dtu_stats.rx_fifo_overflows,
+                    (unsigned long)dtu_stats.rx_buffer_full,
+                    (unsigned long)dtu_stats.sms_polls,
+                    (unsigned long)dtu_stats.sms_poll_hits,
+                    dtu_stats.sms_polls > 0 ?
+                    (unsigned long)(dtu_stats.sms_poll_hits * 100ull / dtu_stats.sms_polls) : 0ul,
+                    (unsigned long)dtu_stats.sms_poll_timeouts,
+                    (unsigned long)dtu_stats.sms_poll_interval_ms,
+                    (unsigned long)dtu_stats.sms_poll_bytes,
+                    (unsigned long)dtu_stats.sms_active_reports);
+}
+
+const modem_backend_t uart_dtu_backend = {
+    .name = "DTU",
+    .task_name = "uart_dtu_task",
+    .probe = uart_dtu_probe,
+    .saved_baud = NULL, // DTU固件不协商速率
+    .init = uart_dtu_init,
+    .run = uart_dtu_task,
+    .format_metrics = uart_dtu_format_metrics,
+    .request_sms_poll = uart_dtu_request_sms_poll,
+};
@@ -5,21 +5,57 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
 
-#include "uart_at_manager.h" // 复用 sms_message_t 和 g_sim_operator
+#include "uart_at_manager.h" // 复用 sms_message_t 和 modem_instance_t
 
 /**
  * @brief Initializes the UART driver for communication with a modem running
  *        Yinerda DTU transparent firmware (config,xxx serial commands).
  *
+ * Allocates the instance's DTU context on first use.
+ *
+ * @param modem The modem instance to drive.
  * @param sms_queue A FreeRTOS queue to send parsed SMS messages to.
  * @return ESP_OK on success, error code otherwise.
  */
-esp_err_t uart_dtu_init(QueueHandle_t sms_queue);
+esp_err_t uart_dtu_init(modem_instance_t *modem, QueueHandle_t sms_queue);
+
+// 接收路径统计,字段含义与uart_at_stats_t中的同名字段相同
+typedef struct {
+    uint32_t rx_dropped_bytes;    // FIFO溢出后丢弃的半行字节数
+    uint32_t rx_truncated_lines;  // 普通行超过128字节或短信内容超长被截断的行数
+    uint32_t rx_buffered_high_water; // 驱动接收缓冲积压峰值(字节)
+    uint32_t rx_wakeups;          // 接收侧唤醒DTU任务的次数(每批完整行一次)
+    uint32_t rx_bytes;            // 累计接收字节数
+    uint32_t rx_fifo_overflows;   // 硬件RX FIFO溢出次数
+    uint32_t rx_buffer_full;      // 驱动接收缓冲满的次数
+    uint32_t sms_polls;           // 发出的config,get,sms次数
+    uint32_t sms_poll_hits;       // 轮询读到新短信(主动上报未送达)的次数
+    uint32_t sms_poll_timeouts;   // 轮询无响应的次数
+    uint32_t sms_poll_interval_ms; // 当前轮询间隔
+    uint32_t sms_poll_bytes;      // 轮询命令与响应占用的串口字节数
+    uint32_t sms_active_reports;  // 轮询之外主动上报的短信行数
+} uart_dtu_stats_t;
+
+/**
+ * @brief Reads the DTU receive path counters of one modem instance. Safe to
+ *        call from any task; all zero if the instance is not running DTU.
+ *
+ * @param modem The modem instance.
+ * @param stats Output structure.
+ */
+void uart_dtu_get_stats(const modem_instance_t *modem, uart_dtu_stats_t *stats);
+
+/**
+ * @brief Asks the DTU task to read the DTU's SMS cache now and to restart
+ *        the poll backoff at the shortest interval. Call after the upstream
+ *        link recovers (MQTT connected). Safe to call from any task.
+ */
+void uart_dtu_request_sms_poll(modem_instance_t *modem);
 
 /**
  * @brief FreeRTOS task to configure the DTU firmware, listen for SMS reports,
  *        poll cached SMS, and send parsed messages to the queue.
- * @param pvParameters Should be NULL.
+ * @param pvParameters The modem_instance_t given to uart_dtu_init.
  */
 void uart_dtu_task(void *pvParameters);
 
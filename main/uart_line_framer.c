@@ -0,0 +1,228 @@
+#include <string.h>
+
+#include "uart_line_framer.h"
+
+// 溢出/断流时写入的标记行: 消费端遇到以此结尾的行直接丢弃
+#define FRAMER_GAP_MARKER   '\x18'
+// 始终为标记行("\x18\n")预留的空间
+#define FRAMER_RESERVE      2
+
+// 生产端: head只有自己写,可直接relaxed读取;tail需acquire以确认消费端已读完旧数据
+static size_t framer_free(const uart_line_framer_t *f, size_t head)
+{
+    size_t used = head - atomic_load_explicit(&f->tail, memory_order_acquire);
+    return used + FRAMER_RESERVE >= f->size ? 0 : f->size - FRAMER_RESERVE - used;
+}
+
+// 写入数据后以release发布新的head,保证消费端看到head时数据已写完
+static void framer_write(uart_line_framer_t *f, const void *data, size_t len)
+{
+    size_t head = atomic_load_explicit(&f->head, memory_order_relaxed);
+    size_t off = head & (f->size - 1);
+    size_t first = f->size - off;
+    if (first > len) {
+        first = len;
+    }
+    memcpy(f->buf + off, data, first);
+    memcpy(f->buf, (const char *)data + first, len - first);
+    atomic_store_explicit(&f->head, head + len, memory_order_release);
+}
+
+static void framer_write_gap_marker(uart_line_framer_t *f)
+{
+    if (!f->at_line_start) {
+        static const char marker[FRAMER_RESERVE] = { FRAMER_GAP_MARKER, '\n' };
+        // 预留空间保证标记总能写入
+        framer_write(f, marker, sizeof(marker));
+        f->at_line_start = true;
+    }
+}
+
+void uart_line_framer_init(uart_line_framer_t *framer, char *storage, size_t size)
+{
+    memset(framer, 0, sizeof(*framer));
+    framer->buf = storage;
+    framer->size = size;
+    framer->at_line_start = true;
+}
+
+void uart_line_framer_reset(uart_line_framer_t *framer)
+{
+    atomic_store(&framer->head, 0);
+    atomic_store(&framer->tail, 0);
+    framer->scan = 0;
+    framer->at_line_start = true;
+    framer->discarding = false;
+}
+
+size_t uart_line_framer_push(uart_line_framer_t *framer, const uint8_t *data, size_t len)
+{
+    if (len == 0) {
+        return 0;
+    }
+
+    if (framer->discarding) {
+        const uint8_t *nl = memchr(data, '\n', len);
+        if (nl == NULL) {
+            atomic_fetch_add_explicit(&framer->dropped_bytes, len, memory_order_relaxed);
+            return 0;
+        }
+        size_t skip = (size_t)(nl - data) + 1;
+        atomic_fetch_add_explicit(&framer->dropped_bytes, skip, memory_order_relaxed);
+        framer->discarding = false;
+        data += skip;
+        len -= skip;
+        if (len == 0) {
+            return 0;
+        }
+    }
+
+    size_t space = framer_free(framer, atomic_load_explicit(&framer->head, memory_order_relaxed));
+    size_t keep = len;
+    if (len > space) {
+        // 只保留能完整放下的行,避免半行与后续数据拼成错误的一行
+        atomic_fetch_add_explicit(&framer->overflow_events, 1, memory_order_relaxed);
+        keep = space;
+        while (keep > 0 && data[keep - 1] != '\n') {
+            keep--;
+        }
+    }
+
+    if (keep > 0) {
+        framer_write(framer, data, keep);
+        framer->at_line_start = data[keep - 1] == '\n';
+    }
+    if (keep < len) {
+        atomic_fetch_add_explicit(&framer->dropped_bytes, len - keep, memory_order_relaxed);
+        framer_write_gap_marker(framer);
+        // 被丢弃部分的最后一行若未结束,后续数据直到换行都属于这行
+        framer->discarding = data[len - 1] != '\n';
+    }
+    return keep;
+}
+
+void uart_line_framer_mark_gap(uart_line_framer_t *framer)
+{
+    // 断在行首时没有被截断的行,之后的数据(如换波特率后的第一个"OK")照常分帧
+    if (!framer->at_line_start) {
+        framer->discarding = true;
+    }
+    framer_write_gap_marker(framer);
+}
+
+bool uart_line_framer_peek_line(uart_line_framer_t *framer, uart_line_span_t *span)
+{
+    const size_t mask = framer->size - 1;
+    // 消费端: tail只有自己写;head需acquire以看到生产端写入的数据
+    size_t tail = atomic_load_explicit(&framer->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&framer->head, memory_order_acquire);
+
+    for (;;) {
+        // 只搜索上次之后新到的字节,每个字节只检查一次
+        bool found = false;
+        while (framer->scan != head) {
+            size_t off = framer->scan & mask;
+            size_t chunk = head - framer->scan;
+            if (chunk > framer->size - off) {
+                chunk = framer->size - off;
+            }
+            const char *nl = memchr(framer->buf + off, '\n', chunk);
+            if (nl != NULL) {
+                framer->scan += (size_t)(nl - (framer->buf + off));
+                found = true;
+                break;
+            }
+            framer->scan += chunk;
+        }
+        if (!found) {
+            return false;
+        }
+
+        size_t len = framer->scan - tail;
+        char last = len > 0 ? framer->buf[(framer->scan - 1) & mask] : '\0';
+        if (last == FRAMER_GAP_MARKER) {
+            uart_line_framer_consume_line(framer);
+            tail = framer->scan;
+            continue;
+        }
+        if (last == '\r') {
+            len--;
+        }
+
+        size_t off = tail & mask;
+        size_t first = framer->size - off;
+        if (first > len) {
+            first = len;
+        }
+        span->seg[0] = framer->buf + off;
+        span->seg_len[0] = first;
+        span->seg[1] = framer->buf;
+        span->seg_len[1] = len - first;
+        span->len = len;
+        return true;
+    }
+}
+
+void uart_line_framer_consume_line(uart_line_framer_t *framer)
+{
+    // scan停在本行的'\n'上;数据用完后再以release释放空间,生产端才会覆盖
+    framer->scan++;
+    atomic_store_explicit(&framer->tail, framer->scan, memory_order_release);
+}
+
+bool uart_line_span_starts_with(const uart_line_span_t *span, const char *prefix)
+{
+    size_t len = strlen(prefix);
+    if (len > span->len) {
+        return false;
+    }
+    size_t first = len < span->seg_len[0] ? len : span->seg_len[0];
+    return memcmp(span->seg[0], prefix, first) == 0 &&
+           memcmp(span->seg[1], prefix + first, len - first) == 0;
+}
+
+size_t uart_line_span_copy(const uart_line_span_t *span, char *out, size_t out_size)
+{
+    size_t len = span->len < out_size ? span->len : out_size - 1;
+    size_t first = len < span->seg_len[0] ? len : span->seg_len[0];
+    memcpy(out, span->seg[0], first);
+    memcpy(out + first, span->seg[1], len - first);
+    out[len] = '\0';
+    return len;
+}
+
+int uart_line_framer_next_line(uart_line_framer_t *framer, char *line, size_t line_size)
+{
+    uart_line_span_t span;
+    if (!uart_line_framer_peek_line(framer, &span)) {
+        return -1;
+    }
+    if (span.len >= line_size) {
+        atomic_fetch_add_explicit(&framer->truncated_lines, 1, memory_order_relaxed);
+    }
+    size_t len = uart_line_span_copy(&span, line, line_size);
+    uart_line_framer_consume_line(framer);
+    return (int)len;
+}
+
+bool uart_line_framer_partial_equals(const uart_line_framer_t *framer, const char *prefix)
+{
+    size_t len = strlen(prefix);
+    size_t tail = atomic_load_explicit(&framer->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&framer->head, memory_order_acquire);
+    // 完整行都已取走(scan追上head)时,[tail, head)就是末尾未结束的部分
+    if (framer->scan != head || head - tail != len) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (framer->buf[(tail + i) & (framer->size - 1)] != prefix[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t uart_line_framer_used(const uart_line_framer_t *framer)
+{
+    return atomic_load(&framer->head) - atomic_load(&framer->tail);
+}
@@ -0,0 +1,138 @@
+#ifndef UART_LINE_FRAMER_H
+#define UART_LINE_FRAMER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+/**
+ * @brief Ring buffer that frames a UART byte stream into "\n"-terminated lines.
+ *
+ * Bytes are appended at head by the receive path. The consumer keeps a scan
+ * cursor, so every byte is searched for the line terminator exactly once no
+ * matter how many UART chunks a line is split across. A completed line is
+ * copied out once and its space released; nothing is ever memmoved.
+ *
+ * When the ring cannot take a whole chunk, only the complete lines that fit
+ * are kept. The rest of the chunk is dropped up to the next terminator and the
+ * partially stored line (if any) is marked so the consumer discards it,
+ * instead of gluing two unrelated fragments into one corrupt line.
+ *
+ * The framer is a lock-free single-producer/single-consumer queue: one task
+ * may call push/mark_gap while another calls next_line/partial_equals, with
+ * no mutex. The producer never blocks; a push that does not fit is counted
+ * as an enqueue failure so backpressure is visible.
+ */
+typedef struct {
+    char *buf;
+    size_t size;                      // power of two
+    _Atomic size_t head;              // next write position, written by the producer only
+    _Atomic size_t tail;              // start of the oldest unconsumed line, written by the consumer only
+    size_t scan;                      // consumer: first byte not yet searched for '\n'
+    bool at_line_start;               // producer: last pushed byte was '\n' (or nothing pushed)
+    bool discarding;                  // producer: dropping input until the next '\n'
+    _Atomic uint32_t overflow_events; // pushes that did not fit completely (enqueue failures)
+    _Atomic uint32_t dropped_bytes;   // input bytes discarded on overflow or resync
+    _Atomic uint32_t truncated_lines; // lines longer than the consumer's line buffer
+} uart_line_framer_t;
+
+/**
+ * @brief A complete line still inside the ring, without its "\r\n".
+ *        The line may wrap, so it is described by up to two segments.
+ */
+typedef struct {
+    const char *seg[2];
+    size_t seg_len[2];
+    size_t len; // seg_len[0] + seg_len[1]
+} uart_line_span_t;
+
+/**
+ * @brief Initializes a framer over caller-provided storage.
+ *
+ * @param storage Backing buffer; size must be a power of two.
+ * @param size Size of storage in bytes.
+ */
+void uart_line_framer_init(uart_line_framer_t *framer, char *storage, size_t size);
+
+/**
+ * @brief Discards all buffered data (statistics are kept).
+ *        Not thread-safe: only call while neither side is running.
+ */
+void uart_line_framer_reset(uart_line_framer_t *framer);
+
+/**
+ * @brief Appends received bytes.
+ *
+ * @return Number of bytes stored; the rest was dropped and counted. A short
+ *         push increments overflow_events only when the ring was full, not
+ *         when it skipped the rest of a line cut off by a gap.
+ */
+size_t uart_line_framer_push(uart_line_framer_t *framer, const uint8_t *data, size_t len);
+
+/**
+ * @brief Marks a gap in the byte stream (e.g. the driver flushed its FIFO).
+ *        If a line was in progress it is discarded and input is ignored
+ *        until the next line terminator; at a line boundary nothing is
+ *        dropped and the next byte starts a new line.
+ */
+void uart_line_framer_mark_gap(uart_line_framer_t *framer);
+
+/**
+ * @brief Pops the next complete line, without its "\r\n" terminator.
+ *
+ * Lines longer than line_size - 1 are truncated (and counted).
+ *
+ * @param line Output buffer, always NUL-terminated on success.
+ * @param line_size Size of the output buffer.
+ * @return Length of the line, or -1 if no complete line is buffered.
+ */
+int uart_line_framer_next_line(uart_line_framer_t *framer, char *line, size_t line_size);
+
+/**
+ * @brief Locates the next complete line without copying it.
+ *
+ * The span stays valid until uart_line_framer_consume_line(); calling peek
+ * again before consuming returns the same line.
+ *
+ * @return true if a complete line is buffered.
+ */
+bool uart_line_framer_peek_line(uart_line_framer_t *framer, uart_line_span_t *span);
+
+/**
+ * @brief Releases the line returned by the last successful peek.
+ */
+void uart_line_framer_consume_line(uart_line_framer_t *framer);
+
+/**
+ * @brief Returns the character at offset pos of a span (pos < span->len).
+ */
+static inline char uart_line_span_at(const uart_line_span_t *span, size_t pos)
+{
+    return pos < span->seg_len[0] ? span->seg[0][pos] : span->seg[1][pos - span->seg_len[0]];
+}
+
+/**
+ * @brief Checks whether a span starts with prefix.
+ */
+bool uart_line_span_starts_with(const uart_line_span_t *span, const char *prefix);
+
+/**
+ * @brief Copies a span into a NUL-terminated buffer, truncating if needed.
+ *
+ * @return Number of characters copied.
+ */
+size_t uart_line_span_copy(const uart_line_span_t *span, char *out, size_t out_size);
+
+/**
+ * @brief Checks whether the unterminated data at the end of the buffer
+ *        equals prefix (used for prompts such as "> " that have no "\r\n").
+ */
+bool uart_line_framer_partial_equals(const uart_line_framer_t *framer, const char *prefix);
+
+/**
+ * @brief Number of buffered bytes not yet consumed.
+ */
+size_t uart_line_framer_used(const uart_line_framer_t *framer);
+
+#endif // UART_LINE_FRAMER_H
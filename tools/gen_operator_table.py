@@ -0,0 +1,127 @@
+#!/usr/bin/env python3
+"""Generate operator_table_data.c from main/operators.csv.
+
+Usage: gen_operator_table.py <operators.csv> <output.c>
+
+Every prefix becomes the range of fixed-width keys it covers (IMSI: 6
+digits, ICCID: 7 digits), so the firmware finds an operator with one
+binary search over sorted integers. Names are deduplicated into a single
+string pool. Errors in the data file fail the build.
+"""
+
+import csv
+import sys
+
+KEY_DIGITS = {'imsi': 6, 'iccid': 7}
+PREFIX_LENGTHS = {'imsi': (5, 6), 'iccid': (4, 5, 6, 7)}
+NAME_MAX_BYTES = 31        # modem_instance_t.operator_name[32]
+SPAN_BITS = 3              # operator_table.c: OPERATOR_INFO_SPAN_BITS
+MAX_NAMES = 1 << (16 - SPAN_BITS)
+
+
+def fail(path, line, msg):
+    sys.exit('{}:{}: {}'.format(path, line, msg))
+
+
+def read_entries(path):
+    entries = {kind: [] for kind in KEY_DIGITS}
+    with open(path, encoding='utf-8', newline='') as f:
+        for line_no, row in enumerate(csv.reader(f), 1):
+            if not row or not row[0].strip() or row[0].lstrip().startswith('#'):
+                continue
+            if len(row) != 4:
+                fail(path, line_no, 'expected type,prefix,operator,country')
+            kind, prefix, name, _country = (field.strip() for field in row)
+            if kind not in KEY_DIGITS:
+                fail(path, line_no, 'unknown type "{}"'.format(kind))
+            if not prefix.isdigit() or len(prefix) not in PREFIX_LENGTHS[kind]:
+                fail(path, line_no, 'bad {} prefix "{}"'.format(kind, prefix))
+            if not name or len(name.encode('utf-8')) > NAME_MAX_BYTES:
+                fail(path, line_no, 'operator name must be 1..{} bytes'.format(NAME_MAX_BYTES))
+            entries[kind].append((prefix, name, line_no))
+    return entries
+
+
+def build_ranges(path, kind, entries):
+    digits = KEY_DIGITS[kind]
+    ranges = []
+    for prefix, name, line_no in entries:
+        span_exp = digits - len(prefix)
+        first = int(prefix) * 10 ** span_exp
+        ranges.append((first, first + 10 ** span_exp - 1, span_exp, prefix, name, line_no))
+    ranges.sort()
+    for prev, cur in zip(ranges, ranges[1:]):
+        if cur[0] <= prev[1]:
+            fail(path, cur[5], '{} prefix {} overlaps {} (line {})'.format(kind, cur[3], prev[3], prev[5]))
+    return ranges
+
+
+def c_string(text):
+    out = []
+    for b in text.encode('utf-8'):
+        if 0x20 <= b < 0x7f and chr(b) not in '"\\?':
+            out.append(chr(b))
+        else:
+            out.append('\\{:03o}'.format(b))
+    return '"{}\\0"'.format(''.join(out))
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit(__doc__)
+    src, dst = sys.argv[1], sys.argv[2]
+    entries = read_entries(src)
+    tables = {kind: build_ranges(src, kind, entries[kind]) for kind in KEY_DIGITS}
+
+    names = []
+    name_index = {}
+    for kind in KEY_DIGITS:
+        for r in tables[kind]:
+            if r[4] not in name_index:
+                name_index[r[4]] = len(names)
+                names.append(r[4])
+    if len(names) > MAX_NAMES:
+        sys.exit('{}: more than {} distinct operator names'.format(src, MAX_NAMES))
+    offsets = []
+    pool_len = 0
+    for name in names:
+        offsets.append(pool_len)
+        pool_len += len(name.encode('utf-8')) + 1
+    if pool_len > 0xFFFF:
+        sys.exit('{}: operator names exceed 64 KB'.format(src))
+
+    lines = [
+        '// Generated by tools/gen_operator_table.py from operators.csv. Do not edit.',
+        '#include "operator_table.h"',
+        '',
+        'const char g_operator_names[] =',
+    ]
+    lines += ['    {} // {}'.format(c_string(name), i) for i, name in enumerate(names)] or ['    "" //']
+    lines[-1] = lines[-1].replace(' //', '; //', 1)
+    lines += ['', 'const uint16_t g_operator_name_offsets[] = {']
+    lines += ['    {},'.format(off) for off in offsets] or ['    0,']
+    lines.append('};')
+
+    for kind in KEY_DIGITS:
+        rows = tables[kind]
+        lines += ['', 'static const uint32_t s_{}_first[] = {{'.format(kind)]
+        lines += ['    {}u, // {}'.format(r[0], r[3]) for r in rows] or ['    0, // empty']
+        lines += ['};', '', 'static const uint16_t s_{}_info[] = {{'.format(kind)]
+        lines += ['    {},'.format(name_index[r[4]] << SPAN_BITS | r[2]) for r in rows] or ['    0,']
+        lines += [
+            '};',
+            '',
+            'const operator_prefix_table_t g_operator_{}_table = {{'.format(kind),
+            '    .first = s_{}_first,'.format(kind),
+            '    .info = s_{}_info,'.format(kind),
+            '    .count = {},'.format(len(rows)),
+            '    .key_digits = {},'.format(KEY_DIGITS[kind]),
+            '};',
+        ]
+
+    with open(dst, 'w', encoding='utf-8', newline='\n') as f:
+        f.write('\n'.join(lines) + '\n')
+
+
+if __name__ == '__main__':
+    main()
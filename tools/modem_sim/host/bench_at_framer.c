@@ -0,0 +1,232 @@
+/*
+ * AT接收分帧基准: uart_line_framer对比原来的平面缓冲(每块strstr扫描 + 删除URC的memmove)。
+ *
+ * 两种做法以相同大小的数据块喂入同样的文本模式+CMT和URC流,先核对取出的短信
+ * 一致,再分别计时。lag列为消费端每4块才处理一次时的吞吐(旧做法随缓冲变满而变慢)。
+ * 用法: bench_at_framer [轮数]
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "uart_line_framer.h"
+
+#define RX_SIZE 4096 // 旧做法的BUF_SIZE,也是AT_RX_RING_SIZE
+#define LAG_CHUNKS 4
+
+// 取出的+CMT正文的摘要,用于核对两种做法结果一致
+typedef struct {
+    uint32_t count;
+    uint32_t hash;
+} digest_t;
+
+static void digest_add(digest_t *d, const char *body, size_t len) {
+    uint32_t h = d->hash ^ 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (uint8_t)body[i]) * 16777619u;
+    }
+    d->hash = h;
+    d->count++;
+}
+
+// ---- 旧做法: 平面缓冲,与原uart_event_task/handle_urc相同的扫描和搬移 ----
+
+typedef struct {
+    char buf[RX_SIZE];
+    int idx;
+} flat_buf_t;
+
+static void flat_append(flat_buf_t *f, const char *data, int len) {
+    if (f->idx + len >= RX_SIZE) {
+        char *cmt = strstr(f->buf, "+CMT:");
+        if (cmt != NULL) {
+            int keep = (int)(cmt - f->buf);
+            memmove(f->buf, cmt, f->idx - keep);
+            f->idx -= keep;
+        } else {
+            f->idx = 0;
+        }
+    }
+    if (f->idx + len >= RX_SIZE) {
+        len = RX_SIZE - f->idx - 1;
+    }
+    memcpy(f->buf + f->idx, data, len);
+    f->idx += len;
+    f->buf[f->idx] = '\0';
+
+    // 删除+CMT和错误结果码以外的URC
+    char *p = f->buf;
+    while (*p) {
+        char *line_end = strstr(p, "\r\n");
+        if (line_end == NULL) {
+            break;
+        }
+        if ((*p == '+' || *p == '^') && strncmp(p, "+CMT:", 5) != 0 &&
+            strncmp(p, "+CME ERROR:", 11) != 0 && strncmp(p, "+CMS ERROR:", 11) != 0) {
+            int line_len = (int)(line_end + 2 - p);
+            memmove(p, line_end + 2, strlen(line_end + 2) + 1);
+            f->idx -= line_len;
+        } else {
+            p = line_end + 2;
+        }
+    }
+}
+
+// 每块之后的结果码检查,返回值只为防止被优化掉
+static int flat_scan(const flat_buf_t *f) {
+    return (strstr(f->buf, "OK\r\n") != NULL) + (strstr(f->buf, "ERROR\r\n") != NULL) +
+           (strstr(f->buf, "+CME ERROR:") != NULL) + (strstr(f->buf, "+CMS ERROR:") != NULL) +
+           (strstr(f->buf, "> ") != NULL);
+}
+
+// handle_urc: 取出完整的+CMT块并把其后的数据前移
+static void flat_consume(flat_buf_t *f, digest_t *d) {
+    for (;;) {
+        char *cmt = strstr(f->buf, "+CMT:");
+        if (cmt == NULL) {
+            return;
+        }
+        char *first = strstr(cmt, "\r\n");
+        char *second = first != NULL ? strstr(first + 2, "\r\n") : NULL;
+        if (second == NULL) {
+            return;
+        }
+        digest_add(d, first + 2, (size_t)(second - first - 2));
+        int processed = (int)(second + 2 - f->buf);
+        memmove(f->buf, f->buf + processed, f->idx - processed + 1);
+        f->idx -= processed;
+    }
+}
+
+static int flat_run(flat_buf_t *f, const char *data, size_t len, size_t chunk, int lag, digest_t *d) {
+    int sink = 0;
+    int pending = 0;
+    for (size_t off = 0; off < len; off += chunk) {
+        size_t n = len - off < chunk ? len - off : chunk;
+        flat_append(f, data + off, (int)n);
+        sink += flat_scan(f);
+        if (++pending >= lag) {
+            flat_consume(f, d);
+            pending = 0;
+        }
+    }
+    flat_consume(f, d);
+    return sink;
+}
+
+// ---- uart_line_framer: 与uart_at_task相同,逐行取出后按行首分类 ----
+
+typedef struct {
+    uart_line_framer_t framer;
+    char storage[RX_SIZE];
+    char line[2048];
+    bool in_cmt;
+} framer_ctx_t;
+
+static void framer_consume(framer_ctx_t *c, digest_t *d) {
+    int len;
+    while ((len = uart_line_framer_next_line(&c->framer, c->line, sizeof(c->line))) >= 0) {
+        if (c->in_cmt) {
+            digest_add(d, c->line, (size_t)len);
+            c->in_cmt = false;
+        } else if (strncmp(c->line, "+CMT:", 5) == 0) {
+            c->in_cmt = true;
+        }
+    }
+}
+
+static void framer_run(framer_ctx_t *c, const char *data, size_t len, size_t chunk, int lag, digest_t *d) {
+    int pending = 0;
+    for (size_t off = 0; off < len; off += chunk) {
+        size_t n = len - off < chunk ? len - off : chunk;
+        uart_line_framer_push(&c->framer, (const uint8_t *)data + off, n);
+        if (++pending >= lag) {
+            framer_consume(c, d);
+            pending = 0;
+        }
+    }
+    framer_consume(c, d);
+}
+
+// ---- 输入 ----
+
+// 一条文本模式短信(UCS2,67个汉字)及其前后常见的URC
+static size_t append_report(char *out, int n) {
+    size_t len = (size_t)sprintf(out, "\r\n+CMT: \"002B0038003600310033003800300030%04X\",,\"25/01/01,10:00:00+32\"\r\n",
+                                 0x0030 + n % 10);
+    for (int i = 0; i < 67; i++) {
+        len += (size_t)sprintf(out + len, "%04X", 0x4F60 + (n + i) % 64);
+    }
+    len += (size_t)sprintf(out + len, "\r\n\r\n+CREG: 1\r\n\r\n^MODE: 17,17\r\n");
+    return len;
+}
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+    int rounds = argc > 1 ? atoi(argv[1]) : 50;
+    static char text[256 * 1024];
+    size_t len = 0;
+    for (int i = 0; len < sizeof(text) - 1024; i++) {
+        len += append_report(text + len, i);
+    }
+
+    static flat_buf_t flat;
+    static framer_ctx_t fc;
+    static const size_t chunks[] = {32, 120, 512};
+    static const int lags[] = {1, LAG_CHUNKS};
+
+    // 一致性: 每种块大小和消费节奏下取出的短信相同
+    for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+        for (size_t l = 0; l < sizeof(lags) / sizeof(lags[0]); l++) {
+            digest_t a = {0}, b = {0};
+            flat.idx = 0;
+            flat.buf[0] = '\0';
+            uart_line_framer_init(&fc.framer, fc.storage, sizeof(fc.storage));
+            fc.in_cmt = false;
+            flat_run(&flat, text, len, chunks[c], lags[l], &a);
+            framer_run(&fc, text, len, chunks[c], lags[l], &b);
+            if (a.count != b.count || a.hash != b.hash || fc.framer.overflow_events != 0) {
+                fprintf(stderr, "mismatch (chunk %zu, lag %d): %u vs %u messages\n",
+                        chunks[c], lags[l], a.count, b.count);
+                return 1;
+            }
+        }
+    }
+    printf("cross-check: identical messages for all chunk sizes\n");
+
+    printf("%zu bytes per round, %d rounds\n", len, rounds);
+    printf("%8s %12s %12s %12s %12s\n", "chunk", "flat MB/s", "framer MB/s", "flat lag", "framer lag");
+    for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+        double mbps[2][2];
+        for (size_t l = 0; l < sizeof(lags) / sizeof(lags[0]); l++) {
+            digest_t d = {0};
+            volatile int sink = 0;
+            flat.idx = 0;
+            flat.buf[0] = '\0';
+            uart_line_framer_init(&fc.framer, fc.storage, sizeof(fc.storage));
+            fc.in_cmt = false;
+
+            double t0 = now_s();
+            for (int r = 0; r < rounds; r++) {
+                sink += flat_run(&flat, text, len, chunks[c], lags[l], &d);
+            }
+            double t1 = now_s();
+            for (int r = 0; r < rounds; r++) {
+                framer_run(&fc, text, len, chunks[c], lags[l], &d);
+            }
+            double t2 = now_s();
+            double mb = (double)len * rounds / 1e6;
+            mbps[l][0] = mb / (t1 - t0);
+            mbps[l][1] = mb / (t2 - t1);
+        }
+        printf("%8zu %12.1f %12.1f %12.1f %12.1f\n", chunks[c], mbps[0][0], mbps[0][1], mbps[1][0], mbps[1][1]);
+    }
+    return 0;
+}
@@ -0,0 +1,249 @@
+/*
+ * 文本模式+CMT解码基准: 直接从环形缓冲中的行解码(uart_at_manager的做法)对比
+ * 原来的先拷出整行、复制头行、累积正文hex、最后整体解码。
+ *
+ * 两种做法都用text_codec解码UCS2,差别只在拷贝和累积;解码器本身见bench_text_codec。
+ * 先核对解出的发件人和内容一致,再分别计时单条和5段长短信。
+ * 用法: bench_cmt_decode [轮数]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "text_codec.h"
+#include "uart_at_manager.h" // sms_message_t
+#include "uart_line_framer.h"
+
+#define RX_SIZE 4096
+#define PART_HEX_LEN 268  // 67个UCS2字符一段,长短信的非末段
+#define ACCUM_HEX_SIZE 4096 // 原s_fragment_buffer.accumulated_content
+
+// ---- 旧做法: 整行拷出 + 头行复制 + hex累积 ----
+
+typedef struct {
+    char line[2048];
+    char header[128];
+    char accum[ACCUM_HEX_SIZE];
+    char sender[32];
+    bool accum_active;
+} copy_ctx_t;
+
+static size_t hex_decode(const char *hex, size_t len, char *out, size_t out_size) {
+    text_utf16_state_t state = TEXT_UTF16_STATE_INIT;
+    size_t out_len = 0;
+    out[0] = '\0';
+    if (text_ucs2_hex_to_utf8(&state, hex, len, out, out_size, &out_len) == TEXT_CODEC_OK) {
+        text_utf16_finish(&state, out, out_size, &out_len);
+    }
+    return out_len;
+}
+
+// 返回true表示sms中是一条完整短信
+static bool copy_part(copy_ctx_t *c, uart_line_framer_t *f, sms_message_t *sms) {
+    if (uart_line_framer_next_line(f, c->line, sizeof(c->line)) < 0) {
+        return false;
+    }
+    // 头行较长时只保留开头,发件人在其中
+    snprintf(c->header, sizeof(c->header), "%.*s", (int)sizeof(c->header) - 1, c->line);
+    int body_len = uart_line_framer_next_line(f, c->line, sizeof(c->line));
+
+    memset(sms, 0, sizeof(*sms));
+    char sender_hex[sizeof(c->sender) * 2 + 1];
+    const char *start = strchr(c->header, '"');
+    const char *end = start != NULL ? strchr(start + 1, '"') : NULL;
+    if (end != NULL && end - start - 1 < (int)sizeof(sender_hex)) {
+        memcpy(sender_hex, start + 1, end - start - 1);
+        sender_hex[end - start - 1] = '\0';
+        hex_decode(sender_hex, strlen(sender_hex), c->sender, sizeof(c->sender));
+    }
+
+    bool is_part = body_len == PART_HEX_LEN;
+    if (!c->accum_active && !is_part) {
+        snprintf(sms->sender, sizeof(sms->sender), "%s", c->sender);
+        hex_decode(c->line, (size_t)body_len, sms->content, sizeof(sms->content));
+        return true;
+    }
+    if (!c->accum_active) {
+        c->accum[0] = '\0';
+        c->accum_active = true;
+    }
+    // 原实现为strlen + strncat
+    size_t used = strlen(c->accum);
+    size_t n = (size_t)body_len < sizeof(c->accum) - 1 - used ? (size_t)body_len : sizeof(c->accum) - 1 - used;
+    memcpy(c->accum + used, c->line, n);
+    c->accum[used + n] = '\0';
+    if (is_part) {
+        return false;
+    }
+    snprintf(sms->sender, sizeof(sms->sender), "%s", c->sender);
+    hex_decode(c->accum, strlen(c->accum), sms->content, sizeof(sms->content));
+    c->accum_active = false;
+    return true;
+}
+
+// ---- 新做法: 与uart_at_manager.c的decode_ucs2_hex_span/parse_cmt_header相同 ----
+
+typedef struct {
+    size_t content_len;
+    bool active;
+} span_ctx_t;
+
+static size_t span_find_char(const uart_line_span_t *span, size_t from, char c) {
+    for (size_t i = from; i < span->len; i++) {
+        if (uart_line_span_at(span, i) == c) {
+            return i;
+        }
+    }
+    return span->len;
+}
+
+static size_t decode_ucs2_hex_span(const uart_line_span_t *span, size_t start, size_t end,
+                                   char *utf8_buf, size_t utf8_buf_len, size_t utf8_len) {
+    text_utf16_state_t state = TEXT_UTF16_STATE_INIT;
+    text_codec_result_t result = TEXT_CODEC_OK;
+    size_t seg0_len = span->seg_len[0];
+    size_t pos = start;
+
+    end = start + (end - start) / 4 * 4;
+    if (pos < seg0_len) {
+        size_t n = ((end < seg0_len ? end : seg0_len) - pos) / 4 * 4;
+        result = text_ucs2_hex_to_utf8(&state, span->seg[0] + pos, n, utf8_buf, utf8_buf_len, &utf8_len);
+        pos += n;
+    }
+    if (result == TEXT_CODEC_OK && pos < seg0_len && pos < end) {
+        char wrapped[4];
+        for (int k = 0; k < 4; k++) {
+            wrapped[k] = uart_line_span_at(span, pos + k);
+        }
+        result = text_ucs2_hex_to_utf8(&state, wrapped, sizeof(wrapped), utf8_buf, utf8_buf_len, &utf8_len);
+        pos += 4;
+    }
+    if (result == TEXT_CODEC_OK && pos < end) {
+        result = text_ucs2_hex_to_utf8(&state, span->seg[1] + (pos - seg0_len), end - pos,
+                                       utf8_buf, utf8_buf_len, &utf8_len);
+    }
+    if (result == TEXT_CODEC_OK) {
+        text_utf16_finish(&state, utf8_buf, utf8_buf_len, &utf8_len);
+    }
+    return utf8_len;
+}
+
+static bool span_part(span_ctx_t *c, uart_line_framer_t *f, sms_message_t *sms) {
+    uart_line_span_t span;
+    if (!uart_line_framer_peek_line(f, &span)) {
+        return false;
+    }
+    if (!c->active) {
+        size_t start = span_find_char(&span, 0, '"');
+        size_t end = start < span.len ? span_find_char(&span, start + 1, '"') : span.len;
+        sms->sender[0] = '\0';
+        decode_ucs2_hex_span(&span, start + 1, end, sms->sender, sizeof(sms->sender), 0);
+        sms->content[0] = '\0';
+        c->content_len = 0;
+        c->active = true;
+    }
+    uart_line_framer_consume_line(f);
+    uart_line_framer_peek_line(f, &span);
+    bool is_part = span.len == PART_HEX_LEN;
+    c->content_len = decode_ucs2_hex_span(&span, 0, span.len, sms->content, sizeof(sms->content), c->content_len);
+    uart_line_framer_consume_line(f);
+    if (is_part) {
+        return false;
+    }
+    c->active = false;
+    return true;
+}
+
+// ---- 输入 ----
+
+// 一条短信的parts段+CMT报告,每段67个字符(末段66个,以免被当成中间段)
+static size_t append_message(char *out, int n, int parts) {
+    size_t len = 0;
+    for (int p = 0; p < parts; p++) {
+        len += (size_t)sprintf(out + len, "+CMT: \"002B00380036003100330038003000300030%04X\",,\"25/01/01,10:00:00+32\"\r\n",
+                               0x0030 + n % 10);
+        int units = p + 1 < parts ? PART_HEX_LEN / 4 : PART_HEX_LEN / 4 - 1;
+        for (int i = 0; i < units; i++) {
+            len += (size_t)sprintf(out + len, "%04X", 0x4F60 + (n + p + i) % 64);
+        }
+        len += (size_t)sprintf(out + len, "\r\n");
+    }
+    return len;
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// 逐条喂入framer并解码,check为true时逐条比较两种做法的结果
+static bool run(const char *msgs[], const size_t lens[], int count, int rounds, bool check,
+                double *copy_ns, double *span_ns) {
+    static copy_ctx_t cc;
+    static span_ctx_t sc;
+    static uart_line_framer_t fa, fb;
+    static char sa[RX_SIZE], sb[RX_SIZE];
+    static sms_message_t a, b;
+    uart_line_framer_init(&fa, sa, sizeof(sa));
+    uart_line_framer_init(&fb, sb, sizeof(sb));
+    memset(&cc, 0, sizeof(cc));
+    memset(&sc, 0, sizeof(sc));
+    *copy_ns = 0;
+    *span_ns = 0;
+
+    for (int r = 0; r < rounds; r++) {
+        for (int m = 0; m < count; m++) {
+            uart_line_framer_push(&fa, (const uint8_t *)msgs[m], lens[m]);
+            uart_line_framer_push(&fb, (const uint8_t *)msgs[m], lens[m]);
+            double t0 = now_ns();
+            bool done_a = false;
+            while (uart_line_framer_used(&fa) > 0) {
+                done_a = copy_part(&cc, &fa, &a);
+            }
+            double t1 = now_ns();
+            bool done_b = false;
+            while (uart_line_framer_used(&fb) > 0) {
+                done_b = span_part(&sc, &fb, &b);
+            }
+            double t2 = now_ns();
+            *copy_ns += t1 - t0;
+            *span_ns += t2 - t1;
+            if (check && (!done_a || !done_b || strcmp(a.sender, b.sender) != 0 ||
+                          strcmp(a.content, b.content) != 0)) {
+                fprintf(stderr, "mismatch in message %d\n", m);
+                return false;
+            }
+        }
+    }
+    *copy_ns /= (double)rounds * count;
+    *span_ns /= (double)rounds * count;
+    return true;
+}
+
+int main(int argc, char **argv) {
+    int rounds = argc > 1 ? atoi(argv[1]) : 2000;
+    enum { MESSAGES = 16 };
+    static const int part_counts[] = {1, 5};
+    static char storage[MESSAGES][2400];
+    const char *msgs[MESSAGES];
+    size_t lens[MESSAGES];
+
+    printf("%6s %14s %14s\n", "parts", "copy ns/msg", "span ns/msg");
+    for (size_t p = 0; p < sizeof(part_counts) / sizeof(part_counts[0]); p++) {
+        for (int m = 0; m < MESSAGES; m++) {
+            lens[m] = append_message(storage[m], m, part_counts[p]);
+            msgs[m] = storage[m];
+        }
+        double copy_ns, span_ns;
+        // 环形缓冲每轮回绕到不同位置,一致性检查覆盖跨回绕的行
+        if (!run(msgs, lens, MESSAGES, 20, true, &copy_ns, &span_ns)) {
+            return 1;
+        }
+        run(msgs, lens, MESSAGES, rounds, false, &copy_ns, &span_ns);
+        printf("%6d %14.0f %14.0f\n", part_counts[p], copy_ns, span_ns);
+    }
+    printf("cross-check: identical sender and content\n");
+    return 0;
+}
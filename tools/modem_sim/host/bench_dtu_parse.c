@@ -0,0 +1,239 @@
+/*
+ * DTU短信行解码基准: 流式解析器(dtu_line_parser)对比先整行缓存再解码的旧做法。
+ *
+ * 两种做法以相同大小的数据块喂入同样的短信行,先核对解码结果一致,再分别计时。
+ * 用法: bench_dtu_parse [轮数]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "dtu_line_parser.h"
+#include "text_codec.h"
+
+#define LINE_BUF_SIZE 4608 // 旧做法的行缓冲: 最长内容hex约4094字符
+
+static const char PREFIX[] = "config,sms,ok,";
+
+// ---- 旧做法: 行缓冲 + 整行解码 ----
+
+typedef struct {
+    char buf[LINE_BUF_SIZE];
+    size_t len;
+} line_buf_t;
+
+static size_t utf8_trim_incomplete_tail(char *buf, size_t len) {
+    size_t end = len;
+    int back = 0;
+    while (end > 0 && back < 3 && ((unsigned char)buf[end - 1] & 0xC0) == 0x80) {
+        end--;
+        back++;
+    }
+    if (end == 0) {
+        return len;
+    }
+    unsigned char lead = (unsigned char)buf[end - 1];
+    int seq_len = 1;
+    if ((lead & 0xE0) == 0xC0) seq_len = 2;
+    else if ((lead & 0xF0) == 0xE0) seq_len = 3;
+    else if ((lead & 0xF8) == 0xF0) seq_len = 4;
+    if (back + 1 < seq_len) {
+        buf[end - 1] = '\0';
+        return end - 1;
+    }
+    return len;
+}
+
+static bool whole_line_decode(const char *line, sms_message_t *sms) {
+    if (strncmp(line, PREFIX, sizeof(PREFIX) - 1) != 0) {
+        return false;
+    }
+    const char *sender_start = line + sizeof(PREFIX) - 1;
+    const char *comma = strchr(sender_start, ',');
+    if (comma == NULL) {
+        return false;
+    }
+    size_t sender_len = comma - sender_start;
+    if (sender_len == 0 || sender_len >= sizeof(sms->sender)) {
+        return false;
+    }
+    memset(sms, 0, sizeof(*sms));
+    memcpy(sms->sender, sender_start, sender_len);
+    const char *hex = comma + 1;
+    size_t hex_len = strlen(hex);
+    if (hex_len == 0 || hex_len % 2 != 0) {
+        return false;
+    }
+    size_t byte_len = hex_len / 2;
+    bool truncated = false;
+    if (byte_len >= sizeof(sms->content)) {
+        byte_len = sizeof(sms->content) - 1;
+        truncated = true;
+    }
+    if (!text_hex_to_bytes(hex, byte_len, (uint8_t *)sms->content)) {
+        return false;
+    }
+    sms->content[byte_len] = '\0';
+    if (truncated) {
+        utf8_trim_incomplete_tail(sms->content, byte_len);
+    }
+    return true;
+}
+
+// 返回解码出的短信条数
+static int whole_line_run(line_buf_t *lb, const uint8_t *data, size_t len, size_t chunk,
+                          sms_message_t *sms) {
+    int count = 0;
+    for (size_t off = 0; off < len; off += chunk) {
+        size_t n = len - off < chunk ? len - off : chunk;
+        for (size_t i = 0; i < n; i++) {
+            char c = (char)data[off + i];
+            if (c != '\n') {
+                if (lb->len < sizeof(lb->buf) - 1) {
+                    lb->buf[lb->len++] = c;
+                }
+                continue;
+            }
+            if (lb->len > 0 && lb->buf[lb->len - 1] == '\r') {
+                lb->len--;
+            }
+            lb->buf[lb->len] = '\0';
+            lb->len = 0;
+            count += whole_line_decode(lb->buf, sms);
+        }
+    }
+    return count;
+}
+
+// ---- 流式解析 ----
+
+static int streaming_run(dtu_line_parser_t *p, const uint8_t *data, size_t len, size_t chunk) {
+    int count = 0;
+    for (size_t off = 0; off < len; off += chunk) {
+        size_t n = len - off < chunk ? len - off : chunk;
+        size_t pos = 0;
+        while (pos < n) {
+            dtu_line_type_t type;
+            pos += dtu_line_parser_feed(p, data + off + pos, n - pos, &type);
+            count += type == DTU_LINE_SMS;
+        }
+    }
+    return count;
+}
+
+// ---- 输入 ----
+
+static size_t append_sms(char *out, const char *sender, const uint8_t *content, size_t len) {
+    size_t n = (size_t)sprintf(out, "%s%s,", PREFIX, sender);
+    for (size_t i = 0; i < len; i++) {
+        n += (size_t)sprintf(out + n, "%02X", content[i]);
+    }
+    memcpy(out + n, "\r\n", 2);
+    return n + 2;
+}
+
+// 生成中文内容(每字3字节UTF-8),bytes为内容字节数
+static size_t cjk_content(uint8_t *out, size_t bytes) {
+    static const uint8_t han[] = {0xE7, 0x9F, 0xAD}; // 短
+    size_t n = 0;
+    while (n + 3 <= bytes) {
+        memcpy(out + n, han, 3);
+        n += 3;
+    }
+    return n;
+}
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 两种做法解码同一数据流,逐条比较结果
+static bool cross_check(const uint8_t *data, size_t len, size_t chunk) {
+    static line_buf_t lb;
+    static dtu_line_parser_t p;
+    static sms_message_t a, b;
+    dtu_line_parser_init(&p, &b);
+    lb.len = 0;
+    size_t start = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (data[i] != '\n') {
+            continue;
+        }
+        int na = whole_line_run(&lb, data + start, i + 1 - start, chunk, &a);
+        int nb = streaming_run(&p, data + start, i + 1 - start, chunk);
+        if (na != nb || (na && (strcmp(a.sender, b.sender) != 0 || strcmp(a.content, b.content) != 0))) {
+            fprintf(stderr, "mismatch at line ending %zu (chunk %zu): %d vs %d\n", i, chunk, na, nb);
+            return false;
+        }
+        start = i + 1;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    int rounds = argc > 1 ? atoi(argv[1]) : 200;
+    static uint8_t content[2100];
+    static char text[64 * 1024];
+    size_t len = 0;
+
+    // 基准流: 8条最长短信(2046字节内容,4092个hex字符)和8条短短信交替
+    size_t long_len = cjk_content(content, sizeof(((sms_message_t *)0)->content) - 1);
+    for (int i = 0; i < 8; i++) {
+        len += append_sms(text + len, "+8613800138000", content, long_len);
+        len += append_sms(text + len, "10086", (const uint8_t *)"balance 12.34", 13);
+    }
+    const uint8_t *data = (const uint8_t *)text;
+
+    // 一致性: 正常流,以及超长截断、非法hex、奇数长度、无内容字段等边界行
+    static char edge[32 * 1024];
+    size_t edge_len = 0;
+    size_t over = cjk_content(content, 2100);
+    edge_len += append_sms(edge + edge_len, "+8613800138000", content, over);
+    edge_len += (size_t)sprintf(edge + edge_len, "config,sms,ok,10086,E79FG\r\n");
+    edge_len += (size_t)sprintf(edge + edge_len, "config,sms,ok,10086,E79\r\n");
+    edge_len += (size_t)sprintf(edge + edge_len, "config,sms,ok,1\r\n");
+    edge_len += (size_t)sprintf(edge + edge_len, "config,sms,ok,,E79FAD\r\n");
+    edge_len += (size_t)sprintf(edge + edge_len, "config,firmwarever,ok,V1.0.8\r\n");
+    edge_len += (size_t)sprintf(edge + edge_len, "config,sms,ok,10086,E79FAD\n");
+    static const size_t chunks[] = {1, 7, 32, 128, 512, 4096};
+    for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+        if (!cross_check(data, len, chunks[c]) ||
+            !cross_check((const uint8_t *)edge, edge_len, chunks[c])) {
+            return 1;
+        }
+    }
+    printf("cross-check: identical results for all chunk sizes\n");
+
+    printf("%zu bytes per round, %d rounds\n", len, rounds);
+    printf("%8s %14s %14s\n", "chunk", "whole-line MB/s", "streaming MB/s");
+    for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+        static line_buf_t lb;
+        static dtu_line_parser_t p;
+        static sms_message_t sms;
+        int na = 0, nb = 0;
+
+        lb.len = 0;
+        double t0 = now_s();
+        for (int r = 0; r < rounds; r++) {
+            na += whole_line_run(&lb, data, len, chunks[c], &sms);
+        }
+        double t1 = now_s();
+        dtu_line_parser_init(&p, &sms);
+        for (int r = 0; r < rounds; r++) {
+            nb += streaming_run(&p, data, len, chunks[c]);
+        }
+        double t2 = now_s();
+        if (na != nb) {
+            fprintf(stderr, "decoded %d vs %d messages\n", na, nb);
+            return 1;
+        }
+        double mb = (double)len * rounds / 1e6;
+        printf("%8zu %14.1f %14.1f\n", chunks[c], mb / (t1 - t0), mb / (t2 - t1));
+    }
+    printf("state: whole-line %zu bytes, streaming %zu bytes\n",
+           sizeof(line_buf_t), sizeof(dtu_line_parser_t));
+    return 0;
+}
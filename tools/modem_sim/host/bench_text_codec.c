@@ -0,0 +1,191 @@
+/*
+ * hex/UCS2解码基准: text_codec对比原来uart_at_manager.c/uart_dtu_manager.c中逐字符
+ * 分支查hex、每个字符都检查输出空间的实现。
+ *
+ * 先在随机BMP字符串(不含代理项,旧实现不支持)和随机输出缓冲大小下核对两者逐字节
+ * 一致,再计时70个UTF-16单元的短信(中文、拉丁、emoji为主)和2KB的DTU hex转字节。
+ * emoji一行对比的旧实现输出本身是错的(代理项各自编码成3字节)。
+ * 用法: bench_text_codec [轮数]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "text_codec.h"
+
+#define MSG_UNITS 70
+#define DTU_BYTES 2048
+
+// ---- 旧实现 ----
+
+static int old_hex_char_to_int(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+static size_t old_ucs2_hex_to_utf8(const char *hex, size_t hex_len, char *out, size_t out_size) {
+    size_t len = 0;
+    for (size_t p = 0; p + 4 <= hex_len; p += 4) {
+        int h1 = old_hex_char_to_int(hex[p]);
+        int h2 = old_hex_char_to_int(hex[p + 1]);
+        int h3 = old_hex_char_to_int(hex[p + 2]);
+        int h4 = old_hex_char_to_int(hex[p + 3]);
+        if (h1 < 0 || h2 < 0 || h3 < 0 || h4 < 0) {
+            break;
+        }
+        unsigned c = (unsigned)(h1 << 12 | h2 << 8 | h3 << 4 | h4);
+        size_t need = c < 0x80 ? 1 : (c < 0x800 ? 2 : 3);
+        if (len + need >= out_size) {
+            break;
+        }
+        if (need == 1) {
+            out[len++] = (char)c;
+        } else if (need == 2) {
+            out[len++] = (char)(0xC0 | c >> 6);
+            out[len++] = (char)(0x80 | (c & 0x3F));
+        } else {
+            out[len++] = (char)(0xE0 | c >> 12);
+            out[len++] = (char)(0x80 | (c >> 6 & 0x3F));
+            out[len++] = (char)(0x80 | (c & 0x3F));
+        }
+    }
+    out[len] = '\0';
+    return len;
+}
+
+static int old_hex_to_bytes(const char *hex, size_t byte_count, unsigned char *out) {
+    for (size_t i = 0; i < byte_count; i++) {
+        int hi = old_hex_char_to_int(hex[2 * i]);
+        int lo = old_hex_char_to_int(hex[2 * i + 1]);
+        if (hi < 0 || lo < 0) {
+            return -1;
+        }
+        out[i] = (unsigned char)(hi << 4 | lo);
+    }
+    return 0;
+}
+
+// ---- text_codec ----
+
+static size_t new_ucs2_hex_to_utf8(const char *hex, size_t hex_len, char *out, size_t out_size) {
+    text_utf16_state_t state = TEXT_UTF16_STATE_INIT;
+    size_t len = 0;
+    if (text_ucs2_hex_to_utf8(&state, hex, hex_len, out, out_size, &len) == TEXT_CODEC_OK) {
+        text_utf16_finish(&state, out, out_size, &len);
+    }
+    return len;
+}
+
+// ---- 输入 ----
+
+// 按UTF-16单元生成hex,大小写交替
+static size_t make_hex(const unsigned *units, size_t unit_count, size_t total_units, char *out) {
+    size_t len = 0;
+    for (size_t i = 0; i < total_units; i++) {
+        len += (size_t)sprintf(out + len, (i & 1) ? "%04x" : "%04X", units[i % unit_count]);
+    }
+    return len;
+}
+
+static unsigned random_bmp_unit(void) {
+    unsigned u;
+    do {
+        u = rand() % 3 == 0 ? (unsigned)(rand() % 0x80) : (unsigned)(rand() & 0xFFFF);
+    } while (u >= 0xD800 && u <= 0xDFFF);
+    return u;
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char **argv) {
+    int rounds = argc > 1 ? atoi(argv[1]) : 200000;
+
+    // 一致性: 包括输出缓冲放不下时截断在同一个字符
+    srand(1);
+    for (int it = 0; it < 20000; it++) {
+        unsigned units[40];
+        size_t n = (size_t)(rand() % 40);
+        for (size_t i = 0; i < n; i++) {
+            units[i] = random_bmp_unit();
+        }
+        char hex[40 * 4 + 1] = "";
+        size_t hex_len = n > 0 ? make_hex(units, n, n, hex) : 0;
+        size_t out_size = 1 + (size_t)(rand() % 130);
+        char a[160], b[160];
+        size_t la = old_ucs2_hex_to_utf8(hex, hex_len, a, out_size);
+        size_t lb = new_ucs2_hex_to_utf8(hex, hex_len, b, out_size);
+        if (la != lb || memcmp(a, b, la + 1) != 0) {
+            fprintf(stderr, "mismatch in string %d (\"%s\", out_size %zu)\n", it, hex, out_size);
+            return 1;
+        }
+    }
+    for (int c = 0; c < 256; c++) {
+        if (text_hex_nibble((char)c) != old_hex_char_to_int((char)c)) {
+            fprintf(stderr, "hex digit mismatch for 0x%02X\n", c);
+            return 1;
+        }
+    }
+    printf("cross-check: identical output on 20000 random BMP strings\n");
+
+    static const unsigned zh[] = {0x60A8, 0x7684, 0x9A8C, 0x8BC1, 0x7801, 0x662F, 0x0031, 0x0032,
+                                  0x0033, 0x0034, 0xFF0C, 0x8BF7, 0x52FF, 0x6CC4, 0x9732, 0x3002};
+    static const unsigned latin[] = {'Y', 'o', 'u', 'r', ' ', 'c', 'o', 'd', 'e', ' ', 'i', 's', ' ', 0xE9, '4', '2'};
+    static const unsigned emoji[] = {0xD83D, 0xDE00, 0xD83D, 0xDC4D, 0x0020, 0xD83C, 0xDF89,
+                                     0x597D, 0xD83D, 0xDE02, 0x0021, 0xD83E, 0xDD73};
+    static const struct {
+        const char *name;
+        const unsigned *units;
+        size_t count;
+    } corpora[] = {
+        {"chinese", zh, sizeof(zh) / sizeof(zh[0])},
+        {"latin", latin, sizeof(latin) / sizeof(latin[0])},
+        {"emoji", emoji, sizeof(emoji) / sizeof(emoji[0])},
+    };
+
+    printf("%-14s %12s %12s %8s\n", "input", "old ns", "new ns", "speedup");
+    char hex[MSG_UNITS * 4 + 1];
+    char out[1024];
+    for (size_t c = 0; c < sizeof(corpora) / sizeof(corpora[0]); c++) {
+        size_t hex_len = make_hex(corpora[c].units, corpora[c].count, MSG_UNITS, hex);
+        volatile size_t sink = 0;
+        double t0 = now_ns();
+        for (int r = 0; r < rounds; r++) {
+            sink += old_ucs2_hex_to_utf8(hex, hex_len, out, sizeof(out));
+        }
+        double t1 = now_ns();
+        for (int r = 0; r < rounds; r++) {
+            sink += new_ucs2_hex_to_utf8(hex, hex_len, out, sizeof(out));
+        }
+        double t2 = now_ns();
+        printf("ucs2 %-9s %12.1f %12.1f %7.2fx\n", corpora[c].name, (t1 - t0) / rounds, (t2 - t1) / rounds,
+               (t1 - t0) / (t2 - t1));
+    }
+
+    // DTU: 2KB UTF-8内容的hex
+    static char dtu_hex[DTU_BYTES * 2 + 1];
+    static unsigned char bytes[DTU_BYTES];
+    for (int i = 0; i < DTU_BYTES; i++) {
+        sprintf(dtu_hex + 2 * i, "%02X", (unsigned char)"\xE4\xBD\xA0" "abc"[i % 4]);
+    }
+    int dtu_rounds = rounds / 10 > 0 ? rounds / 10 : 1;
+    volatile int sink = 0;
+    double t0 = now_ns();
+    for (int r = 0; r < dtu_rounds; r++) {
+        sink += old_hex_to_bytes(dtu_hex, DTU_BYTES, bytes);
+    }
+    double t1 = now_ns();
+    for (int r = 0; r < dtu_rounds; r++) {
+        sink += text_hex_to_bytes(dtu_hex, DTU_BYTES, bytes);
+    }
+    double t2 = now_ns();
+    printf("%-14s %12.0f %12.0f %7.2fx\n", "hex->bytes 2KB", (t1 - t0) / dtu_rounds, (t2 - t1) / dtu_rounds,
+           (t1 - t0) / (t2 - t1));
+    return 0;
+}
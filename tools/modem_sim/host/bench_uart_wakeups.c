@@ -0,0 +1,208 @@
+/*
+ * UART接收唤醒模型: 按波特率给每个字节一个到达时间,模拟驱动事件,统计uart_at_task
+ * 被唤醒的次数、唤醒时没有完整行的次数,以及一行的'\n'到达后多久才唤醒消费者。
+ *
+ * 两种策略:
+ *   fifo:    原来的做法,每个UART_DATA事件(FIFO满120字节或空闲10个字符时间)都读出并唤醒
+ *   pattern: uart_at_manager的做法,'\n'模式检测事件读到行尾后唤醒(空行不唤醒),
+ *            FIFO满不唤醒,只有空闲超时且有未结束的尾部(如"> ")时才读出并唤醒
+ * 这是驱动行为的模型,不调用驱动代码;不计中断和任务切换本身的延迟。
+ * 用法: bench_uart_wakeups
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FIFO_FULL_THRESH 120 // ESP-IDF默认rxfifo_full_thresh
+#define RX_TOUT_SYMBOLS 10   // 两种策略都用10个字符时间的接收超时
+#define MAX_BYTES 16384
+
+typedef struct {
+    char data[MAX_BYTES];
+    double at_us[MAX_BYTES]; // 每个字节收完的时刻
+    size_t len;
+    double byte_us;
+} stream_t;
+
+typedef struct {
+    int wakeups;
+    int empty_wakeups; // 唤醒时没有新的完整非空行
+    int lines;         // 非空行数
+    double max_latency_us;
+    double total_latency_us;
+} result_t;
+
+static void stream_init(stream_t *s, unsigned baud) {
+    s->len = 0;
+    s->byte_us = 10e6 / baud; // 8N1
+}
+
+// gap_ms: 这段数据之前线路空闲的时间
+static void stream_add(stream_t *s, double gap_ms, const char *text) {
+    double t = s->len > 0 ? s->at_us[s->len - 1] : 0;
+    t += gap_ms * 1000;
+    for (const char *p = text; *p && s->len < MAX_BYTES; p++) {
+        t += s->byte_us;
+        s->data[s->len] = *p;
+        s->at_us[s->len] = t;
+        s->len++;
+    }
+}
+
+static bool line_is_blank(const stream_t *s, size_t nl) {
+    return nl == 0 || s->data[nl - 1] == '\n' || (s->data[nl - 1] == '\r' && (nl == 1 || s->data[nl - 2] == '\n'));
+}
+
+// 消费者在t时刻拿到[from, to)的数据
+static void deliver(const stream_t *s, size_t from, size_t to, double t, result_t *r) {
+    bool complete = false;
+    for (size_t i = from; i < to; i++) {
+        if (s->data[i] == '\n' && !line_is_blank(s, i)) {
+            double latency = t - s->at_us[i];
+            r->lines++;
+            r->total_latency_us += latency;
+            if (latency > r->max_latency_us) {
+                r->max_latency_us = latency;
+            }
+            complete = true;
+        }
+    }
+    r->wakeups++;
+    r->empty_wakeups += !complete;
+}
+
+static result_t run_fifo(const stream_t *s) {
+    result_t r = {0};
+    double tout_us = RX_TOUT_SYMBOLS * s->byte_us;
+    size_t unread = 0;
+    for (size_t i = 0; i < s->len; i++) {
+        if (i > unread && s->at_us[i] - s->at_us[i - 1] > tout_us) {
+            deliver(s, unread, i, s->at_us[i - 1] + tout_us, &r);
+            unread = i;
+        }
+        if (i + 1 - unread >= FIFO_FULL_THRESH) {
+            deliver(s, unread, i + 1, s->at_us[i], &r);
+            unread = i + 1;
+        }
+    }
+    if (unread < s->len) {
+        deliver(s, unread, s->len, s->at_us[s->len - 1] + tout_us, &r);
+    }
+    return r;
+}
+
+static result_t run_pattern(const stream_t *s) {
+    result_t r = {0};
+    double tout_us = RX_TOUT_SYMBOLS * s->byte_us;
+    size_t unread = 0;
+    for (size_t i = 0; i < s->len; i++) {
+        if (i > unread && s->at_us[i] - s->at_us[i - 1] > tout_us) {
+            // 空闲超时时没有待读的'\n': 取走没有行结束符的尾部
+            deliver(s, unread, i, s->at_us[i - 1] + tout_us, &r);
+            unread = i;
+        }
+        if (s->data[i] == '\n') {
+            if (line_is_blank(s, i)) {
+                unread = i + 1; // 读走但不唤醒
+            } else {
+                deliver(s, unread, i + 1, s->at_us[i], &r);
+                unread = i + 1;
+            }
+        }
+    }
+    if (unread < s->len) {
+        deliver(s, unread, s->len, s->at_us[s->len - 1] + tout_us, &r);
+    }
+    return r;
+}
+
+// ---- 场景 ----
+
+// 159字节的SMS-DELIVER PDU(318个hex字符)
+static void add_pdu_report(stream_t *s, double gap_ms) {
+    char text[400];
+    int n = sprintf(text, "\r\n+CMT: ,159\r\n");
+    for (int i = 0; i < 159; i++) {
+        n += sprintf(text + n, "%02X", (i * 37) & 0xFF);
+    }
+    sprintf(text + n, "\r\n");
+    stream_add(s, gap_ms, text);
+}
+
+// 文本模式UCS2短信,67个字符
+static void add_text_report(stream_t *s, double gap_ms) {
+    char text[400];
+    int n = sprintf(text, "\r\n+CMT: \"002B0038003600310033003800300030003000300030\",,\"25/01/01,10:00:00+32\"\r\n");
+    for (int i = 0; i < 67; i++) {
+        n += sprintf(text + n, "%04X", 0x4F60 + i);
+    }
+    sprintf(text + n, "\r\n");
+    stream_add(s, gap_ms, text);
+}
+
+typedef struct {
+    const char *name;
+    void (*build)(stream_t *s);
+} scenario_t;
+
+static void pdu_burst(stream_t *s) {
+    for (int i = 0; i < 3; i++) {
+        add_pdu_report(s, 0);
+    }
+}
+
+static void pdu_spaced(stream_t *s) {
+    for (int i = 0; i < 3; i++) {
+        add_pdu_report(s, 50);
+    }
+}
+
+static void text_burst(stream_t *s) {
+    for (int i = 0; i < 10; i++) {
+        add_text_report(s, 0);
+    }
+}
+
+static void status_urcs(stream_t *s) {
+    for (int i = 0; i < 5; i++) {
+        stream_add(s, 1000, "\r\n+CSQ: 24,99\r\n");
+        stream_add(s, 20, "\r\n+CREG: 1\r\n");
+    }
+}
+
+static void command_prompt(stream_t *s) {
+    stream_add(s, 0, "\r\nOK\r\n");
+    stream_add(s, 5, "\r\n> ");
+    stream_add(s, 100, "\r\n+CMGS: 5\r\n\r\nOK\r\n");
+}
+
+int main(void) {
+    static const scenario_t scenarios[] = {
+        {"3 PDUs back to back", pdu_burst},
+        {"3 PDUs 50 ms apart", pdu_spaced},
+        {"10 text reports", text_burst},
+        {"status URCs", status_urcs},
+        {"OK, prompt, +CMGS", command_prompt},
+    };
+    static const unsigned bauds[] = {115200, 921600};
+    static stream_t s;
+
+    printf("%-22s %7s %-8s %8s %6s %8s %14s %14s\n", "scenario", "baud", "policy", "wakeups", "empty",
+           "lines", "max lat ms", "avg lat ms");
+    for (size_t b = 0; b < sizeof(bauds) / sizeof(bauds[0]); b++) {
+        for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+            stream_init(&s, bauds[b]);
+            scenarios[i].build(&s);
+            result_t results[2] = {run_fifo(&s), run_pattern(&s)};
+            static const char *names[2] = {"fifo", "pattern"};
+            for (int p = 0; p < 2; p++) {
+                const result_t *r = &results[p];
+                printf("%-22s %7u %-8s %8d %6d %8d %14.2f %14.2f\n", p == 0 ? scenarios[i].name : "",
+                       bauds[b], names[p], r->wakeups, r->empty_wakeups, r->lines, r->max_latency_us / 1000,
+                       r->lines ? r->total_latency_us / r->lines / 1000 : 0);
+            }
+        }
+    }
+    return 0;
+}
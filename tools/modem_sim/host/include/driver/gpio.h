@@ -0,0 +1,6 @@
+#ifndef MODEM_SIM_GPIO_H
+#define MODEM_SIM_GPIO_H
+
+// 主机上没有引脚,管理模块只用到UART_PIN_NO_CHANGE等常量
+
+#endif // MODEM_SIM_GPIO_H
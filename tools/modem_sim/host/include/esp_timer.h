@@ -0,0 +1,9 @@
+#ifndef MODEM_SIM_ESP_TIMER_H
+#define MODEM_SIM_ESP_TIMER_H
+
+#include <stdint.h>
+
+// 自进程启动起的微秒数
+int64_t esp_timer_get_time(void);
+
+#endif // MODEM_SIM_ESP_TIMER_H
@@ -0,0 +1,32 @@
+// 主机构建: FreeRTOS的POSIX替身,只提供main/中UART管理模块用到的部分
+#ifndef MODEM_SIM_FREERTOS_H
+#define MODEM_SIM_FREERTOS_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define configTICK_RATE_HZ 1000  // 1 tick = 1 ms (CLOCK_MONOTONIC)
+#define portTICK_PERIOD_MS 1
+#define portMAX_DELAY      ((TickType_t)0xffffffffu)
+
+#define pdMS_TO_TICKS(ms)    ((TickType_t)(ms))
+#define pdTICKS_TO_MS(ticks) ((uint32_t)(ticks))
+
+#define pdFALSE 0
+#define pdTRUE  1
+#define pdFAIL  0
+#define pdPASS  1
+
+// 临界区: 单核ESP32-C3上关中断,这里用互斥锁代替
+typedef pthread_mutex_t portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED PTHREAD_MUTEX_INITIALIZER
+#define portENTER_CRITICAL(mux)      pthread_mutex_lock(mux)
+#define portEXIT_CRITICAL(mux)       pthread_mutex_unlock(mux)
+
+#endif // MODEM_SIM_FREERTOS_H
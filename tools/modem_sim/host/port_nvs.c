@@ -0,0 +1,261 @@
+// 主机构建: 内存中的NVS,可选保存到文件(每行"<namespace> <key> u32|str|blob <value>",blob为hex)
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nvs.h"
+
+#define HOST_NVS_MAX_ENTRIES 64
+#define HOST_NVS_NAME_LEN    16  // 与NVS一样,命名空间和键最长15字符
+#define HOST_NVS_VALUE_LEN   64
+
+typedef enum {
+    HOST_NVS_U32,
+    HOST_NVS_STR,
+    HOST_NVS_BLOB,
+} host_nvs_type_t;
+
+typedef struct {
+    char ns[HOST_NVS_NAME_LEN];
+    char key[HOST_NVS_NAME_LEN];
+    host_nvs_type_t type;
+    uint32_t u32;
+    char str[HOST_NVS_VALUE_LEN];
+    uint8_t *blob;
+    size_t blob_len;
+} nvs_entry_t;
+
+static nvs_entry_t s_entries[HOST_NVS_MAX_ENTRIES];
+static size_t s_count;
+static char s_namespaces[HOST_NVS_MAX_ENTRIES][HOST_NVS_NAME_LEN];
+static size_t s_ns_count;
+static const char *s_file;
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void host_nvs_set_file(const char *path) {
+    char ns[HOST_NVS_NAME_LEN];
+    char key[HOST_NVS_NAME_LEN];
+    char type[5];
+    char *line = NULL;
+    size_t line_size = 0;
+    int value_pos;
+
+    s_file = path;
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return;
+    }
+    while (s_count < HOST_NVS_MAX_ENTRIES && getline(&line, &line_size, f) > 0) {
+        if (sscanf(line, "%15s %15s %4s %n", ns, key, type, &value_pos) != 3) {
+            continue;
+        }
+        char *value = line + value_pos;
+        value[strcspn(value, "\n")] = '\0';
+        nvs_entry_t *e = &s_entries[s_count++];
+        memset(e, 0, sizeof(*e));
+        snprintf(e->ns, sizeof(e->ns), "%s", ns);
+        snprintf(e->key, sizeof(e->key), "%s", key);
+        if (strcmp(type, "str") == 0) {
+            e->type = HOST_NVS_STR;
+            snprintf(e->str, sizeof(e->str), "%s", value);
+        } else if (strcmp(type, "blob") == 0) {
+            e->type = HOST_NVS_BLOB;
+            e->blob_len = strlen(value) / 2;
+            e->blob = malloc(e->blob_len + 1);
+            for (size_t i = 0; i < e->blob_len; i++) {
+                unsigned byte = 0;
+                sscanf(value + 2 * i, "%2x", &byte);
+                e->blob[i] = (uint8_t)byte;
+            }
+        } else {
+            e->type = HOST_NVS_U32;
+            e->u32 = (uint32_t)strtoul(value, NULL, 10);
+        }
+    }
+    free(line);
+    fclose(f);
+}
+
+// 句柄即命名空间表下标+1
+static const char *handle_ns(nvs_handle_t handle) {
+    return handle > 0 && handle <= s_ns_count ? s_namespaces[handle - 1] : NULL;
+}
+
+static nvs_entry_t *entry_find(nvs_handle_t handle, const char *key, bool create) {
+    const char *ns = handle_ns(handle);
+    if (ns == NULL) {
+        return NULL;
+    }
+    for (size_t i = 0; i < s_count; i++) {
+        if (strcmp(s_entries[i].ns, ns) == 0 && strcmp(s_entries[i].key, key) == 0) {
+            return &s_entries[i];
+        }
+    }
+    if (!create || s_count == HOST_NVS_MAX_ENTRIES) {
+        return NULL;
+    }
+    nvs_entry_t *e = &s_entries[s_count++];
+    memset(e, 0, sizeof(*e));
+    snprintf(e->ns, sizeof(e->ns), "%s", ns);
+    snprintf(e->key, sizeof(e->key), "%s", key);
+    return e;
+}
+
+esp_err_t nvs_open(const char *name_space, nvs_open_mode_t open_mode, nvs_handle_t *out_handle) {
+    pthread_mutex_lock(&s_lock);
+    bool exists = false;
+    for (size_t i = 0; i < s_count && !exists; i++) {
+        exists = strcmp(s_entries[i].ns, name_space) == 0;
+    }
+    if (!exists && open_mode == NVS_READONLY) {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    size_t i = 0;
+    while (i < s_ns_count && strcmp(s_namespaces[i], name_space) != 0) {
+        i++;
+    }
+    if (i == s_ns_count) {
+        if (s_ns_count == HOST_NVS_MAX_ENTRIES) {
+            pthread_mutex_unlock(&s_lock);
+            return ESP_ERR_NO_MEM;
+        }
+        snprintf(s_namespaces[s_ns_count++], HOST_NVS_NAME_LEN, "%s", name_space);
+    }
+    *out_handle = (nvs_handle_t)(i + 1);
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle) {
+    (void)handle;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    (void)handle;
+    if (s_file == NULL) {
+        return ESP_OK;
+    }
+    pthread_mutex_lock(&s_lock);
+    FILE *f = fopen(s_file, "w");
+    if (f == NULL) {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_FAIL;
+    }
+    for (size_t i = 0; i < s_count; i++) {
+        const nvs_entry_t *e = &s_entries[i];
+        if (e->type == HOST_NVS_STR) {
+            fprintf(f, "%s %s str %s\n", e->ns, e->key, e->str);
+        } else if (e->type == HOST_NVS_BLOB) {
+            fprintf(f, "%s %s blob ", e->ns, e->key);
+            for (size_t j = 0; j < e->blob_len; j++) {
+                fprintf(f, "%02x", e->blob[j]);
+            }
+            fprintf(f, "\n");
+        } else {
+            fprintf(f, "%s %s u32 %lu\n", e->ns, e->key, (unsigned long)e->u32);
+        }
+    }
+    fclose(f);
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *out_value) {
+    pthread_mutex_lock(&s_lock);
+    const nvs_entry_t *e = entry_find(handle, key, false);
+    esp_err_t err = e != NULL && e->type == HOST_NVS_U32 ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+    if (err == ESP_OK) {
+        *out_value = e->u32;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value) {
+    pthread_mutex_lock(&s_lock);
+    nvs_entry_t *e = entry_find(handle, key, true);
+    if (e != NULL) {
+        e->type = HOST_NVS_U32;
+        e->u32 = value;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return e != NULL ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char *key, char *out_value, size_t *length) {
+    pthread_mutex_lock(&s_lock);
+    const nvs_entry_t *e = entry_find(handle, key, false);
+    esp_err_t err = ESP_ERR_NVS_NOT_FOUND;
+    if (e != NULL && e->type == HOST_NVS_STR) {
+        size_t need = strlen(e->str) + 1;
+        if (out_value == NULL) {
+            err = ESP_OK;
+        } else if (*length < need) {
+            err = ESP_ERR_INVALID_SIZE;
+        } else {
+            memcpy(out_value, e->str, need);
+            err = ESP_OK;
+        }
+        *length = need;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char *key, const char *value) {
+    if (strlen(value) >= HOST_NVS_VALUE_LEN || strchr(value, '\n') != NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_lock);
+    nvs_entry_t *e = entry_find(handle, key, true);
+    if (e != NULL) {
+        e->type = HOST_NVS_STR;
+        snprintf(e->str, sizeof(e->str), "%s", value);
+    }
+    pthread_mutex_unlock(&s_lock);
+    return e != NULL ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length) {
+    pthread_mutex_lock(&s_lock);
+    const nvs_entry_t *e = entry_find(handle, key, false);
+    esp_err_t err = ESP_ERR_NVS_NOT_FOUND;
+    if (e != NULL && e->type == HOST_NVS_BLOB) {
+        if (out_value == NULL) {
+            err = ESP_OK;
+        } else if (*length < e->blob_len) {
+            err = ESP_ERR_INVALID_SIZE;
+        } else {
+            memcpy(out_value, e->blob, e->blob_len);
+            err = ESP_OK;
+        }
+        *length = e->blob_len;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length) {
+    uint8_t *copy = malloc(length + 1);
+    if (copy == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(copy, value, length);
+    pthread_mutex_lock(&s_lock);
+    nvs_entry_t *e = entry_find(handle, key, true);
+    if (e != NULL) {
+        free(e->blob);
+        e->type = HOST_NVS_BLOB;
+        e->blob = copy;
+        e->blob_len = length;
+    }
+    pthread_mutex_unlock(&s_lock);
+    if (e == NULL) {
+        free(copy);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,503 @@
+// 主机构建: ESP-IDF UART驱动接口的tty实现,行为说明见include/driver/uart.h
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "driver/uart.h"
+#include "esp_log.h"
+
+#define HOST_UART_PORTS        3
+#define HOST_UART_READ_CHUNK   256  // 一次从tty读取的字节数,对应一次FIFO搬运
+#define HOST_UART_STOP_POLL_MS 100
+
+static const char *TAG = "host_uart";
+
+typedef struct {
+    bool installed;
+    int fd;
+    pthread_t reader;
+    volatile bool stop;
+    pthread_mutex_t lock;
+    pthread_mutex_t write_lock;
+    pthread_cond_t data_cond;   // 缓冲中有新数据
+    pthread_cond_t space_cond;  // 缓冲中有新空间
+
+    uint8_t *rx_buf;
+    size_t rx_size;
+    size_t rx_head;
+    size_t rx_count;
+    uint64_t rx_consumed;       // 已读走或清空的字节总数,模式位置以此为基准
+    uint64_t rx_pushed;
+
+    char pattern_chr;
+    bool pattern_enabled;
+    uint64_t *pat_pos;          // 模式字符的绝对位置
+    int pat_len;
+    int pat_head;
+    int pat_count;
+
+    QueueHandle_t events;
+    uint32_t baud;
+    int rx_tout_symbols;
+    int rx_full_thresh;
+    size_t rx_since_event;      // 上次事件后收到、尚未被模式事件覆盖的字节数
+    bool full_reported;
+} host_uart_t;
+
+static host_uart_t s_uart[HOST_UART_PORTS];
+static const char *s_device[HOST_UART_PORTS];
+
+void host_uart_set_device(uart_port_t uart_num, const char *path) {
+    if (uart_num >= 0 && uart_num < HOST_UART_PORTS) {
+        s_device[uart_num] = path;
+    }
+}
+
+static host_uart_t *uart_get(uart_port_t uart_num) {
+    if (uart_num < 0 || uart_num >= HOST_UART_PORTS || !s_uart[uart_num].installed) {
+        return NULL;
+    }
+    return &s_uart[uart_num];
+}
+
+static void post_event(host_uart_t *uart, uart_event_type_t type, size_t size, bool timeout_flag) {
+    if (uart->events == NULL) {
+        return;
+    }
+    uart_event_t event = {.type = type, .size = size, .timeout_flag = timeout_flag};
+    // 与中断中的xQueueSendFromISR一样不等待,队列满时事件丢失
+    xQueueSend(uart->events, &event, 0);
+}
+
+static speed_t baud_to_speed(uint32_t baud) {
+    switch (baud) {
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 115200: return B115200;
+        case 230400: return B230400;
+        case 460800: return B460800;
+        case 921600: return B921600;
+        default: return B0;
+    }
+}
+
+static void apply_termios(host_uart_t *uart, bool flow_ctrl) {
+    struct termios tio;
+    if (tcgetattr(uart->fd, &tio) != 0) {
+        return;
+    }
+    cfmakeraw(&tio);
+    tio.c_cflag |= CLOCAL | CREAD;
+    if (flow_ctrl) {
+        tio.c_cflag |= CRTSCTS;
+    } else {
+        tio.c_cflag &= ~CRTSCTS;
+    }
+    speed_t speed = baud_to_speed(uart->baud);
+    if (speed != B0) {
+        cfsetispeed(&tio, speed);
+        cfsetospeed(&tio, speed);
+    }
+    // pty不支持部分设置,失败时保持原样即可
+    tcsetattr(uart->fd, TCSANOW, &tio);
+}
+
+// 线路空闲超时: rx_tout_symbols个字符时间,至少1 ms
+static int rx_timeout_ms(const host_uart_t *uart) {
+    uint32_t us = (uint32_t)uart->rx_tout_symbols * 10 * 1000000u / (uart->baud ? uart->baud : 115200);
+    return us < 1000 ? 1 : (int)((us + 999) / 1000);
+}
+
+static void rx_push(host_uart_t *uart, const uint8_t *data, size_t len) {
+    size_t patterns = 0;
+    size_t after_last_pattern = len;
+
+    pthread_mutex_lock(&uart->lock);
+    for (size_t i = 0; i < len; i++) {
+        uart->rx_buf[(uart->rx_head + uart->rx_count + i) % uart->rx_size] = data[i];
+        if (uart->pattern_enabled && (char)data[i] == uart->pattern_chr) {
+            patterns++;
+            after_last_pattern = len - i - 1;
+            if (uart->pat_count < uart->pat_len) {
+                uart->pat_pos[(uart->pat_head + uart->pat_count) % uart->pat_len] = uart->rx_pushed + i;
+                uart->pat_count++;
+            } else {
+                ESP_LOGW(TAG, "Pattern queue full, position lost");
+            }
+        }
+    }
+    uart->rx_count += len;
+    uart->rx_pushed += len;
+    pthread_cond_broadcast(&uart->data_cond);
+    pthread_mutex_unlock(&uart->lock);
+
+    for (size_t i = 0; i < patterns; i++) {
+        post_event(uart, UART_PATTERN_DET, 0, false);
+    }
+    uart->rx_since_event = patterns > 0 ? after_last_pattern : uart->rx_since_event + len;
+    if (uart->rx_full_thresh > 0 && uart->rx_since_event >= (size_t)uart->rx_full_thresh) {
+        post_event(uart, UART_DATA, uart->rx_since_event, false);
+        uart->rx_since_event = 0;
+    }
+}
+
+static void *uart_reader(void *arg) {
+    host_uart_t *uart = arg;
+    uint8_t chunk[HOST_UART_READ_CHUNK];
+
+    while (!uart->stop) {
+        pthread_mutex_lock(&uart->lock);
+        size_t space = uart->rx_size - uart->rx_count;
+        if (space == 0) {
+            // 不再读取,数据留在tty中(相当于流控挡住对端),取走数据后恢复
+            if (!uart->full_reported) {
+                uart->full_reported = true;
+                pthread_mutex_unlock(&uart->lock);
+                post_event(uart, UART_BUFFER_FULL, 0, false);
+                continue;
+            }
+            struct timespec deadline;
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            deadline.tv_sec += 1;
+            pthread_cond_timedwait(&uart->space_cond, &uart->lock, &deadline);
+            pthread_mutex_unlock(&uart->lock);
+            continue;
+        }
+        uart->full_reported = false;
+        pthread_mutex_unlock(&uart->lock);
+
+        struct pollfd pfd = {.fd = uart->fd, .events = POLLIN};
+        int ready = poll(&pfd, 1, uart->rx_since_event > 0 ? rx_timeout_ms(uart) : HOST_UART_STOP_POLL_MS);
+        if (ready == 0) {
+            if (uart->rx_since_event > 0) {
+                post_event(uart, UART_DATA, uart->rx_since_event, true);
+                uart->rx_since_event = 0;
+            }
+            continue;
+        }
+        if (ready < 0 || (pfd.revents & (POLLERR | POLLHUP | POLLNVAL))) {
+            // 对端(模拟器)尚未打开或已退出
+            usleep(HOST_UART_STOP_POLL_MS * 1000);
+            continue;
+        }
+        ssize_t n = read(uart->fd, chunk, space < sizeof(chunk) ? space : sizeof(chunk));
+        if (n > 0) {
+            rx_push(uart, chunk, (size_t)n);
+        } else if (n < 0 && errno != EAGAIN && errno != EINTR) {
+            usleep(HOST_UART_STOP_POLL_MS * 1000);
+        }
+    }
+    return NULL;
+}
+
+esp_err_t uart_driver_install(uart_port_t uart_num, int rx_buffer_size, int tx_buffer_size,
+                              int queue_size, QueueHandle_t *uart_queue, int intr_alloc_flags) {
+    (void)tx_buffer_size;
+    (void)intr_alloc_flags;
+    if (uart_num < 0 || uart_num >= HOST_UART_PORTS || rx_buffer_size <= 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    host_uart_t *uart = &s_uart[uart_num];
+    if (uart->installed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    const char *device = s_device[uart_num] ? s_device[uart_num] : getenv("MODEM_SIM_TTY");
+    if (device == NULL) {
+        ESP_LOGE(TAG, "No tty device set (host_uart_set_device or MODEM_SIM_TTY)");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    memset(uart, 0, sizeof(*uart));
+    uart->fd = open(device, O_RDWR | O_NOCTTY);
+    if (uart->fd < 0) {
+        ESP_LOGE(TAG, "Cannot open %s: %s", device, strerror(errno));
+        return ESP_FAIL;
+    }
+    uart->rx_buf = malloc((size_t)rx_buffer_size);
+    if (uart->rx_buf == NULL) {
+        close(uart->fd);
+        return ESP_ERR_NO_MEM;
+    }
+    uart->rx_size = (size_t)rx_buffer_size;
+    uart->baud = 115200;
+    uart->rx_tout_symbols = 10;
+    uart->rx_full_thresh = 120;
+    pthread_mutex_init(&uart->lock, NULL);
+    pthread_mutex_init(&uart->write_lock, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&uart->data_cond, &attr);
+    pthread_cond_init(&uart->space_cond, &attr);
+    pthread_condattr_destroy(&attr);
+    apply_termios(uart, false);
+    tcflush(uart->fd, TCIOFLUSH);
+
+    if (queue_size > 0 && uart_queue != NULL) {
+        uart->events = xQueueCreate(queue_size, sizeof(uart_event_t));
+        *uart_queue = uart->events;
+    }
+    uart->installed = true;
+    if (pthread_create(&uart->reader, NULL, uart_reader, uart) != 0) {
+        uart->installed = false;
+        close(uart->fd);
+        free(uart->rx_buf);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t uart_driver_delete(uart_port_t uart_num) {
+    host_uart_t *uart = uart_get(uart_num);
+    if (uart == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    uart->stop = true;
+    pthread_cond_broadcast(&uart->space_cond);
+    pthread_join(uart->reader, NULL);
+    uart->installed = false;
+    close(uart->fd);
+    free(uart->rx_buf);
+    free(uart->pat_pos);
+    if (uart->events != NULL) {
+        vQueueDelete(uart->events);
+    }
+    return ESP_OK;
+}
+
+bool uart_is_driver_installed(uart_port_t uart_num) {
+    return uart_get(uart_num) != NULL;
+}
+
+esp_err_t uart_param_config(uart_port_t uart_num, const uart_config_t *uart_config) {
+    host_uart_t *uart = uart_get(uart_num);
+    if (uart == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    uart->baud = (uint32_t)uart_config->baud_rate;
+    apply_termios(uart, uart_config->flow_ctrl == UART_HW_FLOWCTRL_CTS_RTS);
+    return ESP_OK;
+}
+
+esp_err_t uart_set_pin(uart_port_t uart_num, int tx_io_num, int rx_io_num, int rts_io_num, int cts_io_num) {
+    (void)tx_io_num;
+    (void)rx_io_num;
+    (void)rts_io_num;
+    (void)cts_io_num;
+    return uart_get(uart_num) ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t uart_set_baudrate(uart_port_t uart_num, uint32_t baudrate) {
+    host_uart_t *uart = uart_get(uart_num);
+    if (uart == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    struct termios tio;
+    uart->baud = baudrate;
+    speed_t speed = baud_to_speed(baudrate);
+    if (speed != B0 && tcgetattr(uart->fd, &tio) == 0) {
+        cfsetispeed(&tio, speed);
+        cfsetospeed(&tio, speed);
+        tcsetattr(uart->fd, TCSADRAIN, &tio);
+    }
+    return ESP_OK;
+}
+
+esp_err_t uart_set_rx_timeout(uart_port_t uart_num, const uint8_t tout_thresh) {
+    host_uart_t *uart = uart_get(uart_num);
+    if (uart == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    uart->rx_tout_symbols = tout_thresh;
+    return ESP_OK;
+}
+
+esp_err_t uart_set_rx_full_threshold(uart_port_t uart_num, int threshold) {
+    host_uart_t *uart = uart_get(uart_num);
+    if (uart == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    uart->rx_full_thresh = threshold;
+    return ESP_OK;
+}
+
+int uart_read_bytes(uart_port_t uart_num, void *buf, uint32_t length, TickType_t ticks_to_wait) {
+    host_uart_t *uart = uart_get(uart_num);
+    if (uart == NULL) {
+        return -1;
+    }
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += ticks_to_wait / 1000;
+    deadline.tv_nsec += (long)(ticks_to_wait % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    // 与ESP-IDF一样等到读满length或超时
+    uint8_t *out = buf;
+    uint32_t copied = 0;
+    pthread_mutex_lock(&uart->lock);
+    while (1) {
+        while (copied < length && uart->rx_count > 0) {
+            size_t n = length - copied;
+            size_t contiguous = uart->rx_size - uart->rx_head;
+            if (n > uart->rx_count) {
+                n = uart->rx_count;
+            }
+            if (n > contiguous) {
+                n = contiguous;
+            }
+            memcpy(out + copied, uart->rx_buf + uart->rx_head, n);
+            uart->rx_head = (uart->rx_head + n) % uart->rx_size;
+            uart->rx_count -= n;
+            uart->rx_consumed += n;
+            copied += n;
+        }
+        if (copied == length || ticks_to_wait == 0) {
+            break;
+        }
+        if (ticks_to_wait == portMAX_DELAY) {
+            pthread_cond_wait(&uart->data_cond, &uart->lock);
+        } else if (pthread_cond_timedwait(&uart->data_cond, &uart->lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    pthread_cond_signal(&uart->space_cond);
+    pthread_mutex_unlock(&uart->lock);
+    return (int)copied;
+}
+
+int uart_write_bytes(uart_port_t uart_num, const void *src, size_t size) {
+    host_uart_t *uart = uart_get(uart_num);
+    if (uart == NULL) {
+        return -1;
+    }
+    const uint8_t *p = src;
+    size_t left = size;
+    pthread_mutex_lock(&uart->write_lock);
+    while (left > 0) {
+        ssize_t n = write(uart->fd, p, left);
+        if (n < 0) {
+            if (errno == EINTR || errno == EAGAIN) {
+                continue;
+            }
+            break;
+        }
+        p += n;
+        left -= (size_t)n;
+    }
+    pthread_mutex_unlock(&uart->write_lock);
+    return (int)(size - left);
+}
+
+esp_err_t uart_wait_tx_done(uart_port_t uart_num, TickType_t ticks_to_wait) {
+    (void)ticks_to_wait;
+    host_uart_t *uart = uart_get(uart_num);
+    if (uart == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    tcdrain(uart->fd);
+    return ESP_OK;
+}
+
+esp_err_t uart_flush_input(uart_port_t uart_num) {
+    host_uart_t *uart = uart_get(uart_num);
+    if (uart == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    tcflush(uart->fd, TCIFLUSH);
+    pthread_mutex_lock(&uart->lock);
+    // 清掉的数据中的模式位置随rx_consumed前移而失效
+    uart->rx_consumed += uart->rx_count;
+    uart->rx_head = 0;
+    uart->rx_count = 0;
+    uart->rx_since_event = 0;
+    pthread_cond_signal(&uart->space_cond);
+    pthread_mutex_unlock(&uart->lock);
+    return ESP_OK;
+}
+
+esp_err_t uart_get_buffered_data_len(uart_port_t uart_num, size_t *size) {
+    host_uart_t *uart = uart_get(uart_num);
+    if (uart == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    pthread_mutex_lock(&uart->lock);
+    *size = uart->rx_count;
+    pthread_mutex_unlock(&uart->lock);
+    return ESP_OK;
+}
+
+esp_err_t uart_enable_pattern_det_baud_intr(uart_port_t uart_num, char pattern_chr, uint8_t chr_num,
+                                            int chr_tout, int post_idle, int pre_idle) {
+    (void)chr_tout;
+    (void)post_idle;
+    (void)pre_idle;
+    host_uart_t *uart = uart_get(uart_num);
+    if (uart == NULL || chr_num != 1) {
+        return uart == NULL ? ESP_ERR_INVALID_STATE : ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&uart->lock);
+    uart->pattern_chr = pattern_chr;
+    uart->pattern_enabled = true;
+    pthread_mutex_unlock(&uart->lock);
+    return ESP_OK;
+}
+
+esp_err_t uart_pattern_queue_reset(uart_port_t uart_num, int queue_length) {
+    host_uart_t *uart = uart_get(uart_num);
+    if (uart == NULL || queue_length <= 0) {
+        return uart == NULL ? ESP_ERR_INVALID_STATE : ESP_ERR_INVALID_ARG;
+    }
+    uint64_t *pos = calloc((size_t)queue_length, sizeof(*pos));
+    if (pos == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    pthread_mutex_lock(&uart->lock);
+    free(uart->pat_pos);
+    uart->pat_pos = pos;
+    uart->pat_len = queue_length;
+    uart->pat_head = 0;
+    uart->pat_count = 0;
+    pthread_mutex_unlock(&uart->lock);
+    return ESP_OK;
+}
+
+// 返回相对读指针的位置;已被读走或清空的位置丢弃
+static int pattern_pos(host_uart_t *uart, bool pop) {
+    int result = -1;
+    pthread_mutex_lock(&uart->lock);
+    while (uart->pat_count > 0) {
+        uint64_t abs_pos = uart->pat_pos[uart->pat_head];
+        bool stale = abs_pos < uart->rx_consumed;
+        if (stale || pop) {
+            uart->pat_head = (uart->pat_head + 1) % uart->pat_len;
+            uart->pat_count--;
+        }
+        if (!stale) {
+            result = (int)(abs_pos - uart->rx_consumed);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&uart->lock);
+    return result;
+}
+
+int uart_pattern_pop_pos(uart_port_t uart_num) {
+    host_uart_t *uart = uart_get(uart_num);
+    return uart ? pattern_pos(uart, true) : -1;
+}
+
+int uart_pattern_get_pos(uart_port_t uart_num) {
+    host_uart_t *uart = uart_get(uart_num);
+    return uart ? pattern_pos(uart, false) : -1;
+}
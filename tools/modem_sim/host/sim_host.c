@@ -0,0 +1,330 @@
+/*
+ * 在Linux上运行main/中的UART管理模块(AT或DTU),对端是modem_sim.py的pty或真实串口。
+ *
+ * 用法: modem_sim_host --device <tty> [--device <tty2>] [--firmware at|dtu|auto]...
+ *                      [--expect N] [--timeout S] [--queue-depth N] [--consumer-delay MS]
+ *                      [--nvs FILE] [--log-level 0..5] [--capture FILE]
+ *
+ * 每个--device是一个模组(最多MODEM_MAX_INSTANCES个),按顺序接在modem_backend_default_config
+ * 给出的端口上;--firmware按同样顺序对应各模组,只给一个时所有模组相同。
+ *
+ * stdout每行一个JSON事件,供modem_sim.py --run核对:
+ *   {"event":"ready","t_ms":..,"modem":N,"operator":".."}   模组就绪(mqtt_manager_publish_device_ready)
+ *   {"event":"sms","t_ms":..,"modem":N,"sender":"..","content":".."}
+ *   {"event":"done","received":N,"elapsed_ms":..,"cpu_ms":..,"stats":{..},"modems":[{..},..]}
+ * stats为模组0的统计(与单模组时相同),modems为各模组的后端和吞吐统计。
+ * t_ms为CLOCK_MONOTONIC毫秒,与模拟器的time.monotonic()同一时钟;cpu_ms为整个进程
+ * (含UART读线程)的CPU时间。日志写到stderr。
+ *
+ * --capture FILE: 退出前调用uart_capture_dump(),把发往抓包主题的各块按MQTT收到的
+ * 原样写入FILE,可用replay.py回放。
+ *
+ * --firmware auto: 与固件的CONFIG_APP_MODEM_FIRMWARE_AUTO相同,开机探测模组固件;
+ * stats中的backend和probe_ms为识别结果和耗时(--nvs保存上次的识别结果)。
+ */
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "driver/uart.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "nvs.h"
+
+#include "modem_backend.h"
+#include "mqtt_manager.h"
+#include "sms_dedup.h"
+#include "sms_pool.h"
+#include "uart_at_manager.h"
+#include "uart_capture.h"
+#include "uart_dtu_manager.h"
+
+static volatile sig_atomic_t s_stop;
+static pthread_mutex_t s_out_lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE *s_capture_file;
+
+static void on_signal(int sig) {
+    (void)sig;
+    s_stop = 1;
+}
+
+static double monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static void json_string(FILE *out, const char *s) {
+    fputc('"', out);
+    for (const unsigned char *p = (const unsigned char *)s; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            fprintf(out, "\\%c", *p);
+        } else if (*p < 0x20) {
+            fprintf(out, "\\u%04x", *p);
+        } else {
+            fputc(*p, out);
+        }
+    }
+    fputc('"', out);
+}
+
+// 固件中由mqtt_manager发布,这里只报告就绪时间
+esp_err_t mqtt_manager_publish_device_ready(const modem_instance_t *modem) {
+    pthread_mutex_lock(&s_out_lock);
+    printf("{\"event\":\"ready\",\"t_ms\":%.1f,\"modem\":%u,\"operator\":",
+           monotonic_ms(), modem->index);
+    json_string(stdout, modem->operator_name);
+    printf("}\n");
+    fflush(stdout);
+    pthread_mutex_unlock(&s_out_lock);
+    return ESP_OK;
+}
+
+// 固件中发往MQTT;这里只把抓包导出的各块写入--capture文件
+esp_err_t mqtt_manager_publish(const char *topic, const char *payload, int len, int qos) {
+    (void)qos;
+    if (s_capture_file == NULL || strcmp(topic, CONFIG_APP_MQTT_TOPIC_CAPTURE) != 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (len == 0) {
+        len = (int)strlen(payload);
+    }
+    return fwrite(payload, 1, (size_t)len, s_capture_file) == (size_t)len ? ESP_OK : ESP_FAIL;
+}
+
+static double cpu_ms(void) {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000.0 +
+           (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1000.0;
+}
+
+// 追加到stats对象中,两种固件共用
+static void print_dedup_stats(void) {
+    sms_dedup_stats_t st;
+    sms_dedup_get_stats(&st);
+    printf(",\"sms_dedup_entries\":%lu,\"sms_dedup_hits\":%lu,\"sms_dedup_misses\":%lu,"
+           "\"sms_dedup_evictions\":%lu,\"sms_dedup_restored\":%lu,\"sms_dedup_snapshots\":%lu",
+           (unsigned long)st.entries, (unsigned long)st.hits, (unsigned long)st.misses,
+           (unsigned long)st.evictions, (unsigned long)st.restored, (unsigned long)st.snapshots);
+}
+
+static void print_pool_stats(void) {
+    sms_pool_stats_t st;
+    sms_pool_get_stats(&st);
+    printf(",\"sms_pool_size\":%lu,\"sms_pool_peak\":%lu,\"sms_pool_exhausted\":%lu,"
+           "\"sms_pool_alloc_failed\":%lu,\"sms_pool_try_missed\":%lu",
+           (unsigned long)st.size, (unsigned long)st.peak, (unsigned long)st.exhausted,
+           (unsigned long)st.failed, (unsigned long)st.try_missed);
+}
+
+static void print_backend_stats(size_t index) {
+    modem_backend_stats_t st;
+    modem_backend_get_stats(index, &st);
+    printf(",\"backend\":");
+    json_string(stdout, st.backend != NULL ? st.backend : "");
+    printf(",\"probe_ms\":%lu,\"probe_rounds\":%lu,\"probe_detected\":%d",
+           (unsigned long)st.probe_ms, (unsigned long)st.probe_rounds, st.detected ? 1 : 0);
+}
+
+static void print_at_stats(const modem_instance_t *modem) {
+    uart_at_stats_t st;
+    uart_at_get_stats(modem, &st);
+    printf(",\"stats\":{\"rx_bytes\":%lu,\"rx_wakeups\":%lu,\"rx_ring_high_water\":%lu,"
+           "\"rx_dropped_bytes\":%lu,\"rx_truncated_lines\":%lu,\"rx_buffer_full\":%lu,"
+           "\"sms_store_mode_switches\":%lu,\"sms_store_drained\":%lu,\"sms_store_deleted\":%lu,"
+           "\"sms_reasm_evictions\":%lu,\"sms_reasm_timeouts\":%lu,\"at_cmd_count\":%lu,"
+           "\"at_cmd_timeouts\":%lu,\"at_cmd_latency_avg_ms\":%lu,\"at_cmd_latency_max_ms\":%lu,"
+           "\"modem_ready_ms\":%lu,\"modem_warm_start\":%lu",
+           (unsigned long)st.rx_bytes, (unsigned long)st.rx_wakeups,
+           (unsigned long)st.rx_ring_high_water, (unsigned long)st.rx_dropped_bytes,
+           (unsigned long)st.rx_truncated_lines, (unsigned long)st.rx_buffer_full,
+           (unsigned long)st.sms_store_mode_switches, (unsigned long)st.sms_store_drained,
+           (unsigned long)st.sms_store_deleted, (unsigned long)st.sms_reasm_evictions,
+           (unsigned long)st.sms_reasm_timeouts, (unsigned long)st.at_cmd_count,
+           (unsigned long)st.at_cmd_timeouts, (unsigned long)st.at_cmd_latency_avg_ms,
+           (unsigned long)st.at_cmd_latency_max_ms, (unsigned long)st.modem_ready_ms,
+           (unsigned long)st.modem_warm_start);
+    print_dedup_stats();
+    print_pool_stats();
+    print_backend_stats(modem->index);
+    printf("}");
+}
+
+static void print_dtu_stats(const modem_instance_t *modem) {
+    uart_dtu_stats_t st;
+    uart_dtu_get_stats(modem, &st);
+    printf(",\"stats\":{\"rx_bytes\":%lu,\"rx_wakeups\":%lu,\"rx_buffered_high_water\":%lu,"
+           "\"rx_dropped_bytes\":%lu,\"rx_truncated_lines\":%lu,\"rx_buffer_full\":%lu,"
+           "\"sms_polls\":%lu,\"sms_poll_hits\":%lu,\"sms_poll_timeouts\":%lu,"
+           "\"sms_poll_interval_ms\":%lu,\"sms_poll_bytes\":%lu,\"sms_active_reports\":%lu",
+           (unsigned long)st.rx_bytes, (unsigned long)st.rx_wakeups,
+           (unsigned long)st.rx_buffered_high_water, (unsigned long)st.rx_dropped_bytes,
+           (unsigned long)st.rx_truncated_lines, (unsigned long)st.rx_buffer_full,
+           (unsigned long)st.sms_polls, (unsigned long)st.sms_poll_hits,
+           (unsigned long)st.sms_poll_timeouts, (unsigned long)st.sms_poll_interval_ms,
+           (unsigned long)st.sms_poll_bytes, (unsigned long)st.sms_active_reports);
+    print_dedup_stats();
+    print_pool_stats();
+    print_backend_stats(modem->index);
+    printf("}");
+}
+
+// 各模组的吞吐,received为本进程从队列中取到的条数
+static void print_modems(const long *received) {
+    printf(",\"modems\":[");
+    for (size_t i = 0; i < modem_backend_count(); i++) {
+        modem_backend_stats_t st;
+        modem_backend_get_stats(i, &st);
+        printf("%s{\"modem\":%u,\"backend\":", i > 0 ? "," : "", (unsigned)i);
+        json_string(stdout, st.backend != NULL ? st.backend : "");
+        printf(",\"received\":%ld,\"sms_queued\":%lu,\"sms_duplicates\":%lu,\"sms_dropped\":%lu,"
+               "\"sms_peak_per_s\":%lu,\"rx_bytes\":%lu,\"rx_peak_Bps\":%lu}",
+               received[i], (unsigned long)st.sms_queued, (unsigned long)st.sms_duplicates,
+               (unsigned long)st.sms_dropped, (unsigned long)st.sms_peak_per_s,
+               (unsigned long)st.rx_bytes, (unsigned long)st.rx_peak_bytes_per_s);
+    }
+    printf("]");
+}
+
+static const modem_backend_t *parse_firmware(const char *val) {
+    return strcmp(val, "dtu") == 0 ? &uart_dtu_backend :
+           strcmp(val, "auto") == 0 ? NULL : &uart_at_backend;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "usage: %s --device <tty> [--device <tty2>] [--firmware at|dtu|auto]...\n"
+            "          [--expect N] [--timeout S] [--queue-depth N] [--consumer-delay MS]\n"
+            "          [--nvs FILE] [--log-level 0..5] [--capture FILE]\n",
+            argv0);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    const char *devices[MODEM_MAX_INSTANCES];
+    size_t device_count = 0;
+    const modem_backend_t *backends[MODEM_MAX_INSTANCES];
+    size_t backend_count = 0;
+    long expect = 0;
+    long timeout_s = 0;
+    long queue_depth = 10; // 与app_main相同
+    long consumer_delay_ms = 0;
+    long log_level = ESP_LOG_WARN;
+    const char *capture_path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        const char *opt = argv[i];
+        const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+        if (val == NULL) {
+            usage(argv[0]);
+        }
+        i++;
+        if (strcmp(opt, "--device") == 0) {
+            if (device_count == MODEM_MAX_INSTANCES) {
+                fprintf(stderr, "at most %d --device (CONFIG_APP_MODEM_COUNT)\n", MODEM_MAX_INSTANCES);
+                usage(argv[0]);
+            }
+            devices[device_count++] = val;
+        } else if (strcmp(opt, "--firmware") == 0) {
+            if (backend_count == MODEM_MAX_INSTANCES) {
+                usage(argv[0]);
+            }
+            backends[backend_count++] = parse_firmware(val);
+        } else if (strcmp(opt, "--expect") == 0) {
+            expect = strtol(val, NULL, 10);
+        } else if (strcmp(opt, "--timeout") == 0) {
+            timeout_s = strtol(val, NULL, 10);
+        } else if (strcmp(opt, "--queue-depth") == 0) {
+            queue_depth = strtol(val, NULL, 10);
+        } else if (strcmp(opt, "--consumer-delay") == 0) {
+            consumer_delay_ms = strtol(val, NULL, 10);
+        } else if (strcmp(opt, "--nvs") == 0) {
+            host_nvs_set_file(val);
+        } else if (strcmp(opt, "--log-level") == 0) {
+            log_level = strtol(val, NULL, 10);
+        } else if (strcmp(opt, "--capture") == 0) {
+            capture_path = val;
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (device_count == 0 || queue_depth <= 0 || backend_count > device_count) {
+        usage(argv[0]);
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    esp_log_level_set("*", (esp_log_level_t)log_level);
+    modem_instance_config_t configs[MODEM_MAX_INSTANCES];
+    for (size_t i = 0; i < device_count; i++) {
+        modem_backend_default_config((uint8_t)i, &configs[i]);
+        configs[i].backend = backend_count == 0 ? &uart_at_backend :
+                             backends[i < backend_count ? i : backend_count - 1];
+        host_uart_set_device(configs[i].uart.num, devices[i]);
+    }
+    ESP_ERROR_CHECK(sms_dedup_init());
+
+    ESP_ERROR_CHECK(sms_pool_init((size_t)queue_depth));
+    QueueHandle_t sms_queue = xQueueCreate(queue_depth, sizeof(sms_message_t *));
+    ESP_ERROR_CHECK(modem_backend_start(sms_queue, configs, device_count));
+
+    // sms_processor_task的位置: 取出短信,可选地模拟慢速上报造成队列积压
+    sms_message_t *sms;
+    long received = 0;
+    long received_by_modem[MODEM_MAX_INSTANCES] = {0};
+    double start = monotonic_ms();
+    while (!s_stop && (expect == 0 || received < expect) &&
+           (timeout_s == 0 || monotonic_ms() - start < timeout_s * 1000.0)) {
+        if (xQueueReceive(sms_queue, &sms, pdMS_TO_TICKS(100)) != pdPASS) {
+            continue;
+        }
+        received++;
+        if (sms->modem < MODEM_MAX_INSTANCES) {
+            received_by_modem[sms->modem]++;
+        }
+        pthread_mutex_lock(&s_out_lock);
+        printf("{\"event\":\"sms\",\"t_ms\":%.1f,\"modem\":%u,\"sender\":",
+               monotonic_ms(), sms->modem);
+        json_string(stdout, sms->sender);
+        printf(",\"content\":");
+        json_string(stdout, sms->content);
+        printf("}\n");
+        fflush(stdout);
+        pthread_mutex_unlock(&s_out_lock);
+        if (consumer_delay_ms > 0) {
+            vTaskDelay(pdMS_TO_TICKS(consumer_delay_ms)); // 慢速发布期间缓冲仍被占用
+        }
+        sms_pool_free(sms);
+    }
+
+    if (capture_path != NULL) {
+        s_capture_file = fopen(capture_path, "wb");
+        if (s_capture_file == NULL || uart_capture_dump() != ESP_OK) {
+            fprintf(stderr, "capture dump to %s failed\n", capture_path);
+        }
+        if (s_capture_file != NULL) {
+            fclose(s_capture_file);
+        }
+    }
+
+    pthread_mutex_lock(&s_out_lock);
+    printf("{\"event\":\"done\",\"received\":%ld,\"elapsed_ms\":%.1f,\"cpu_ms\":%.1f",
+           received, monotonic_ms() - start, cpu_ms());
+    if (modem_backend_get(0) == &uart_dtu_backend) {
+        print_dtu_stats(modem_backend_instance(0));
+    } else {
+        print_at_stats(modem_backend_instance(0));
+    }
+    print_modems(received_by_modem);
+    printf("}\n");
+    fflush(stdout);
+    pthread_mutex_unlock(&s_out_lock);
+    return expect > 0 && received < expect ? 1 : 0;
+}
@@ -0,0 +1,182 @@
+/*
+ * AT命令引擎测试: 直接编译uart_at_manager.c,对端是test_at_modem.h中脚本化的模组。
+ *
+ * - 命令排队依次发送,上一条的OK处理完才发出下一条;队列满时提交失败
+ * - 执行期间到达的URC照常分发,不归入命令响应
+ * - at_send_chain: 合并成一行发送;出错时逐条重发并给出每条的结果;超时不逐条重发
+ * - 收到"> "提示后发送数据,以之后的OK结束;不需要输入的命令收到提示时发ESC并按失败结束
+ *
+ * 用法: test_at_chain (失败时返回非0)
+ */
+// 被测代码的发送交给脚本化的模组,见test_at_modem.h
+#define uart_write_bytes test_uart_write_bytes
+#include "uart_at_manager.c"
+
+#include "test_uart_at.h"
+#include "test_at_modem.h"
+
+#define QUEUE_LEN    4
+#define REPLY_MS     50    // 不应答的命令用的超时
+
+static void test_queue(void) {
+    uart_at_ctx_t *ctx = test_at_ctx(QUEUE_LEN);
+    static const exchange_t script[] = {
+        {"AT+CGMR", "\r\nEC800M\r\n\r\n+CMTI: \"SM\",3\r\n\r\nOK\r\n"},
+        {"AT1", "\r\nOK\r\n"}, {"AT2", "\r\nOK\r\n"}, {"AT3", "\r\nERROR\r\n"}, {"AT4", "\r\nOK\r\n"},
+        {"AT5", "\r\nOK\r\n"}, {"AT6", "\r\nOK\r\n"}, {"AT7", "\r\n+CME ERROR: 10\r\n"}, {"AT8", "\r\nOK\r\n"},
+    };
+    static const char *names[] = {"AT+CGMR", "AT1", "AT2", "AT3", "AT4", "AT5", "AT6", "AT7", "AT8", "AT9"};
+    _Static_assert(ARRAY_LEN(names) == AT_CMD_QUEUE_LEN + 2, "one in flight, a full queue and one more");
+    modem_start(ctx, script, ARRAY_LEN(script));
+
+    // 第一条立即发出,其余排队;队列满时拒绝
+    at_command_t cmds[ARRAY_LEN(names)];
+    char response[128];
+    for (size_t i = 0; i < ARRAY_LEN(names); i++) {
+        cmds[i] = (at_command_t){ .cmd = names[i], .timeout = pdMS_TO_TICKS(AT_COMMAND_TIMEOUT_MS) };
+    }
+    cmds[0].response = response;
+    cmds[0].response_size = sizeof(response);
+    for (size_t i = 0; i < AT_CMD_QUEUE_LEN + 1; i++) {
+        CHECK(at_submit(ctx, &cmds[i]) == ESP_OK, "submit %s", names[i]);
+    }
+    CHECK(at_submit(ctx, &cmds[AT_CMD_QUEUE_LEN + 1]) == ESP_ERR_NO_MEM, "full queue accepted a command");
+    CHECK(s_modem.step == 1, "%u commands sent at once", (unsigned)s_modem.step);
+
+    at_wait(ctx, &cmds[AT_CMD_QUEUE_LEN]);
+    for (size_t i = 0; i < AT_CMD_QUEUE_LEN + 1; i++) {
+        at_result_t want = i == 3 || i == 7 ? AT_RESULT_ERROR : AT_RESULT_OK;
+        CHECK(cmds[i].result == want, "%s: result %d", names[i], cmds[i].result);
+    }
+    CHECK(strcmp(response, "\r\nEC800M\r\n\r\nOK\r\n") == 0, "response [%s]", response);
+    CHECK(ctx->store_drain_pending, "+CMTI during a command not dispatched");
+    CHECK(atomic_load(&ctx->at_cmd_count) == AT_CMD_QUEUE_LEN + 1, "at_cmd_count %lu",
+          (unsigned long)atomic_load(&ctx->at_cmd_count));
+    modem_done();
+    test_at_free(ctx);
+}
+
+static const char *const s_setup[] = {"E0", "+CMGF=0", "+CNMI=2,2,0,0,0"};
+
+static void test_chain_ok(void) {
+    uart_at_ctx_t *ctx = test_at_ctx(QUEUE_LEN);
+    static const exchange_t script[] = {
+        {"ATE0;+CMGF=0;+CNMI=2,2,0,0,0", "\r\nOK\r\n"},
+    };
+    modem_start(ctx, script, ARRAY_LEN(script));
+
+    bool ok[ARRAY_LEN(s_setup)] = {false};
+    char response[64];
+    CHECK(at_send_chain(ctx, s_setup, ARRAY_LEN(s_setup), ok, response, sizeof(response),
+                        pdMS_TO_TICKS(AT_COMMAND_TIMEOUT_MS)) == ESP_OK, "chain failed");
+    CHECK(ok[0] && ok[1] && ok[2], "ok[] %d%d%d", ok[0], ok[1], ok[2]);
+    modem_done();
+    test_at_free(ctx);
+}
+
+static void test_chain_retry(void) {
+    uart_at_ctx_t *ctx = test_at_ctx(QUEUE_LEN);
+    static const exchange_t script[] = {
+        {"ATE0;+CMGF=0;+CNMI=2,2,0,0,0", "\r\nERROR\r\n"},
+        {"ATE0", "\r\nOK\r\n"},
+        {"AT+CMGF=0", "\r\n+CMS ERROR: 302\r\n"},
+        {"AT+CNMI=2,2,0,0,0", "\r\nOK\r\n"},
+    };
+    modem_start(ctx, script, ARRAY_LEN(script));
+
+    bool ok[ARRAY_LEN(s_setup)] = {false};
+    char response[64];
+    CHECK(at_send_chain(ctx, s_setup, ARRAY_LEN(s_setup), ok, response, sizeof(response),
+                        pdMS_TO_TICKS(AT_COMMAND_TIMEOUT_MS)) == ESP_FAIL, "chain with a failed command");
+    CHECK(ok[0] && !ok[1] && ok[2], "ok[] %d%d%d", ok[0], ok[1], ok[2]);
+    CHECK(strcmp(response, "\r\nOK\r\n") == 0, "response of the last command [%s]", response);
+    modem_done();
+    test_at_free(ctx);
+
+    // 合并后超过AT_CHAIN_MAX_LEN时直接逐条发送
+    ctx = test_at_ctx(QUEUE_LEN);
+    char long_cmd[AT_CHAIN_MAX_LEN];
+    memset(long_cmd, 'X', sizeof(long_cmd) - 4);
+    long_cmd[sizeof(long_cmd) - 4] = '\0';
+    char long_line[AT_CHAIN_MAX_LEN + 2];
+    snprintf(long_line, sizeof(long_line), "AT%s", long_cmd);
+    const char *const cmds[] = {"E0", long_cmd};
+    const exchange_t long_script[] = {
+        {"ATE0", "\r\nOK\r\n"},
+        {long_line, "\r\nOK\r\n"},
+    };
+    modem_start(ctx, long_script, ARRAY_LEN(long_script));
+    bool ok2[2] = {false};
+    CHECK(at_send_chain(ctx, cmds, 2, ok2, response, sizeof(response),
+                        pdMS_TO_TICKS(AT_COMMAND_TIMEOUT_MS)) == ESP_OK, "over-long chain");
+    CHECK(ok2[0] && ok2[1], "ok[] %d%d", ok2[0], ok2[1]);
+    modem_done();
+    test_at_free(ctx);
+}
+
+static void test_chain_timeout(void) {
+    uart_at_ctx_t *ctx = test_at_ctx(QUEUE_LEN);
+    static const exchange_t script[] = {
+        {"ATE0;+CMGF=0;+CNMI=2,2,0,0,0", NULL},
+    };
+    modem_start(ctx, script, ARRAY_LEN(script));
+
+    bool ok[ARRAY_LEN(s_setup)] = {true, true, true};
+    char response[64];
+    CHECK(at_send_chain(ctx, s_setup, ARRAY_LEN(s_setup), ok, response, sizeof(response),
+                        pdMS_TO_TICKS(REPLY_MS)) == ESP_ERR_TIMEOUT, "chain did not time out");
+    CHECK(!ok[0] && !ok[1] && !ok[2], "ok[] %d%d%d", ok[0], ok[1], ok[2]);
+    CHECK(atomic_load(&ctx->at_cmd_timeouts) == 1, "at_cmd_timeouts %lu",
+          (unsigned long)atomic_load(&ctx->at_cmd_timeouts));
+    modem_done();
+    test_at_free(ctx);
+}
+
+static void test_prompt(void) {
+    uart_at_ctx_t *ctx = test_at_ctx(QUEUE_LEN);
+    static const char pdu[] = "0011000B918113000000F10000AA0568656C6C6F\x1a";
+    static const exchange_t script[] = {
+        {"AT+CMGS=18", "\r\n> "},
+        {pdu, "\r\n+CMGS: 7\r\n\r\nOK\r\n"},
+        // 不需要输入的命令收到提示: 发ESC,命令按失败结束,下一条照常执行
+        {"AT+CMGF=0", "\r\n> "},
+        {"\x1b", NULL},
+        {"AT", "\r\nOK\r\n"},
+    };
+    modem_start(ctx, script, ARRAY_LEN(script));
+
+    char response[64];
+    at_command_t send = {
+        .cmd = "AT+CMGS=18",
+        .timeout = pdMS_TO_TICKS(AT_COMMAND_TIMEOUT_MS),
+        .response = response,
+        .response_size = sizeof(response),
+        .payload = pdu,
+        .payload_len = strlen(pdu),
+    };
+    CHECK(at_submit(ctx, &send) == ESP_OK, "submit AT+CMGS");
+    at_wait(ctx, &send);
+    CHECK(send.result == AT_RESULT_OK && send.payload_sent, "AT+CMGS: result %d, payload_sent %d",
+          send.result, send.payload_sent);
+    CHECK(strstr(response, "\r\n+CMGS: 7\r\n") != NULL, "response [%s]", response);
+
+    at_command_t mode = { .cmd = "AT+CMGF=0", .timeout = pdMS_TO_TICKS(AT_COMMAND_TIMEOUT_MS) };
+    at_command_t probe = { .cmd = "AT", .timeout = pdMS_TO_TICKS(AT_COMMAND_TIMEOUT_MS) };
+    CHECK(at_submit(ctx, &mode) == ESP_OK && at_submit(ctx, &probe) == ESP_OK, "submit");
+    at_wait(ctx, &probe);
+    CHECK(mode.result == AT_RESULT_ERROR, "unexpected prompt: result %d", mode.result);
+    CHECK(probe.result == AT_RESULT_OK, "command after the prompt: result %d", probe.result);
+    modem_done();
+    test_at_free(ctx);
+}
+
+int main(void) {
+    esp_log_level_set("*", ESP_LOG_NONE);
+    test_queue();
+    test_chain_ok();
+    test_chain_retry();
+    test_chain_timeout();
+    test_prompt();
+    printf("at_chain: %d failures\n", s_failures);
+    return s_failures != 0;
+}
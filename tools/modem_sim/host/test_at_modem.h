@@ -0,0 +1,97 @@
+/*
+ * 脚本化的模组,供uart_at_manager测试使用。测试在包含uart_at_manager.c之前
+ * (及driver/uart.h之前)定义
+ *
+ *     #define uart_write_bytes test_uart_write_bytes
+ *
+ * 被测代码的发送就全部交给这里: 模组按脚本检查收到的每条命令,把回复推入分帧缓冲
+ * 并唤醒当前任务,等待中的at_wait随即处理。在test_uart_at.h之后包含。
+ */
+#ifndef TEST_AT_MODEM_H
+#define TEST_AT_MODEM_H
+
+#define ARRAY_LEN(a) (sizeof(a) / sizeof((a)[0]))
+
+typedef struct {
+    const char *rx;     // 模组应收到的命令行(不含"\r"),或"> "之后的数据(含结尾的Ctrl-Z/ESC)
+    const char *reply;  // 回复的原始字节,NULL表示不应答
+} exchange_t;
+
+static struct {
+    uart_at_ctx_t *ctx;
+    const exchange_t *script;
+    size_t len;
+    size_t step;
+    char rx[AT_CHAIN_MAX_LEN + 64];
+    size_t rx_len;
+    bool input_mode;    // 已回复"> ",等待数据
+} s_modem;
+
+static inline void modem_start(uart_at_ctx_t *ctx, const exchange_t *script, size_t len) {
+    s_modem.ctx = ctx;
+    s_modem.script = script;
+    s_modem.len = len;
+    s_modem.step = 0;
+    s_modem.rx_len = 0;
+    s_modem.input_mode = false;
+    atomic_store(&ctx->uart_at_task_handle, xTaskGetCurrentTaskHandle());
+}
+
+// 脚本应已全部执行完,命令队列为空
+static inline void modem_done(void) {
+    CHECK(s_modem.step == s_modem.len, "modem got %u of %u expected writes",
+          (unsigned)s_modem.step, (unsigned)s_modem.len);
+    CHECK(s_modem.ctx->at_inflight == NULL && s_modem.ctx->at_queue_count == 0, "commands left in the queue");
+}
+
+static inline void modem_handle(void) {
+    s_modem.rx[s_modem.rx_len] = '\0';
+    s_modem.rx_len = 0;
+    if (s_modem.step == s_modem.len) {
+        CHECK(false, "unexpected write [%s]", s_modem.rx);
+        return;
+    }
+    const exchange_t *ex = &s_modem.script[s_modem.step++];
+    CHECK(strcmp(s_modem.rx, ex->rx) == 0, "step %u: got [%s], want [%s]",
+          (unsigned)s_modem.step, s_modem.rx, ex->rx);
+    uart_line_span_t unread;
+    if (!s_modem.input_mode) {
+        // 新命令只能在上一条的回复全部处理之后发出
+        CHECK(!uart_line_framer_peek_line(&s_modem.ctx->rx_framer, &unread),
+              "[%s] sent before the previous reply was read", s_modem.rx);
+    }
+    s_modem.input_mode = false;
+    if (ex->reply != NULL) {
+        size_t n = strlen(ex->reply);
+        uart_line_framer_push(&s_modem.ctx->rx_framer, (const uint8_t *)ex->reply, n);
+        notify_rx_consumer(s_modem.ctx);
+        s_modem.input_mode = n >= 2 && strcmp(ex->reply + n - 2, "> ") == 0;
+    }
+}
+
+int test_uart_write_bytes(uart_port_t uart_num, const void *src, size_t size) {
+    (void)uart_num;
+    const char *bytes = src;
+    for (size_t i = 0; i < size; i++) {
+        char c = bytes[i];
+        if (c == '\n' && s_modem.rx_len == 0) {
+            continue;
+        }
+        bool end = s_modem.input_mode ? (c == '\x1a' || c == '\x1b') : c == '\r';
+        if ((!end || s_modem.input_mode) && s_modem.rx_len < sizeof(s_modem.rx) - 1) {
+            s_modem.rx[s_modem.rx_len++] = c;
+        }
+        if (end) {
+            modem_handle();
+        }
+    }
+    return (int)size;
+}
+
+// 模组主动上报(不对应任何命令)
+static inline void modem_push(uart_at_ctx_t *ctx, const char *text) {
+    uart_line_framer_push(&ctx->rx_framer, (const uint8_t *)text, strlen(text));
+    notify_rx_consumer(ctx);
+}
+
+#endif // TEST_AT_MODEM_H
@@ -0,0 +1,173 @@
+/*
+ * 缓冲池取空测试(PDU模式): 直接编译uart_at_manager.c,对端是test_at_modem.h中脚本化的模组。
+ * 测试自己取走池中全部缓冲,模拟sms_processor不再归还。
+ *
+ * - 池的计数: 不等待时只计try_missed;等待计exhausted,等待超时再计failed
+ * - 直接上报的+CMT(单条或长短信分段)取不到缓冲时丢弃,计入模组的sms_dropped
+ * - 从存储读出的短信留在模组上,不标记删除;缓冲归还后重新读取并投递
+ *
+ * 用法: test_at_pool (失败时返回非0)
+ */
+// 被测代码的发送交给脚本化的模组,见test_at_modem.h
+#define uart_write_bytes test_uart_write_bytes
+#include "uart_at_manager.c"
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "test_uart_at.h"
+#include "test_at_modem.h"
+
+#define QUEUE_LEN 4
+#define POOL_MAX  64
+
+static sms_message_t *s_held[POOL_MAX];
+static size_t s_held_count;
+
+// 取走池中全部缓冲
+static void pool_take_all(void) {
+    sms_message_t *sms;
+    while (s_held_count < POOL_MAX && (sms = sms_pool_alloc(0)) != NULL) {
+        s_held[s_held_count++] = sms;
+    }
+}
+
+static void pool_return_all(void) {
+    while (s_held_count > 0) {
+        sms_pool_free(s_held[--s_held_count]);
+    }
+}
+
+static void *return_one_later(void *arg) {
+    (void)arg;
+    usleep(50 * 1000);
+    sms_pool_free(s_held[--s_held_count]);
+    return NULL;
+}
+
+static void test_pool_counters(void) {
+    uart_at_ctx_t *ctx = test_at_ctx(QUEUE_LEN);
+    sms_pool_stats_t before, st;
+    sms_pool_get_stats(&before);
+
+    pool_take_all();
+    sms_pool_get_stats(&st);
+    CHECK(s_held_count == st.size && st.in_use == st.size, "took %zu of %lu buffers", s_held_count,
+          (unsigned long)st.size);
+    // 取空时的那次试取
+    CHECK(st.try_missed == before.try_missed + 1 && st.exhausted == before.exhausted &&
+          st.failed == before.failed, "zero wait: try_missed %lu, exhausted %lu, failed %lu",
+          (unsigned long)(st.try_missed - before.try_missed), (unsigned long)(st.exhausted - before.exhausted),
+          (unsigned long)(st.failed - before.failed));
+
+    CHECK(sms_pool_alloc(pdMS_TO_TICKS(20)) == NULL, "buffer from an empty pool");
+    sms_pool_get_stats(&st);
+    CHECK(st.exhausted == before.exhausted + 1 && st.failed == before.failed + 1 &&
+          st.try_missed == before.try_missed + 1, "timed-out wait: exhausted %lu, failed %lu",
+          (unsigned long)(st.exhausted - before.exhausted), (unsigned long)(st.failed - before.failed));
+
+    // 等待期间有缓冲归还: 只计exhausted
+    pthread_t thread;
+    pthread_create(&thread, NULL, return_one_later, NULL);
+    sms_message_t *sms = sms_pool_alloc(pdMS_TO_TICKS(2000));
+    pthread_join(thread, NULL);
+    CHECK(sms != NULL, "no buffer after one was returned");
+    s_held[s_held_count++] = sms;
+    sms_pool_get_stats(&st);
+    CHECK(st.exhausted == before.exhausted + 2 && st.failed == before.failed + 1,
+          "satisfied wait: exhausted %lu, failed %lu", (unsigned long)(st.exhausted - before.exhausted),
+          (unsigned long)(st.failed - before.failed));
+
+    pool_return_all();
+    sms_pool_get_stats(&st);
+    CHECK(st.in_use == 0 && st.peak == st.size, "in_use %lu, peak %lu", (unsigned long)st.in_use,
+          (unsigned long)st.peak);
+    test_at_free(ctx);
+}
+
+static void test_direct_dropped(void) {
+    uart_at_ctx_t *ctx = test_at_ctx(QUEUE_LEN);
+    const char *s = "+8613600000001";
+    uint32_t dropped = atomic_load(&s_test_modem.sms_dropped);
+    sms_pool_stats_t before, st;
+    sms_pool_get_stats(&before);
+
+    // 单条和长短信的第一段各等待SMS_BUFFER_WAIT_MS后丢弃
+    pool_take_all();
+    test_cmt(ctx, s, 0, 0, 0, "pool direct");
+    test_cmt(ctx, s, 6, 2, 1, "pool part 1,");
+    CHECK(test_queued(ctx) == 0 && ctx->single_sms == NULL, "%u queued", (unsigned)test_queued(ctx));
+    for (int i = 0; i < SMS_REASSEMBLY_SLOTS; i++) {
+        CHECK(!ctx->reassembly[i].is_active, "reassembly entry %d started without a buffer", i);
+    }
+    CHECK(atomic_load(&s_test_modem.sms_dropped) == dropped + 2, "sms_dropped +%lu",
+          (unsigned long)(atomic_load(&s_test_modem.sms_dropped) - dropped));
+    sms_pool_get_stats(&st);
+    CHECK(st.failed == before.failed + 2, "failed +%lu", (unsigned long)(st.failed - before.failed));
+
+    // 缓冲归还后照常
+    pool_return_all();
+    test_cmt(ctx, s, 0, 0, 0, "pool direct again");
+    CHECK(test_expect_sms(ctx, s, "pool direct again"), "+CMT after buffers returned");
+    CHECK(atomic_load(&s_test_modem.sms_dropped) == dropped + 2, "sms_dropped after buffers returned");
+    test_at_free(ctx);
+}
+
+// 追加一条"+CMGL: <index>,..."头和PDU行
+static void list_add(char **out, uint16_t index, const char *sender, const char *text) {
+    char hex[2 * SMS_PDU_MAX_BYTES + 1];
+    test_pdu_hex(hex, sender, 0, 0, 0, text);
+    *out += sprintf(*out, "\r\n+CMGL: %u,1,,%u\r\n%s\r\n", index, (unsigned)(strlen(hex) / 2 - 1), hex);
+}
+
+static void test_store_kept(void) {
+    uart_at_ctx_t *ctx = test_at_ctx(QUEUE_LEN);
+    const char *s = "+8613600000002";
+    static char list[1024];
+    static char response[AT_RESPONSE_MAX_LEN];
+    char *p = list;
+    list_add(&p, 1, s, "pool stored one");
+    list_add(&p, 2, s, "pool stored two");
+    strcpy(p, "\r\nOK\r\n");
+    const exchange_t script[] = {
+        {SMS_CNMI_STORE, "\r\nOK\r\n"},
+        {"AT+CMGL=4", list},
+        {"AT+CMGL=4", list},
+        {"AT+CMGD=1;+CMGD=2", "\r\nOK\r\n"},
+        {SMS_CNMI_DIRECT, "\r\nOK\r\n"},
+    };
+    modem_start(ctx, script, ARRAY_LEN(script));
+    uint32_t dropped = atomic_load(&s_test_modem.sms_dropped);
+
+    // 第一条等待超时后留在存储中,同一次读取的其余短信不再取缓冲
+    pool_take_all();
+    ctx->store_enter_requested = true;
+    ctx->store_drain_pending = true;
+    sms_store_service(ctx, response, sizeof(response));
+    CHECK(s_modem.step == 2, "step %zu: delete sent without buffers", s_modem.step);
+    CHECK(test_queued(ctx) == 0 && ctx->store_drain_pending, "%u queued, drain pending %d",
+          (unsigned)test_queued(ctx), ctx->store_drain_pending);
+    CHECK(!store_delete_pending(ctx, 1) && !store_delete_pending(ctx, 2), "marked for delete");
+    CHECK(atomic_load(&s_test_modem.sms_dropped) == dropped, "stored SMS counted as dropped");
+
+    // 缓冲归还: 重新读取,投递后删除
+    pool_return_all();
+    sms_store_service(ctx, response, sizeof(response));
+    CHECK(s_modem.step == 4 && !ctx->store_drain_pending, "step %zu, drain pending %d", s_modem.step,
+          ctx->store_drain_pending);
+    CHECK(test_expect_sms(ctx, s, "pool stored one"), "index 1");
+    CHECK(test_expect_sms(ctx, s, "pool stored two"), "index 2");
+    sms_store_service(ctx, response, sizeof(response));
+    CHECK(!ctx->store_mode, "still in store mode");
+    modem_done();
+    test_at_free(ctx);
+}
+
+int main(void) {
+    esp_log_level_set("*", ESP_LOG_NONE);
+    test_pool_counters();
+    test_direct_dropped();
+    test_store_kept();
+    printf("at_pool: %d failures\n", s_failures);
+    return s_failures != 0;
+}
@@ -0,0 +1,287 @@
+/*
+ * 长短信拼接测试(PDU模式): 直接编译uart_at_manager.c,经handle_cmt_body送入分段,
+ * 检查SMS队列中的结果和拼接表、分段缓冲池的状态。
+ *
+ * - 多个发件人(及同一发件人的不同参考号)的分段交错、乱序到达
+ * - 拼接表满时按LRU淘汰,被淘汰的条目提前投递已收到的内容
+ * - 乱序分段占满共用分段缓冲池时淘汰最久未更新的其他条目,缺失的分段跳过
+ * - 最后一段超时未到时投递已累积的内容,未超时的条目保留
+ * - 学到约1 s的间隔后3 s即投递;超时后到达的分段计为迟到,间隔计入直方图
+ * - 超时投递时队列满: 条目保留,只计一次丢弃,队列有空位后重试投递
+ *
+ * 用法: test_at_reassembly (失败时返回非0)
+ */
+#include "uart_at_manager.c"
+
+#include "test_uart_at.h"
+
+#define QUEUE_LEN 20
+
+static int live_entries(uart_at_ctx_t *ctx) {
+    int live = 0;
+    for (int i = 0; i < SMS_REASSEMBLY_SLOTS; i++) {
+        live += ctx->reassembly[i].is_active;
+    }
+    return live;
+}
+
+static void check_idle(uart_at_ctx_t *ctx) {
+    CHECK(live_entries(ctx) == 0, "%d entries still active", live_entries(ctx));
+    CHECK(ctx->part_pool_used == 0, "fragment pool not returned (0x%lx)", (unsigned long)ctx->part_pool_used);
+    CHECK(test_queued(ctx) == 0, "%u unexpected SMS queued", (unsigned)test_queued(ctx));
+    test_at_free(ctx);
+}
+
+// 第seq段的内容,如"a2,"
+static const char *part_text(char letter, int seq) {
+    static char text[8];
+    snprintf(text, sizeof(text), "%c%d,", letter, seq);
+    return text;
+}
+
+static void send_part(uart_at_ctx_t *ctx, const char *sender, char letter, uint8_t ref, uint8_t total,
+                      uint8_t seq) {
+    test_cmt(ctx, sender, ref, total, seq, part_text(letter, seq));
+}
+
+static void test_interleaved(void) {
+    uart_at_ctx_t *ctx = test_at_ctx(QUEUE_LEN);
+    const char *a = "+8613800000001", *b = "+8613800000002", *c = "+8613800000003";
+
+    // a与c的参考号相同,a另有一条参考号不同的长短信d
+    send_part(ctx, a, 'a', 1, 3, 1);
+    send_part(ctx, b, 'b', 2, 3, 2);
+    send_part(ctx, c, 'c', 1, 3, 3);
+    send_part(ctx, a, 'd', 9, 2, 2);
+    send_part(ctx, a, 'a', 1, 3, 3);
+    send_part(ctx, b, 'b', 2, 3, 1);
+    send_part(ctx, c, 'c', 1, 3, 1);
+    CHECK(live_entries(ctx) == 4 && test_queued(ctx) == 0, "parts completed a message too early");
+    // b1到达后接上了暂存的b2,仍暂存c3、d2、a3
+    CHECK(__builtin_popcount(ctx->part_pool_used) == 3, "%d fragments buffered",
+          __builtin_popcount(ctx->part_pool_used));
+
+    send_part(ctx, a, 'a', 1, 3, 2);
+    CHECK(test_expect_sms(ctx, a, "a1,a2,a3,"), "sender a, ref 1");
+    send_part(ctx, b, 'b', 2, 3, 3);
+    CHECK(test_expect_sms(ctx, b, "b1,b2,b3,"), "sender b");
+    send_part(ctx, a, 'd', 9, 2, 1);
+    CHECK(test_expect_sms(ctx, a, "d1,d2,"), "sender a, ref 9");
+    send_part(ctx, c, 'c', 1, 3, 2);
+    CHECK(test_expect_sms(ctx, c, "c1,c2,c3,"), "sender c");
+
+    // 重复的分段不影响结果
+    send_part(ctx, b, 'e', 3, 2, 1);
+    send_part(ctx, b, 'e', 3, 2, 1);
+    send_part(ctx, b, 'e', 3, 2, 2);
+    CHECK(test_expect_sms(ctx, b, "e1,e2,"), "duplicate part");
+
+    CHECK(atomic_load(&ctx->reasm_evictions) == 0 && atomic_load(&ctx->reasm_timeouts) == 0,
+          "unexpected eviction or timeout");
+    check_idle(ctx);
+}
+
+static void test_table_lru(void) {
+    uart_at_ctx_t *ctx = test_at_ctx(QUEUE_LEN);
+    static const char *senders[] = {"+8613900000001", "+8613900000002", "+8613900000003",
+                                    "+8613900000004", "+8613900000005"};
+    _Static_assert(SMS_REASSEMBLY_SLOTS == 4, "test assumes the host build's 4 reassembly slots");
+
+    for (int i = 0; i < 4; i++) {
+        send_part(ctx, senders[i], (char)('f' + i), 1, 3, 1);
+    }
+    send_part(ctx, senders[0], 'f', 1, 3, 2); // senders[1]成为最久未更新的条目
+    send_part(ctx, senders[4], 'j', 1, 3, 1);
+    CHECK(atomic_load(&ctx->reasm_evictions) == 1, "evictions %lu",
+          (unsigned long)atomic_load(&ctx->reasm_evictions));
+    CHECK(test_expect_sms(ctx, senders[1], "g1,"), "LRU entry not flushed");
+    CHECK(live_entries(ctx) == 4, "%d entries active", live_entries(ctx));
+
+    send_part(ctx, senders[0], 'f', 1, 3, 3);
+    CHECK(test_expect_sms(ctx, senders[0], "f1,f2,f3,"), "touched entry");
+    for (int i = 2; i < 5; i++) {
+        send_part(ctx, senders[i], (char)('f' + i), 1, 3, 3);
+        send_part(ctx, senders[i], (char)('f' + i), 1, 3, 2);
+        char want[16];
+        snprintf(want, sizeof(want), "%c1,%c2,%c3,", 'f' + i, 'f' + i, 'f' + i);
+        CHECK(test_expect_sms(ctx, senders[i], want), "sender %d", i);
+    }
+    check_idle(ctx);
+}
+
+static void test_part_pool(void) {
+    uart_at_ctx_t *ctx = test_at_ctx(QUEUE_LEN);
+    const char *p = "+8613700000001", *q = "+8613700000002", *r = "+8613700000003";
+    _Static_assert(SMS_PART_POOL_SIZE == 2 * MAX_SMS_FRAGMENTS, "test assumes a 20-part pool");
+
+    // 各缺第1段: p和q各暂存9段,r暂存2段,池满
+    for (int seq = 2; seq <= 10; seq++) {
+        send_part(ctx, p, 'p', 5, 10, (uint8_t)seq);
+    }
+    for (int seq = 2; seq <= 10; seq++) {
+        send_part(ctx, q, 'q', 5, 10, (uint8_t)seq);
+    }
+    send_part(ctx, r, 'r', 5, 10, 2);
+    send_part(ctx, r, 'r', 5, 10, 3);
+    CHECK(ctx->part_pool_used == (1u << SMS_PART_POOL_SIZE) - 1, "pool not full");
+    CHECK(test_queued(ctx) == 0, "flushed before the pool ran out");
+
+    // r的下一段需要缓冲: 淘汰最久未更新的p,缺失的第1段跳过
+    send_part(ctx, r, 'r', 5, 10, 4);
+    CHECK(atomic_load(&ctx->reasm_evictions) == 1, "evictions %lu",
+          (unsigned long)atomic_load(&ctx->reasm_evictions));
+    CHECK(test_expect_sms(ctx, p, "p2,p3,p4,p5,p6,p7,p8,p9,p10,"), "evicted entry");
+    CHECK(__builtin_popcount(ctx->part_pool_used) == 9 + 3, "%d fragments buffered",
+          __builtin_popcount(ctx->part_pool_used));
+
+    send_part(ctx, q, 'q', 5, 10, 1);
+    CHECK(test_expect_sms(ctx, q, "q1,q2,q3,q4,q5,q6,q7,q8,q9,q10,"), "q");
+    for (int seq = 10; seq >= 5; seq--) {
+        send_part(ctx, r, 'r', 5, 10, (uint8_t)seq);
+    }
+    send_part(ctx, r, 'r', 5, 10, 1);
+    CHECK(test_expect_sms(ctx, r, "r1,r2,r3,r4,r5,r6,r7,r8,r9,r10,"), "r");
+    check_idle(ctx);
+}
+
+// 把条目的上一段到达时刻提前age_ms
+static void age_entry_ms(uart_at_ctx_t *ctx, const char *sender, uint32_t age_ms) {
+    for (int i = 0; i < SMS_REASSEMBLY_SLOTS; i++) {
+        sms_reassembly_entry_t *entry = &ctx->reassembly[i];
+        if (entry->is_active && strcmp(entry->message->sender, sender) == 0) {
+            entry->last_fragment_time -= pdMS_TO_TICKS(age_ms);
+        }
+    }
+}
+
+// 把条目的上一段到达时刻提前到超时之外
+static void age_entry(uart_at_ctx_t *ctx, const char *sender) {
+    age_entry_ms(ctx, sender, fragment_gap_timeout_ms(&ctx->gaps) + 100);
+}
+
+static void test_timeout(void) {
+    uart_at_ctx_t *ctx = test_at_ctx(QUEUE_LEN);
+    const char *t = "+8613600000001", *u = "+8613600000002";
+
+    send_part(ctx, t, 't', 7, 3, 1);
+    send_part(ctx, t, 't', 7, 3, 3);
+    send_part(ctx, u, 'u', 7, 2, 1);
+    age_entry(ctx, t);
+    reassembly_expire(ctx);
+    CHECK(atomic_load(&ctx->reasm_timeouts) == 1, "timeouts %lu",
+          (unsigned long)atomic_load(&ctx->reasm_timeouts));
+    CHECK(test_expect_sms(ctx, t, "t1,t3,"), "timed-out entry");
+    CHECK(live_entries(ctx) == 1, "entry within the timeout was flushed");
+    CHECK(ctx->part_pool_used == 0, "timed-out entry kept its fragment buffer");
+
+    // 迟到的第2段开始新的条目,同样超时投递
+    send_part(ctx, t, 't', 7, 3, 2);
+    CHECK(live_entries(ctx) == 2 && test_queued(ctx) == 0, "late part not pending");
+    age_entry(ctx, t);
+    reassembly_expire(ctx);
+    CHECK(test_expect_sms(ctx, t, "t2,"), "late part");
+
+    send_part(ctx, u, 'u', 7, 2, 2);
+    CHECK(test_expect_sms(ctx, u, "u1,u2,"), "entry within the timeout");
+    CHECK(atomic_load(&ctx->reasm_timeouts) == 2, "timeouts %lu",
+          (unsigned long)atomic_load(&ctx->reasm_timeouts));
+    check_idle(ctx);
+}
+
+static void test_late_fragment(void) {
+    uart_at_ctx_t *ctx = test_at_ctx(QUEUE_LEN);
+    const char *v = "+8613600000003", *w = "+8613600000004";
+
+    // 已学到约1 s的间隔: 缺末段的长短信3 s后投递
+    for (int i = 0; i < 10; i++) {
+        fragment_gap_record(&ctx->gaps, 1000);
+    }
+    CHECK(fragment_gap_timeout_ms(&ctx->gaps) == FRAGMENT_GAP_TIMEOUT_MIN_MS, "timeout %lu",
+          (unsigned long)fragment_gap_timeout_ms(&ctx->gaps));
+    send_part(ctx, v, 'v', 3, 2, 1);
+    send_part(ctx, w, 'w', 3, 2, 1);
+    age_entry_ms(ctx, v, FRAGMENT_GAP_TIMEOUT_MIN_MS - 100);
+    reassembly_expire(ctx);
+    CHECK(test_queued(ctx) == 0, "flushed before the learned timeout");
+    age_entry_ms(ctx, v, 200);
+    age_entry_ms(ctx, w, FRAGMENT_GAP_TIMEOUT_MIN_MS + 100);
+    reassembly_expire(ctx);
+    CHECK(test_expect_sms(ctx, v, "v1,"), "v after 3.1 s");
+    CHECK(test_expect_sms(ctx, w, "w1,"), "w after 3.1 s");
+
+    // v的末段5 s后才到: 计为迟到,间隔计入6 s桶;同一发件人的普通短信不计
+    for (int i = 0; i < SMS_REASSEMBLY_SLOTS; i++) {
+        sms_expired_entry_t *expired = &ctx->reassembly_expired[i];
+        if (strcmp(expired->sender, v) == 0) {
+            expired->last_fragment_time -= pdMS_TO_TICKS(5000 - FRAGMENT_GAP_TIMEOUT_MIN_MS);
+        }
+    }
+    test_cmt(ctx, w, 0, 0, 0, "w single after a timeout");
+    CHECK(test_expect_sms(ctx, w, "w single after a timeout"), "single SMS");
+    send_part(ctx, v, 'v', 3, 2, 2);
+    fragment_gap_stats_t stats;
+    fragment_gap_get_stats(&ctx->gaps, &stats);
+    CHECK(stats.late_fragments == 1 && stats.counts[7] == 1, "late %lu, 6 s bucket %lu",
+          (unsigned long)stats.late_fragments, (unsigned long)stats.counts[7]);
+
+    // 迟到的分段开始新的条目
+    age_entry(ctx, v);
+    reassembly_expire(ctx);
+    CHECK(test_expect_sms(ctx, v, "v2,"), "late part");
+    check_idle(ctx);
+}
+
+static void test_flush_retry(void) {
+    uart_at_ctx_t *ctx = test_at_ctx(QUEUE_LEN);
+    const char *x = "+8613600000005", *y = "+8613600000006";
+    char text[32];
+
+    send_part(ctx, y, 'y', 8, 3, 1);
+    send_part(ctx, y, 'y', 8, 3, 3);
+    for (int i = 0; i < QUEUE_LEN; i++) {
+        snprintf(text, sizeof(text), "filler %d", i);
+        test_cmt(ctx, x, 0, 0, 0, text);
+    }
+
+    // 队列满: 条目保留等待重试,只计一次丢弃
+    uint32_t dropped = atomic_load(&ctx->modem->sms_dropped);
+    age_entry(ctx, y);
+    reassembly_expire(ctx);
+    reassembly_expire(ctx);
+    reassembly_expire(ctx);
+    CHECK(atomic_load(&ctx->modem->sms_dropped) - dropped == 1, "dropped %lu",
+          (unsigned long)(atomic_load(&ctx->modem->sms_dropped) - dropped));
+    CHECK(live_entries(ctx) == 1 && ctx->reassembly[0].flush_pending + ctx->reassembly[1].flush_pending +
+          ctx->reassembly[2].flush_pending + ctx->reassembly[3].flush_pending == 1, "entry not kept for a retry");
+    CHECK(atomic_load(&ctx->reasm_timeouts) == 1, "timeouts %lu", (unsigned long)atomic_load(&ctx->reasm_timeouts));
+
+    // 待重试的条目不再接收分段
+    send_part(ctx, y, 'y', 8, 3, 2);
+    CHECK(live_entries(ctx) == 2, "late part joined a flushed entry");
+
+    // 队列有空位后的第一次检查即投递
+    CHECK(test_expect_sms(ctx, x, "filler 0"), "filler 0");
+    reassembly_expire(ctx);
+    CHECK(live_entries(ctx) == 1, "flushed entry not delivered");
+    for (int i = 1; i < QUEUE_LEN; i++) {
+        snprintf(text, sizeof(text), "filler %d", i);
+        CHECK(test_expect_sms(ctx, x, text), "filler %d", i);
+    }
+    CHECK(test_expect_sms(ctx, y, "y1,y3,"), "retried SMS");
+    age_entry(ctx, y);
+    reassembly_expire(ctx);
+    CHECK(test_expect_sms(ctx, y, "y2,"), "late part");
+    check_idle(ctx);
+}
+
+int main(void) {
+    esp_log_level_set("*", ESP_LOG_ERROR);
+    test_interleaved();
+    test_table_lru();
+    test_part_pool();
+    test_timeout();
+    test_late_fragment();
+    test_flush_retry();
+    printf("at_reassembly: %d failures\n", s_failures);
+    return s_failures != 0;
+}
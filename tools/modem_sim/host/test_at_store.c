@@ -0,0 +1,219 @@
+/*
+ * 存储转发测试(PDU模式): 直接编译uart_at_manager.c,对端是test_at_modem.h中脚本化的模组,
+ * SMS队列为10个(SMS_QUEUE_LEN),测试自己充当sms_processor取出短信。
+ *
+ * - 启动时一次AT+CMGL读出存储中的单条短信和乱序的长短信分段,一行AT+CMGD删除
+ * - 消费者停顿时直接上报填满队列后切到存储模式;读取中队列满,其余短信留在存储中,
+ *   队列有空位后再读;每条短信只投递一次,存储清空后切回直接上报
+ * - 合并的删除超时: 不再发送其余批次,重新读取存储,仍在的短信由去重识别(或按删除标记跳过)后删除
+ *
+ * 用法: test_at_store (失败时返回非0)
+ */
+// 被测代码的发送交给脚本化的模组,见test_at_modem.h
+#define uart_write_bytes test_uart_write_bytes
+#include "uart_at_manager.c"
+
+#include "test_uart_at.h"
+#include "test_at_modem.h"
+
+#define QUEUE_LEN SMS_QUEUE_LEN
+
+static char s_response[AT_RESPONSE_MAX_LEN];
+
+// 追加一条"+CMGL: <index>,..."头和PDU行
+static void list_add(char **out, uint16_t index, const char *sender, uint8_t ref, uint8_t total, uint8_t seq,
+                     const char *text) {
+    char hex[2 * SMS_PDU_MAX_BYTES + 1];
+    test_pdu_hex(hex, sender, ref, total, seq, text);
+    *out += sprintf(*out, "\r\n+CMGL: %u,1,,%u\r\n%s\r\n", index, (unsigned)(strlen(hex) / 2 - 1), hex);
+}
+
+static void list_end(char *out) {
+    strcpy(out, "\r\nOK\r\n");
+}
+
+static void service(uart_at_ctx_t *ctx) {
+    sms_store_service(ctx, s_response, sizeof(s_response));
+}
+
+static bool store_empty(uart_at_ctx_t *ctx) {
+    for (size_t i = 0; i < ARRAY_LEN(ctx->store_delete_bits); i++) {
+        if (ctx->store_delete_bits[i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void test_startup_drain(void) {
+    uart_at_ctx_t *ctx = test_at_ctx(QUEUE_LEN);
+    const char *a = "+8613500000001", *b = "+8613500000002";
+    static char list[2048];
+    char *p = list;
+    list_add(&p, 1, a, 0, 0, 0, "start one");
+    list_add(&p, 2, b, 0, 0, 0, "start two");
+    list_add(&p, 3, a, 0, 0, 0, "start three");
+    list_add(&p, 4, b, 9, 3, 2, "s2,");
+    list_add(&p, 5, b, 9, 3, 3, "s3,");
+    list_add(&p, 6, b, 9, 3, 1, "s1,");
+    list_end(p);
+    const exchange_t script[] = {
+        {SMS_CNMI_STORE, "\r\nOK\r\n"},
+        {"AT+CMGL=4", list},
+        {"AT+CMGD=1;+CMGD=2;+CMGD=3;+CMGD=4;+CMGD=5;+CMGD=6", "\r\nOK\r\n"},
+        {SMS_CNMI_DIRECT, "\r\nOK\r\n"},
+    };
+    modem_start(ctx, script, ARRAY_LEN(script));
+
+    // 与uart_at_task启动时相同
+    ctx->store_enter_requested = true;
+    ctx->store_drain_pending = true;
+    service(ctx);
+    CHECK(ctx->store_mode && !ctx->store_drain_pending, "store mode %d, drain pending %d",
+          ctx->store_mode, ctx->store_drain_pending);
+    CHECK(atomic_load(&ctx->store_drained) == 4 && atomic_load(&ctx->store_deleted) == 6,
+          "drained %lu, deleted %lu", (unsigned long)atomic_load(&ctx->store_drained),
+          (unsigned long)atomic_load(&ctx->store_deleted));
+    CHECK(store_empty(ctx), "delete marks left");
+
+    // 队列未空时保持存储模式
+    service(ctx);
+    CHECK(s_modem.step == 3, "switched back with SMS still queued");
+    CHECK(test_expect_sms(ctx, a, "start one"), "index 1");
+    CHECK(test_expect_sms(ctx, b, "start two"), "index 2");
+    CHECK(test_expect_sms(ctx, a, "start three"), "index 3");
+    CHECK(test_expect_sms(ctx, b, "s1,s2,s3,"), "long SMS from indexes 4-6");
+    service(ctx);
+    CHECK(!ctx->store_mode, "still in store mode after the drain");
+    modem_done();
+    test_at_free(ctx);
+}
+
+static void test_burst(void) {
+    uart_at_ctx_t *ctx = test_at_ctx(QUEUE_LEN);
+    const char *c = "+8613500000003";
+    static char list1[2048], list2[2048];
+    char *p = list1;
+    char text[32];
+    for (uint16_t i = 1; i <= 5; i++) {
+        snprintf(text, sizeof(text), "stored %u", i);
+        list_add(&p, i, c, 0, 0, 0, text);
+    }
+    list_end(p);
+    // 下标1已投递并删除
+    p = list2;
+    for (uint16_t i = 2; i <= 5; i++) {
+        snprintf(text, sizeof(text), "stored %u", i);
+        list_add(&p, i, c, 0, 0, 0, text);
+    }
+    list_end(p);
+    const exchange_t script[] = {
+        {SMS_CNMI_STORE, "\r\nOK\r\n"},
+        {"AT+CMGL=4", list1},
+        {"AT+CMGD=1", "\r\nOK\r\n"},
+        {"AT+CMGL=4", list2},
+        {"AT+CMGD=2;+CMGD=3;+CMGD=4;+CMGD=5", "\r\nOK\r\n"},
+        {SMS_CNMI_DIRECT, "\r\nOK\r\n"},
+    };
+    modem_start(ctx, script, ARRAY_LEN(script));
+
+    // 消费者停顿: 直接上报的短信填到只剩一个空位时请求切到存储模式
+    for (int i = 1; i <= QUEUE_LEN - 1; i++) {
+        CHECK(!ctx->store_enter_requested, "store mode requested with %u queued", (unsigned)test_queued(ctx));
+        snprintf(text, sizeof(text), "direct %d", i);
+        test_cmt(ctx, c, 0, 0, 0, text);
+    }
+    CHECK(ctx->store_enter_requested, "no store mode with one free slot");
+    service(ctx);
+    CHECK(ctx->store_mode, "not in store mode");
+
+    for (int i = 1; i <= 5; i++) {
+        snprintf(text, sizeof(text), "\r\n+CMTI: \"ME\",%d\r\n", i);
+        modem_push(ctx, text);
+    }
+    wait_for_rx_data(ctx, 0);
+    CHECK(ctx->store_drain_pending, "+CMTI did not request a drain");
+
+    // 只剩一个空位: 读出的第一条入队,其余留在存储中
+    service(ctx);
+    CHECK(test_queued(ctx) == QUEUE_LEN, "%u queued", (unsigned)test_queued(ctx));
+    CHECK(ctx->store_drain_pending && store_empty(ctx), "drain pending %d after a full queue",
+          ctx->store_drain_pending);
+    service(ctx);
+    CHECK(s_modem.step == 3, "listed the storage with a full queue");
+
+    for (int i = 1; i <= QUEUE_LEN - 1; i++) {
+        snprintf(text, sizeof(text), "direct %d", i);
+        CHECK(test_expect_sms(ctx, c, text), "direct %d", i);
+    }
+    CHECK(test_expect_sms(ctx, c, "stored 1"), "index 1");
+    service(ctx);
+    for (int i = 2; i <= 5; i++) {
+        snprintf(text, sizeof(text), "stored %d", i);
+        CHECK(test_expect_sms(ctx, c, text), "index %d", i);
+    }
+    service(ctx);
+    CHECK(!ctx->store_mode && !ctx->store_drain_pending, "store mode %d, drain pending %d",
+          ctx->store_mode, ctx->store_drain_pending);
+    CHECK(atomic_load(&ctx->store_drained) == 5 && atomic_load(&ctx->store_deleted) == 5,
+          "drained %lu, deleted %lu", (unsigned long)atomic_load(&ctx->store_drained),
+          (unsigned long)atomic_load(&ctx->store_deleted));
+    modem_done();
+    test_at_free(ctx);
+}
+
+static void test_delete_timeout(void) {
+    uart_at_ctx_t *ctx = test_at_ctx(QUEUE_LEN);
+    const char *d = "+8613500000004";
+    static char list[4096];
+    char *p = list;
+    char text[32];
+    for (uint16_t i = 1; i <= SMS_STORE_DELETE_BATCH + 1; i++) {
+        snprintf(text, sizeof(text), "timeout %u", i);
+        list_add(&p, i, d, 0, 0, 0, text);
+    }
+    list_end(p);
+    const exchange_t script[] = {
+        {"AT+CMGL=4", list},
+        // 模组不应答: 第二批(下标9)不再发送
+        {"AT+CMGD=1;+CMGD=2;+CMGD=3;+CMGD=4;+CMGD=5;+CMGD=6;+CMGD=7;+CMGD=8", NULL},
+        // 重新读取: 下标1-8由去重识别,下标9仍有删除标记直接跳过
+        {"AT+CMGL=4", list},
+        {"AT+CMGD=1;+CMGD=2;+CMGD=3;+CMGD=4;+CMGD=5;+CMGD=6;+CMGD=7;+CMGD=8", "\r\nOK\r\n"},
+        {"AT+CMGD=9", "\r\nOK\r\n"},
+    };
+    modem_start(ctx, script, ARRAY_LEN(script));
+    uint32_t duplicates = atomic_load(&ctx->modem->sms_duplicates);
+
+    ctx->store_mode = true;
+    ctx->store_drain_pending = true;
+    service(ctx);
+    CHECK(ctx->store_drain_pending, "timed-out delete did not request another listing");
+    for (uint16_t i = 1; i <= SMS_STORE_DELETE_BATCH; i++) {
+        CHECK(!store_delete_pending(ctx, i), "index %u still marked after the timeout", i);
+    }
+    CHECK(store_delete_pending(ctx, SMS_STORE_DELETE_BATCH + 1), "unsent batch lost its delete mark");
+    CHECK(atomic_load(&ctx->store_deleted) == 0, "deleted %lu", (unsigned long)atomic_load(&ctx->store_deleted));
+    service(ctx);
+    CHECK(atomic_load(&ctx->store_deleted) == SMS_STORE_DELETE_BATCH + 1, "deleted %lu",
+          (unsigned long)atomic_load(&ctx->store_deleted));
+    CHECK(atomic_load(&ctx->modem->sms_duplicates) - duplicates == SMS_STORE_DELETE_BATCH, "duplicates %lu",
+          (unsigned long)(atomic_load(&ctx->modem->sms_duplicates) - duplicates));
+    for (int i = 1; i <= SMS_STORE_DELETE_BATCH + 1; i++) {
+        snprintf(text, sizeof(text), "timeout %d", i);
+        CHECK(test_expect_sms(ctx, d, text), "index %d", i);
+    }
+    CHECK(test_queued(ctx) == 0, "delivered twice");
+    CHECK(store_empty(ctx), "delete marks left");
+    modem_done();
+    test_at_free(ctx);
+}
+
+int main(void) {
+    esp_log_level_set("*", ESP_LOG_NONE);
+    test_startup_drain();
+    test_burst();
+    test_delete_timeout();
+    printf("at_store: %d failures\n", s_failures);
+    return s_failures != 0;
+}
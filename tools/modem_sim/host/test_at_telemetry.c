@@ -0,0 +1,181 @@
+/*
+ * 模组状态采样测试: 直接编译uart_at_manager.c,对端是test_at_modem.h中脚本化的模组。
+ *
+ * - 未到间隔不发送;到期且空闲时发出合并的查询,响应经URC处理函数填入状态缓存
+ * - 一次140字节的收发在115200波特率下记为12152 us
+ * - 近期有短信、有待拼接的分段、有待读取的存储、有其他命令时推迟,每次到期只计一次推迟
+ * - 采样期间到达的+CMTI照常消费;超时计为失败
+ *
+ * 用法: test_at_telemetry (失败时返回非0)
+ */
+// 被测代码的发送交给脚本化的模组,见test_at_modem.h
+#define uart_write_bytes test_uart_write_bytes
+#include "uart_at_manager.c"
+
+#include "test_uart_at.h"
+#include "test_at_modem.h"
+
+#define QUEUE_LEN 4
+
+// 加上命令行的30字节共140字节
+static const char s_reply[] = "\r\n+CSQ: 24,0\r\n\r\n+CREG: 0,1\r\n\r\n+CEREG: 2,1,\"1A2B\",\"0C0D0E0F\",7\r\n"
+                              "\r\n+CPMS: \"ME\",13,50,\"SM\",0,5,\"ME\",13,50\r\n\r\nOK\r\n";
+
+// 让下一次采样到期,且上一次短信活动已在安静期之外
+static void make_due(uart_at_ctx_t *ctx) {
+    TickType_t now = xTaskGetTickCount();
+    ctx->telemetry_last_tick = now - pdMS_TO_TICKS(MODEM_TELEMETRY_INTERVAL_MS);
+    ctx->sms_activity_tick = now - pdMS_TO_TICKS(MODEM_TELEMETRY_SMS_QUIET_MS);
+}
+
+static uint32_t deferrals(uart_at_ctx_t *ctx) {
+    return atomic_load(&ctx->telemetry_deferrals);
+}
+
+// 提交采样并等它完成
+static void sample(uart_at_ctx_t *ctx) {
+    size_t step = s_modem.step;
+    modem_telemetry_service(ctx);
+    CHECK(ctx->telemetry_busy && s_modem.step == step + 1, "sample not sent");
+    at_wait(ctx, &ctx->telemetry_cmd);
+    CHECK(!ctx->telemetry_busy, "sample still busy");
+}
+
+static void test_sample(void) {
+    uart_at_ctx_t *ctx = test_at_ctx(QUEUE_LEN);
+    static const exchange_t script[] = {
+        {MODEM_TELEMETRY_QUERY, s_reply},
+    };
+    modem_start(ctx, script, ARRAY_LEN(script));
+
+    // 未到间隔
+    make_due(ctx);
+    ctx->telemetry_last_tick += pdMS_TO_TICKS(1000);
+    modem_telemetry_service(ctx);
+    CHECK(s_modem.step == 0 && !ctx->telemetry_busy, "sample before the interval");
+
+    make_due(ctx);
+    sample(ctx);
+    CHECK(atomic_load(&ctx->telemetry_samples) == 1 && atomic_load(&ctx->telemetry_failures) == 0,
+          "samples %lu, failures %lu", (unsigned long)atomic_load(&ctx->telemetry_samples),
+          (unsigned long)atomic_load(&ctx->telemetry_failures));
+    _Static_assert(sizeof(MODEM_TELEMETRY_QUERY) + 1 + sizeof(s_reply) - 1 == 140, "a 140-byte exchange");
+    CHECK(atomic_load(&ctx->telemetry_uart_us) == 12152, "uart_us %lu at %lu baud",
+          (unsigned long)atomic_load(&ctx->telemetry_uart_us), (unsigned long)atomic_load(&ctx->uart_baud));
+
+    modem_status_t st;
+    modem_status_get(&ctx->status, &st);
+    CHECK(st.rssi_dbm == -65 && st.creg_stat == 1 && st.cereg_stat == 1 && st.lac == 0x1A2B &&
+          st.cell_id == 0x0C0D0E0F && st.sms_used == 13 && st.sms_total == 50,
+          "rssi %d creg %u cereg %u lac %x ci %lx cpms %u/%u", st.rssi_dbm, st.creg_stat, st.cereg_stat, st.lac,
+          (unsigned long)st.cell_id, st.sms_used, st.sms_total);
+
+    // 刚采过,下一次未到期
+    modem_telemetry_service(ctx);
+    CHECK(!ctx->telemetry_busy, "sampled again right away");
+    modem_done();
+    test_at_free(ctx);
+}
+
+static void test_deferrals(void) {
+    uart_at_ctx_t *ctx = test_at_ctx(QUEUE_LEN);
+    const char *s = "+8613400000001";
+    static const exchange_t script[] = {
+        {MODEM_TELEMETRY_QUERY, s_reply},
+        {"AT", "\r\nOK\r\n"},
+        {MODEM_TELEMETRY_QUERY, s_reply},
+        {MODEM_TELEMETRY_QUERY, s_reply},
+        {MODEM_TELEMETRY_QUERY, s_reply},
+    };
+    modem_start(ctx, script, ARRAY_LEN(script));
+
+    // 刚收到+CMT: 推迟到安静期之后
+    make_due(ctx);
+    char hex[2 * SMS_PDU_MAX_BYTES + 1];
+    char cmt[sizeof(hex) + 32];
+    test_pdu_hex(hex, s, 0, 0, 0, "telemetry quiet");
+    snprintf(cmt, sizeof(cmt), "\r\n+CMT: ,%u\r\n%s\r\n", (unsigned)(strlen(hex) / 2 - 1), hex);
+    modem_push(ctx, cmt);
+    wait_for_rx_data(ctx, 0);
+    CHECK(test_expect_sms(ctx, s, "telemetry quiet"), "+CMT");
+    modem_telemetry_service(ctx);
+    modem_telemetry_service(ctx);
+    CHECK(deferrals(ctx) == 1 && !ctx->telemetry_busy, "recent SMS: deferrals %lu",
+          (unsigned long)deferrals(ctx));
+    make_due(ctx);
+    sample(ctx);
+
+    // 其他命令执行中
+    make_due(ctx);
+    at_command_t probe = { .cmd = "AT", .timeout = pdMS_TO_TICKS(AT_COMMAND_TIMEOUT_MS) };
+    CHECK(at_submit(ctx, &probe) == ESP_OK, "submit AT");
+    modem_telemetry_service(ctx);
+    modem_telemetry_service(ctx);
+    CHECK(deferrals(ctx) == 2 && !ctx->telemetry_busy, "command in flight: deferrals %lu",
+          (unsigned long)deferrals(ctx));
+    at_wait(ctx, &probe);
+    sample(ctx);
+
+    // 长短信还缺分段
+    make_due(ctx);
+    test_cmt(ctx, s, 4, 2, 1, "tel1,");
+    modem_telemetry_service(ctx);
+    modem_telemetry_service(ctx);
+    CHECK(deferrals(ctx) == 3 && !ctx->telemetry_busy, "pending part: deferrals %lu",
+          (unsigned long)deferrals(ctx));
+    test_cmt(ctx, s, 4, 2, 2, "tel2,");
+    CHECK(test_expect_sms(ctx, s, "tel1,tel2,"), "long SMS");
+    sample(ctx);
+
+    // 存储中有待读取的短信
+    make_due(ctx);
+    ctx->store_drain_pending = true;
+    modem_telemetry_service(ctx);
+    modem_telemetry_service(ctx);
+    CHECK(deferrals(ctx) == 4 && !ctx->telemetry_busy, "pending drain: deferrals %lu",
+          (unsigned long)deferrals(ctx));
+    ctx->store_drain_pending = false;
+    sample(ctx);
+
+    CHECK(atomic_load(&ctx->telemetry_samples) == 4, "samples %lu",
+          (unsigned long)atomic_load(&ctx->telemetry_samples));
+    modem_done();
+    test_at_free(ctx);
+}
+
+static void test_urc_and_timeout(void) {
+    uart_at_ctx_t *ctx = test_at_ctx(QUEUE_LEN);
+    static const exchange_t script[] = {
+        {MODEM_TELEMETRY_QUERY, "\r\n+CSQ: 20,0\r\n\r\n+CMTI: \"ME\",7\r\n\r\n+CREG: 0,5\r\n\r\nOK\r\n"},
+        {MODEM_TELEMETRY_QUERY, NULL},
+    };
+    modem_start(ctx, script, ARRAY_LEN(script));
+
+    make_due(ctx);
+    sample(ctx);
+    CHECK(ctx->store_drain_pending, "+CMTI during a sample not handled");
+    CHECK(strstr(ctx->telemetry_response, "+CMTI") == NULL, "+CMTI in the sample response");
+    modem_status_t st;
+    modem_status_get(&ctx->status, &st);
+    CHECK(st.rssi_dbm == -73 && st.creg_stat == 5, "rssi %d creg %u", st.rssi_dbm, st.creg_stat);
+    ctx->store_drain_pending = false;
+
+    // 模组不应答: 超时后计为失败,不计入样本
+    make_due(ctx);
+    sample(ctx);
+    CHECK(ctx->telemetry_cmd.result == AT_RESULT_TIMEOUT, "result %d", ctx->telemetry_cmd.result);
+    CHECK(atomic_load(&ctx->telemetry_samples) == 1 && atomic_load(&ctx->telemetry_failures) == 1,
+          "samples %lu, failures %lu", (unsigned long)atomic_load(&ctx->telemetry_samples),
+          (unsigned long)atomic_load(&ctx->telemetry_failures));
+    modem_done();
+    test_at_free(ctx);
+}
+
+int main(void) {
+    esp_log_level_set("*", ESP_LOG_NONE);
+    test_sample();
+    test_deferrals();
+    test_urc_and_timeout();
+    printf("at_telemetry: %d failures\n", s_failures);
+    return s_failures != 0;
+}
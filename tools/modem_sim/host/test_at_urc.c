@@ -0,0 +1,236 @@
+/*
+ * URC分发与模组状态缓存测试: 直接编译uart_at_manager.c,对端是test_at_modem.h中脚本化的模组。
+ *
+ * - 每个内置和状态类前缀都在自己的桶链中,桶链不长于3
+ * - 内置、状态类、注册的处理函数依次运行,短前缀的注册处理函数最后运行
+ * - 命令执行期间: 处理函数消费的行不归入响应,未消费的(如+CSQ)同时进入响应和状态缓存
+ * - +CREG/+CEREG的主动上报与查询响应(含带引号的LAC/CI)、CSQ 99、+CPIN、^MODE、
+ *   +CPMS两种响应、网络时间(拒绝RTC默认的"70/01/01")
+ * - 写入方持续更新时读取方读到的快照不会新旧混杂
+ *
+ * 用法: test_at_urc (失败时返回非0)
+ */
+// 被测代码的发送交给脚本化的模组,见test_at_modem.h
+#define uart_write_bytes test_uart_write_bytes
+#include "uart_at_manager.c"
+
+#include <pthread.h>
+
+#include "test_uart_at.h"
+#include "test_at_modem.h"
+
+#define QUEUE_LEN 4
+#define SNAPSHOT_WRITES 200000
+
+static void dispatch(uart_at_ctx_t *ctx, const char *line) {
+    at_handle_line(ctx, line, (int)strlen(line));
+}
+
+static void test_buckets(void) {
+    uart_at_ctx_t *ctx = test_at_ctx(QUEUE_LEN);
+    const char *prefixes[AT_URC_REGISTERED_BASE];
+    for (size_t i = 0; i < AT_URC_BUILTIN_COUNT; i++) {
+        prefixes[i] = s_builtin_urc_handlers[i].prefix;
+    }
+    for (size_t i = 0; i < AT_URC_STATUS_COUNT; i++) {
+        prefixes[AT_URC_BUILTIN_COUNT + i] = s_status_urc_handlers[i].prefix;
+    }
+
+    for (size_t i = 0; i < AT_URC_REGISTERED_BASE; i++) {
+        bool found = false;
+        int chain = 0;
+        for (uint8_t id = atomic_load(&ctx->urc_index.head[urc_bucket(prefixes[i])]); id != AT_URC_ID_NONE;
+             id = atomic_load(&ctx->urc_index.next[id])) {
+            found |= id == i;
+            chain++;
+        }
+        CHECK(found, "%s not in its bucket", prefixes[i]);
+        CHECK(chain <= 3, "%s shares its bucket with %d prefixes", prefixes[i], chain - 1);
+    }
+    CHECK(atomic_load(&ctx->urc_index.short_head) == AT_URC_ID_NONE, "built-in short prefix");
+    test_at_free(ctx);
+}
+
+static char s_calls[16];
+
+static bool record(const char *line, int len, void *arg) {
+    (void)line;
+    (void)len;
+    size_t n = strlen(s_calls);
+    if (n + 1 < sizeof(s_calls)) {
+        s_calls[n] = *(const char *)arg;
+    }
+    return false;
+}
+
+static bool record_after_builtins(const char *line, int len, void *arg) {
+    // 内置的就绪标志和状态缓存已先处理了同一行
+    uart_at_ctx_t *ctx = s_test_modem.ctx;
+    bool ready = strcmp(line, "+CPIN: READY") == 0;
+    modem_status_t status;
+    modem_status_get(&ctx->status, &status);
+    CHECK(status.sim == (ready ? MODEM_SIM_READY : MODEM_SIM_PIN_REQUIRED) &&
+          (!ready || (ctx->modem_ready_urcs & MODEM_URC_SIM_READY)),
+          "registered handler ran before the built-ins");
+    return record(line, len, arg);
+}
+
+static bool consume(const char *line, int len, void *arg) {
+    record(line, len, arg);
+    return true;
+}
+
+static void test_order(void) {
+    uart_at_ctx_t *ctx = test_at_ctx(QUEUE_LEN);
+    atomic_store(&s_test_modem.backend, &uart_at_backend);
+
+    CHECK(uart_at_register_urc_handler(&s_test_modem, "+", record, "s") == ESP_OK, "register +");
+    CHECK(uart_at_register_urc_handler(&s_test_modem, "+CPIN:", record_after_builtins, "a") == ESP_OK,
+          "register +CPIN:");
+    CHECK(uart_at_register_urc_handler(&s_test_modem, "+CPIN: R", record, "b") == ESP_OK, "register +CPIN: R");
+    CHECK(uart_at_register_urc_handler(&s_test_modem, "+CGEV:", consume, "c") == ESP_OK, "register +CGEV:");
+    CHECK(uart_at_register_urc_handler(&s_test_modem, "", record, "x") == ESP_ERR_INVALID_ARG, "empty prefix");
+
+    memset(s_calls, 0, sizeof(s_calls));
+    dispatch(ctx, "+CPIN: READY");
+    CHECK(strcmp(s_calls, "abs") == 0, "call order [%s], want [abs]", s_calls);
+    memset(s_calls, 0, sizeof(s_calls));
+    dispatch(ctx, "+CPIN: SIM PIN");
+    CHECK(strcmp(s_calls, "as") == 0, "call order [%s], want [as]", s_calls);
+    memset(s_calls, 0, sizeof(s_calls));
+    dispatch(ctx, "OK");
+    CHECK(s_calls[0] == '\0', "[%s] ran for OK", s_calls);
+
+    // 执行中的命令: 被消费的+CGEV不归入响应,+CSQ同时进入响应和状态缓存
+    static const exchange_t script[] = {
+        {"AT+CSQ", "\r\n+CGEV: ME PDN ACT 1\r\n+CSQ: 20,0\r\n\r\nOK\r\n"},
+    };
+    modem_start(ctx, script, ARRAY_LEN(script));
+    char response[128];
+    memset(s_calls, 0, sizeof(s_calls));
+    CHECK(at_send_command(ctx, "AT+CSQ", response, sizeof(response), pdMS_TO_TICKS(AT_COMMAND_TIMEOUT_MS)) == ESP_OK,
+          "AT+CSQ failed");
+    CHECK(strcmp(response, "\r\n+CSQ: 20,0\r\n\r\nOK\r\n") == 0, "response [%s]", response);
+    CHECK(strcmp(s_calls, "css") == 0, "calls [%s], want [css]", s_calls);
+    modem_status_t status;
+    modem_status_get(&ctx->status, &status);
+    CHECK(status.rssi_dbm == -73 && status.ber == 0, "rssi %d ber %u", status.rssi_dbm, status.ber);
+    modem_done();
+    atomic_store(&s_test_modem.backend, NULL);
+    test_at_free(ctx);
+}
+
+static modem_status_t parse(modem_status_cache_t *cache, const char *line) {
+    bool consumed = false;
+    bool matched = false;
+    for (size_t i = 0; i < AT_URC_STATUS_COUNT; i++) {
+        const at_urc_handler_t *h = &s_status_urc_handlers[i];
+        if (strncmp(line, h->prefix, h->prefix_len) == 0) {
+            matched = true;
+            consumed |= h->handler(line, (int)strlen(line), cache);
+        }
+    }
+    CHECK(matched && !consumed, "%s: matched %d, consumed %d", line, matched, consumed);
+    modem_status_t status;
+    modem_status_get(cache, &status);
+    return status;
+}
+
+static void test_parsers(void) {
+    modem_status_cache_t cache;
+    modem_status_init(&cache);
+    modem_status_t st = parse(&cache, "+CSQ: 99,99");
+    CHECK(st.rssi_dbm == MODEM_RSSI_UNKNOWN && st.ber == 99, "CSQ 99: rssi %d ber %u", st.rssi_dbm, st.ber);
+    st = parse(&cache, "+CSQ: 31,7");
+    CHECK(st.rssi_dbm == -51 && st.ber == 7, "CSQ 31: rssi %d ber %u", st.rssi_dbm, st.ber);
+
+    // 主动上报: <stat>,<lac>,<ci>,<AcT>
+    st = parse(&cache, "+CEREG: 1,\"1A2B\",\"0C0D0E0F\",7");
+    CHECK(st.cereg_stat == 1 && st.lac == 0x1A2B && st.cell_id == 0x0C0D0E0F && st.access_tech == 7,
+          "CEREG URC: stat %u lac %x ci %lx act %u", st.cereg_stat, st.lac, (unsigned long)st.cell_id,
+          st.access_tech);
+    CHECK(modem_status_is_registered(&st), "home LTE not registered");
+    // 查询响应多一个<n>
+    st = parse(&cache, "+CREG: 2,5,\"00AB\",\"0001\"");
+    CHECK(st.creg_stat == 5 && st.lac == 0xAB && st.cell_id == 1, "CREG query: stat %u lac %x ci %lx",
+          st.creg_stat, st.lac, (unsigned long)st.cell_id);
+    st = parse(&cache, "+CGREG: 0,2");
+    CHECK(st.cgreg_stat == 2, "CGREG query: stat %u", st.cgreg_stat);
+    st = parse(&cache, "+CEREG: 3");
+    CHECK(st.cereg_stat == 3 && st.lac == 0xAB, "CEREG URC without location: stat %u lac %x", st.cereg_stat,
+          st.lac);
+
+    st = parse(&cache, "+CPIN: SIM PIN");
+    CHECK(st.sim == MODEM_SIM_PIN_REQUIRED, "SIM PIN: %d", st.sim);
+    st = parse(&cache, "+CPIN: NOT INSERTED");
+    CHECK(st.sim == MODEM_SIM_NOT_INSERTED, "NOT INSERTED: %d", st.sim);
+    st = parse(&cache, "^MODE: 17,17");
+    CHECK(st.sys_mode == 17 && st.sys_submode == 17, "MODE %u,%u", st.sys_mode, st.sys_submode);
+
+    st = parse(&cache, "+CPMS: \"ME\",3,50,\"ME\",3,50,\"ME\",3,50");
+    CHECK(st.sms_used == 3 && st.sms_total == 50, "CPMS query: %u/%u", st.sms_used, st.sms_total);
+    st = parse(&cache, "+CPMS: 4,50,4,50,4,50");
+    CHECK(st.sms_used == 4 && st.sms_total == 50, "CPMS set: %u/%u", st.sms_used, st.sms_total);
+
+    // RTC默认值不是网络时间
+    st = parse(&cache, "+CCLK: \"70/01/01,00:00:12+00\"");
+    CHECK(st.network_time == 0, "RTC default taken as network time");
+    st = parse(&cache, "+CTZV: +32");
+    CHECK(st.network_time == 0 && st.tz_quarter_hours == 32, "CTZV: tz %d", st.tz_quarter_hours);
+    st = parse(&cache, "+NITZ: 24/05/01,12:00:00+32,0");
+    CHECK(st.network_time == 1714536000 && st.tz_quarter_hours == 32, "NITZ: utc %lld tz %d",
+          (long long)st.network_time, st.tz_quarter_hours);
+}
+
+static modem_status_cache_t s_shared;
+static atomic_bool s_writer_done;
+
+static void *snapshot_writer(void *arg) {
+    (void)arg;
+    char line[48];
+    for (uint32_t k = 1; k <= SNAPSHOT_WRITES; k++) {
+        // LAC取小区ID的低16位,读取方据此发现新旧混杂的快照
+        snprintf(line, sizeof(line), "+CEREG: 1,\"%04lX\",\"%08lX\",7", (unsigned long)(k & 0xFFFF),
+                 (unsigned long)k);
+        modem_status_on_reg(line, (int)strlen(line), &s_shared);
+    }
+    atomic_store(&s_writer_done, true);
+    return NULL;
+}
+
+static void test_snapshot(void) {
+    modem_status_init(&s_shared);
+    atomic_store(&s_writer_done, false);
+    pthread_t writer;
+    pthread_create(&writer, NULL, snapshot_writer, NULL);
+
+    unsigned long reads = 0, torn = 0;
+    uint32_t last = 0;
+    bool monotonic = true;
+    while (!atomic_load(&s_writer_done)) {
+        modem_status_t st;
+        modem_status_get(&s_shared, &st);
+        reads++;
+        if (st.cell_id != 0 && (st.cell_id & 0xFFFF) != st.lac) {
+            torn++;
+        }
+        monotonic &= st.cell_id >= last;
+        last = st.cell_id;
+    }
+    pthread_join(writer, NULL);
+    modem_status_t st;
+    modem_status_get(&s_shared, &st);
+    CHECK(torn == 0, "%lu torn snapshots in %lu reads", torn, reads);
+    CHECK(monotonic, "a read went back to an older snapshot");
+    CHECK(st.cell_id == SNAPSHOT_WRITES, "last write %lu", (unsigned long)st.cell_id);
+}
+
+int main(void) {
+    esp_log_level_set("*", ESP_LOG_NONE);
+    test_buckets();
+    test_order();
+    test_parsers();
+    test_snapshot();
+    printf("at_urc: %d failures\n", s_failures);
+    return s_failures != 0;
+}
@@ -0,0 +1,226 @@
+/*
+ * dtu_line_parser测试: 同一段串口数据按每种块大小切开喂入,结果都应与整行喂入相同。
+ *
+ * - 短信行的号码和UTF-8内容;一次喂入多行时每次只消费到行尾
+ * - 内容超出sms->content时截断,不留半个UTF-8字符
+ * - 非法hex、奇数长度、无内容的短信行为INVALID;没有内容字段、号码为空的为普通行
+ * - 普通行只保留前127个字符;只以'\n'结尾的行
+ * - 断流后丢弃到下一个'\n',之后照常解析
+ * - 没有解码目标(缓冲池空)时短信行报告为NO_BUFFER,其他行照常
+ *
+ * 用法: test_dtu_line_parser (失败时返回非0)
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "dtu_line_parser.h"
+
+static int s_failures;
+
+#define CHECK(cond, ...)                                \
+    do {                                                \
+        if (!(cond)) {                                  \
+            printf("FAIL %s:%d: ", __func__, __LINE__); \
+            printf(__VA_ARGS__);                        \
+            printf("\n");                               \
+            s_failures++;                               \
+        }                                               \
+    } while (0)
+
+#define MAX_LINES 8
+
+typedef struct {
+    int count;
+    dtu_line_type_t type[MAX_LINES];
+    char text[MAX_LINES][DTU_LINE_PARSER_TEXT_SIZE];
+    sms_message_t sms[MAX_LINES]; // 每个DTU_LINE_SMS的结果
+} lines_t;
+
+static const char *type_name(dtu_line_type_t type) {
+    static const char *names[] = {"NONE", "TEXT", "SMS", "SMS_INVALID", "SMS_NO_BUFFER"};
+    return names[type];
+}
+
+// 按chunk字节一块喂入,记录每个结束的行
+static void feed(dtu_line_parser_t *p, const char *data, size_t len, size_t chunk, lines_t *out) {
+    for (size_t off = 0; off < len; off += chunk) {
+        size_t n = len - off < chunk ? len - off : chunk;
+        size_t pos = 0;
+        while (pos < n) {
+            dtu_line_type_t type;
+            pos += dtu_line_parser_feed(p, (const uint8_t *)data + off + pos, n - pos, &type);
+            if (type == DTU_LINE_NONE || out->count == MAX_LINES) {
+                continue;
+            }
+            out->type[out->count] = type;
+            snprintf(out->text[out->count], sizeof(out->text[0]), "%s", p->text);
+            if (type == DTU_LINE_SMS) {
+                out->sms[out->count] = *p->sms;
+            }
+            out->count++;
+        }
+    }
+}
+
+static sms_message_t s_target;
+
+// 每种块大小下的结果都与整行喂入相同,返回整行喂入的结果
+static void parse_all_chunks(const char *data, size_t len, lines_t *want) {
+    static dtu_line_parser_t p;
+    static lines_t got;
+    memset(want, 0, sizeof(*want));
+    dtu_line_parser_init(&p, &s_target);
+    feed(&p, data, len, len, want);
+
+    for (size_t chunk = 1; chunk < len; chunk++) {
+        memset(&got, 0, sizeof(got));
+        dtu_line_parser_init(&p, &s_target);
+        feed(&p, data, len, chunk, &got);
+        bool same = got.count == want->count;
+        for (int i = 0; same && i < got.count; i++) {
+            same = got.type[i] == want->type[i] && strcmp(got.text[i], want->text[i]) == 0 &&
+                   (got.type[i] != DTU_LINE_SMS || (strcmp(got.sms[i].sender, want->sms[i].sender) == 0 &&
+                                                    strcmp(got.sms[i].content, want->sms[i].content) == 0));
+        }
+        if (!same) {
+            CHECK(false, "chunk %zu differs from the whole input (%d lines vs %d)", chunk, got.count, want->count);
+            return;
+        }
+    }
+}
+
+static size_t put_sms(char *out, const char *sender, const char *content, const char *eol) {
+    size_t n = (size_t)sprintf(out, "config,sms,ok,%s,", sender);
+    for (const char *c = content; *c; c++) {
+        n += (size_t)sprintf(out + n, "%02X", (unsigned char)*c);
+    }
+    return n + (size_t)sprintf(out + n, "%s", eol);
+}
+
+static void test_lines(void) {
+    static char data[512];
+    size_t len = 0;
+    len += put_sms(data + len, "+8613800138000", "你好, DTU", "\r\n");
+    len += (size_t)sprintf(data + len, "config,sms,ok,1\r\n");
+    len += put_sms(data + len, "10086", "balance 12.34", "\n");
+    len += (size_t)sprintf(data + len, "config,sms,ok,10086,E79FG\r\n");
+    len += (size_t)sprintf(data + len, "config,sms,ok,10086,E79\r\n");
+    len += (size_t)sprintf(data + len, "config,sms,ok,10086,\r\n");
+    len += (size_t)sprintf(data + len, "config,sms,ok,,E79FAD\r\n");
+    len += (size_t)sprintf(data + len, "config,sms,ok,10086,E7\rAD\r\n");
+
+    lines_t want;
+    parse_all_chunks(data, len, &want);
+    static const dtu_line_type_t types[] = {
+        DTU_LINE_SMS, DTU_LINE_TEXT, DTU_LINE_SMS, DTU_LINE_SMS_INVALID,
+        DTU_LINE_SMS_INVALID, DTU_LINE_SMS_INVALID, DTU_LINE_TEXT, DTU_LINE_SMS_INVALID,
+    };
+    CHECK(want.count == MAX_LINES, "%d lines", want.count);
+    for (int i = 0; i < want.count && i < MAX_LINES; i++) {
+        CHECK(want.type[i] == types[i], "line %d: %s, want %s [%s]", i, type_name(want.type[i]),
+              type_name(types[i]), want.text[i]);
+    }
+    CHECK(strcmp(want.sms[0].sender, "+8613800138000") == 0 && strcmp(want.sms[0].content, "你好, DTU") == 0,
+          "line 0: [%s] from %s", want.sms[0].content, want.sms[0].sender);
+    CHECK(strcmp(want.text[1], "config,sms,ok,1") == 0, "line 1: [%s]", want.text[1]);
+    CHECK(strcmp(want.sms[2].sender, "10086") == 0 && strcmp(want.sms[2].content, "balance 12.34") == 0,
+          "line 2: [%s] from %s", want.sms[2].content, want.sms[2].sender);
+}
+
+static void test_truncation(void) {
+    static char content[sizeof(s_target.content) + 64];
+    static char data[2 * sizeof(content) + 512];
+    dtu_line_parser_t p;
+
+    // "AB"之后全是3字节的汉字: 内容写满时切在最后一个汉字中间
+    size_t n = 2;
+    memcpy(content, "AB", 2);
+    while (n + 3 < sizeof(content)) {
+        memcpy(content + n, "短", 3);
+        n += 3;
+    }
+    content[n] = '\0';
+    size_t len = put_sms(data, "+8613800138000", content, "\r\n");
+    len += (size_t)sprintf(data + len, "config,version,ok,");
+    for (int i = 0; i < 200; i++) {
+        data[len++] = (char)('a' + i % 26);
+    }
+    len += (size_t)sprintf(data + len, "\r\nOK\r\n");
+
+    lines_t want;
+    parse_all_chunks(data, len, &want);
+    size_t kept = strlen(want.sms[0].content);
+    CHECK(want.count == 3 && want.type[0] == DTU_LINE_SMS, "%d lines, first %s", want.count,
+          type_name(want.type[0]));
+    CHECK(kept == 2 + 3 * ((sizeof(s_target.content) - 1 - 2) / 3) &&
+          memcmp(want.sms[0].content, content, kept) == 0, "kept %zu content bytes", kept);
+    CHECK(want.type[1] == DTU_LINE_TEXT && strlen(want.text[1]) == DTU_LINE_PARSER_TEXT_SIZE - 1 &&
+          strncmp(want.text[1], "config,version,ok,abc", 21) == 0, "long text line [%s]", want.text[1]);
+    CHECK(want.type[2] == DTU_LINE_TEXT && strcmp(want.text[2], "OK") == 0, "line after the long line [%s]",
+          want.text[2]);
+
+    dtu_line_parser_init(&p, &s_target);
+    memset(&want, 0, sizeof(want));
+    feed(&p, data, len, 64, &want);
+    CHECK(p.truncated_lines == 2, "truncated_lines %lu", (unsigned long)p.truncated_lines);
+    CHECK(dtu_line_parser_starts_with(&p, "OK") && !dtu_line_parser_starts_with(&p, "OK+"), "starts_with");
+}
+
+static void test_gap(void) {
+    static char data[256];
+    size_t first = put_sms(data, "+8613800138000", "first", "\r\n");
+    size_t half = first / 2;
+    size_t len = first + put_sms(data + first, "+8613800138001", "second", "\r\n");
+
+    // 前一行读到一半时断流: 其余部分丢弃,下一行照常
+    dtu_line_parser_t p;
+    lines_t got;
+    memset(&got, 0, sizeof(got));
+    dtu_line_parser_init(&p, &s_target);
+    feed(&p, data, half, half, &got);
+    dtu_line_parser_mark_gap(&p);
+    feed(&p, data + half, len - half, 7, &got);
+    CHECK(got.count == 1 && got.type[0] == DTU_LINE_SMS && strcmp(got.sms[0].content, "second") == 0,
+          "%d lines after the gap", got.count);
+    // 丢弃到'\n'为止,'\n'本身不计
+    CHECK(p.dropped_bytes == first - half - 1, "dropped %lu", (unsigned long)p.dropped_bytes);
+}
+
+static void test_no_buffer(void) {
+    static char data[256];
+    size_t len = put_sms(data, "+8613800138000", "no buffer", "\r\n");
+    len += (size_t)sprintf(data + len, "config,sms,ok,1\r\n");
+    len += (size_t)sprintf(data + len, "config,sms,ok,,E79FAD\r\n");
+    len += (size_t)sprintf(data + len, "OK\r\n");
+
+    // sms为NULL: 短信行的其余字节跳过,不写任何缓冲
+    static const dtu_line_type_t types[] = {
+        DTU_LINE_SMS_NO_BUFFER, DTU_LINE_TEXT, DTU_LINE_TEXT, DTU_LINE_TEXT,
+    };
+    for (size_t chunk = 1; chunk <= len; chunk++) {
+        dtu_line_parser_t p;
+        lines_t got;
+        memset(&got, 0, sizeof(got));
+        dtu_line_parser_init(&p, NULL);
+        feed(&p, data, len, chunk, &got);
+        bool same = got.count == 4;
+        for (int i = 0; same && i < got.count; i++) {
+            same = got.type[i] == types[i];
+        }
+        if (!same) {
+            CHECK(false, "chunk %zu: %d lines, first %s", chunk, got.count, type_name(got.type[0]));
+            return;
+        }
+        CHECK(strcmp(got.text[1], "config,sms,ok,1") == 0 && strcmp(got.text[3], "OK") == 0,
+              "chunk %zu: [%s] [%s]", chunk, got.text[1], got.text[3]);
+    }
+}
+
+int main(void) {
+    test_lines();
+    test_truncation();
+    test_gap();
+    test_no_buffer();
+    printf("dtu_line_parser: %d failures\n", s_failures);
+    return s_failures != 0;
+}
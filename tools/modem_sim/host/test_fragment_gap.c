@@ -0,0 +1,147 @@
+/*
+ * fragment_gap测试: 直接编译fragment_gap.c,按给定的间隔序列检查学到的分段超时。
+ *
+ * - 样本不足8个时为上限30 s;约1 s的间隔得到下限3 s
+ * - 100个样本中2个5 s的离群值把超时抬到9 s,之后的正常间隔经衰减使其回落
+ * - 桶边界、超过上限的间隔不突破上限、迟到分段的计数
+ * - 运营商不变时保留直方图,变化时清空
+ *
+ * 用法: test_fragment_gap (失败时返回非0)
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "fragment_gap.c"
+
+static int s_failures;
+
+// 替代port_freertos.c的时钟: 只有port_log.c的时间戳用到
+int64_t esp_timer_get_time(void) {
+    return 0;
+}
+
+#define CHECK(cond, ...)                                \
+    do {                                                \
+        if (!(cond)) {                                  \
+            printf("FAIL %s:%d: ", __func__, __LINE__); \
+            printf(__VA_ARGS__);                        \
+            printf("\n");                               \
+            s_failures++;                               \
+        }                                               \
+    } while (0)
+
+static void record_n(fragment_gap_t *gap, int n, uint32_t gap_ms) {
+    for (int i = 0; i < n; i++) {
+        fragment_gap_record(gap, gap_ms);
+    }
+}
+
+static void test_buckets(void) {
+    static const struct {
+        uint32_t gap_ms;
+        uint32_t bucket;
+    } cases[] = {
+        {0, 0}, {200, 0}, {201, 1}, {1000, 2}, {1001, 3}, {5000, 7}, {30000, 12}, {30001, 13}, {UINT32_MAX, 13},
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        CHECK(gap_bucket(cases[i].gap_ms) == cases[i].bucket, "%lu ms in bucket %lu, want %lu",
+              (unsigned long)cases[i].gap_ms, (unsigned long)gap_bucket(cases[i].gap_ms),
+              (unsigned long)cases[i].bucket);
+    }
+}
+
+static void test_learn(void) {
+    fragment_gap_t gap;
+    fragment_gap_init(&gap);
+    CHECK(fragment_gap_timeout_ms(&gap) == FRAGMENT_GAP_TIMEOUT_MAX_MS, "initial %lu",
+          (unsigned long)fragment_gap_timeout_ms(&gap));
+
+    record_n(&gap, GAP_MIN_SAMPLES - 1, 1000);
+    CHECK(fragment_gap_timeout_ms(&gap) == FRAGMENT_GAP_TIMEOUT_MAX_MS, "%lu with %d samples",
+          (unsigned long)fragment_gap_timeout_ms(&gap), GAP_MIN_SAMPLES - 1);
+    record_n(&gap, 1, 1000);
+    CHECK(fragment_gap_timeout_ms(&gap) == FRAGMENT_GAP_TIMEOUT_MIN_MS, "%lu for 1 s gaps",
+          (unsigned long)fragment_gap_timeout_ms(&gap));
+
+    // 100个样本中2个离群值: 第99百分位落在6 s桶,放宽50%
+    fragment_gap_init(&gap);
+    record_n(&gap, 49, 1000);
+    record_n(&gap, 1, 5000);
+    record_n(&gap, 49, 1000);
+    record_n(&gap, 1, 5000);
+    CHECK(fragment_gap_timeout_ms(&gap) == 9000, "%lu with 2%% outliers",
+          (unsigned long)fragment_gap_timeout_ms(&gap));
+    // 1%的离群值不影响
+    fragment_gap_t one;
+    fragment_gap_init(&one);
+    record_n(&one, 99, 1000);
+    record_n(&one, 1, 5000);
+    CHECK(fragment_gap_timeout_ms(&one) == FRAGMENT_GAP_TIMEOUT_MIN_MS, "%lu with 1%% outliers",
+          (unsigned long)fragment_gap_timeout_ms(&one));
+
+    // 此后只有正常间隔: 计数减半后离群值很快不足1%
+    int n = 0;
+    while (fragment_gap_timeout_ms(&gap) != FRAGMENT_GAP_TIMEOUT_MIN_MS && n < 4 * GAP_DECAY_SAMPLES) {
+        fragment_gap_record(&gap, 1000);
+        n++;
+    }
+    CHECK(fragment_gap_timeout_ms(&gap) == FRAGMENT_GAP_TIMEOUT_MIN_MS && n > GAP_DECAY_SAMPLES - 100 &&
+          n <= 2 * GAP_DECAY_SAMPLES, "back to %lu after %d samples",
+          (unsigned long)fragment_gap_timeout_ms(&gap), n);
+
+    fragment_gap_stats_t stats;
+    fragment_gap_get_stats(&gap, &stats);
+    CHECK(stats.samples == 100 + (uint32_t)n, "samples %lu", (unsigned long)stats.samples);
+    CHECK(stats.counts[7] == 1, "6 s bucket %lu after one halving", (unsigned long)stats.counts[7]);
+
+    // 超过上限的间隔
+    fragment_gap_init(&gap);
+    record_n(&gap, GAP_MIN_SAMPLES, 45000);
+    CHECK(fragment_gap_timeout_ms(&gap) == FRAGMENT_GAP_TIMEOUT_MAX_MS, "%lu for 45 s gaps",
+          (unsigned long)fragment_gap_timeout_ms(&gap));
+    fragment_gap_init(&gap);
+    record_n(&gap, GAP_MIN_SAMPLES, 24000);
+    CHECK(fragment_gap_timeout_ms(&gap) == FRAGMENT_GAP_TIMEOUT_MAX_MS, "%lu for 24 s gaps",
+          (unsigned long)fragment_gap_timeout_ms(&gap));
+}
+
+static void test_late_and_context(void) {
+    fragment_gap_t gap;
+    fragment_gap_init(&gap);
+    fragment_gap_set_context(&gap, "CHINA MOBILE");
+    record_n(&gap, 10, 1000);
+    fragment_gap_record_late(&gap, 5000);
+
+    fragment_gap_stats_t stats;
+    fragment_gap_get_stats(&gap, &stats);
+    CHECK(stats.late_fragments == 1 && stats.samples == 11 && stats.counts[7] == 1,
+          "late %lu, samples %lu, 6 s %lu", (unsigned long)stats.late_fragments, (unsigned long)stats.samples,
+          (unsigned long)stats.counts[7]);
+    CHECK(stats.timeout_ms == 9000, "timeout %lu after a late part", (unsigned long)stats.timeout_ms);
+
+    // 同一运营商: 保留
+    fragment_gap_set_context(&gap, "CHINA MOBILE");
+    fragment_gap_get_stats(&gap, &stats);
+    CHECK(stats.counts[2] == 10 && stats.timeout_ms == 9000, "histogram reset for the same operator");
+
+    // 换了运营商: 清空直方图,累计计数保留
+    fragment_gap_set_context(&gap, "CHN-UNICOM");
+    fragment_gap_get_stats(&gap, &stats);
+    uint32_t total = 0;
+    for (int i = 0; i < FRAGMENT_GAP_BUCKETS; i++) {
+        total += stats.counts[i];
+    }
+    CHECK(total == 0 && stats.timeout_ms == FRAGMENT_GAP_TIMEOUT_MAX_MS,
+          "%lu gaps, timeout %lu after the change", (unsigned long)total, (unsigned long)stats.timeout_ms);
+    CHECK(stats.samples == 11 && stats.late_fragments == 1, "samples %lu, late %lu",
+          (unsigned long)stats.samples, (unsigned long)stats.late_fragments);
+}
+
+int main(void) {
+    esp_log_level_set("*", ESP_LOG_NONE);
+    test_buckets();
+    test_learn();
+    test_late_and_context();
+    printf("fragment_gap: %d failures\n", s_failures);
+    return s_failures != 0;
+}
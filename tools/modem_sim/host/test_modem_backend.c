@@ -0,0 +1,218 @@
+/*
+ * 多模组测试: 直接编译modem_backend.c,不启动任务,手工建立两个模组实例。
+ *
+ * - 各模组的NVS命名空间: 模组0沿用原名,其余加序号;放不下时报错
+ * - 上次识别的后端按模组分别保存
+ * - 交给队列时标记模组序号,入队、重复、丢弃按模组计数;两张SIM卡收到的同一条短信各投递一次
+ * - 指标: 模组0的平铺字段和每个模组一项的"modems"数组,缓冲不足时不越界
+ *
+ * 用法: test_modem_backend (失败时返回非0)
+ */
+#include "modem_backend.c"
+
+#include <stdlib.h>
+
+static int s_failures;
+
+#define CHECK(cond, ...)                                \
+    do {                                                \
+        if (!(cond)) {                                  \
+            printf("FAIL %s:%d: ", __func__, __LINE__); \
+            printf(__VA_ARGS__);                        \
+            printf("\n");                               \
+            s_failures++;                               \
+        }                                               \
+    } while (0)
+
+// sim_host.c提供的MQTT出口,测试中不发布
+esp_err_t mqtt_manager_publish_device_ready(const modem_instance_t *modem) {
+    (void)modem;
+    return ESP_OK;
+}
+
+esp_err_t mqtt_manager_publish(const char *topic, const char *payload, int len, int qos) {
+    (void)topic;
+    (void)payload;
+    (void)len;
+    (void)qos;
+    return ESP_OK;
+}
+
+static int fake_format_metrics(const modem_instance_t *modem, char *buf, size_t size) {
+    return snprintf(buf, size, ",\"fake_modem\":%u", modem->index);
+}
+
+static const modem_backend_t s_fake_backend = {
+    .name = "FAKE",
+    .task_name = "fake_task",
+    .format_metrics = fake_format_metrics,
+};
+
+// 按modem_backend_start的方式编号,但不探测也不启动任务
+static void setup_modems(size_t count) {
+    memset(s_modems, 0, sizeof(s_modems));
+    for (size_t i = 0; i < count; i++) {
+        s_modems[i].index = (uint8_t)i;
+        s_modems[i].phone_number = "";
+        snprintf(s_modems[i].operator_name, sizeof(s_modems[i].operator_name), "op%u", (unsigned)i);
+        atomic_store(&s_modems[i].backend, &s_fake_backend);
+    }
+    s_modem_count = count;
+}
+
+static void test_nvs_names(void) {
+    setup_modems(2);
+    char name[MODEM_NVS_NAME_SIZE];
+    CHECK(modem_backend_nvs_name(&s_modems[0], "modem_cfg", name, sizeof(name)) == ESP_OK &&
+          strcmp(name, "modem_cfg") == 0, "modem 0: %s", name);
+    CHECK(modem_backend_nvs_name(&s_modems[1], "modem_cfg", name, sizeof(name)) == ESP_OK &&
+          strcmp(name, "modem_cfg1") == 0, "modem 1: %s", name);
+    // 实际用到的命名空间加一位序号仍放得下
+    CHECK(modem_backend_nvs_name(&s_modems[1], BACKEND_NVS_NAMESPACE, name, sizeof(name)) == ESP_OK &&
+          strcmp(name, "modem_backend1") == 0, "modem 1: %s", name);
+    // 15个字符: 模组0可用,模组1放不下
+    CHECK(modem_backend_nvs_name(&s_modems[0], "abcdefghijklmno", name, sizeof(name)) == ESP_OK,
+          "15 characters for modem 0");
+    CHECK(modem_backend_nvs_name(&s_modems[1], "abcdefghijklmno", name, sizeof(name)) == ESP_ERR_INVALID_SIZE,
+          "16 characters for modem 1");
+
+    // 上次识别的后端各自保存
+    save_last_backend(&s_modems[1], 1);
+    CHECK(load_last_backend(&s_modems[0]) == 0 && load_last_backend(&s_modems[1]) == 1,
+          "last backend %lu/%lu", (unsigned long)load_last_backend(&s_modems[0]),
+          (unsigned long)load_last_backend(&s_modems[1]));
+    save_last_backend(&s_modems[0], 1);
+    save_last_backend(&s_modems[1], 0);
+    CHECK(load_last_backend(&s_modems[0]) == 1 && load_last_backend(&s_modems[1]) == 0,
+          "last backend %lu/%lu after swapping", (unsigned long)load_last_backend(&s_modems[0]),
+          (unsigned long)load_last_backend(&s_modems[1]));
+
+    CHECK(modem_backend_count() == 2 && modem_backend_instance(1) == &s_modems[1] &&
+          modem_backend_instance(2) == NULL && modem_backend_get(2) == NULL, "instance lookup");
+}
+
+static sms_message_t *new_sms(const char *sender, const char *content) {
+    sms_message_t *sms = calloc(1, sizeof(*sms));
+    snprintf(sms->sender, sizeof(sms->sender), "%s", sender);
+    snprintf(sms->content, sizeof(sms->content), "%s", content);
+    sms->modem = 0xFF;
+    return sms;
+}
+
+// 交给队列;未入队时释放
+static modem_sms_handoff_t hand_off(size_t modem, QueueHandle_t queue, const char *content) {
+    sms_message_t *sms = new_sms("+8613500000001", content);
+    modem_sms_handoff_t result = modem_backend_hand_off(&s_modems[modem], queue, &sms, 0);
+    CHECK((result == MODEM_SMS_QUEUED) == (sms == NULL), "ownership after %d", result);
+    free(sms);
+    return result;
+}
+
+// 返回队首短信的模组序号,队列空时返回-1
+static int receive(QueueHandle_t queue) {
+    sms_message_t *sms = NULL;
+    int modem = -1;
+    if (xQueueReceive(queue, &sms, 0) == pdPASS) {
+        modem = sms->modem;
+        free(sms);
+    }
+    return modem;
+}
+
+static void test_hand_off(void) {
+    setup_modems(2);
+    QueueHandle_t queue = xQueueCreate(2, sizeof(sms_message_t *));
+
+    // 同一条短信先后到达两张SIM卡: 各投递一次,带各自的序号
+    CHECK(hand_off(0, queue, "backend: same text") == MODEM_SMS_QUEUED, "modem 0");
+    CHECK(hand_off(1, queue, "backend: same text") == MODEM_SMS_QUEUED, "same text on modem 1");
+    CHECK(receive(queue) == 0 && receive(queue) == 1, "modem tags");
+
+    // 同一模组重读: 重复
+    CHECK(hand_off(1, queue, "backend: same text") == MODEM_SMS_DUPLICATE, "repeat on modem 1");
+    CHECK(hand_off(0, queue, "backend: same text") == MODEM_SMS_DUPLICATE, "repeat on modem 0");
+
+    // 队列满: 丢弃计入收到它的模组,未记入去重表,之后重读仍会投递
+    CHECK(hand_off(1, queue, "backend: fill 1") == MODEM_SMS_QUEUED, "fill 1");
+    CHECK(hand_off(1, queue, "backend: fill 2") == MODEM_SMS_QUEUED, "fill 2");
+    CHECK(hand_off(1, queue, "backend: full") == MODEM_SMS_DROPPED, "queue full");
+    CHECK(receive(queue) == 1, "drain");
+    CHECK(hand_off(1, queue, "backend: full") == MODEM_SMS_QUEUED, "retry after a drop");
+    modem_backend_count_dropped(&s_modems[1]);
+    modem_backend_count_rx(&s_modems[0], 100);
+    modem_backend_count_rx(&s_modems[0], 50);
+    modem_backend_count_rx(&s_modems[1], 7);
+
+    modem_backend_stats_t st0, st1;
+    modem_backend_get_stats(0, &st0);
+    modem_backend_get_stats(1, &st1);
+    CHECK(st0.sms_queued == 1 && st0.sms_duplicates == 1 && st0.sms_dropped == 0,
+          "modem 0: queued %lu, duplicates %lu, dropped %lu", (unsigned long)st0.sms_queued,
+          (unsigned long)st0.sms_duplicates, (unsigned long)st0.sms_dropped);
+    CHECK(st1.sms_queued == 4 && st1.sms_duplicates == 1 && st1.sms_dropped == 2,
+          "modem 1: queued %lu, duplicates %lu, dropped %lu", (unsigned long)st1.sms_queued,
+          (unsigned long)st1.sms_duplicates, (unsigned long)st1.sms_dropped);
+    CHECK(st1.sms_peak_per_s == 4, "modem 1 peak %lu", (unsigned long)st1.sms_peak_per_s);
+    CHECK(st0.rx_bytes == 150 && st0.rx_peak_bytes_per_s == 150 && st1.rx_bytes == 7,
+          "rx %lu (peak %lu) / %lu", (unsigned long)st0.rx_bytes, (unsigned long)st0.rx_peak_bytes_per_s,
+          (unsigned long)st1.rx_bytes);
+    CHECK(st0.backend == s_fake_backend.name, "backend name");
+
+    modem_backend_stats_t none;
+    modem_backend_get_stats(2, &none);
+    CHECK(none.backend == NULL && none.sms_queued == 0, "stats of a modem that was not started");
+
+    while (receive(queue) >= 0) {
+    }
+    vQueueDelete(queue);
+}
+
+static void test_metrics(void) {
+    setup_modems(2);
+    atomic_store(&s_modems[0].sms_queued, 3);
+    atomic_store(&s_modems[1].sms_dropped, 2);
+    atomic_store(&s_modems[1].backend, NULL); // 模组1还在探测
+
+    static char buf[2 * MODEM_METRICS_ENTRY_MAX + 256];
+    int len = modem_backend_format_metrics(buf, sizeof(buf));
+    static const char want[] =
+        ",\"modem_backend\":\"FAKE\",\"modem_probe_ms\":0,\"modem_probe_rounds\":0,\"modem_probe_detected\":0"
+        ",\"fake_modem\":0"
+        ",\"modems\":[{\"modem\":0,\"backend\":\"FAKE\",\"operator\":\"op0\",\"sms_queued\":3,"
+        "\"sms_duplicates\":0,\"sms_dropped\":0,\"sms_peak_per_s\":0,\"rx_bytes\":0,\"rx_peak_Bps\":0},"
+        "{\"modem\":1,\"backend\":\"\",\"operator\":\"op1\",\"sms_queued\":0,"
+        "\"sms_duplicates\":0,\"sms_dropped\":2,\"sms_peak_per_s\":0,\"rx_bytes\":0,\"rx_peak_Bps\":0}]";
+    CHECK(len == (int)strlen(want) && strcmp(buf, want) == 0, "metrics (%d bytes)\n%s", len, buf);
+
+    // 缓冲不足: 截断但以'\0'结尾,返回值不小于缓冲大小
+    for (size_t size = 1; size < strlen(want); size += 13) {
+        char *small = malloc(size);
+        len = modem_backend_format_metrics(small, size);
+        CHECK(len >= (int)size && strlen(small) == size - 1 && strncmp(small, want, size - 1) == 0,
+              "%d bytes into %zu", len, size);
+        free(small);
+    }
+
+    // 最长的一项不超过MODEM_METRICS_ENTRY_MAX
+    setup_modems(1);
+    memset(s_modems[0].operator_name, 'x', sizeof(s_modems[0].operator_name) - 1);
+    atomic_store(&s_modems[0].sms_queued, UINT32_MAX);
+    atomic_store(&s_modems[0].sms_duplicates, UINT32_MAX);
+    atomic_store(&s_modems[0].sms_dropped, UINT32_MAX);
+    atomic_store(&s_modems[0].sms_peak_per_s, UINT32_MAX);
+    atomic_store(&s_modems[0].rx_bytes, UINT32_MAX);
+    atomic_store(&s_modems[0].rx_peak_bytes_per_s, UINT32_MAX);
+    len = modem_backend_format_metrics(buf, sizeof(buf));
+    const char *entry = strstr(buf, ",\"modems\":[");
+    CHECK(entry != NULL && strlen(entry) <= MODEM_METRICS_ENTRY_MAX, "longest entry %zu bytes",
+          entry != NULL ? strlen(entry) : 0);
+}
+
+int main(void) {
+    esp_log_level_set("*", ESP_LOG_NONE);
+    test_nvs_names();
+    test_hand_off();
+    test_metrics();
+    printf("modem_backend: %d failures\n", s_failures);
+    return s_failures != 0;
+}
@@ -0,0 +1,357 @@
+/*
+ * sms_dedup测试: 直接编译sms_dedup.c,用可控的时钟驱动,对照一个简单的参考模型。
+ *
+ * - 随机的查询/记录/时间推进序列,每步后比较去重结果、存活条目和统计,并检查哈希表
+ *   不变式(每个条目从起始槽到所在槽之间没有空槽,s_used与非空槽数一致)
+ * - 后移删除跨越表尾回绕的探测链
+ * - 表满时整表清理过期条目,仍然满则淘汰最早过期的条目
+ * - NVS快照的版本和长度校验、停机时长扣减、剩余时间截断,以及写入后重新加载
+ *
+ * 用法: test_sms_dedup (失败时返回非0)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sms_dedup.c"
+
+static int s_failures;
+static int64_t s_now_us;
+
+// 替代port_freertos.c的时钟: 测试手动推进
+int64_t esp_timer_get_time(void) {
+    return s_now_us;
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return (TickType_t)(s_now_us / 1000);
+}
+
+static void advance_s(uint32_t seconds) {
+    s_now_us += (int64_t)seconds * 1000000;
+}
+
+#define CHECK(cond, ...)                        \
+    do {                                        \
+        if (!(cond)) {                          \
+            printf("FAIL %s:%d: ", __func__, __LINE__); \
+            printf(__VA_ARGS__);                \
+            printf("\n");                       \
+            s_failures++;                       \
+        }                                       \
+    } while (0)
+
+// 与sms_dedup_seen相同,但只看不刷新,用于比较表内容
+static bool table_has(uint32_t fp) {
+    uint32_t now = dedup_now_s();
+    for (uint32_t i = 0; i < DEDUP_SLOTS; i++) {
+        if (s_slots[i].fp == fp && !slot_expired(&s_slots[i], now)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 开放寻址不变式: 条目从起始槽线性探测可达,s_used为非空槽数,指纹不重复
+static bool table_consistent(void) {
+    uint32_t used = 0;
+    for (uint32_t j = 0; j < DEDUP_SLOTS; j++) {
+        if (s_slots[j].fp == 0) {
+            continue;
+        }
+        used++;
+        for (uint32_t i = s_slots[j].fp & DEDUP_MASK; i != j; i = (i + 1) & DEDUP_MASK) {
+            if (s_slots[i].fp == 0 || s_slots[i].fp == s_slots[j].fp) {
+                printf("slot %u (fp %08x) unreachable from its home\n", (unsigned)j, (unsigned)s_slots[j].fp);
+                return false;
+            }
+        }
+    }
+    if (used != s_used || used > DEDUP_ENTRIES) {
+        printf("s_used %u, %u slots occupied\n", (unsigned)s_used, (unsigned)used);
+        return false;
+    }
+    return true;
+}
+
+static void reset_table(void) {
+    memset(s_slots, 0, sizeof(s_slots));
+    s_used = 0;
+    atomic_store(&s_evictions, 0);
+    atomic_store(&s_expirations, 0);
+}
+
+// 起始槽为home的第n个指纹(高位区分)
+static uint32_t fp_at(uint32_t home, uint32_t n) {
+    return ((n + 1) << 16) | home;
+}
+
+static void test_remove_wraparound(void) {
+    reset_table();
+    uint32_t now = dedup_now_s();
+    const uint32_t last = DEDUP_MASK;
+    // a,b起始于last-1,c起始于last,d起始于0: b占last,c回绕到0,d被挤到1
+    uint32_t a = fp_at(last - 1, 0), b = fp_at(last - 1, 1), c = fp_at(last, 0), d = fp_at(0, 0);
+    uint32_t e = fp_at(2, 0); // 起始槽就是所在槽,不应移动
+    uint32_t fps[] = {a, b, c, d, e};
+    for (size_t i = 0; i < sizeof(fps) / sizeof(fps[0]); i++) {
+        dedup_insert(fps[i], now + 100, now);
+    }
+    CHECK(s_slots[last - 1].fp == a && s_slots[last].fp == b && s_slots[0].fp == c &&
+          s_slots[1].fp == d && s_slots[2].fp == e, "unexpected layout before removal");
+
+    slot_remove(last - 1);
+    CHECK(s_slots[last - 1].fp == b, "b not shifted back");
+    CHECK(s_slots[last].fp == c, "c not shifted back across the wrap");
+    CHECK(s_slots[0].fp == d, "d not shifted back to slot 0");
+    CHECK(s_slots[1].fp == 0, "slot 1 not emptied");
+    CHECK(s_slots[2].fp == e, "e moved although it is at its home slot");
+    CHECK(table_consistent(), "table inconsistent after wrap-around removal");
+
+    // 删除回绕后的中间条目: d起始于0,已在0,不应移到last
+    slot_remove(last);
+    CHECK(s_slots[last].fp == 0 && s_slots[0].fp == d, "d moved before its home slot");
+    CHECK(table_consistent(), "table inconsistent after second removal");
+
+    // 过期条目在查找途中被清理,之后的条目仍可找到
+    reset_table();
+    for (size_t i = 0; i < 4; i++) {
+        dedup_insert(fps[i], now + (i == 1 ? 1 : 100), now);
+    }
+    advance_s(2);
+    uint32_t empty;
+    CHECK(slot_find(d, dedup_now_s(), &empty) >= 0, "d lost after lazy expiry of b");
+    CHECK(slot_find(b, dedup_now_s(), &empty) < 0, "expired b still found");
+    CHECK(s_used == 3 && table_consistent(), "table inconsistent after lazy expiry");
+}
+
+static void test_make_room(void) {
+    reset_table();
+    uint32_t now = dedup_now_s();
+    // 全部挤在同一段探测链上,淘汰和清理都要经过前移
+    for (uint32_t n = 0; n < DEDUP_ENTRIES; n++) {
+        dedup_insert(fp_at((DEDUP_MASK - 3 + n % 8) & DEDUP_MASK, n), now + 100 + n, now);
+    }
+    CHECK(s_used == DEDUP_ENTRIES && table_consistent(), "table not full");
+
+    // 全部未过期: 淘汰最早过期的一条(n=0)
+    uint32_t extra = fp_at(5, 1000);
+    dedup_insert(extra, now + 1000, now);
+    CHECK(atomic_load(&s_evictions) == 1, "evictions %u", (unsigned)atomic_load(&s_evictions));
+    CHECK(!table_has(fp_at(DEDUP_MASK - 3, 0)), "oldest entry not evicted");
+    CHECK(table_has(fp_at((DEDUP_MASK - 2) & DEDUP_MASK, 1)) && table_has(extra), "wrong entry evicted");
+    CHECK(s_used == DEDUP_ENTRIES && table_consistent(), "table inconsistent after eviction");
+
+    // 一部分过期: 只清理过期条目,不淘汰
+    advance_s(100 + 10);
+    now = dedup_now_s();
+    dedup_insert(fp_at(7, 1001), now + 1000, now);
+    CHECK(atomic_load(&s_evictions) == 1, "evicted although expired entries were available");
+    CHECK(atomic_load(&s_expirations) == 10, "expirations %u", (unsigned)atomic_load(&s_expirations));
+    CHECK(table_has(extra) && table_has(fp_at(7, 1001)) && table_has(fp_at(DEDUP_MASK - 3 + 11 % 8, 11)) &&
+          !table_has(fp_at(DEDUP_MASK - 3 + 9 % 8, 9)), "wrong entries after expiry");
+    CHECK(table_consistent(), "table inconsistent after expiry");
+}
+
+// 参考模型: 存活条目的指纹和过期时刻,按sms_dedup.c的语义维护
+typedef struct {
+    uint32_t fp;
+    uint32_t expires_s;
+} model_entry_t;
+
+static model_entry_t s_model[DEDUP_ENTRIES];
+static uint32_t s_model_count;
+
+static void model_purge(uint32_t now) {
+    for (uint32_t i = 0; i < s_model_count;) {
+        if ((int32_t)(s_model[i].expires_s - now) <= 0) {
+            s_model[i] = s_model[--s_model_count];
+        } else {
+            i++;
+        }
+    }
+}
+
+static int model_find(uint32_t fp) {
+    for (uint32_t i = 0; i < s_model_count; i++) {
+        if (s_model[i].fp == fp) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+static bool model_seen(uint32_t fp, uint32_t now) {
+    model_purge(now);
+    int i = model_find(fp);
+    if (i >= 0) {
+        s_model[i].expires_s = now + DEDUP_WINDOW_S;
+    }
+    return i >= 0;
+}
+
+static void model_record(uint32_t fp, uint32_t now) {
+    model_purge(now);
+    int i = model_find(fp);
+    if (i < 0) {
+        if (s_model_count == DEDUP_ENTRIES) {
+            uint32_t oldest = 0;
+            for (uint32_t j = 1; j < s_model_count; j++) {
+                if ((int32_t)(s_model[j].expires_s - s_model[oldest].expires_s) < 0) {
+                    oldest = j;
+                }
+            }
+            s_model[oldest] = s_model[--s_model_count];
+        }
+        i = (int)s_model_count++;
+        s_model[i].fp = fp;
+    }
+    s_model[i].expires_s = now + DEDUP_WINDOW_S;
+}
+
+static bool model_matches_table(void) {
+    uint32_t now = dedup_now_s();
+    model_purge(now);
+    uint32_t live = 0;
+    for (uint32_t i = 0; i < DEDUP_SLOTS; i++) {
+        if (s_slots[i].fp == 0 || slot_expired(&s_slots[i], now)) {
+            continue;
+        }
+        live++;
+        int m = model_find(s_slots[i].fp);
+        if (m < 0 || s_model[m].expires_s != s_slots[i].expires_s) {
+            printf("table entry %08x not in the model\n", (unsigned)s_slots[i].fp);
+            return false;
+        }
+    }
+    if (live != s_model_count) {
+        printf("%u live entries, model has %u\n", (unsigned)live, (unsigned)s_model_count);
+        return false;
+    }
+    return true;
+}
+
+static void make_sms(sms_message_t *sms, uint32_t id) {
+    memset(sms, 0, sizeof(*sms));
+    snprintf(sms->sender, sizeof(sms->sender), "+861380000%04u", (unsigned)(id % 10000));
+    snprintf(sms->content, sizeof(sms->content), "message %u", (unsigned)id);
+    sms->modem = (uint8_t)(id % 2);
+}
+
+static void test_against_model(void) {
+    sms_dedup_init();
+    s_model_count = 0;
+    srand(1);
+    // 每步至少推进1秒: 过期时刻互不相同,淘汰对象唯一
+    for (int step = 0; step < 20000; step++) {
+        // 号码池大于条目上限,间隔分布让表时满时空
+        uint32_t id = (uint32_t)rand() % (DEDUP_ENTRIES * 2);
+        sms_message_t sms;
+        make_sms(&sms, id);
+        uint32_t fp;
+        bool seen = sms_dedup_seen(&sms, &fp);
+        uint32_t now = dedup_now_s();
+        if (seen != model_seen(fp, now)) {
+            CHECK(false, "step %d: seen=%d for message %u", step, seen, (unsigned)id);
+            return;
+        }
+        if (!seen) {
+            sms_dedup_record(fp);
+            model_record(fp, now);
+        }
+        if (!table_consistent() || !model_matches_table()) {
+            CHECK(false, "step %d: table differs from the model", step);
+            return;
+        }
+        advance_s(1 + (uint32_t)rand() % (step % 1000 < 500 ? 2 : 8));
+    }
+    sms_dedup_stats_t stats;
+    sms_dedup_get_stats(&stats);
+    CHECK(stats.evictions > 0 && stats.expirations > 0 && stats.hits > 0,
+          "sequence did not exercise evictions/expirations/hits (%u/%u/%u)",
+          (unsigned)stats.evictions, (unsigned)stats.expirations, (unsigned)stats.hits);
+}
+
+static void write_snapshot(uint16_t version, uint16_t count, uint32_t wall_time,
+                           const dedup_snapshot_entry_t *entries, size_t extra_bytes) {
+    uint8_t blob[sizeof(dedup_snapshot_header_t) + 8 * sizeof(dedup_snapshot_entry_t) + 8] = {0};
+    dedup_snapshot_header_t header = {.version = version, .count = count, .wall_time = wall_time};
+    memcpy(blob, &header, sizeof(header));
+    memcpy(blob + sizeof(header), entries, count * sizeof(*entries));
+    nvs_handle_t nvs_handle;
+    nvs_open(DEDUP_NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    nvs_set_blob(nvs_handle, DEDUP_NVS_KEY_SNAPSHOT, blob,
+                 sizeof(header) + count * sizeof(*entries) + extra_bytes);
+    nvs_commit(nvs_handle);
+    nvs_close(nvs_handle);
+}
+
+static void test_snapshot(void) {
+    const dedup_snapshot_entry_t entries[] = {
+        {fp_at(1, 0), 50}, {fp_at(1, 1), 500}, {fp_at(9, 0), DEDUP_WINDOW_S * 10}, {0, 100},
+    };
+    const uint16_t count = sizeof(entries) / sizeof(entries[0]);
+
+    write_snapshot(DEDUP_SNAPSHOT_VERSION + 1, count, 0, entries, 0);
+    sms_dedup_init();
+    CHECK(s_used == 0, "snapshot with another version restored");
+
+    write_snapshot(DEDUP_SNAPSHOT_VERSION, count, 0, entries, 4);
+    sms_dedup_init();
+    CHECK(s_used == 0, "snapshot with a wrong length restored");
+
+    write_snapshot(DEDUP_SNAPSHOT_VERSION, count, 0, entries, 0);
+    sms_dedup_init();
+    uint32_t now = dedup_now_s();
+    uint32_t empty;
+    CHECK(atomic_load(&s_restored) == 3, "restored %u", (unsigned)atomic_load(&s_restored));
+    CHECK(table_has(fp_at(1, 0)) && table_has(fp_at(1, 1)), "entries missing");
+    int32_t slot = slot_find(fp_at(9, 0), now, &empty);
+    CHECK(slot >= 0 && s_slots[slot].expires_s == now + DEDUP_WINDOW_S, "remaining time not capped");
+
+    // 写快照时和现在的系统时间都有效: 停机的100秒从剩余时间中扣除
+    write_snapshot(DEDUP_SNAPSHOT_VERSION, count, (uint32_t)time(NULL) - 100, entries, 0);
+    sms_dedup_init();
+    now = dedup_now_s();
+    CHECK(atomic_load(&s_restored) == 2, "restored %u after downtime", (unsigned)atomic_load(&s_restored));
+    CHECK(!table_has(fp_at(1, 0)), "entry outlived its window during downtime");
+    slot = slot_find(fp_at(1, 1), now, &empty);
+    // time()可能在两次调用之间跨秒,停机时长允许多1秒
+    CHECK(slot >= 0 && s_slots[slot].expires_s + 1 >= now + 400 && s_slots[slot].expires_s <= now + 400,
+          "downtime not deducted");
+
+    // 写入后重新加载得到相同的条目和剩余时间
+    advance_s(5);
+    sms_message_t sms;
+    uint32_t fp;
+    make_sms(&sms, 42);
+    sms_dedup_seen(&sms, &fp);
+    sms_dedup_record(fp);
+    sms_dedup_snapshot_if_due();
+    dedup_slot_t before[DEDUP_SLOTS];
+    memcpy(before, s_slots, sizeof(before));
+    uint32_t used = s_used;
+    sms_dedup_init();
+    CHECK(s_used == used, "reloaded %u entries, saved %u", (unsigned)s_used, (unsigned)used);
+    for (uint32_t i = 0; i < DEDUP_SLOTS; i++) {
+        if (before[i].fp != 0) {
+            slot = slot_find(before[i].fp, dedup_now_s(), &empty);
+            CHECK(slot >= 0 && s_slots[slot].expires_s + 1 >= before[i].expires_s &&
+                      s_slots[slot].expires_s <= before[i].expires_s,
+                  "entry %08x changed across the snapshot", (unsigned)before[i].fp);
+        }
+    }
+    CHECK(sms_dedup_seen(&sms, &fp), "recorded message not suppressed after reload");
+}
+
+int main(void) {
+    esp_log_level_set("*", ESP_LOG_ERROR);
+    s_now_us = 1000000;
+    test_remove_wraparound();
+    test_make_room();
+    test_against_model();
+    test_snapshot();
+    printf("sms_dedup: %d failures\n", s_failures);
+    return s_failures != 0;
+}
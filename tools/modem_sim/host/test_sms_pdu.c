@@ -0,0 +1,157 @@
+/*
+ * sms_pdu解码测试: 一组SMS-DELIVER PDU及其应有的发件人、编码、分段信息和UTF-8内容。
+ *
+ * 前两条是公开资料中的真实PDU,其余按3GPP TS 23.040编码(与modem_sim.py相同的编码方式),
+ * 覆盖GSM-7扩展表、UCS2代理对、8位数据、8/16位参考号的分段UDH、UDH后的填充位、
+ * 取值非法的分段IE以及截断和非DELIVER的PDU。另外检查每种输出缓冲大小下截断
+ * 不会留下半个字符。
+ * 用法: test_sms_pdu (失败时返回非0)
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "sms_pdu.h"
+
+typedef struct {
+    const char *name;
+    const char *hex;
+    bool ok;                 // sms_pdu_parse_deliver应返回的结果
+    const char *sender;
+    const char *text;        // 内容为text重复repeat次
+    int repeat;
+    sms_pdu_encoding_t encoding;
+    bool is_concat;
+    uint16_t concat_ref;
+    uint8_t concat_total;
+    uint8_t concat_seq;
+} pdu_case_t;
+
+static const pdu_case_t s_cases[] = {
+    {"Published example, international number",
+     "07911326040000F0040B911346610089F60000208062917314080CC8F71D14969741F977FD07",
+     true, "+31641600986", "How are you?", 1, SMS_PDU_ENCODING_GSM7, false, 0, 0, 0},
+    {"Published example, alphanumeric sender",
+     "0791448720003023240DD0E474D81C0EBB010000111011315214000BE474D81C0EBB5DE3771B",
+     true, "diafaan", "diafaan.com", 1, SMS_PDU_ENCODING_GSM7, false, 0, 0, 0},
+    {"GSM-7 with escape table",
+     "0891683108200105F0040D91683108108300F000005210713165002321C8329BFD066DCA75F91BB4E1BDD71B1F6883C26F52A04D6F03DC50362F",
+     true, "+8613800138000", "Hello €uro [ok] {x} ~|^\\", 1, SMS_PDU_ENCODING_GSM7, false, 0, 0, 0},
+    {"UCS2 Chinese, national number",
+     "0891683108200105F00405810180F60008521071316500230E60A8597D002C4E2D56FD79FB52A8",
+     true, "10086", "您好,中国移动", 1, SMS_PDU_ENCODING_UCS2, false, 0, 0, 0},
+    {"8-bit as ISO-8859-1",
+     "0891683108200105F0040C9144770009103200045210713165002306436166E920BD",
+     true, "+447700900123", "Café ½", 1, SMS_PDU_ENCODING_8BIT, false, 0, 0, 0},
+    {"UCS2 surrogate pair",
+     "0891683108200105F0040D91683108108300F00008521071316500230C004800690020D83DDE000021",
+     true, "+8613800138000", "Hi 😀!", 1, SMS_PDU_ENCODING_UCS2, false, 0, 0, 0},
+    {"GSM-7 part 1/3, 8-bit reference, fill bits",
+     "0891683108200105F0440C91447700091032000052107131650023A005000342030182C16030180C0683C16030180C0683C16030180C0683C16030180C0683C16030180C0683C16030180C0683C16030180C0683C16030180C0683C16030180C0683C16030180C0683C16030180C0683C16030180C0683C16030180C0683C16030180C0683C16030180C0683C16030180C0683C16030180C0683C16030180C0683C16030180C0683",
+     true, "+447700900123", "A", 153, SMS_PDU_ENCODING_GSM7, true, 0x42, 3, 1},
+    {"GSM-7 part 3/3, 16-bit reference",
+     "0891683108200105F0440C914477000910320000521071316500231106080412340303D4709A0D8287E574",
+     true, "+447700900123", "Tail part", 1, SMS_PDU_ENCODING_GSM7, true, 0x1234, 3, 3},
+    {"UCS2 part 2/2",
+     "0891683108200105F04405815985F80008521071316500238C0500030702026D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B6D4B",
+     true, "95588", "测", 67, SMS_PDU_ENCODING_UCS2, true, 0x7, 2, 2},
+    {"UCS2 part 1/2, 16-bit reference",
+     "0891683108200105F04405815985F80008521071316500238B0608040102020100E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E900E9",
+     true, "95588", "é", 66, SMS_PDU_ENCODING_UCS2, true, 0x102, 2, 1},
+    {"Other IE before the concatenation IE",
+     "0891683108200105F04405815985F80004521071316500230A08240100000309020178",
+     true, "95588", "x", 1, SMS_PDU_ENCODING_8BIT, true, 0x9, 2, 1},
+    {"Part number 0 is not a concatenation",
+     "0891683108200105F04405815985F80004521071316500230A0500030502007A65726F",
+     true, "95588", "zero", 1, SMS_PDU_ENCODING_8BIT, false, 0, 0, 0},
+    {"Part number beyond total is not a concatenation",
+     "0891683108200105F04405815985F80004521071316500230B0500030502037468726565",
+     true, "95588", "three", 1, SMS_PDU_ENCODING_8BIT, false, 0, 0, 0},
+    {"Truncated user data",
+     "0891683108200105F0040D91683108108300F000005210713165002305C8329B",
+     false, "", "", 1, SMS_PDU_ENCODING_GSM7, false, 0, 0, 0},
+    {"SMS-SUBMIT is rejected",
+     "0891683108200105F0010D91683108108300F000005210713165002305C8329BFD06",
+     false, "", "", 1, SMS_PDU_ENCODING_GSM7, false, 0, 0, 0},
+    {"SMSC length beyond the PDU",
+     "FF91683108200105F0040D91683108108300F000005210713165002305C8329BFD06",
+     false, "", "", 1, SMS_PDU_ENCODING_GSM7, false, 0, 0, 0},
+};
+
+static int s_failures;
+
+static void fail(const pdu_case_t *c, const char *what) {
+    printf("FAIL %s: %s\n", c->name, what);
+    s_failures++;
+}
+
+static size_t hex_to_bytes(const char *hex, uint8_t *out, size_t out_size) {
+    size_t n = strlen(hex) / 2;
+    if (n > out_size) {
+        return 0;
+    }
+    for (size_t i = 0; i < n; i++) {
+        unsigned v;
+        sscanf(hex + 2 * i, "%2x", &v);
+        out[i] = (uint8_t)v;
+    }
+    return n;
+}
+
+static void check_case(const pdu_case_t *c) {
+    uint8_t raw[SMS_PDU_MAX_BYTES];
+    sms_pdu_t pdu;
+    size_t len = hex_to_bytes(c->hex, raw, sizeof(raw));
+    if (sms_pdu_parse_deliver(raw, len, &pdu) != c->ok) {
+        fail(c, c->ok ? "not parsed" : "parsed");
+        return;
+    }
+    if (!c->ok) {
+        return;
+    }
+
+    char expected[1024] = "";
+    for (int i = 0; i < c->repeat; i++) {
+        strcat(expected, c->text);
+    }
+    char text[1024];
+    bool truncated = false;
+    sms_pdu_ud_to_utf8(pdu.encoding, pdu.ud, pdu.ud_len, text, sizeof(text), 0, &truncated);
+
+    if (strcmp(pdu.sender, c->sender) != 0) {
+        fail(c, "sender");
+    }
+    if (pdu.encoding != c->encoding) {
+        fail(c, "encoding");
+    }
+    if (strcmp(text, expected) != 0 || truncated) {
+        printf("     got  [%s]\n     want [%s]\n", text, expected);
+        fail(c, "text");
+    }
+    if (pdu.is_concat != c->is_concat ||
+        (c->is_concat && (pdu.concat_ref != c->concat_ref || pdu.concat_total != c->concat_total ||
+                          pdu.concat_seq != c->concat_seq))) {
+        fail(c, "concatenation header");
+    }
+
+    // 截断只能发生在字符边界,已写入的部分与完整结果一致
+    for (size_t size = 1; size <= strlen(expected); size++) {
+        char small[1024];
+        truncated = false;
+        size_t n = sms_pdu_ud_to_utf8(pdu.encoding, pdu.ud, pdu.ud_len, small, size, 0, &truncated);
+        if (n >= size || small[n] != '\0' || !truncated || memcmp(small, expected, n) != 0 ||
+            ((unsigned char)expected[n] & 0xC0) == 0x80) {
+            fail(c, "truncation");
+            break;
+        }
+    }
+}
+
+int main(void) {
+    size_t count = sizeof(s_cases) / sizeof(s_cases[0]);
+    for (size_t i = 0; i < count; i++) {
+        check_case(&s_cases[i]);
+    }
+    printf("%zu PDUs, %d failures\n", count, s_failures);
+    return s_failures != 0;
+}
@@ -0,0 +1,167 @@
+/*
+ * uart_at_manager测试的公共部分: 在包含uart_at_manager.c之后包含本文件。
+ *
+ * 不安装UART驱动也不启动任务,测试直接调用被测的静态函数。短信按SMS-DELIVER PDU
+ * (8位编码,内容即ASCII)构造,经handle_cmt_body送入拼接流程。
+ */
+#ifndef TEST_UART_AT_H
+#define TEST_UART_AT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int s_failures;
+
+#define CHECK(cond, ...)                                \
+    do {                                                \
+        if (!(cond)) {                                  \
+            printf("FAIL %s:%d: ", __func__, __LINE__); \
+            printf(__VA_ARGS__);                        \
+            printf("\n");                               \
+            s_failures++;                               \
+        }                                               \
+    } while (0)
+
+// sim_host.c提供的MQTT出口,测试中不发布
+esp_err_t mqtt_manager_publish_device_ready(const modem_instance_t *modem) {
+    (void)modem;
+    return ESP_OK;
+}
+
+esp_err_t mqtt_manager_publish(const char *topic, const char *payload, int len, int qos) {
+    (void)topic;
+    (void)payload;
+    (void)len;
+    (void)qos;
+    return ESP_OK;
+}
+
+static modem_instance_t s_test_modem;
+
+/**
+ * @brief 按uart_at_init的方式建立上下文,但不安装驱动、不启动任务
+ *
+ * @param queue_len SMS队列长度,sms_pool按它分配缓冲
+ */
+static uart_at_ctx_t *test_at_ctx(size_t queue_len) {
+    static bool pool_ready;
+    if (!pool_ready) {
+        sms_pool_init(queue_len);
+        pool_ready = true;
+    }
+    uart_at_ctx_t *ctx = calloc(1, sizeof(*ctx));
+    ctx->modem = &s_test_modem;
+    s_test_modem.ctx = ctx;
+    modem_backend_nvs_name(&s_test_modem, MODEM_NVS_NAMESPACE, ctx->nvs_namespace, sizeof(ctx->nvs_namespace));
+    modem_status_init(&ctx->status);
+    urc_index_init(&ctx->urc_index);
+    fragment_gap_init(&ctx->gaps);
+#if CONFIG_APP_SMS_PDU_MODE
+    ctx->cmt_store_index = SMS_STORE_INDEX_NONE;
+#endif
+    for (int i = 0; i < SMS_REASSEMBLY_SLOTS; i++) {
+        reassembly_release(ctx, &ctx->reassembly[i]);
+    }
+    uart_line_framer_init(&ctx->rx_framer, ctx->rx_ring, sizeof(ctx->rx_ring));
+    ctx->at_prompt_tail = SIZE_MAX;
+    atomic_store(&ctx->uart_baud, UART_BAUD_RATE);
+    ctx->sms_queue = xQueueCreate(queue_len, sizeof(sms_message_t *));
+    return ctx;
+}
+
+// 归还条目和待投递短信占用的缓冲,丢弃队列中剩余的短信
+static void test_at_free(uart_at_ctx_t *ctx) {
+    for (int i = 0; i < SMS_REASSEMBLY_SLOTS; i++) {
+        reassembly_release(ctx, &ctx->reassembly[i]);
+    }
+    sms_pool_free(ctx->single_sms);
+    sms_message_t *sms;
+    while (xQueueReceive(ctx->sms_queue, &sms, 0) == pdPASS) {
+        sms_pool_free(sms);
+    }
+    vQueueDelete(ctx->sms_queue);
+    s_test_modem.ctx = NULL;
+    free(ctx);
+}
+
+static uart_line_span_t test_span(const char *text) {
+    uart_line_span_t span = {{text, ""}, {strlen(text), 0}, strlen(text)};
+    return span;
+}
+
+static void put_hex(char **out, uint8_t byte) {
+    *out += sprintf(*out, "%02X", byte);
+}
+
+/**
+ * @brief 构造一条8位编码的SMS-DELIVER PDU的hex
+ *
+ * @param sender 国际号码("+"加数字)
+ * @param total  为0时不带分段UDH
+ */
+static void test_pdu_hex(char *out, const char *sender, uint8_t ref, uint8_t total, uint8_t seq,
+                         const char *text) {
+    const char *digits = sender[0] == '+' ? sender + 1 : sender;
+    size_t ndigits = strlen(digits);
+    size_t text_len = strlen(text);
+
+    put_hex(&out, 0x00);                       // 使用SIM中的短信中心
+    put_hex(&out, total ? 0x44 : 0x04);        // SMS-DELIVER,有分段时置UDHI
+    put_hex(&out, (uint8_t)ndigits);
+    put_hex(&out, 0x91);
+    for (size_t i = 0; i < ndigits; i += 2) {
+        uint8_t lo = (uint8_t)(digits[i] - '0');
+        uint8_t hi = i + 1 < ndigits ? (uint8_t)(digits[i + 1] - '0') : 0xF;
+        put_hex(&out, (uint8_t)(hi << 4 | lo));
+    }
+    put_hex(&out, 0x00);                       // PID
+    put_hex(&out, 0x04);                       // DCS: 8位数据
+    for (int i = 0; i < 7; i++) {
+        put_hex(&out, 0x11);                   // SCTS,内容不影响解码
+    }
+    put_hex(&out, (uint8_t)(text_len + (total ? 6 : 0)));
+    if (total) {
+        uint8_t udh[] = {0x05, 0x00, 0x03, ref, total, seq};
+        for (size_t i = 0; i < sizeof(udh); i++) {
+            put_hex(&out, udh[i]);
+        }
+    }
+    for (size_t i = 0; i < text_len; i++) {
+        put_hex(&out, (uint8_t)text[i]);
+    }
+}
+
+// 送入一段+CMT正文(直接上报,不来自模组存储)
+static inline void test_cmt(uart_at_ctx_t *ctx, const char *sender, uint8_t ref, uint8_t total, uint8_t seq,
+                     const char *text) {
+    char hex[2 * SMS_PDU_MAX_BYTES + 1];
+    test_pdu_hex(hex, sender, ref, total, seq, text);
+    uart_line_span_t span = test_span(hex);
+    ctx->cmt_store_index = SMS_STORE_INDEX_NONE;
+    handle_cmt_body(ctx, &span);
+}
+
+/**
+ * @brief 取出队列中的下一条短信,比较发件人和内容并归还缓冲
+ * @return 队列为空或不一致时返回false
+ */
+static inline bool test_expect_sms(uart_at_ctx_t *ctx, const char *sender, const char *content) {
+    sms_message_t *sms = NULL;
+    if (xQueueReceive(ctx->sms_queue, &sms, 0) != pdPASS) {
+        printf("     no SMS queued, want [%s] from %s\n", content, sender);
+        return false;
+    }
+    bool ok = strcmp(sms->sender, sender) == 0 && strcmp(sms->content, content) == 0;
+    if (!ok) {
+        printf("     got  [%s] from %s\n     want [%s] from %s\n", sms->content, sms->sender, content, sender);
+    }
+    sms_pool_free(sms);
+    return ok;
+}
+
+static inline size_t test_queued(uart_at_ctx_t *ctx) {
+    return (size_t)(uxQueueMessagesWaiting(ctx->sms_queue));
+}
+
+#endif // TEST_UART_AT_H
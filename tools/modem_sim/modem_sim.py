@@ -0,0 +1,950 @@
+#!/usr/bin/env python3
+"""Scriptable modem simulator on a Linux pseudo-terminal.
+
+Usage: modem_sim.py [options] [scenario]
+
+Plays an Air724UG running AT firmware (--firmware at) or Yinerda DTU
+firmware (--firmware dtu) on a pty, so uart_at_manager.c and
+uart_dtu_manager.c can be exercised without hardware: either the host
+build in tools/modem_sim/host or any program that opens the printed
+device. The scenario file (see scenarios/) injects SMS bursts,
+interleaved long messages, line noise and slow or missing responses.
+
+With --run the simulator starts the host build itself ("{tty}" in the
+command is replaced by the pty path), compares the messages it reports
+with the ones sent and prints throughput and latency. Exit status is 0
+only if every message sent in full arrived exactly once and unchanged.
+
+With --modems N each modem gets its own pty ("{tty0}", "{tty1}", ... in
+the command; "{tty}" is modem 0) and plays the scenario concurrently with
+its own random seed. --firmware takes one value per modem, comma
+separated. Messages are matched per modem using the "modem" field the
+host reports, and each modem gets its own report.
+"""
+
+import argparse
+import codecs
+import json
+import os
+import random
+import re
+import shlex
+import signal
+import subprocess
+import sys
+import termios
+import threading
+import time
+import tty
+
+# ---------------------------------------------------------------------------
+# SMS encoding (3GPP TS 23.038 / 23.040)
+
+GSM7_BASIC = ('@£$¥èéùìòÇ\nØø\rÅåΔ_ΦΓΛΩΠΨΣΘΞ\x1bÆæßÉ !"#¤%&\'()*+,-./0123456789:;<=>?'
+              '¡ABCDEFGHIJKLMNOPQRSTUVWXYZÄÖÑÜ§¿abcdefghijklmnopqrstuvwxyzäöñüà')
+GSM7_EXT = {'\f': 0x0A, '^': 0x14, '{': 0x28, '}': 0x29, '\\': 0x2F,
+            '[': 0x3C, '~': 0x3D, ']': 0x3E, '|': 0x40, '€': 0x65}
+GSM7_INDEX = {ch: i for i, ch in enumerate(GSM7_BASIC) if ch != '\x1b'}
+
+SINGLE_UNITS = {'gsm7': 160, 'ucs2': 70}
+# 每段载荷: 8位参考号UDH占6字节,16位参考号占7字节
+PART_UNITS = {('gsm7', False): 153, ('gsm7', True): 152, ('ucs2', False): 67, ('ucs2', True): 66}
+
+
+def gsm7_septets(text):
+    """Septets for text, or None if it needs UCS2."""
+    out = []
+    for ch in text:
+        if ch in GSM7_INDEX:
+            out.append(GSM7_INDEX[ch])
+        elif ch in GSM7_EXT:
+            out += [0x1B, GSM7_EXT[ch]]
+        else:
+            return None
+    return out
+
+
+def split_parts(text, ref16=False):
+    """Splits text the way a phone does: (encoding, [part text, ...])."""
+    if gsm7_septets(text) is not None:
+        encoding = 'gsm7'
+        units = [len(gsm7_septets(ch)) for ch in text]
+    else:
+        encoding = 'ucs2'
+        units = [len(ch.encode('utf-16-be')) // 2 for ch in text]
+    if sum(units) <= SINGLE_UNITS[encoding]:
+        return encoding, [text]
+    limit = PART_UNITS[(encoding, ref16)]
+    parts, cur, used = [], '', 0
+    for ch, n in zip(text, units):
+        # 转义字符和代理对不跨段
+        if used + n > limit:
+            parts.append(cur)
+            cur, used = '', 0
+        cur += ch
+        used += n
+    parts.append(cur)
+    return encoding, parts
+
+
+def semi_octets(digits):
+    if len(digits) % 2:
+        digits += 'F'
+    return ''.join(digits[i + 1] + digits[i] for i in range(0, len(digits), 2))
+
+
+def pack_septets(septets, fill_bits=0):
+    acc, nbits, out = 0, fill_bits, bytearray()
+    for s in septets:
+        acc |= (s & 0x7F) << nbits
+        nbits += 7
+        while nbits >= 8:
+            out.append(acc & 0xFF)
+            acc >>= 8
+            nbits -= 8
+    if nbits > 0:
+        out.append(acc & 0xFF)
+    return bytes(out)
+
+
+def encode_address(sender):
+    if re.fullmatch(r'\+?\d+', sender):
+        digits = sender.lstrip('+')
+        ton = 0x91 if sender.startswith('+') else 0x81
+        return '{:02X}{:02X}{}'.format(len(digits), ton, semi_octets(digits))
+    # 字母数字发件人: GSM-7打包,长度按半字节计
+    packed = pack_septets(gsm7_septets(sender) or gsm7_septets('?' * len(sender)))
+    return '{:02X}D0{}'.format(len(packed) * 2, packed.hex().upper())
+
+
+def scts(now):
+    lt = time.localtime(now)
+    tz = -(time.altzone if lt.tm_isdst > 0 else time.timezone) // 900
+    fields = '{:02d}{:02d}{:02d}{:02d}{:02d}{:02d}'.format(
+        lt.tm_year % 100, lt.tm_mon, lt.tm_mday, lt.tm_hour, lt.tm_min, lt.tm_sec)
+    tz_field = semi_octets('{:02d}'.format(abs(tz)))
+    if tz < 0:
+        tz_field = tz_field[0] + '{:X}'.format(int(tz_field[1], 16) | 0x8)
+    return semi_octets(fields) + tz_field
+
+
+def deliver_pdu(sender, encoding, text, concat=None, ref16=False, now=None):
+    """SMS-DELIVER PDU hex with an SMSC address; returns (hex, TPDU length)."""
+    udh = b''
+    if concat is not None:
+        ref, total, seq = concat
+        if ref16:
+            udh = bytes([6, 0x08, 4, (ref >> 8) & 0xFF, ref & 0xFF, total, seq])
+        else:
+            udh = bytes([5, 0x00, 3, ref & 0xFF, total, seq])
+    if encoding == 'gsm7':
+        septets = gsm7_septets(text)
+        header_septets = (len(udh) * 8 + 6) // 7
+        ud = bytearray(pack_septets([0] * header_septets + septets))
+        ud[:len(udh)] = udh
+        udl, dcs = header_septets + len(septets), 0x00
+    else:
+        ud = udh + text.encode('utf-16-be')
+        udl, dcs = len(ud), 0x08
+    first = 0x04 | (0x40 if udh else 0)  # SMS-DELIVER, TP-MMS, TP-UDHI
+    tpdu = '{:02X}{}00{:02X}{}{:02X}{}'.format(
+        first, encode_address(sender), dcs, scts(now or time.time()), udl, bytes(ud).hex().upper())
+    smsc = '0891683108200805F0'  # +8613800280500
+    return smsc + tpdu, len(tpdu) // 2
+
+
+def ucs2_hex(text):
+    return text.encode('utf-16-be').hex().upper()
+
+
+def text_mode_stamp(now):
+    lt = time.localtime(now)
+    return '{:02d}/{:02d}/{:02d},{:02d}:{:02d}:{:02d}+32'.format(
+        lt.tm_year % 100, lt.tm_mon, lt.tm_mday, lt.tm_hour, lt.tm_min, lt.tm_sec)
+
+
+# ---------------------------------------------------------------------------
+# Scenario text generators: @ascii:N @cjk:N @emoji:N @mixed:N
+
+WORDS = 'alpha bravo charlie delta echo foxtrot golf hotel india juliet kilo lima mike'.split()
+CJK = '验证码短信网关测试中文长消息拼接运营商通知您的账户余额请注意查收感谢使用'
+EMOJI = '😀😂🎉👍🚀❤🔥✅'
+
+
+def generate_text(spec, rng):
+    m = re.fullmatch(r'@(ascii|cjk|emoji|mixed):(\d+)', spec)
+    if not m:
+        return spec
+    kind, n = m.group(1), int(m.group(2))
+    out = ''
+    while len(out) < n:
+        if kind == 'ascii':
+            out += rng.choice(WORDS) + ' '
+        elif kind == 'cjk':
+            out += rng.choice(CJK)
+        elif kind == 'emoji':
+            out += rng.choice(EMOJI)
+        else:
+            out += rng.choice([rng.choice(WORDS) + ' ', rng.choice(CJK), rng.choice(EMOJI)])
+    return out[:n]
+
+
+# ---------------------------------------------------------------------------
+# Serial line
+
+SPEEDS = {getattr(termios, 'B{}'.format(b)): b
+          for b in (9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600)
+          if hasattr(termios, 'B{}'.format(b))}
+
+class Line:
+    """Master side of the pty with optional baud-rate pacing."""
+
+    def __init__(self, baud):
+        self.master, self.slave = os.openpty()
+        tty.setraw(self.slave)
+        self.path = os.ttyname(self.slave)
+        self.baud = baud
+        self.rx_baud = baud       # 模组接收的速率,AT+IPR回OK后立即生效
+        self.rx_dropped = 0
+        self.lock = threading.Lock()
+        self.bytes_out = 0
+        self._next = time.monotonic()
+
+    def write(self, data):
+        """Writes data atomically with respect to other writers."""
+        with self.lock:
+            step = 64 if self.baud else len(data)
+            for i in range(0, len(data), step):
+                chunk = data[i:i + step]
+                if self.baud:
+                    self._next = max(self._next, time.monotonic())
+                    delay = self._next - time.monotonic()
+                    if delay > 0:
+                        time.sleep(delay)
+                    self._next += len(chunk) * 10 / self.baud
+                os.write(self.master, chunk)
+            self.bytes_out += len(data)
+
+    def set_baud(self, baud):
+        with self.lock:
+            if self.baud:
+                self.baud = baud
+
+    def host_baud(self):
+        """Baud rate the host set on the slave side, or 0 if unknown."""
+        try:
+            return SPEEDS.get(termios.tcgetattr(self.master)[5], 0)
+        except termios.error:
+            return 0
+
+    def read(self):
+        try:
+            data = os.read(self.master, 4096)
+        except OSError:
+            # 对端尚未打开或已关闭
+            time.sleep(0.05)
+            return b''
+        # 速率不一致时模组收到的是乱码,当作没收到
+        host = self.host_baud()
+        if self.rx_baud and host and host != self.rx_baud:
+            self.rx_dropped += len(data)
+            return b''
+        return data
+
+
+# ---------------------------------------------------------------------------
+# Modem personalities
+
+class Message:
+    def __init__(self, sender, text, parts, exact):
+        self.sender = sender
+        self.text = text
+        self.parts = parts
+        self.exact = exact
+        self.sent_at = None      # 最后一段写出的时间(time.monotonic)
+        self.lost = False
+        self.report = True       # DTU: False表示不主动上报,只进缓存
+
+
+class Modem:
+    def __init__(self, line, args):
+        self.line = line
+        self.args = args
+        self.ready = threading.Event()
+        self.delays = []          # [(prefix, seconds)]
+        self.mute_until = 0.0
+        self.commands = 0
+        self.intercept = None     # replay.py: 返回True的命令由回放的抓包应答
+
+    def send_lines(self, *lines):
+        """Sends one block: "\\r\\n<line>\\r\\n<line>...\\r\\n", like a URC or one response."""
+        self.line.write(b'\r\n' + '\r\n'.join(lines).encode('utf-8') + b'\r\n')
+
+    def send_blocks(self, blocks):
+        self.line.write(b''.join(b'\r\n' + '\r\n'.join(b).encode('utf-8') + b'\r\n' for b in blocks))
+
+    def response_delay(self, cmd):
+        for prefix, seconds in self.delays:
+            if cmd.upper().startswith(prefix.upper()):
+                return seconds
+        return 0.0
+
+    def on_input(self, cmd):
+        if not cmd:
+            return
+        self.commands += 1
+        if self.intercept and self.intercept(cmd):
+            return
+        if time.monotonic() < self.mute_until:
+            log('muted, ignoring: {}'.format(cmd))
+            return
+        delay = self.response_delay(cmd)
+        if delay:
+            time.sleep(delay)
+        self.handle(cmd)
+
+
+class AtModem(Modem):
+    """Air724UG AT firmware: the subset uart_at_manager.c uses."""
+
+    def __init__(self, line, args):
+        super().__init__(line, args)
+        self.echo = True
+        self.cmee = 0
+        self.cmgf = 0
+        self.cscs = 'IRA'
+        self.cnmi = [0, 0, 0, 0, 0]
+        self.creg_n = 0
+        self.cereg_n = 0
+        self.ipr = args.baud or 115200
+        self.storage = {}         # index -> (stat, header args, body)
+        self.storage_total = args.storage
+        self.storage_overflows = 0
+
+    # -- 命令 --------------------------------------------------------------
+
+    def ok(self):
+        return ['OK']
+
+    def error(self, code='operation not allowed', num=3):
+        if self.cmee == 2:
+            return ['+CME ERROR: {}'.format(code)]
+        if self.cmee == 1:
+            return ['+CME ERROR: {}'.format(num)]
+        return ['ERROR']
+
+    def handle(self, raw):
+        if self.echo:
+            self.line.write(raw.encode('utf-8', 'replace') + b'\r\n')
+        if raw.upper() in ('AT', 'AT;'):
+            return self.send_lines('OK')
+        if not raw.upper().startswith('AT'):
+            return self.send_lines(*self.error())
+        # 一行多条命令: AT+A;+B;E0,任一条失败则不再执行后面的。
+        # 每条命令的信息行自成一块,最后是结果码
+        blocks = []
+        for sub in raw[2:].split(';'):
+            sub = sub.strip()
+            if not sub:
+                continue
+            lines = self.command(sub)
+            if lines is None:
+                lines = self.error('operation not supported', 4)
+            if lines and 'ERROR' in lines[-1]:
+                blocks.append([lines[-1]])
+                break
+            if lines:
+                blocks.append(lines)
+        else:
+            blocks.append(['OK'])
+        self.send_blocks(blocks)
+
+    def command(self, sub):
+        up = sub.upper()
+        m = re.fullmatch(r'E([01])', up)
+        if m:
+            self.echo = m.group(1) == '1'
+            return []
+        m = re.fullmatch(r'\+CMEE=([012])', up)
+        if m:
+            self.cmee = int(m.group(1))
+            return []
+        m = re.fullmatch(r'\+CMGF=([01])', up)
+        if m:
+            self.cmgf = int(m.group(1))
+            return []
+        if up == '+CMGF?':
+            return ['+CMGF: {}'.format(self.cmgf)]
+        m = re.fullmatch(r'\+CSCS="(\w+)"', up)
+        if m:
+            if m.group(1) not in ('IRA', 'GSM', 'UCS2'):
+                return self.error()
+            self.cscs = m.group(1)
+            return []
+        if up == '+CSCS?':
+            return ['+CSCS: "{}"'.format(self.cscs)]
+        m = re.fullmatch(r'\+CNMI=([\d,]+)', up)
+        if m:
+            values = [int(v) if v else 0 for v in m.group(1).split(',')]
+            self.cnmi = (values + [0] * 5)[:5]
+            if self.cnmi[1] in (1, 2):
+                self.ready.set()
+            return []
+        if up == '+CNMI?':
+            return ['+CNMI: ' + ','.join(str(v) for v in self.cnmi)]
+        if up == '+CIMI':
+            return [self.args.imsi]
+        if up in ('+CCID', '+ICCID'):
+            return ['+CCID: ' + self.args.iccid]
+        if up == '+CPIN?':
+            return ['+CPIN: READY']
+        if up == '+CSQ':
+            return ['+CSQ: {},99'.format(self.args.rssi)]
+        m = re.fullmatch(r'\+C(E?)REG=([012])', up)
+        if m:
+            setattr(self, 'cereg_n' if m.group(1) else 'creg_n', int(m.group(2)))
+            return []
+        m = re.fullmatch(r'\+C(E?)REG\?', up)
+        if m:
+            n = self.cereg_n if m.group(1) else self.creg_n
+            name = '+CEREG' if m.group(1) else '+CREG'
+            if n == 2:
+                return ['{}: 2,1,"1A2B","0C3D4E5",7'.format(name)]
+            return ['{}: {},1'.format(name, n)]
+        if up == '+CCLK?':
+            return ['+CCLK: "{}"'.format(text_mode_stamp(time.time()))]
+        if up == '+CPMS?':
+            used = len(self.storage)
+            return ['+CPMS: ' + ','.join(['"SM",{},{}'.format(used, self.storage_total)] * 3)]
+        m = re.fullmatch(r'\+IPR=(\d+)', up)
+        if m:
+            self.ipr = int(m.group(1))
+            if self.line.rx_baud:
+                self.line.rx_baud = self.ipr
+            # 回OK之后才按新速率发送,与模组一致
+            threading.Timer(0.001, self.line.set_baud, (self.ipr,)).start()
+            return []
+        if up == '+IPR?':
+            return ['+IPR: {}'.format(self.ipr)]
+        if re.fullmatch(r'\+IFC=\d,\d', up):
+            return []
+        m = re.fullmatch(r'\+CMGL=(\d|"\w+(?: \w+)?")', up)
+        if m:
+            return self.list_stored()
+        m = re.fullmatch(r'\+CMGD=(\d+)(?:,(\d))?', up)
+        if m:
+            index = int(m.group(1))
+            if index >= self.storage_total:
+                return ['+CMS ERROR: 321']
+            if m.group(2) and m.group(2) != '0':
+                self.storage.clear()
+            else:
+                self.storage.pop(index, None)
+            return []
+        return None
+
+    def list_stored(self):
+        out = []
+        for index in sorted(self.storage):
+            stat, pdu_len, body, header = self.storage[index]
+            if self.cmgf == 0:
+                out += ['+CMGL: {},{},,{}'.format(index, stat, pdu_len), body]
+            else:
+                out += ['+CMGL: {},"{}",{}'.format(index, 'REC UNREAD' if stat == 0 else 'REC READ', header),
+                        body]
+            self.storage[index] = (1, pdu_len, body, header)
+        return out
+
+    # -- 来短信 -------------------------------------------------------------
+
+    def deliver_part(self, sender, encoding, text, concat, ref16):
+        now = time.time()
+        if self.cmgf == 0:
+            pdu, pdu_len = deliver_pdu(sender, encoding, text, concat, ref16, now)
+            header, body = ',{}'.format(pdu_len), pdu
+        else:
+            # 文本模式只上报去掉UDH后的正文,长短信分段靠正文长度识别
+            pdu_len = 0
+            if self.cscs == 'UCS2':
+                header = '"{}","","{}"'.format(ucs2_hex(sender), text_mode_stamp(now))
+                body = ucs2_hex(text)
+            else:
+                header = '"{}","","{}"'.format(sender, text_mode_stamp(now))
+                body = text
+        if self.cnmi[1] == 2:
+            self.send_lines('+CMT: ' + header, body)
+            return True
+        index = next((i for i in range(self.storage_total) if i not in self.storage), None)
+        if index is None:
+            self.storage_overflows += 1
+            log('storage full, part from {} lost'.format(sender))
+            return False
+        self.storage[index] = (0, pdu_len, body, header)
+        if self.cnmi[1] == 1:
+            self.send_lines('+CMTI: "SM",{}'.format(index))
+        return True
+
+    def message_exact(self, parts, order, dropped, text):
+        if dropped or len(text.encode('utf-8')) >= 2048:
+            return False
+        # 文本模式没有UDH,乱序到达的分段只能按到达顺序拼接
+        return self.cmgf == 0 or order == sorted(order)
+
+    def storage_empty(self):
+        return not self.storage
+
+
+class DtuModem(Modem):
+    """Yinerda DTU firmware: config,<verb>,... lines, SMS as UTF-8 hex."""
+
+    CACHE_SIZE = 10
+
+    def __init__(self, line, args):
+        super().__init__(line, args)
+        self.sms_on = False
+        self.cache = []
+
+    def handle(self, raw):
+        fields = raw.split(',')
+        if len(fields) < 2 or fields[0] != 'config':
+            return
+        verb, args = fields[1], fields[2:]
+        if verb == 'get' and args == ['firmwarever']:
+            return self.send_line('config,firmwarever,ok,{}'.format(self.args.dtu_version))
+        if verb == 'get' and args == ['iccid']:
+            return self.send_line('config,iccid,ok,{}'.format(self.args.iccid))
+        if verb == 'set' and args[:1] == ['smson']:
+            self.sms_on = len(args) > 1 and args[1] == '1'
+            if self.sms_on:
+                self.ready.set()
+            return self.send_line('config,smson,ok')
+        if verb == 'get' and args == ['sms']:
+            # 读缓存不清除缓存,与实物一致;重复的由固件去重
+            if not self.cache:
+                return self.send_line('config,sms,ok')
+            return self.send_line(self.cache[-1])
+        name = args[0] if verb in ('get', 'set') and args else verb
+        self.send_line('config,{},error'.format(name))
+
+    def send_line(self, text):
+        self.line.write(text.encode('utf-8') + b'\r\n')
+
+    def deliver_message(self, sender, text, report=True):
+        line = 'config,sms,ok,{},{}'.format(sender, text.encode('utf-8').hex().upper())
+        self.cache = (self.cache + [line])[-self.CACHE_SIZE:]
+        if self.sms_on and report:
+            self.send_line(line)
+        return True
+
+    def storage_empty(self):
+        return True
+
+
+# ---------------------------------------------------------------------------
+# Scenario
+
+class ScenarioError(Exception):
+    pass
+
+
+def parse_scenario(path):
+    steps, stack = [], []
+    with open(path, encoding='utf-8') as f:
+        for line_no, raw in enumerate(f, 1):
+            tokens = shlex.split(raw, comments=True)
+            if not tokens:
+                continue
+            op, pos, kw = tokens[0], [], {}
+            for tok in tokens[1:]:
+                m = re.fullmatch(r'(\w+)=(.*)', tok)
+                if m and not tok.startswith('+'):
+                    kw[m.group(1)] = m.group(2)
+                else:
+                    pos.append(tok)
+            step = (line_no, op, pos, kw)
+            if op == 'repeat':
+                stack.append((steps, step))
+                steps = []
+            elif op == 'end':
+                if not stack:
+                    raise ScenarioError('{}:{}: "end" without "repeat"'.format(path, line_no))
+                body, (outer, head) = steps, stack.pop()
+                steps = outer
+                steps.append((head[0], 'repeat', head[2], {'body': body}))
+            else:
+                steps.append(step)
+    if stack:
+        raise ScenarioError('{}: "repeat" without "end"'.format(path))
+    return steps
+
+
+class Runner:
+    def __init__(self, modem, args, seed=None):
+        self.modem = modem
+        self.args = args
+        self.rng = random.Random(args.seed if seed is None else seed)
+        self.messages = []
+        self.ref = self.rng.randrange(256)
+        self.serial = 0
+
+    def run(self, steps):
+        for line_no, op, pos, kw in steps:
+            fn = getattr(self, 'op_' + op, None)
+            if fn is None:
+                raise ScenarioError('line {}: unknown step "{}"'.format(line_no, op))
+            try:
+                fn(*pos, **kw)
+            except TypeError as e:
+                raise ScenarioError('line {}: {}: {}'.format(line_no, op, e))
+
+    # -- 步骤 ---------------------------------------------------------------
+
+    def op_repeat(self, count, body):
+        for _ in range(int(count)):
+            self.run(body)
+
+    def op_sleep(self, ms):
+        time.sleep(int(ms) / 1000)
+
+    def op_wait_ready(self, timeout_ms='60000'):
+        if not self.modem.ready.wait(int(timeout_ms) / 1000):
+            raise ScenarioError('host did not enable SMS reporting within {} ms'.format(timeout_ms))
+        log('host ready')
+
+    def op_wait_drained(self, timeout_ms='60000'):
+        deadline = time.monotonic() + int(timeout_ms) / 1000
+        while not self.modem.storage_empty():
+            if time.monotonic() > deadline:
+                raise ScenarioError('modem storage not drained within {} ms'.format(timeout_ms))
+            time.sleep(0.05)
+
+    def op_urc(self, *text):
+        self.modem.send_lines(' '.join(text))
+
+    def op_raw(self, text):
+        self.modem.line.write(codecs.decode(text, 'unicode_escape').encode('latin-1'))
+
+    def op_noise(self, nbytes, printable='0'):
+        n = int(nbytes)
+        if printable != '0':
+            data = bytes(self.rng.choice(b'ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789+:,"\r\n ') for _ in range(n))
+        else:
+            data = bytes(self.rng.randrange(256) for _ in range(n))
+        # 以换行结束,后面的行仍能正常分帧
+        self.modem.line.write(data + b'\r\n')
+
+    def op_delay(self, ms, prefix=''):
+        self.modem.delays = [d for d in self.modem.delays if d[0] != prefix]
+        if int(ms) > 0:
+            self.modem.delays.append((prefix, int(ms) / 1000))
+            # 前缀越长越优先
+            self.modem.delays.sort(key=lambda d: -len(d[0]))
+
+    def op_mute(self, ms):
+        self.modem.mute_until = time.monotonic() + int(ms) / 1000
+
+    def op_sms(self, sender, text, gap='0', order='', drop='', ref16='0'):
+        msg = self.make_message(sender, text, ref16 != '0', order, drop)
+        self.send_parts([msg], int(gap))
+
+    def op_burst(self, count, sender, text, interval='0', gap='0', ref16='0'):
+        for _ in range(int(count)):
+            msg = self.make_message(sender, text, ref16 != '0')
+            self.send_parts([msg], int(gap))
+            if int(interval):
+                time.sleep(int(interval) / 1000)
+
+    def op_interleave(self, count, sender, text, gap='0', ref16='0'):
+        msgs = [self.make_message(sender, text, ref16 != '0') for _ in range(int(count))]
+        self.send_parts(msgs, int(gap))
+
+    # -- 辅助 ---------------------------------------------------------------
+
+    def make_message(self, sender, text, ref16, order='', drop=''):
+        self.serial += 1
+        sender = sender.replace('{n}', str(self.serial))
+        text = generate_text(text, self.rng).replace('{n}', str(self.serial))
+        encoding, parts = split_parts(text, ref16)
+        seqs = [int(s) for s in order.split(',')] if order else list(range(1, len(parts) + 1))
+        dropped = {int(s) for s in drop.split(',')} if drop else set()
+        if sorted(seqs) != list(range(1, len(parts) + 1)):
+            raise ScenarioError('order={} does not match {} parts'.format(order, len(parts)))
+        seqs = [s for s in seqs if s not in dropped]
+        self.ref = (self.ref + 1) % (65536 if ref16 else 256)
+        if isinstance(self.modem, DtuModem):
+            # DTU固件上报时长短信已拼接完整
+            # drop=1: 主动上报丢失,只能由缓存轮询取回
+            exact = len(text.encode('utf-8')) < 2048
+            msg = Message(sender, text, [(None, text)], exact)
+            msg.report = 1 not in dropped
+        else:
+            exact = self.modem.message_exact(parts, seqs, dropped, text)
+            concat = len(parts) > 1
+            msg = Message(sender, text, [((self.ref, len(parts), s) if concat else None, parts[s - 1])
+                                         for s in seqs], exact)
+        msg.encoding = encoding
+        msg.ref16 = ref16
+        self.messages.append(msg)
+        return msg
+
+    def send_parts(self, msgs, gap_ms):
+        # 多条消息的分段轮流发送
+        queues = [list(m.parts) for m in msgs]
+        first = True
+        while any(queues):
+            for msg, queue in zip(msgs, queues):
+                if not queue:
+                    continue
+                if not first and gap_ms:
+                    time.sleep(gap_ms / 1000)
+                first = False
+                concat, text = queue.pop(0)
+                if isinstance(self.modem, DtuModem):
+                    ok = self.modem.deliver_message(msg.sender, text, msg.report)
+                else:
+                    ok = self.modem.deliver_part(msg.sender, msg.encoding, text, concat, msg.ref16)
+                if not ok:
+                    msg.lost = True
+                msg.sent_at = time.monotonic()
+
+
+# ---------------------------------------------------------------------------
+# Host program and report
+
+def log(text):
+    print('[modem_sim] ' + text, file=sys.stderr, flush=True)
+
+
+class Host:
+    def __init__(self, command, tty_paths):
+        def expand(arg):
+            arg = re.sub(r'\{tty(\d+)\}', lambda m: tty_paths[int(m.group(1))], arg)
+            return arg.replace('{tty}', tty_paths[0])
+        argv = [expand(a) for a in shlex.split(command)]
+        self.proc = subprocess.Popen(argv, stdout=subprocess.PIPE, text=True)
+        self.received = []
+        self.ready_at = None
+        self.final = None
+        self.thread = threading.Thread(target=self._read, daemon=True)
+        self.thread.start()
+
+    def _read(self):
+        for raw in self.proc.stdout:
+            try:
+                event = json.loads(raw)
+            except ValueError:
+                continue
+            kind = event.get('event')
+            if kind == 'sms':
+                self.received.append(event)
+            elif kind == 'ready':
+                self.ready_at = event.get('t_ms')
+            elif kind == 'done':
+                self.final = event
+
+    def received_by(self, index):
+        return [e for e in self.received if e.get('modem', 0) == index]
+
+    def stop(self, timeout):
+        if self.proc.poll() is None:
+            self.proc.send_signal(signal.SIGTERM)
+        try:
+            self.proc.wait(timeout)
+        except subprocess.TimeoutExpired:
+            self.proc.kill()
+            self.proc.wait()
+        self.thread.join(1)
+
+
+def percentile(values, p):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100))]
+
+
+def report(runner, modem, received, elapsed):
+    msgs = [m for m in runner.messages if not m.lost]
+    pending = {}
+    for m in msgs:
+        pending.setdefault((m.sender, m.text), []).append(m)
+    by_sender = {}
+    for m in msgs:
+        if not m.exact:
+            by_sender.setdefault(m.sender, []).append(m)
+
+    matched, latencies, unexpected = [], [], []
+    split = {}  # 已匹配的不完整短信,主机可能分几次投递(缺段或文本模式乱序)
+    pieces = 0
+    for event in received:
+        key = (event.get('sender'), event.get('content'))
+        candidates = [m for m in pending.get(key, []) if m.exact]
+        if not candidates:
+            candidates = by_sender.get(key[0], [])
+        if not candidates:
+            if key[0] in split:
+                pieces += 1
+            else:
+                unexpected.append(event)
+            continue
+        msg = candidates.pop(0)
+        if msg in pending.get((msg.sender, msg.text), []):
+            pending[(msg.sender, msg.text)].remove(msg)
+        if msg in by_sender.get(msg.sender, []):
+            by_sender[msg.sender].remove(msg)
+        matched.append(msg)
+        if not msg.exact:
+            split[msg.sender] = msg
+        if msg.sent_at is not None:
+            latencies.append(event['t_ms'] - msg.sent_at * 1000)
+
+    exact_total = sum(1 for m in msgs if m.exact)
+    exact_matched = sum(1 for m in matched if m.exact)
+    missing = exact_total - exact_matched
+    parts = sum(len(m.parts) for m in runner.messages)
+
+    print('messages sent:    {} ({} parts, {} bytes on the line, {} lost to full storage)'.format(
+        len(runner.messages), parts, modem.line.bytes_out, len(runner.messages) - len(msgs)))
+    if modem.line.rx_dropped:
+        print('input ignored:    {} bytes sent at the wrong baud rate'.format(modem.line.rx_dropped))
+    print('messages received: {} ({} exact of {}, {} partial in {} pieces, {} missing, {} unexpected)'.format(
+        len(received), exact_matched, exact_total, len(matched) - exact_matched,
+        len(matched) - exact_matched + pieces, missing, len(unexpected)))
+    if latencies:
+        print('latency ms:       p50 {:.1f}  p99 {:.1f}  max {:.1f}'.format(
+            percentile(latencies, 50), percentile(latencies, 99), max(latencies)))
+    sent_times = [m.sent_at for m in runner.messages if m.sent_at is not None]
+    if received and sent_times:
+        span = received[-1]['t_ms'] / 1000 - min(sent_times)
+        if span > 0:
+            print('throughput:       {:.1f} SMS/s over {:.2f} s'.format(len(received) / span, span))
+    print('scenario time:    {:.2f} s, {} commands answered'.format(elapsed, modem.commands))
+    for event in unexpected[:5]:
+        print('unexpected: {!r} {!r}'.format(event.get('sender'), event.get('content', '')[:80]))
+    return 0 if missing == 0 and not unexpected else 1
+
+
+def run_concurrently(runners, steps):
+    """Plays the scenario on every modem at once; raises the first ScenarioError."""
+    errors = []
+
+    def run(runner):
+        try:
+            runner.run(steps)
+        except ScenarioError as e:
+            errors.append(e)
+
+    threads = [threading.Thread(target=run, args=(r,), daemon=True) for r in runners[1:]]
+    for t in threads:
+        t.start()
+    run(runners[0])
+    for t in threads:
+        t.join()
+    if errors:
+        raise errors[0]
+
+
+# ---------------------------------------------------------------------------
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('scenario', nargs='?', help='scenario file (default: only answer commands)')
+    parser.add_argument('--firmware', default='at',
+                        help='at or dtu; comma separated per modem with --modems (default at)')
+    parser.add_argument('--modems', type=int, default=1,
+                        help='simulate this many modems, each on its own pty (default 1)')
+    parser.add_argument('--link', help='also make the pty reachable at this path (symlink)')
+    parser.add_argument('--baud', type=int, default=115200,
+                        help='pace output like a UART at this initial rate, following AT+IPR, and ignore '
+                             'input sent at another rate; 0 writes as fast as the host reads (default 115200)')
+    parser.add_argument('--run', metavar='CMD', help='start CMD ("{tty}" = pty path) and check what it reports')
+    parser.add_argument('--linger', type=float, default=3.0,
+                        help='seconds to wait for the host after the scenario (default 3)')
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('--imsi', default='460001234567890')
+    parser.add_argument('--iccid', default='89860012345678901234')
+    parser.add_argument('--rssi', type=int, default=24)
+    parser.add_argument('--storage', type=int, default=50, help='SMS storage slots (AT+CPMS)')
+    parser.add_argument('--dtu-version', default='V1.0.8')
+    parser.add_argument('--stay', action='store_true', help='keep answering after the scenario until Ctrl-C')
+    args = parser.parse_args()
+
+    try:
+        steps = parse_scenario(args.scenario) if args.scenario else []
+    except (OSError, ScenarioError) as e:
+        sys.exit(str(e))
+
+    firmwares = args.firmware.split(',')
+    if args.modems < 1 or any(fw not in ('at', 'dtu') for fw in firmwares):
+        parser.error('--firmware must be at or dtu (comma separated per modem), --modems at least 1')
+    firmwares = [firmwares[min(i, len(firmwares) - 1)] for i in range(args.modems)]
+
+    def reader(line, modem):
+        buf = b''
+        while True:
+            buf += line.read()
+            while True:
+                m = re.search(rb'[\r\n]', buf)
+                if not m:
+                    break
+                cmd, buf = buf[:m.start()], buf[m.end():]
+                modem.on_input(cmd.decode('utf-8', 'replace').strip())
+
+    lines, modems, runners = [], [], []
+    for i, fw in enumerate(firmwares):
+        line = Line(args.baud)
+        modem = (DtuModem if fw == 'dtu' else AtModem)(line, args)
+        if args.link and i == 0:
+            if os.path.islink(args.link):
+                os.unlink(args.link)
+            os.symlink(line.path, args.link)
+        log('{} firmware on {}'.format(fw.upper(), args.link if args.link and i == 0 else line.path))
+        threading.Thread(target=reader, args=(line, modem), daemon=True).start()
+        lines.append(line)
+        modems.append(modem)
+        # 各模组的随机文本和参考号互不相同
+        runners.append(Runner(modem, args, seed=args.seed + i))
+
+    host = Host(args.run, [line.path for line in lines]) if args.run else None
+    start = time.monotonic()
+    status = 0
+    try:
+        run_concurrently(runners, steps)
+        elapsed = time.monotonic() - start
+        if args.stay or (not steps and not host):
+            signal.pause()
+        deadline = time.monotonic() + args.linger
+        expected = sum(1 for r in runners for m in r.messages if not m.lost)
+        while host and time.monotonic() < deadline and len(host.received) < expected:
+            time.sleep(0.05)
+        if not host:
+            time.sleep(args.linger)
+    except ScenarioError as e:
+        log(str(e))
+        status = 2
+        elapsed = time.monotonic() - start
+    except KeyboardInterrupt:
+        elapsed = time.monotonic() - start
+
+    if host:
+        host.stop(5)
+        final = host.final or {}
+        host_modems = final.get('modems') or []
+        for i, (runner, modem) in enumerate(zip(runners, modems)):
+            if len(modems) > 1:
+                print('== modem {} ({})'.format(i, firmwares[i].upper()))
+            result = report(runner, modem, host.received_by(i), elapsed)
+            status = status or result
+            if len(modems) > 1 and i < len(host_modems):
+                print('host modem:       ' + json.dumps(host_modems[i], sort_keys=True))
+        if final.get('stats'):
+            print('host stats:       ' + json.dumps(final['stats'], sort_keys=True))
+    else:
+        for runner, line in zip(runners, lines):
+            print('sent {} messages, {} bytes in {:.2f} s'.format(
+                len(runner.messages), line.bytes_out, elapsed))
+    if args.link and os.path.islink(args.link):
+        os.unlink(args.link)
+    sys.exit(status)
+
+
+if __name__ == '__main__':
+    main()
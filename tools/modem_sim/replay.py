@@ -0,0 +1,261 @@
+#!/usr/bin/env python3
+"""Replay a UART capture (CONFIG_APP_UART_CAPTURE_ENABLE) through the host build.
+
+Usage: replay.py [options] capture.bin
+
+capture.bin holds the chunks published on CONFIG_APP_MQTT_TOPIC_CAPTURE,
+as received (e.g. mosquitto_sub -t esp32/capture -N > capture.bin), or
+written by modem_sim_host --capture. --show prints the records.
+
+With --run the host build is started on a pty and the captured modem
+output is written back at the original pace, or --speed times faster.
+If older records were overwritten, the capture lacks the boot sequence
+and the simulated modem from modem_sim.py answers it first. Each captured
+command waits until the host sends the same command, so its captured
+response follows it as it did on the device. Commands the host sends that
+are not in the capture are answered by the simulated modem. Afterwards the
+messages the host decoded and its CPU time are printed.
+"""
+
+import argparse
+import json
+import os
+import struct
+import sys
+import threading
+import time
+from types import SimpleNamespace
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import modem_sim  # noqa: E402
+
+CHUNK = struct.Struct('<4sBBHIIHH')   # uart_capture_chunk_t
+RECORD = struct.Struct('<IHBB')       # uart_capture_record_t
+MAGIC = b'UCAP'
+VERSION = 1
+CHUNK_LAST = 0x01
+RX, TX = 0, 1
+
+
+class CaptureError(Exception):
+    pass
+
+
+def load(path, dump_id=None):
+    """Returns (dump_id, lost_records, [(t_us, dir, bytes)]) of one complete dump."""
+    with open(path, 'rb') as f:
+        data = f.read()
+    dumps = {}
+    pos = 0
+    while pos + CHUNK.size <= len(data):
+        magic, version, flags, index, did, lost, length, _ = CHUNK.unpack_from(data, pos)
+        if magic != MAGIC or version != VERSION:
+            raise CaptureError('{}: no capture chunk at offset {}'.format(path, pos))
+        pos += CHUNK.size
+        dump = dumps.setdefault(did, {'chunks': {}, 'last': None, 'lost': lost})
+        dump['chunks'][index] = data[pos:pos + length]
+        if flags & CHUNK_LAST:
+            dump['last'] = index
+        pos += length
+
+    complete = [d for d, v in dumps.items()
+                if v['last'] is not None and all(i in v['chunks'] for i in range(v['last'] + 1))]
+    if dump_id is None:
+        if not complete:
+            raise CaptureError('{}: no complete dump ({} partial)'.format(path, len(dumps)))
+        dump_id = complete[-1]
+    elif dump_id not in complete:
+        raise CaptureError('{}: dump {} missing or incomplete'.format(path, dump_id))
+    dump = dumps[dump_id]
+    stream = b''.join(dump['chunks'][i] for i in range(dump['last'] + 1))
+
+    records = []
+    pos = 0
+    while pos + RECORD.size <= len(stream):
+        t_us, length, direction, _ = RECORD.unpack_from(stream, pos)
+        pos += RECORD.size
+        records.append((t_us, direction, stream[pos:pos + length]))
+        pos += length
+    return dump_id, dump['lost'], records
+
+
+def show(records):
+    if not records:
+        return
+    start = records[0][0]
+    for t_us, direction, data in records:
+        print('{:12.3f} {} {}'.format(((t_us - start) & 0xffffffff) / 1000.0,
+                                      '<' if direction == RX else '>',
+                                      repr(data)[2:-1]))
+
+
+def commands(records):
+    """Splits the TX records into whole command lines: {record index: line}."""
+    result = {}
+    pending, first = b'', None
+    for i, (_, direction, data) in enumerate(records):
+        if direction != TX:
+            continue
+        if first is None:
+            first = i
+        pending += data
+        while b'\r' in pending or b'\n' in pending:
+            cut = min(p for p in (pending.find(b'\r'), pending.find(b'\n')) if p >= 0)
+            line = pending[:cut].decode('utf-8', 'replace').strip()
+            pending = pending[cut + 1:]
+            if line:
+                result[first] = line
+            first = i if pending else None
+    return result
+
+
+class Replayer:
+    def __init__(self, modem, records, speed, lockstep_timeout):
+        self.modem = modem
+        self.records = records
+        self.speed = speed
+        self.timeout = lockstep_timeout
+        self.cmds = commands(records)
+        self.order = sorted(self.cmds)
+        self.next_cmd = 0              # self.order中下一条等待主机发出的命令
+        self.claimed = threading.Condition()
+        self.early = 0                 # 主机先于回放进度发出的命令数
+        self.matched = 0
+        self.missed = []
+        self.active = False
+
+    def intercept(self, cmd):
+        """Called by the simulated modem; True if the capture answers cmd."""
+        with self.claimed:
+            if not self.active or self.next_cmd >= len(self.order):
+                return False
+            if cmd != self.cmds[self.order[self.next_cmd]]:
+                return False
+            self.next_cmd += 1
+            self.matched += 1
+            self.claimed.notify_all()
+            return True
+
+    def wait_for(self, index):
+        """Waits until the host sends the captured command at record index."""
+        deadline = time.monotonic() + self.timeout
+        with self.claimed:
+            position = self.order.index(index)
+            if self.next_cmd > position:
+                self.early += 1
+                return
+            while self.next_cmd <= position:
+                remaining = deadline - time.monotonic()
+                if remaining <= 0:
+                    # 主机这次没有发出该命令: 跳过,其响应照样回放
+                    self.missed.append(self.cmds[index])
+                    self.next_cmd = position + 1
+                    return
+                self.claimed.wait(remaining)
+
+    def run(self):
+        self.active = True
+        prev_t = None
+        rx_bytes = 0
+        for i, (t_us, direction, data) in enumerate(self.records):
+            if prev_t is not None:
+                time.sleep(((t_us - prev_t) & 0xffffffff) / 1e6 / self.speed)
+            prev_t = t_us
+            if direction == RX:
+                self.modem.line.write(data)
+                rx_bytes += len(data)
+            elif i in self.cmds and self.timeout > 0:
+                self.wait_for(i)
+        self.active = False
+        return rx_bytes
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('capture')
+    parser.add_argument('--dump-id', type=int, help='dump to use if the file holds several (default: last)')
+    parser.add_argument('--show', action='store_true', help='print the records and exit')
+    parser.add_argument('--run', metavar='CMD', help='host build to replay into ("{tty}" = pty path)')
+    parser.add_argument('--firmware', choices=('at', 'dtu'), default='at',
+                        help='simulated modem for the boot sequence (default at)')
+    parser.add_argument('--speed', type=float, default=1.0,
+                        help='replay this many times faster (default 1)')
+    parser.add_argument('--lockstep-timeout', type=float, default=5.0,
+                        help='seconds to wait for each captured command; 0 = ignore commands (default 5)')
+    parser.add_argument('--linger', type=float, default=3.0,
+                        help='seconds to wait for the host after the replay (default 3)')
+    args = parser.parse_args()
+
+    if args.speed <= 0:
+        parser.error('--speed must be positive')
+
+    try:
+        dump_id, lost, records = load(args.capture, args.dump_id)
+    except (OSError, CaptureError) as e:
+        sys.exit(str(e))
+    rx = sum(len(d) for _, direction, d in records if direction == RX)
+    span = ((records[-1][0] - records[0][0]) & 0xffffffff) / 1e6 if records else 0.0
+    modem_sim.log('dump {}: {} records, {} bytes from the modem over {:.1f} s, {} older records lost'.format(
+        dump_id, len(records), rx, span, lost))
+    if args.show:
+        show(records)
+        return
+    if not args.run:
+        parser.error('--run or --show is required')
+
+    sim_args = SimpleNamespace(storage=50, imsi='460001234567890', iccid='89860012345678901234',
+                               rssi=24, dtu_version='V1.0.8')
+    line = modem_sim.Line(0)
+    modem = (modem_sim.DtuModem if args.firmware == 'dtu' else modem_sim.AtModem)(line, sim_args)
+    replayer = Replayer(modem, records, args.speed, args.lockstep_timeout)
+    modem.intercept = replayer.intercept
+
+    def reader():
+        buf = b''
+        while True:
+            buf += line.read()
+            while True:
+                cut = [p for p in (buf.find(b'\r'), buf.find(b'\n')) if p >= 0]
+                if not cut:
+                    break
+                cmd, buf = buf[:min(cut)], buf[min(cut) + 1:]
+                modem.on_input(cmd.decode('utf-8', 'replace').strip())
+
+    threading.Thread(target=reader, daemon=True).start()
+    # 没有记录被覆盖时抓包从开机开始,主机的启动过程也由抓包应答;
+    # 否则先由模拟模组完成启动,再回放
+    from_boot = lost == 0
+    replayer.active = from_boot
+    host = modem_sim.Host(args.run, [line.path])
+    if not from_boot:
+        if not modem.ready.wait(60):
+            host.stop(5)
+            sys.exit('host did not finish booting')
+        time.sleep(0.5)
+
+    before = len(host.received)
+    start = time.monotonic()
+    replayer.run()
+    elapsed = time.monotonic() - start
+    deadline = time.monotonic() + args.linger
+    while time.monotonic() < deadline:
+        time.sleep(0.05)
+    host.stop(5)
+
+    decoded = host.received[before:]
+    print('replayed:   {} bytes in {:.2f} s (captured over {:.2f} s)'.format(rx, elapsed, span))
+    print('commands:   {} matched ({} sent early), {} not sent by the host'.format(
+        replayer.matched, replayer.early, len(replayer.missed)))
+    for cmd in replayer.missed[:5]:
+        print('  not sent: {}'.format(cmd))
+    print('messages:   {}'.format(len(decoded)))
+    for event in decoded:
+        print('  {} {!r}'.format(event.get('sender'), event.get('content', '')[:60]))
+    if host.final:
+        print('host cpu:   {:.1f} ms'.format(host.final.get('cpu_ms', 0)))
+        if host.final.get('stats'):
+            print('host stats: ' + json.dumps(host.final['stats'], sort_keys=True))
+
+
+if __name__ == '__main__':
+    main()